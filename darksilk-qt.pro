@@ -113,7 +113,7 @@ INCLUDEPATH += src/secp256k1/include
 LIBS += $$PWD/src/secp256k1/src/libsecp256k1_la-secp256k1.o
 !win32 {
     # we use QMAKE_CXXFLAGS_RELEASE even without RELEASE=1 because we use RELEASE to indicate linking preferences not -O preferences
-    gensecp256k1.commands = cd $$PWD/src/secp256k1 && ./autogen.sh && ./configure --disable-shared --with-pic --with-bignum=no --enable-module-recovery && CC=$$QMAKE_CC CXX=$$QMAKE_CXX $(MAKE) OPT=\"$$QMAKE_CXXFLAGS $$QMAKE_CXXFLAGS_RELEASE\"
+    gensecp256k1.commands = cd $$PWD/src/secp256k1 && ./autogen.sh && ./configure --disable-shared --with-pic --with-bignum=no --enable-module-recovery --enable-module-ecdh && CC=$$QMAKE_CC CXX=$$QMAKE_CXX $(MAKE) OPT=\"$$QMAKE_CXXFLAGS $$QMAKE_CXXFLAGS_RELEASE\"
 } else {
     #Windows ???
 }
@@ -228,6 +228,7 @@ HEADERS +=  src/qt/darksilkgui.h \
             src/bignum.h \
             src/chainparams.h \
             src/chainparamsseeds.h \
+            src/blockfile.h \
             src/checkpoints.h \
             src/cleanse.h \
             src/compat.h \
@@ -251,6 +252,7 @@ HEADERS +=  src/qt/darksilkgui.h \
             src/txmempool.h \
             src/wallet/walletdb.h \
             src/script/script.h \
+            src/script/sigcache.h \
             src/init.h \
             src/mruset.h \
             src/json/json_spirit_writer_template.h \
@@ -272,6 +274,7 @@ HEADERS +=  src/qt/darksilkgui.h \
             src/qt/transactiondesc.h \
             src/qt/transactiondescdialog.h \
             src/qt/darksilkamountfield.h \
+            src/wallet/coinselection.h \
             src/wallet/wallet.h \
             src/keystore.h \
             src/qt/transactionfilterproxy.h \
@@ -336,10 +339,12 @@ HEADERS +=  src/qt/darksilkgui.h \
             src/primitives/transaction.h \
             src/anon/stormnode/stormnode-sync.h \
             src/chain.h \
+            src/checkqueue.h \
             src/coins.h \
             src/script/compressor.h \
             src/undo.h \
             src/leveldbwrapper.h \
+            src/leveldbbatch.h \
             src/streams.h \
             src/txdb-leveldb.h \
             src/amount.h \
@@ -382,10 +387,12 @@ SOURCES +=  src/qt/darksilk.cpp src/qt/darksilkgui.cpp \
             src/ecwrapper.cpp \
             src/pubkey.cpp \
             src/script/script.cpp \
+            src/script/sigcache.cpp \
             src/main.cpp \
             src/miner.cpp \
             src/init.cpp \
             src/net.cpp \
+            src/blockfile.cpp \
             src/checkpoints.cpp \
             src/addrman.cpp \
             src/base58.cpp \
@@ -401,6 +408,7 @@ SOURCES +=  src/qt/darksilk.cpp src/qt/darksilkgui.cpp \
             src/qt/transactiondescdialog.cpp \
             src/qt/darksilkstrings.cpp \
             src/qt/darksilkamountfield.cpp \
+            src/wallet/coinselection.cpp \
             src/wallet/wallet.cpp \
             src/keystore.cpp \
             src/qt/transactionfilterproxy.cpp \
@@ -198,7 +198,7 @@ void CSandstormPool::ProcessMessageSandstorm(CNode* pfrom, std::string& strComma
             bool missingTx = false;
 
             CValidationState state;
-            CTransaction tx; //TODO (Amir): Use CMutableTransaction
+            CMutableTransaction tx;
 
             BOOST_FOREACH(const CTxOut o, out){
                 nValueOut += o.nValue;
@@ -257,7 +257,8 @@ void CSandstormPool::ProcessMessageSandstorm(CNode* pfrom, std::string& strComma
 
             {
                 LOCK(cs_main);
-                if(!AcceptableInputs(mempool, state, tx, false, NULL, false)) {
+                CTransaction txCheck(tx);
+                if(!AcceptableInputs(mempool, state, txCheck, false, NULL, false)) {
                     LogPrintf("ssi -- transaction not valid! \n");
                     errorID = ERR_INVALID_TX;
                     pfrom->PushMessage("sssu", sessionID, GetState(), GetEntriesCount(), STORMNODE_REJECTED, errorID);
@@ -1140,7 +1141,7 @@ void CSandstormPool::SendSandstormDenominate(std::vector<CTxIn>& vin, std::vecto
         CAmount nValueOut = 0;
 
         CValidationState state;
-        CTransaction tx; //TODO (Amir): Use CMutableTransaction
+        CMutableTransaction tx;
 
         BOOST_FOREACH(const CTxOut& o, vout){
             nValueOut += o.nValue;
@@ -1155,10 +1156,11 @@ void CSandstormPool::SendSandstormDenominate(std::vector<CTxIn>& vin, std::vecto
 
         LogPrintf("Submitting tx %s\n", tx.ToString());
 
+        CTransaction txCheck(tx);
         while(true){
             TRY_LOCK(cs_main, lockMain);
             if(!lockMain) { MilliSleep(50); continue;}
-            if(!AcceptableInputs(mempool, state, tx, false, NULL, false, true)){
+            if(!AcceptableInputs(mempool, state, txCheck, false, NULL, false, true)){
                 LogPrintf("ssi -- transaction not valid! %s \n", tx.ToString());
                 UnlockCoins();
                 SetNull();
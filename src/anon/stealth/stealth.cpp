@@ -3,9 +3,10 @@
 // file license.txt or http://www.opensource.org/licenses/mit-license.php.
 
 #include <openssl/rand.h>
-#include <openssl/ec.h>
-#include <openssl/ecdsa.h>
-#include <openssl/obj_mac.h>
+
+#include <secp256k1_ecdh.h>
+
+#include <boost/thread.hpp>
 
 #include "anon/stealth/stealth.h"
 #include "base58.h"
@@ -157,55 +158,47 @@ int GenerateRandomSecret(ec_secret& out)
     return 0;
 };
 
+static secp256k1_context* secp256k1_context_stealth = NULL;
+static boost::once_flag stealthContextOnce = BOOST_ONCE_INIT;
+
+static void CreateStealthContext()
+{
+    secp256k1_context_stealth = secp256k1_context_create(SECP256K1_CONTEXT_SIGN | SECP256K1_CONTEXT_VERIFY);
+}
+
+// Both the multiplication tables are built once and only read afterwards,
+// so the context is shared by all threads.
+static const secp256k1_context* StealthContext()
+{
+    boost::call_once(stealthContextOnce, CreateStealthContext);
+    return secp256k1_context_stealth;
+}
+
+static bool SerializePubkey(const secp256k1_pubkey& pubkey, ec_point& out)
+{
+    size_t nSize = ec_compressed_size;
+    out.resize(ec_compressed_size);
+    secp256k1_ec_pubkey_serialize(StealthContext(), &out[0], &nSize, &pubkey, SECP256K1_EC_COMPRESSED);
+    return nSize == ec_compressed_size;
+}
+
 int SecretToPublicKey(const ec_secret& secret, ec_point& out)
 {
     // -- public key = private * G
-    int rv = 0;
-    
-    EC_GROUP *ecgrp = EC_GROUP_new_by_curve_name(NID_secp256k1);
-    
-    if (!ecgrp)
+    secp256k1_pubkey pubkey;
+    if (!secp256k1_ec_pubkey_create(StealthContext(), &pubkey, &secret.e[0]))
     {
-        printf("SecretToPublicKey(): EC_GROUP_new_by_curve_name failed.\n");
+        printf("SecretToPublicKey(): invalid secret.\n");
         return 1;
     };
 
-    BIGNUM* bnIn = BN_bin2bn(&secret.e[0], ec_secret_size, BN_new());
-    if (!bnIn)
+    if (!SerializePubkey(pubkey, out))
     {
-        EC_GROUP_free(ecgrp);
-        printf("SecretToPublicKey(): BN_bin2bn failed\n");
+        printf("SecretToPublicKey(): out incorrect length.\n");
         return 1;
     };
-    
-    EC_POINT* pub = EC_POINT_new(ecgrp);
-    
-    
-    EC_POINT_mul(ecgrp, pub, bnIn, NULL, NULL, NULL);
-    
-    BIGNUM* bnOut = EC_POINT_point2bn(ecgrp, pub, POINT_CONVERSION_COMPRESSED, BN_new(), NULL);
-    if (!bnOut)
-    {
-        printf("SecretToPublicKey(): point2bn failed\n");
-        rv = 1;
-    } else
-    {
-        out.resize(ec_compressed_size);
-        if (BN_num_bytes(bnOut) != (int) ec_compressed_size
-            || BN_bn2bin(bnOut, &out[0]) != (int) ec_compressed_size)
-        {
-            printf("SecretToPublicKey(): bnOut incorrect length.\n");
-            rv = 1;
-        };
-        
-        BN_free(bnOut);
-    };
-    
-    EC_GROUP_free(ecgrp);
-    BN_free(bnIn);
-    EC_POINT_free(pub);
 
-    return rv;
+    return 0;
 };
 
 
@@ -237,180 +230,40 @@ int StealthSecret(ec_secret& secret, ec_point& pubkey, const ec_point& pkSpend,
     
     
     Recipient gets R' and P
-    
-    test 0 and infinity?
     */
-    
-    int rv = 0;
-    std::vector<uint8_t> vchOutQ;
-    
-    BN_CTX* bnCtx   = NULL;
-    BIGNUM* bnEphem = NULL;
-    BIGNUM* bnQ     = NULL;
-    EC_POINT* Q     = NULL;
-    BIGNUM* bnOutQ  = NULL;
-    BIGNUM* bnc     = NULL;
-    EC_POINT* C     = NULL;
-    BIGNUM* bnR     = NULL;
-    EC_POINT* R     = NULL;
-    EC_POINT* Rout  = NULL;
-    BIGNUM* bnOutR  = NULL;
-    
-    EC_GROUP* ecgrp = EC_GROUP_new_by_curve_name(NID_secp256k1);
-    
-    if (!ecgrp)
+
+    const secp256k1_context* ctx = StealthContext();
+
+    secp256k1_pubkey Q;
+    if (pubkey.empty() || !secp256k1_ec_pubkey_parse(ctx, &Q, &pubkey[0], pubkey.size()))
     {
-        printf("StealthSecret(): EC_GROUP_new_by_curve_name failed.\n");
+        printf("StealthSecret(): Q is not a valid public key.\n");
         return 1;
     };
-    
-    if (!(bnCtx = BN_CTX_new()))
-    {
-        printf("StealthSecret(): BN_CTX_new failed.\n");
-        rv = 1;
-        goto End;
-    };
-    
-    if (!(bnEphem = BN_bin2bn(&secret.e[0], ec_secret_size, BN_new())))
-    {
-        printf("StealthSecret(): bnEphem BN_bin2bn failed.\n");
-        rv = 1;
-        goto End;
-    };
-    
-    if (!(bnQ = BN_bin2bn(&pubkey[0], pubkey.size(), BN_new())))
-    {
-        printf("StealthSecret(): bnQ BN_bin2bn failed\n");
-        rv = 1;
-        goto End;
-    };
-    
-    if (!(Q = EC_POINT_bn2point(ecgrp, bnQ, NULL, bnCtx)))
-    {
-        printf("StealthSecret(): Q EC_POINT_bn2point failed\n");
-        rv = 1;
-        goto End;
-    };
-    
-    // -- eQ
-    // EC_POINT_mul(const EC_GROUP *group, EC_POINT *r, const BIGNUM *n, const EC_POINT *q, const BIGNUM *m, BN_CTX *ctx);
-    // EC_POINT_mul calculates the value generator * n + q * m and stores the result in r. The value n may be NULL in which case the result is just q * m. 
-    if (!EC_POINT_mul(ecgrp, Q, NULL, Q, bnEphem, bnCtx))
-    {
-        printf("StealthSecret(): eQ EC_POINT_mul failed\n");
-        rv = 1;
-        goto End;
-    };
-    
-    if (!(bnOutQ = EC_POINT_point2bn(ecgrp, Q, POINT_CONVERSION_COMPRESSED, BN_new(), bnCtx)))
-    {
-        printf("StealthSecret(): Q EC_POINT_bn2point failed\n");
-        rv = 1;
-        goto End;
-    };
-    
-    
-    vchOutQ.resize(ec_compressed_size);
-    if (BN_num_bytes(bnOutQ) != (int) ec_compressed_size
-        || BN_bn2bin(bnOutQ, &vchOutQ[0]) != (int) ec_compressed_size)
-    {
-        printf("StealthSecret(): bnOutQ incorrect length.\n");
-        rv = 1;
-        goto End;
-    };
-    
-    SHA256(&vchOutQ[0], vchOutQ.size(), &sharedSOut.e[0]);
-    
-    if (!(bnc = BN_bin2bn(&sharedSOut.e[0], ec_secret_size, BN_new())))
-    {
-        printf("StealthSecret(): BN_bin2bn failed\n");
-        rv = 1;
-        goto End;
-    };
-    
-    // -- cG
-    if (!(C = EC_POINT_new(ecgrp)))
-    {
-        printf("StealthSecret(): C EC_POINT_new failed\n");
-        rv = 1;
-        goto End;
-    };
-    
-    if (!EC_POINT_mul(ecgrp, C, bnc, NULL, NULL, bnCtx))
-    {
-        printf("StealthSecret(): C EC_POINT_mul failed\n");
-        rv = 1;
-        goto End;
-    };
-    
-    if (!(bnR = BN_bin2bn(&pkSpend[0], pkSpend.size(), BN_new())))
-    {
-        printf("StealthSecret(): bnR BN_bin2bn failed\n");
-        rv = 1;
-        goto End;
-    };
-    
-    
-    if (!(R = EC_POINT_bn2point(ecgrp, bnR, NULL, bnCtx)))
-    {
-        printf("StealthSecret(): R EC_POINT_bn2point failed\n");
-        rv = 1;
-        goto End;
-    };
-    
-    if (!EC_POINT_mul(ecgrp, C, bnc, NULL, NULL, bnCtx))
-    {
-        printf("StealthSecret(): C EC_POINT_mul failed\n");
-        rv = 1;
-        goto End;
-    };
-    
-    if (!(Rout = EC_POINT_new(ecgrp)))
-    {
-        printf("StealthSecret(): Rout EC_POINT_new failed\n");
-        rv = 1;
-        goto End;
-    };
-    
-    if (!EC_POINT_add(ecgrp, Rout, R, C, bnCtx))
+
+    secp256k1_pubkey R;
+    if (pkSpend.empty() || !secp256k1_ec_pubkey_parse(ctx, &R, &pkSpend[0], pkSpend.size()))
     {
-        printf("StealthSecret(): Rout EC_POINT_add failed\n");
-        rv = 1;
-        goto End;
+        printf("StealthSecret(): R is not a valid public key.\n");
+        return 1;
     };
-    
-    if (!(bnOutR = EC_POINT_point2bn(ecgrp, Rout, POINT_CONVERSION_COMPRESSED, BN_new(), bnCtx)))
+
+    // -- c = H(eQ), the SHA256 of the compressed point
+    if (!secp256k1_ecdh(ctx, &sharedSOut.e[0], &Q, &secret.e[0]))
     {
-        printf("StealthSecret(): Rout EC_POINT_bn2point failed\n");
-        rv = 1;
-        goto End;
+        printf("StealthSecret(): eQ secp256k1_ecdh failed.\n");
+        return 1;
     };
-    
-    
-    pkOut.resize(ec_compressed_size);
-    if (BN_num_bytes(bnOutR) != (int) ec_compressed_size
-        || BN_bn2bin(bnOutR, &pkOut[0]) != (int) ec_compressed_size)
+
+    // -- R' = R + cG
+    if (!secp256k1_ec_pubkey_tweak_add(ctx, &R, &sharedSOut.e[0])
+        || !SerializePubkey(R, pkOut))
     {
-        printf("StealthSecret(): pkOut incorrect length.\n");
-        rv = 1;
-        goto End;
+        printf("StealthSecret(): R + cG failed.\n");
+        return 1;
     };
-    
-    End:
-    if (bnOutR)     BN_free(bnOutR);
-    if (Rout)       EC_POINT_free(Rout);
-    if (R)          EC_POINT_free(R);
-    if (bnR)        BN_free(bnR);
-    if (C)          EC_POINT_free(C);
-    if (bnc)        BN_free(bnc);
-    if (bnOutQ)     BN_free(bnOutQ);
-    if (Q)          EC_POINT_free(Q);
-    if (bnQ)        BN_free(bnQ);
-    if (bnEphem)    BN_free(bnEphem);
-    if (bnCtx)      BN_CTX_free(bnCtx);
-    EC_GROUP_free(ecgrp);
-    
-    return rv;
+
+    return 0;
 };
 
 
@@ -421,228 +274,126 @@ int StealthSecretSpend(ec_secret& scanSecret, ec_point& ephemPubkey, ec_secret&
     c  = H(dP)
     R' = R + cG     [without decrypting wallet]
        = (f + c)G   [after decryption of wallet]
-         Remember: mod curve.order, pad with 0x00s where necessary?
+         Remember: mod curve.order
     */
-    
-    int rv = 0;
-    std::vector<uint8_t> vchOutP;
-    
-    BN_CTX* bnCtx           = NULL;
-    BIGNUM* bnScanSecret    = NULL;
-    BIGNUM* bnP             = NULL;
-    EC_POINT* P             = NULL;
-    BIGNUM* bnOutP          = NULL;
-    BIGNUM* bnc             = NULL;
-    BIGNUM* bnOrder         = NULL;
-    BIGNUM* bnSpend         = NULL;
-    
-    EC_GROUP* ecgrp = EC_GROUP_new_by_curve_name(NID_secp256k1);
-    
-    if (!ecgrp)
+
+    const secp256k1_context* ctx = StealthContext();
+
+    secp256k1_pubkey P;
+    if (ephemPubkey.empty() || !secp256k1_ec_pubkey_parse(ctx, &P, &ephemPubkey[0], ephemPubkey.size()))
     {
-        printf("StealthSecretSpend(): EC_GROUP_new_by_curve_name failed.\n");
+        printf("StealthSecretSpend(): P is not a valid public key.\n");
         return 1;
     };
-    
-    if (!(bnCtx = BN_CTX_new()))
-    {
-        printf("StealthSecretSpend(): BN_CTX_new failed.\n");
-        rv = 1;
-        goto End;
-    };
-    
-    if (!(bnScanSecret = BN_bin2bn(&scanSecret.e[0], ec_secret_size, BN_new())))
-    {
-        printf("StealthSecretSpend(): bnScanSecret BN_bin2bn failed.\n");
-        rv = 1;
-        goto End;
-    };
-    
-    if (!(bnP = BN_bin2bn(&ephemPubkey[0], ephemPubkey.size(), BN_new())))
-    {
-        printf("StealthSecretSpend(): bnP BN_bin2bn failed\n");
-        rv = 1;
-        goto End;
-    };
-    
-    if (!(P = EC_POINT_bn2point(ecgrp, bnP, NULL, bnCtx)))
-    {
-        printf("StealthSecretSpend(): P EC_POINT_bn2point failed\n");
-        rv = 1;
-        goto End;
-    };
-    
-    // -- dP
-    if (!EC_POINT_mul(ecgrp, P, NULL, P, bnScanSecret, bnCtx))
-    {
-        printf("StealthSecretSpend(): dP EC_POINT_mul failed\n");
-        rv = 1;
-        goto End;
-    };
-    
-    if (!(bnOutP = EC_POINT_point2bn(ecgrp, P, POINT_CONVERSION_COMPRESSED, BN_new(), bnCtx)))
-    {
-        printf("StealthSecretSpend(): P EC_POINT_bn2point failed\n");
-        rv = 1;
-        goto End;
-    };
-    
-    
-    vchOutP.resize(ec_compressed_size);
-    if (BN_num_bytes(bnOutP) != (int) ec_compressed_size
-        || BN_bn2bin(bnOutP, &vchOutP[0]) != (int) ec_compressed_size)
-    {
-        printf("StealthSecretSpend(): bnOutP incorrect length.\n");
-        rv = 1;
-        goto End;
-    };
-    
-    uint8_t hash1[32];
-    SHA256(&vchOutP[0], vchOutP.size(), (uint8_t*)hash1);
-    
-    
-    if (!(bnc = BN_bin2bn(&hash1[0], 32, BN_new())))
-    {
-        printf("StealthSecretSpend(): BN_bin2bn failed\n");
-        rv = 1;
-        goto End;
-    };
-    
-    if (!(bnOrder = BN_new())
-        || !EC_GROUP_get_order(ecgrp, bnOrder, bnCtx))
-    {
-        printf("StealthSecretSpend(): EC_GROUP_get_order failed\n");
-        rv = 1;
-        goto End;
-    };
-    
-    if (!(bnSpend = BN_bin2bn(&spendSecret.e[0], ec_secret_size, BN_new())))
-    {
-        printf("StealthSecretSpend(): bnSpend BN_bin2bn failed.\n");
-        rv = 1;
-        goto End;
-    };
-    
-    //if (!BN_add(r, a, b)) return 0;
-    //return BN_nnmod(r, r, m, ctx);
-    if (!BN_mod_add(bnSpend, bnSpend, bnc, bnOrder, bnCtx))
-    {
-        printf("StealthSecretSpend(): bnSpend BN_mod_add failed.\n");
-        rv = 1;
-        goto End;
-    };
-    
-    if (BN_is_zero(bnSpend)) // possible?
-    {
-        printf("StealthSecretSpend(): bnSpend is zero.\n");
-        rv = 1;
-        goto End;
-    };
-    
-    if (BN_num_bytes(bnSpend) != (int) ec_secret_size
-        || BN_bn2bin(bnSpend, &secretOut.e[0]) != (int) ec_secret_size)
+
+    ec_secret sShared;
+    if (!secp256k1_ecdh(ctx, &sShared.e[0], &P, &scanSecret.e[0]))
     {
-        printf("StealthSecretSpend(): bnSpend incorrect length.\n");
-        rv = 1;
-        goto End;
+        printf("StealthSecretSpend(): dP secp256k1_ecdh failed.\n");
+        return 1;
     };
-    
-    End:
-    if (bnSpend)        BN_free(bnSpend);
-    if (bnOrder)        BN_free(bnOrder);
-    if (bnc)            BN_free(bnc);
-    if (bnOutP)         BN_free(bnOutP);
-    if (P)              EC_POINT_free(P);
-    if (bnP)            BN_free(bnP);
-    if (bnScanSecret)   BN_free(bnScanSecret);
-    if (bnCtx)          BN_CTX_free(bnCtx);
-    EC_GROUP_free(ecgrp);
-    
-    return rv;
+
+    return StealthSharedToSecretSpend(sShared, spendSecret, secretOut);
 };
 
 
 int StealthSharedToSecretSpend(ec_secret& sharedS, ec_secret& spendSecret, ec_secret& secretOut)
 {
-    
-    int rv = 0;
-    std::vector<uint8_t> vchOutP;
-    
-    BN_CTX* bnCtx           = NULL;
-    BIGNUM* bnc             = NULL;
-    BIGNUM* bnOrder         = NULL;
-    BIGNUM* bnSpend         = NULL;
-    
-    EC_GROUP* ecgrp = EC_GROUP_new_by_curve_name(NID_secp256k1);
-    
-    if (!ecgrp)
+    // -- f + c mod n; fails if it comes to zero
+    secretOut = spendSecret;
+    if (!secp256k1_ec_privkey_tweak_add(StealthContext(), &secretOut.e[0], &sharedS.e[0]))
     {
-        printf("StealthSecretSpend(): EC_GROUP_new_by_curve_name failed.\n");
+        printf("StealthSharedToSecretSpend(): f + c is not a valid secret.\n");
         return 1;
     };
-    
-    if (!(bnCtx = BN_CTX_new()))
-    {
-        printf("StealthSecretSpend(): BN_CTX_new failed.\n");
-        rv = 1;
-        goto End;
-    };
-    
-    if (!(bnc = BN_bin2bn(&sharedS.e[0], ec_secret_size, BN_new())))
-    {
-        printf("StealthSecretSpend(): BN_bin2bn failed\n");
-        rv = 1;
-        goto End;
-    };
-    
-    if (!(bnOrder = BN_new())
-        || !EC_GROUP_get_order(ecgrp, bnOrder, bnCtx))
-    {
-        printf("StealthSecretSpend(): EC_GROUP_get_order failed\n");
-        rv = 1;
-        goto End;
-    };
-    
-    if (!(bnSpend = BN_bin2bn(&spendSecret.e[0], ec_secret_size, BN_new())))
-    {
-        printf("StealthSecretSpend(): bnSpend BN_bin2bn failed.\n");
-        rv = 1;
-        goto End;
-    };
-    
-    //if (!BN_add(r, a, b)) return 0;
-    //return BN_nnmod(r, r, m, ctx);
-    if (!BN_mod_add(bnSpend, bnSpend, bnc, bnOrder, bnCtx))
-    {
-        printf("StealthSecretSpend(): bnSpend BN_mod_add failed.\n");
-        rv = 1;
-        goto End;
-    };
-    
-    if (BN_is_zero(bnSpend)) // possible?
+
+    return 0;
+};
+
+void CStealthScanner::Clear()
+{
+    vScanSecret.clear();
+    vSpendPubkey.clear();
+}
+
+bool CStealthScanner::AddAddress(const data_chunk& scan_secret, const ec_point& spend_pubkey)
+{
+    const secp256k1_context* ctx = StealthContext();
+
+    if (scan_secret.size() != ec_secret_size
+        || !secp256k1_ec_seckey_verify(ctx, &scan_secret[0]))
+        return false;
+
+    secp256k1_pubkey R;
+    if (spend_pubkey.empty() || !secp256k1_ec_pubkey_parse(ctx, &R, &spend_pubkey[0], spend_pubkey.size()))
+        return false;
+
+    ec_secret d;
+    memcpy(&d.e[0], &scan_secret[0], ec_secret_size);
+    vScanSecret.push_back(d);
+    vSpendPubkey.push_back(R);
+    return true;
+}
+
+bool CStealthScanner::Derive(const ec_point& pkEphem, std::vector<Derived>& vOut) const
+{
+    vOut.clear();
+
+    const secp256k1_context* ctx = StealthContext();
+
+    secp256k1_pubkey P;
+    if (pkEphem.size() != ec_compressed_size || !secp256k1_ec_pubkey_parse(ctx, &P, &pkEphem[0], pkEphem.size()))
+        return false;
+
+    vOut.reserve(vScanSecret.size());
+    for (size_t i = 0; i < vScanSecret.size(); ++i)
     {
-        printf("StealthSecretSpend(): bnSpend is zero.\n");
-        rv = 1;
-        goto End;
+        Derived derived;
+        derived.nAddress = i;
+
+        // -- c = H(dP), R' = R + cG
+        secp256k1_pubkey R = vSpendPubkey[i];
+        if (!secp256k1_ecdh(ctx, &derived.sShared.e[0], &P, &vScanSecret[i].e[0])
+            || !secp256k1_ec_pubkey_tweak_add(ctx, &R, &derived.sShared.e[0])
+            || !SerializePubkey(R, derived.pkSpendR))
+            continue;
+
+        vOut.push_back(derived);
     };
-    
-    if (BN_num_bytes(bnSpend) != (int) ec_secret_size
-        || BN_bn2bin(bnSpend, &secretOut.e[0]) != (int) ec_secret_size)
+
+    return true;
+}
+
+static void StealthDeriveThread(const CStealthScanner* pscanner, const std::vector<ec_point>* pvEphem,
+    std::vector<std::vector<CStealthScanner::Derived> >* pvOut, size_t nStart, size_t nStride)
+{
+    for (size_t i = nStart; i < pvEphem->size(); i += nStride)
+        pscanner->Derive((*pvEphem)[i], (*pvOut)[i]);
+}
+
+void CStealthScanner::DeriveBatch(const std::vector<ec_point>& vEphem, std::vector<std::vector<Derived> >& vOut, int nThreads) const
+{
+    vOut.clear();
+    vOut.resize(vEphem.size());
+
+    // Not worth starting threads for a handful of multiplications
+    size_t nWork = vEphem.size() * vScanSecret.size();
+    if (nThreads > (int)(nWork / 16))
+        nThreads = nWork / 16;
+
+    if (nThreads <= 1)
     {
-        printf("StealthSecretSpend(): bnSpend incorrect length.\n");
-        rv = 1;
-        goto End;
+        StealthDeriveThread(this, &vEphem, &vOut, 0, 1);
+        return;
     };
-    
-    End:
-    if (bnSpend)        BN_free(bnSpend);
-    if (bnOrder)        BN_free(bnOrder);
-    if (bnc)            BN_free(bnc);
-    if (bnCtx)          BN_CTX_free(bnCtx);
-    EC_GROUP_free(ecgrp);
-    
-    return rv;
-};
+
+    StealthContext();
+    boost::thread_group threadGroup;
+    for (int i = 1; i < nThreads; i++)
+        threadGroup.create_thread(boost::bind(&StealthDeriveThread, this, &vEphem, &vOut, i, nThreads));
+    StealthDeriveThread(this, &vEphem, &vOut, 0, nThreads);
+    threadGroup.join_all();
+}
 
 bool IsStealthAddress(const std::string& encodedAddress)
 {
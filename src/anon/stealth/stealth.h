@@ -13,6 +13,8 @@
 #include "util.h"
 #include "serialize.h"
 
+#include <secp256k1.h>
+
 typedef std::vector<uint8_t> data_chunk;
 
 const size_t ec_secret_size = 32;
@@ -98,6 +100,39 @@ public:
     }
 };
 
+/** Owned stealth addresses prepared for scanning.
+ *
+ * Keeps each scan secret next to its parsed spend public key, so an
+ * ephemeral key is matched against every address with one ECDH and one
+ * tweak each, however many outputs the transaction has.
+ */
+class CStealthScanner
+{
+public:
+    /** What ephemeral key P gives for one address */
+    struct Derived
+    {
+        size_t nAddress;    // position in the order addresses were added
+        ec_secret sShared;  // c = H(dP)
+        ec_point pkSpendR;  // R' = R + cG, compressed
+    };
+
+    void Clear();
+    /** Returns false if the secret or key is not valid */
+    bool AddAddress(const data_chunk& scan_secret, const ec_point& spend_pubkey);
+    size_t size() const { return vScanSecret.size(); }
+
+    /** Derive for every address, skipping those where P gives no valid key */
+    bool Derive(const ec_point& pkEphem, std::vector<Derived>& vOut) const;
+
+    /** Derive for many ephemeral keys, split over up to nThreads threads */
+    void DeriveBatch(const std::vector<ec_point>& vEphem, std::vector<std::vector<Derived> >& vOut, int nThreads) const;
+
+private:
+    std::vector<ec_secret> vScanSecret;
+    std::vector<secp256k1_pubkey> vSpendPubkey;
+};
+
 void AppendChecksum(data_chunk& data);
 
 bool VerifyChecksum(const data_chunk& data);
@@ -427,7 +427,7 @@ void CBudgetManager::CheckAndRemove()
 }
 
 //TODO (Amir): Use CMutableTransaction here -->
-void CBudgetManager::FillBlockPayee(CTransaction& txNew, CAmount nFees)
+void CBudgetManager::FillBlockPayee(CMutableTransaction& txNew, CAmount nFees)
 {
     LOCK(cs);
 
@@ -139,7 +139,7 @@ public:
     bool PropExists(uint256 nHash);
     bool IsTransactionValid(const CTransaction& txNew, int nBlockHeight);
     std::string GetRequiredPaymentsString(int nBlockHeight);
-    void FillBlockPayee(CTransaction& txNew, CAmount nFees); //TODO (Amir): Use CMutableTransaction
+    void FillBlockPayee(CMutableTransaction& txNew, CAmount nFees);
 
     void CheckOrphanVotes();
 
@@ -192,12 +192,11 @@ bool IsBlockValueValid(const CBlock& block, CAmount nExpectedValue){
     {
         nHeight = pindexPrev->nHeight+1;
     }
-    //TODO (Amir): Put back... conversion from 'std::map<uint256, CBlockIndex*>::iterator error.
-    // else { //out of order
-     //   BlockMap::iterator mi = mapBlockIndex.find(block.hashPrevBlock);
-     //   if (mi != mapBlockIndex.end() && (*mi).second)
-     //       nHeight = (*mi).second->nHeight+1;
-    //}
+    else { //out of order
+        BlockMap::iterator mi = mapBlockIndex.find(block.hashPrevBlock);
+        if (mi != mapBlockIndex.end() && (*mi).second)
+            nHeight = (*mi).second->nHeight+1;
+    }
 
     if(nHeight == 0){
         LogPrintf("IsBlockValueValid() : WARNING: Couldn't find previous block");
@@ -270,7 +269,7 @@ bool IsBlockPayeeValid(const CTransaction& txNew, int nBlockHeight)
 }
 
 
-void FillBlockPayee(CTransaction& txNew, CAmount nFees) //TODO (Amir): Use CMutableTransaction here
+void FillBlockPayee(CMutableTransaction& txNew, CAmount nFees)
 {
     CBlockIndex* pindexPrev = pindexBest;
     if(!pindexPrev) return;
@@ -292,7 +291,7 @@ std::string GetRequiredPaymentsString(int nBlockHeight)
 }
 
 //TODO (Amir): Use CMutableTransaction.
-void CStormnodePayments::FillBlockPayee(CTransaction& txNew, CAmount nFees)
+void CStormnodePayments::FillBlockPayee(CMutableTransaction& txNew, CAmount nFees)
 {
     CBlockIndex* pindexPrev = pindexBest;
     if(!pindexPrev) return;
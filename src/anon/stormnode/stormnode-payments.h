@@ -31,7 +31,7 @@ bool IsReferenceNode(CTxIn& vin);
 bool IsBlockPayeeValid(const CTransaction& txNew, int nBlockHeight);
 std::string GetRequiredPaymentsString(int nBlockHeight);
 bool IsBlockValueValid(const CBlock& block, CAmount nExpectedValue);
-void FillBlockPayee(CTransaction& txNew, CAmount nFees);
+void FillBlockPayee(CMutableTransaction& txNew, CAmount nFees);
 
 void DumpStormnodePayments();
 
@@ -267,7 +267,7 @@ public:
     int GetMinStormnodePaymentsProto();
     void ProcessMessageStormnodePayments(CNode* pfrom, std::string& strCommand, CDataStream& vRecv);
     std::string GetRequiredPaymentsString(int nBlockHeight);
-    void FillBlockPayee(CTransaction& txNew, CAmount nFees);
+    void FillBlockPayee(CMutableTransaction& txNew, CAmount nFees);
     std::string ToString() const;
     int GetOldestBlock();
     int GetNewestBlock();
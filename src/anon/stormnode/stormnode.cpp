@@ -16,45 +16,35 @@
 
 // keep track of the scanning errors I've seen
 map<uint256, int> mapSeenStormnodeScanningErrors;
-// cache block hashes as we calculate them
-std::map<int64_t, uint256> mapCacheBlockHashes;
 
-//Get the last hash that matches the modulus given. Processed in reverse order
+//Get the hash of the block below nBlockHeight in the active chain
 bool GetBlockHash(uint256& hash, int nBlockHeight)
 {
-    if (pindexBest == NULL) return false;
-
-    if(nBlockHeight == 0)
-        nBlockHeight = pindexBest->nHeight;
-
-    if(mapCacheBlockHashes.count(nBlockHeight)){
-        hash = mapCacheBlockHashes[nBlockHeight];
-        return true;
-    }
+    // Block index entries are never freed and their pprev never changes,
+    // so a snapshot of the tip stays walkable without cs_main
+    const CBlockIndex* pindexTip = pindexBest;
+    if (pindexTip == NULL) return false;
 
-    const CBlockIndex *BlockLastSolved = pindexBest;
-    const CBlockIndex *BlockReading = pindexBest;
-
-    if (BlockLastSolved == NULL || BlockLastSolved->nHeight == 0 || pindexBest->nHeight+1 < nBlockHeight) return false;
-
-    int nBlocksAgo = 0;
-    if(nBlockHeight > 0) nBlocksAgo = (pindexBest->nHeight+1)-nBlockHeight;
-    assert(nBlocksAgo >= 0);
-
-    int n = 0;
-    for (unsigned int i = 1; BlockReading && BlockReading->nHeight > 0; i++) {
-        if(n >= nBlocksAgo){
-            hash = BlockReading->GetBlockHash();
-            mapCacheBlockHashes[nBlockHeight] = hash;
-            return true;
-        }
-        n++;
+    // The block one below nBlockHeight, or one below the tip if nBlockHeight is 0
+    int nHeight = nBlockHeight > 0 ? nBlockHeight - 1 : pindexTip->nHeight - (nBlockHeight == 0 ? 1 : 0);
+    if (nHeight <= 0 || nHeight > pindexTip->nHeight) return false;
 
-        if (BlockReading->pprev == NULL) { assert(BlockReading); break; }
-        BlockReading = BlockReading->pprev;
+    const CBlockIndex* pindex = pindexTip;
+    {
+        // chainActive is reallocated by SetTip under cs_main. Callers hold
+        // stormnode locks, so don't wait for it: walk back from the snapshot
+        // while a block is being connected.
+        TRY_LOCK(cs_main, lockMain);
+        if (lockMain)
+            pindex = chainActive[nHeight];
+        else
+            while (pindex && pindex->nHeight > nHeight)
+                pindex = pindex->pprev;
     }
+    if (pindex == NULL) return false;
 
-    return false;
+    hash = pindex->GetBlockHash();
+    return true;
 }
 
 CStormnode::CStormnode()
@@ -440,10 +430,11 @@ bool CStormnodeBroadcast::CheckInputsAndAdd(int& nDoS)
     }
 
     CValidationState state;
-    CTransaction tx; //TODO (Amir): Use CMutableTransaction here?
+    CMutableTransaction txNew;
     CTxOut vout = CTxOut(9999.99*COIN, sandStormPool.collateralPubKey);
-    tx.vin.push_back(vin);
-    tx.vout.push_back(vout);
+    txNew.vin.push_back(vin);
+    txNew.vout.push_back(vout);
+    CTransaction tx(txNew);
 
     {
         TRY_LOCK(cs_main, lockMain);
@@ -26,7 +26,6 @@ using namespace std;
 class CStormnode;
 class CStormnodeBroadcast;
 class CStormnodePing;
-extern map<int64_t, uint256> mapCacheBlockHashes;
 
 bool GetBlockHash(uint256& hash, int nBlockHeight);
 
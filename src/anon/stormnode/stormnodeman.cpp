@@ -36,15 +36,6 @@ struct CompareScoreTxIn
     }
 };
 
-struct CompareScoreSN
-{
-    bool operator()(const pair<int64_t, CStormnode>& t1,
-                    const pair<int64_t, CStormnode>& t2) const
-    {
-        return t1.first < t2.first;
-    }
-};
-
 //
 // CStormnodeDB
 //
@@ -205,8 +196,12 @@ void DumpStormnodes()
     LogPrintf("Stormnode dump finished  %dms\n", GetTimeMillis() - nStart);
 }
 
+// Rank tables kept at once; InstantX votes and payments use a few heights
+static const unsigned int MAX_STORMNODE_RANK_TABLES = 32;
+
 CStormnodeMan::CStormnodeMan() {
     nSsqCount = 0;
+    nListVersion = 0;
 }
 
 bool CStormnodeMan::Add(CStormnode &sn)
@@ -221,6 +216,7 @@ bool CStormnodeMan::Add(CStormnode &sn)
     {
         LogPrint("stormnode", "CStormnodeMan: Adding new Stormnode %s - %i now\n", sn.addr.ToString(), size() + 1);
         vStormnodes.push_back(sn);
+        nListVersion++;
         return true;
     }
 
@@ -249,7 +245,9 @@ void CStormnodeMan::Check()
     LOCK(cs);
 
     BOOST_FOREACH(CStormnode& sn, vStormnodes) {
+        int nState = sn.activeState;
         sn.Check();
+        if(sn.activeState != nState) nListVersion++;
     }
 }
 
@@ -292,6 +290,7 @@ void CStormnodeMan::CheckAndRemove(bool forceExpiredRemoval)
             }
 
             it = vStormnodes.erase(it);
+            nListVersion++;
         } else {
             ++it;
         }
@@ -354,6 +353,8 @@ void CStormnodeMan::Clear()
 {
     LOCK(cs);
     vStormnodes.clear();
+    mapRanks.clear();
+    nListVersion++;
     mAskedUsForStormnodeList.clear();
     mWeAskedForStormnodeList.clear();
     mWeAskedForStormnodeListEntry.clear();
@@ -558,13 +559,33 @@ CStormnode* CStormnodeMan::GetCurrentStormNode(int mod, int64_t nBlockHeight, in
     return winner;
 }
 
-int CStormnodeMan::GetStormnodeRank(const CTxIn& vin, int64_t nBlockHeight, int minProtocol, bool fOnlyActive)
+const CStormnodeRanks* CStormnodeMan::GetRanks(int64_t nBlockHeight, int minProtocol, bool fOnlyActive)
 {
-    std::vector<pair<int64_t, CTxIn> > vecStormnodeScores;
+    AssertLockHeld(cs);
 
     //make sure we know about this block
     uint256 hash = 0;
-    if(!GetBlockHash(hash, nBlockHeight)) return -1;
+    if(!GetBlockHash(hash, nBlockHeight)) return NULL;
+
+    boost::tuple<int64_t, int, bool> key(nBlockHeight, minProtocol, fOnlyActive);
+    std::map<boost::tuple<int64_t, int, bool>, CStormnodeRanks>::iterator it = mapRanks.find(key);
+    if(it != mapRanks.end()) {
+        const CStormnodeRanks& ranks = it->second;
+        if(ranks.nListVersion == nListVersion && ranks.hashBlock == hash &&
+                GetTime() - ranks.nTimeBuilt < STORMNODE_CHECK_SECONDS)
+            return &ranks;
+    } else {
+        // drop the table built longest ago
+        if(mapRanks.size() >= MAX_STORMNODE_RANK_TABLES) {
+            std::map<boost::tuple<int64_t, int, bool>, CStormnodeRanks>::iterator itOldest = mapRanks.begin();
+            for(std::map<boost::tuple<int64_t, int, bool>, CStormnodeRanks>::iterator mi = mapRanks.begin(); mi != mapRanks.end(); ++mi)
+                if(mi->second.nTimeBuilt < itOldest->second.nTimeBuilt) itOldest = mi;
+            mapRanks.erase(itOldest);
+        }
+        it = mapRanks.insert(make_pair(key, CStormnodeRanks())).first;
+    }
+
+    std::vector<pair<int64_t, CTxIn> > vecStormnodeScores;
 
     // scan for winner
     BOOST_FOREACH(CStormnode& sn, vStormnodes) {
@@ -581,48 +602,49 @@ int CStormnodeMan::GetStormnodeRank(const CTxIn& vin, int64_t nBlockHeight, int
 
     sort(vecStormnodeScores.rbegin(), vecStormnodeScores.rend(), CompareScoreTxIn());
 
-    int rank = 0;
+    CStormnodeRanks& ranks = it->second;
+    ranks.hashBlock = hash;
+    ranks.nTimeBuilt = GetTime();
+    ranks.nListVersion = nListVersion;
+    ranks.vRanked.clear();
+    ranks.mapRank.clear();
+    ranks.vRanked.reserve(vecStormnodeScores.size());
     BOOST_FOREACH (PAIRTYPE(int64_t, CTxIn)& s, vecStormnodeScores){
-        rank++;
-        if(s.second.prevout == vin.prevout) {
-            return rank;
-        }
+        ranks.vRanked.push_back(s.second);
+        // the first of two entries for one outpoint ranks higher
+        ranks.mapRank.insert(make_pair(s.second.prevout, (int)ranks.vRanked.size()));
     }
 
-    return -1;
+    LogPrint("stormnode", "CStormnodeMan::GetRanks - ranked %d Stormnodes at height %d\n", ranks.vRanked.size(), nBlockHeight);
+    return &ranks;
 }
 
-std::vector<pair<int, CStormnode> > CStormnodeMan::GetStormnodeRanks(int64_t nBlockHeight, int minProtocol)
+int CStormnodeMan::GetStormnodeRank(const CTxIn& vin, int64_t nBlockHeight, int minProtocol, bool fOnlyActive)
 {
-    std::vector<pair<int64_t, CStormnode> > vecStormnodeScores;
-    std::vector<pair<int, CStormnode> > vecStormnodeRanks;
-
-    //make sure we know about this block
-    uint256 hash = 0;
-    if(!GetBlockHash(hash, nBlockHeight)) return vecStormnodeRanks;
-
-    // scan for winner
-    BOOST_FOREACH(CStormnode& sn, vStormnodes) {
+    LOCK(cs);
 
-        sn.Check();
+    const CStormnodeRanks* pranks = GetRanks(nBlockHeight, minProtocol, fOnlyActive);
+    if(pranks == NULL) return -1;
 
-        if(sn.protocolVersion < minProtocol) continue;
-        if(!sn.IsEnabled()) {
-            continue;
-        }
+    boost::unordered_map<COutPoint, int, OutPointHasher>::const_iterator it = pranks->mapRank.find(vin.prevout);
+    if(it == pranks->mapRank.end()) return -1;
+    return it->second;
+}
 
-        uint256 n = sn.CalculateScore(1, nBlockHeight);
-        int64_t n2 = n.GetCompact(false);
+std::vector<pair<int, CStormnode> > CStormnodeMan::GetStormnodeRanks(int64_t nBlockHeight, int minProtocol)
+{
+    std::vector<pair<int, CStormnode> > vecStormnodeRanks;
 
-        vecStormnodeScores.push_back(make_pair(n2, sn));
-    }
+    LOCK(cs);
 
-    sort(vecStormnodeScores.rbegin(), vecStormnodeScores.rend(), CompareScoreSN());
+    const CStormnodeRanks* pranks = GetRanks(nBlockHeight, minProtocol, true);
+    if(pranks == NULL) return vecStormnodeRanks;
 
     int rank = 0;
-    BOOST_FOREACH (PAIRTYPE(int64_t, CStormnode)& s, vecStormnodeScores){
+    BOOST_FOREACH (const CTxIn& vin, pranks->vRanked){
         rank++;
-        vecStormnodeRanks.push_back(make_pair(rank, s.second));
+        CStormnode* psn = Find(vin);
+        if(psn) vecStormnodeRanks.push_back(make_pair(rank, *psn));
     }
 
     return vecStormnodeRanks;
@@ -630,34 +652,12 @@ std::vector<pair<int, CStormnode> > CStormnodeMan::GetStormnodeRanks(int64_t nBl
 
 CStormnode* CStormnodeMan::GetStormnodeByRank(int nRank, int64_t nBlockHeight, int minProtocol, bool fOnlyActive)
 {
-    std::vector<pair<int64_t, CTxIn> > vecStormnodeScores;
-
-    // scan for winner
-    BOOST_FOREACH(CStormnode& sn, vStormnodes) {
-
-        if(sn.protocolVersion < minProtocol) continue;
-        if(fOnlyActive) {
-            sn.Check();
-            if(!sn.IsEnabled()) continue;
-        }
-
-        uint256 n = sn.CalculateScore(1, nBlockHeight);
-        int64_t n2 = n.GetCompact(false);
-
-        vecStormnodeScores.push_back(make_pair(n2, sn.vin));
-    }
-
-    sort(vecStormnodeScores.rbegin(), vecStormnodeScores.rend(), CompareScoreTxIn());
+    LOCK(cs);
 
-    int rank = 0;
-    BOOST_FOREACH (PAIRTYPE(int64_t, CTxIn)& s, vecStormnodeScores){
-        rank++;
-        if(rank == nRank) {
-            return Find(s.second);
-        }
-    }
+    const CStormnodeRanks* pranks = GetRanks(nBlockHeight, minProtocol, fOnlyActive);
+    if(pranks == NULL || nRank < 1 || nRank > (int)pranks->vRanked.size()) return NULL;
 
-    return NULL;
+    return Find(pranks->vRanked[nRank - 1]);
 }
 
 void CStormnodeMan::ProcessStormnodeConnections()
@@ -812,6 +812,7 @@ void CStormnodeMan::Remove(CTxIn vin)
         if((*it).vin == vin){
             LogPrint("stormnode", "CStormnodeMan: Removing Stormnode %s - %i now\n", (*it).addr.ToString(), size() - 1);
             vStormnodes.erase(it);
+            nListVersion++;
             break;
         }
         ++it;
@@ -13,6 +13,10 @@
 #include "main.h"
 #include "anon/stormnode/stormnode.h"
 
+#include <boost/tuple/tuple.hpp>
+#include <boost/tuple/tuple_comparison.hpp>
+#include <boost/unordered_map.hpp>
+
 static const unsigned int STORMNODES_DUMP_SECONDS = (15*60);// 15 Minutes
 static const unsigned int STORMNODES_SSEG_SECONDS = (1*60*60);// 1 Hour
 
@@ -46,6 +50,26 @@ public:
     ReadResult Read(CStormnodeMan& snodemanToLoad, bool fDryRun = false);
 };
 
+struct OutPointHasher
+{
+    size_t operator()(const COutPoint& outpoint) const { return outpoint.hash.GetLow64() + outpoint.n; }
+};
+
+/** Stormnode ranks for one block height, sorted once and looked up by
+ *  outpoint.
+ */
+class CStormnodeRanks
+{
+public:
+    uint256 hashBlock;          // block the scores were derived from
+    int64_t nTimeBuilt;
+    unsigned int nListVersion;  // CStormnodeMan list version it was built from
+    std::vector<CTxIn> vRanked; // vRanked[rank - 1]
+    boost::unordered_map<COutPoint, int, OutPointHasher> mapRank;
+
+    CStormnodeRanks() : hashBlock(0), nTimeBuilt(0), nListVersion(0) {}
+};
+
 class CStormnodeMan
 {
 private:
@@ -64,6 +88,15 @@ private:
     // which Stormnodes we've asked for
     std::map<COutPoint, int64_t> mWeAskedForStormnodeListEntry;
 
+    // bumped whenever an entry is added, removed or changes state
+    unsigned int nListVersion;
+    // rank tables by (height, minimum protocol, only active)
+    std::map<boost::tuple<int64_t, int, bool>, CStormnodeRanks> mapRanks;
+
+    /// Ranks at nBlockHeight, rebuilt only when the list, the block at that
+    /// height or (after STORMNODE_CHECK_SECONDS) the stormnode states may have changed
+    const CStormnodeRanks* GetRanks(int64_t nBlockHeight, int minProtocol, bool fOnlyActive);
+
 public:
     // Keep track of all broadcasts I've seen
     map<uint256, CStormnodeBroadcast> mapSeenStormnodeBroadcast;
@@ -86,6 +119,8 @@ public:
 
         READWRITE(mapSeenStormnodeBroadcast);
         READWRITE(mapSeenStormnodePing);
+        if (ser_action.ForRead())
+            nListVersion++;
     }
 
     CStormnodeMan();
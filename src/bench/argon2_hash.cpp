@@ -0,0 +1,59 @@
+// Copyright (c) 2015-2016 Silk Network
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "hash.h"
+#include "primitives/block.h"
+#include "util.h"
+
+#include <iostream>
+
+#include <boost/thread.hpp>
+
+static void Argon2HeaderHash(benchmark::State& state, unsigned int nThreads)
+{
+    CBlockHeader header;
+    header.nVersion = CBlockHeader::CURRENT_VERSION;
+    header.hashPrevBlock = GetRandHash();
+    header.hashMerkleRoot = GetRandHash();
+    header.nTime = 1444948732;
+    header.nBits = 0x1e0fffff;
+    header.nNonce = 0;
+
+    unsigned int nWasThreads = nArgon2Threads;
+    nArgon2Threads = nThreads;
+
+    uint64_t nHashes = 0;
+    int64_t nStart = GetTimeMicros();
+    while (state.KeepRunning()) {
+        header.nNonce++;
+        header.GetPoWArgonHash();
+        nHashes++;
+    }
+    int64_t nElapsed = GetTimeMicros() - nStart;
+    std::cout << "# " << nThreads << " thread(s): "
+              << (nElapsed > 0 ? nHashes * 1000000 / nElapsed : 0) << " headers/s\n";
+
+    nArgon2Threads = nWasThreads;
+}
+
+static void Argon2HeaderHashOneThread(benchmark::State& state)
+{
+    Argon2HeaderHash(state, 1);
+}
+
+static void Argon2HeaderHashFourThreads(benchmark::State& state)
+{
+    Argon2HeaderHash(state, 4);
+}
+
+static void Argon2HeaderHashAllThreads(benchmark::State& state)
+{
+    Argon2HeaderHash(state, std::max(boost::thread::hardware_concurrency(), 1U));
+}
+
+BENCHMARK(Argon2HeaderHashOneThread);
+BENCHMARK(Argon2HeaderHashFourThreads);
+BENCHMARK(Argon2HeaderHashAllThreads);
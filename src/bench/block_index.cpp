@@ -0,0 +1,76 @@
+// Copyright (c) 2015-2016 Silk Network
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "chain.h"
+#include "util.h"
+
+#include <iostream>
+#include <map>
+
+// Entries in the synthetic block index, about the size of the chain today
+static const unsigned int BENCH_INDEX_SIZE = 500000;
+
+// Random lookups per benchmark iteration
+static const unsigned int BENCH_LOOKUPS = 1000;
+
+static const std::vector<uint256>& BenchBlockHashes()
+{
+    static std::vector<uint256> vHash;
+    if (vHash.empty()) {
+        vHash.reserve(BENCH_INDEX_SIZE);
+        for (unsigned int i = 0; i < BENCH_INDEX_SIZE; i++)
+            vHash.push_back(GetRandHash());
+        std::cout << "# block index: " << BENCH_INDEX_SIZE << " entries, " << BENCH_LOOKUPS << " random lookups per iteration\n";
+    }
+    return vHash;
+}
+
+template<typename Map>
+static void BlockIndexLookup(benchmark::State& state)
+{
+    static CBlockIndexArena arena;
+    static Map mapIndex;
+    const std::vector<uint256>& vHash = BenchBlockHashes();
+    if (mapIndex.empty())
+        for (unsigned int i = 0; i < vHash.size(); i++)
+            mapIndex.insert(std::make_pair(vHash[i], arena.Alloc()));
+
+    while (state.KeepRunning()) {
+        for (unsigned int i = 0; i < BENCH_LOOKUPS; i++) {
+            typename Map::const_iterator mi = mapIndex.find(vHash[GetRand(vHash.size())]);
+            assert(mi != mapIndex.end());
+        }
+    }
+}
+
+// How mapBlockIndex was stored before it became a BlockMap
+static void BlockIndexLookupOrdered(benchmark::State& state)
+{
+    BlockIndexLookup<std::map<uint256, CBlockIndex*> >(state);
+}
+
+static void BlockIndexLookupHashed(benchmark::State& state)
+{
+    BlockIndexLookup<BlockMap>(state);
+}
+
+// Building the index the way CTxDB::LoadBlockIndex does
+static void BlockIndexLoad(benchmark::State& state)
+{
+    const std::vector<uint256>& vHash = BenchBlockHashes();
+    while (state.KeepRunning()) {
+        CBlockIndexArena arena;
+        BlockMap mapIndex;
+        for (unsigned int i = 0; i < 20000; i++) {
+            BlockMap::iterator mi = mapIndex.insert(std::make_pair(vHash[i], arena.Alloc())).first;
+            mi->second->phashBlock = &mi->first;
+        }
+    }
+}
+
+BENCHMARK(BlockIndexLookupOrdered);
+BENCHMARK(BlockIndexLookupHashed);
+BENCHMARK(BlockIndexLoad);
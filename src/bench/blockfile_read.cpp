@@ -0,0 +1,116 @@
+// Copyright (c) 2015-2016 Silk Network
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "blockfile.h"
+#include "main.h"
+#include "primitives/transaction.h"
+#include "util.h"
+
+#include <iostream>
+
+#include <boost/filesystem.hpp>
+
+// Transactions written to the synthetic block file
+static const unsigned int BENCH_FILE_TXS = 20000;
+
+// Random transaction reads per benchmark iteration
+static const unsigned int BENCH_READS = 1000;
+
+/** A blk0001.dat full of transactions in a temporary data directory. */
+class CBenchBlockFile
+{
+public:
+    boost::filesystem::path pathDir;
+    std::vector<unsigned int> vTxPos;
+
+    CBenchBlockFile()
+    {
+        pathDir = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path("bench_darksilk_%%%%%%%%");
+        boost::filesystem::create_directories(pathDir);
+        mapArgs["-datadir"] = pathDir.string();
+        ClearDatadirCache();
+
+        CAutoFile fileout(fopen(BlockFilePath(1).string().c_str(), "wb"), SER_DISK, CLIENT_VERSION);
+        assert(!fileout.IsNull());
+        for (unsigned int i = 0; i < BENCH_FILE_TXS; i++) {
+            CMutableTransaction tx;
+            tx.nTime = 1444948732 + i;
+            tx.vin.resize(1);
+            tx.vin[0].prevout = COutPoint(GetRandHash(), i % 4);
+            tx.vin[0].scriptSig = CScript() << std::vector<unsigned char>(72, i & 0xff) << std::vector<unsigned char>(33, 2);
+            tx.vout.resize(2);
+            for (unsigned int j = 0; j < tx.vout.size(); j++) {
+                tx.vout[j].nValue = (i + 1) * CENT;
+                tx.vout[j].scriptPubKey = CScript() << OP_DUP << OP_HASH160 << std::vector<unsigned char>(20, j) << OP_EQUALVERIFY << OP_CHECKSIG;
+            }
+            vTxPos.push_back(ftell(fileout));
+            fileout << CTransaction(tx);
+        }
+        std::cout << "# block file: " << BENCH_FILE_TXS << " txs, " << BENCH_READS << " random tx reads per iteration\n";
+    }
+
+    ~CBenchBlockFile()
+    {
+        blockFileReader.CloseAll();
+        boost::system::error_code ec;
+        boost::filesystem::remove_all(pathDir, ec);
+    }
+
+    unsigned int RandomTxPos() const
+    {
+        return vTxPos[GetRand(vTxPos.size())];
+    }
+};
+
+static const CBenchBlockFile& GetBenchBlockFile()
+{
+    static CBenchBlockFile benchFile;
+    return benchFile;
+}
+
+// How CTransactionPoS::ReadFromDisk read a transaction before the pool:
+// one fopen/fseek/fclose per read.
+static void BlockFileReadFopen(benchmark::State& state)
+{
+    const CBenchBlockFile& benchFile = GetBenchBlockFile();
+    while (state.KeepRunning()) {
+        for (unsigned int i = 0; i < BENCH_READS; i++) {
+            CAutoFile filein(OpenBlockFile(1, 0, "rb"), SER_DISK, CLIENT_VERSION);
+            assert(!filein.IsNull());
+            fseek(filein, benchFile.RandomTxPos(), SEEK_SET);
+            CTransaction tx;
+            filein >> tx;
+        }
+    }
+}
+
+static void BlockFileRead(benchmark::State& state, bool fMap)
+{
+    const CBenchBlockFile& benchFile = GetBenchBlockFile();
+    blockFileReader.Configure(DEFAULT_BLOCKFILE_POOL, fMap);
+    blockFileReader.SetAppendFile(2);
+    while (state.KeepRunning()) {
+        for (unsigned int i = 0; i < BENCH_READS; i++) {
+            CTransaction tx;
+            bool fRead = blockFileReader.Read(1, benchFile.RandomTxPos(), tx, SER_DISK, CLIENT_VERSION);
+            assert(fRead);
+        }
+    }
+}
+
+static void BlockFileReadPooled(benchmark::State& state)
+{
+    BlockFileRead(state, false);
+}
+
+static void BlockFileReadMapped(benchmark::State& state)
+{
+    BlockFileRead(state, true);
+}
+
+BENCHMARK(BlockFileReadFopen);
+BENCHMARK(BlockFileReadPooled);
+BENCHMARK(BlockFileReadMapped);
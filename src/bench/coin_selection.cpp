@@ -0,0 +1,123 @@
+// Copyright (c) 2015-2016 Silk Network
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "util.h"
+#include "wallet/coinselection.h"
+
+#include <iostream>
+
+// Coins in the synthetic wallets, and payments selected from each
+static const unsigned int BENCH_SMALL_WALLET = 100;
+static const unsigned int BENCH_LARGE_WALLET = 2000;
+static const unsigned int BENCH_PAYMENTS = 50;
+
+/** A wallet of coins and a list of payments, the same on every run. */
+class CBenchWallet
+{
+public:
+    std::vector<CSelectionInput> vInputs;
+    std::vector<CAmount> vTargets;
+    CAmount nTotal;
+
+    CBenchWallet(unsigned int nCoins) : nTotal(0)
+    {
+        // Fixed seed: every run selects from the same corpus
+        seed_insecure_rand(true);
+        for (unsigned int i = 0; i < nCoins; i++) {
+            // Mostly change-sized coins, some round payments received
+            CAmount nValue = (insecure_rand() % 4 == 0) ? (CAmount)(1 + insecure_rand() % 100) * COIN
+                                                         : (CAmount)(1 + insecure_rand() % 1000000) * 1000;
+            vInputs.push_back(CSelectionInput(nValue, 1, i));
+            nTotal += nValue;
+        }
+        SortSelectionInputs(vInputs);
+        for (unsigned int i = 0; i < BENCH_PAYMENTS; i++) {
+            // Half of the payments can be paid exactly with two of the coins
+            if (i % 2 == 0)
+                vTargets.push_back(vInputs[insecure_rand() % nCoins].nValue + vInputs[insecure_rand() % nCoins].nValue);
+            else
+                vTargets.push_back((CAmount)(1 + insecure_rand() % 5000) * CENT);
+        }
+        std::cout << "# " << nCoins << " coins worth " << FormatMoney(nTotal) << ", " << BENCH_PAYMENTS << " payments\n";
+    }
+};
+
+static CBenchWallet& GetSmallWallet()
+{
+    static CBenchWallet wallet(BENCH_SMALL_WALLET);
+    return wallet;
+}
+
+static CBenchWallet& GetLargeWallet()
+{
+    static CBenchWallet wallet(BENCH_LARGE_WALLET);
+    return wallet;
+}
+
+// The coins below target + CENT, as SelectCoinsMinConf hands them to the solvers
+static void LowerInputs(const CBenchWallet& wallet, CAmount nTarget, std::vector<CSelectionInput>& vValue, CAmount& nTotalLower)
+{
+    vValue.clear();
+    nTotalLower = 0;
+    for (unsigned int i = 0; i < wallet.vInputs.size(); i++) {
+        if (wallet.vInputs[i].nValue < nTarget + CENT) {
+            vValue.push_back(wallet.vInputs[i]);
+            nTotalLower += wallet.vInputs[i].nValue;
+        }
+    }
+}
+
+// How SelectCoinsMinConf solved before: two rounds of the knapsack
+// approximation, each on its own copy of the coins.
+static void KnapsackByValue(std::vector<CSelectionInput> vValue, CAmount nTotalLower, CAmount nTarget, std::vector<char>& vfBest, CAmount& nBest)
+{
+    ApproximateBestSubset(vValue, nTotalLower, nTarget, vfBest, nBest, 1000);
+    if (nBest != nTarget && nTotalLower >= nTarget + CENT) {
+        std::vector<CSelectionInput> vCopy(vValue);
+        ApproximateBestSubset(vCopy, nTotalLower, nTarget + CENT, vfBest, nBest, 1000);
+    }
+}
+
+static void RunKnapsack(benchmark::State& state, const CBenchWallet& wallet)
+{
+    std::vector<CSelectionInput> vValue;
+    std::vector<char> vfBest;
+    CAmount nTotalLower, nBest;
+    while (state.KeepRunning()) {
+        for (unsigned int i = 0; i < wallet.vTargets.size(); i++) {
+            LowerInputs(wallet, wallet.vTargets[i], vValue, nTotalLower);
+            if (nTotalLower > wallet.vTargets[i])
+                KnapsackByValue(vValue, nTotalLower, wallet.vTargets[i], vfBest, nBest);
+        }
+    }
+}
+
+static void RunBnB(benchmark::State& state, const CBenchWallet& wallet)
+{
+    std::vector<CSelectionInput> vValue;
+    std::vector<char> vfBest;
+    CAmount nTotalLower, nBest;
+    while (state.KeepRunning()) {
+        for (unsigned int i = 0; i < wallet.vTargets.size(); i++) {
+            LowerInputs(wallet, wallet.vTargets[i], vValue, nTotalLower);
+            if (nTotalLower <= wallet.vTargets[i] || SelectCoinsBnB(vValue, wallet.vTargets[i], 0, vfBest, nBest))
+                continue;
+            ApproximateBestSubset(vValue, nTotalLower, wallet.vTargets[i], vfBest, nBest, 1000);
+            if (nBest != wallet.vTargets[i] && nTotalLower >= wallet.vTargets[i] + CENT)
+                ApproximateBestSubset(vValue, nTotalLower, wallet.vTargets[i] + CENT, vfBest, nBest, 1000);
+        }
+    }
+}
+
+static void CoinSelectionKnapsackSmall(benchmark::State& state) { RunKnapsack(state, GetSmallWallet()); }
+static void CoinSelectionKnapsackLarge(benchmark::State& state) { RunKnapsack(state, GetLargeWallet()); }
+static void CoinSelectionBnBSmall(benchmark::State& state) { RunBnB(state, GetSmallWallet()); }
+static void CoinSelectionBnBLarge(benchmark::State& state) { RunBnB(state, GetLargeWallet()); }
+
+BENCHMARK(CoinSelectionKnapsackSmall);
+BENCHMARK(CoinSelectionKnapsackLarge);
+BENCHMARK(CoinSelectionBnBSmall);
+BENCHMARK(CoinSelectionBnBLarge);
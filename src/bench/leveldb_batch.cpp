@@ -0,0 +1,74 @@
+// Copyright (c) 2015-2016 Silk Network
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "leveldbbatch.h"
+#include "tinyformat.h"
+
+#include <leveldb/write_batch.h>
+
+// Roughly the number of tx index writes queued while connecting a large block.
+static const unsigned int BENCH_BATCH_KEYS = 4000;
+
+static std::string BatchKey(unsigned int i)
+{
+    return strprintf("tx%064x", i);
+}
+
+// The WriteBatch::Handler replay CTxDB::ScanBatch used before the overlay.
+class CReplayScanner : public leveldb::WriteBatch::Handler
+{
+public:
+    std::string needle;
+    bool fFound;
+
+    CReplayScanner() : fFound(false) {}
+
+    virtual void Put(const leveldb::Slice& key, const leveldb::Slice& value)
+    {
+        if (key.ToString() == needle)
+            fFound = true;
+    }
+
+    virtual void Delete(const leveldb::Slice& key)
+    {
+        if (key.ToString() == needle)
+            fFound = true;
+    }
+};
+
+// Each queued write is preceded by a read of the same key, as in
+// CTxDB::UpdateTxIndex / ReadTxIndex during ConnectBlock.
+static void LevelDBBatchReplayScan(benchmark::State& state)
+{
+    while (state.KeepRunning()) {
+        leveldb::WriteBatch batch;
+        for (unsigned int i = 0; i < BENCH_BATCH_KEYS; i++) {
+            CReplayScanner scanner;
+            scanner.needle = BatchKey(i);
+            batch.Iterate(&scanner);
+            assert(!scanner.fFound);
+            batch.Put(scanner.needle, "value");
+        }
+    }
+}
+
+static void LevelDBBatchIndexedLookup(benchmark::State& state)
+{
+    while (state.KeepRunning()) {
+        CLevelDBIndexedBatch batch;
+        for (unsigned int i = 0; i < BENCH_BATCH_KEYS; i++) {
+            std::string strKey = BatchKey(i);
+            std::string strValue;
+            bool fDeleted;
+            bool fFound = batch.Lookup(strKey, &strValue, &fDeleted);
+            assert(!fFound);
+            batch.Put(strKey, "value");
+        }
+    }
+}
+
+BENCHMARK(LevelDBBatchReplayScan);
+BENCHMARK(LevelDBBatchIndexedLookup);
@@ -0,0 +1,54 @@
+// Copyright (c) 2015-2016 Silk Network
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "smessage.h"
+#include "util.h"
+
+#include <iostream>
+
+// About the size of a short text message once encrypted
+static const unsigned int BENCH_PAYLOAD = 1024;
+
+static void SecureMsgPow(benchmark::State& state, int nThreads)
+{
+    std::vector<uint8_t> vchMessage(SMSG_HDR_LEN + BENCH_PAYLOAD);
+    GetRandBytes(&vchMessage[0], vchMessage.size());
+    SecureMessage* psmsg = (SecureMessage*) &vchMessage[0];
+    psmsg->version[0] = 1;
+    psmsg->nPayload = BENCH_PAYLOAD;
+
+    bool fWasEnabled = fSecMsgEnabled;
+    fSecMsgEnabled = true;
+
+    uint64_t nTotalHashes = 0;
+    int64_t nStart = GetTimeMicros();
+    while (state.KeepRunning()) {
+        // a new message each time, so every iteration searches from scratch
+        psmsg->timestamp = GetTime() + nTotalHashes;
+        uint64_t nHashes = 0;
+        int rv = SecureMsgSetHash(&vchMessage[0], &vchMessage[SMSG_HDR_LEN], BENCH_PAYLOAD, nThreads, &nHashes);
+        assert(rv == 0);
+        nTotalHashes += nHashes;
+    }
+    int64_t nElapsed = GetTimeMicros() - nStart;
+    std::cout << "# " << (nThreads > 0 ? nThreads : (int)boost::thread::hardware_concurrency()) << " thread(s): "
+              << (nElapsed > 0 ? nTotalHashes * 1000000 / nElapsed : 0) << " hashes/s\n";
+
+    fSecMsgEnabled = fWasEnabled;
+}
+
+static void SecureMsgPowOneThread(benchmark::State& state)
+{
+    SecureMsgPow(state, 1);
+}
+
+static void SecureMsgPowAllThreads(benchmark::State& state)
+{
+    SecureMsgPow(state, 0);
+}
+
+BENCHMARK(SecureMsgPowOneThread);
+BENCHMARK(SecureMsgPowAllThreads);
@@ -0,0 +1,178 @@
+// Copyright (c) 2015-2016 Silk Network
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "anon/stealth/stealth.h"
+
+#include <iostream>
+
+#include <boost/thread.hpp>
+
+#include <openssl/ec.h>
+#include <openssl/obj_mac.h>
+#include <openssl/sha.h>
+
+// Owned stealth addresses, and stealth transactions in a scanned block
+static const unsigned int BENCH_ADDRESSES = 20;
+static const unsigned int BENCH_TXS = 200;
+
+// Other outputs of each stealth transaction, e.g. the payment and change
+static const unsigned int BENCH_OUTPUTS = 2;
+
+/** Owned stealth addresses and the ephemeral keys of a block paying none of them. */
+class CBenchStealth
+{
+public:
+    std::vector<ec_secret> vScanSecret;
+    std::vector<ec_point> vSpendPubkey;
+    std::vector<ec_point> vEphem;
+    CStealthScanner scanner;
+
+    CBenchStealth()
+    {
+        for (unsigned int i = 0; i < BENCH_ADDRESSES; i++) {
+            ec_secret sScan, sSpend;
+            ec_point pkSpend;
+            GenerateRandomSecret(sScan);
+            GenerateRandomSecret(sSpend);
+            SecretToPublicKey(sSpend, pkSpend);
+            vScanSecret.push_back(sScan);
+            vSpendPubkey.push_back(pkSpend);
+            scanner.AddAddress(data_chunk(sScan.e, sScan.e + ec_secret_size), pkSpend);
+        }
+        for (unsigned int i = 0; i < BENCH_TXS; i++) {
+            ec_secret sEphem;
+            ec_point pkEphem;
+            GenerateRandomSecret(sEphem);
+            SecretToPublicKey(sEphem, pkEphem);
+            vEphem.push_back(pkEphem);
+        }
+        std::cout << "# " << BENCH_ADDRESSES << " addresses, " << BENCH_TXS << " stealth txs with "
+                  << BENCH_OUTPUTS << " other outputs each\n";
+    }
+};
+
+static CBenchStealth& GetBenchStealth()
+{
+    static CBenchStealth benchStealth;
+    return benchStealth;
+}
+
+// StealthSecret as it was on OpenSSL: a new curve group and context per
+// call, c = H(eQ) and R' = R + cG through the generic EC_POINT arithmetic.
+static bool StealthSecretOpenSSL(const ec_secret& secret, const ec_point& pubkey, const ec_point& pkSpend, ec_secret& sharedSOut, ec_point& pkOut)
+{
+    bool fOk = false;
+    ec_point vchOutQ(ec_compressed_size);
+    BIGNUM* bnEphem = NULL;
+    BIGNUM* bnQ = NULL;
+    BIGNUM* bnOutQ = NULL;
+    BIGNUM* bnc = NULL;
+    BIGNUM* bnR = NULL;
+    BIGNUM* bnOutR = NULL;
+    EC_POINT* Q = NULL;
+    EC_POINT* C = NULL;
+    EC_POINT* R = NULL;
+    EC_POINT* Rout = NULL;
+
+    EC_GROUP* ecgrp = EC_GROUP_new_by_curve_name(NID_secp256k1);
+    BN_CTX* bnCtx = BN_CTX_new();
+    if (!ecgrp || !bnCtx)
+        goto End;
+
+    // -- eQ
+    if (!(bnEphem = BN_bin2bn(&secret.e[0], ec_secret_size, BN_new()))
+        || !(bnQ = BN_bin2bn(&pubkey[0], pubkey.size(), BN_new()))
+        || !(Q = EC_POINT_bn2point(ecgrp, bnQ, NULL, bnCtx))
+        || !EC_POINT_mul(ecgrp, Q, NULL, Q, bnEphem, bnCtx)
+        || !(bnOutQ = EC_POINT_point2bn(ecgrp, Q, POINT_CONVERSION_COMPRESSED, BN_new(), bnCtx))
+        || BN_num_bytes(bnOutQ) != (int) ec_compressed_size
+        || BN_bn2bin(bnOutQ, &vchOutQ[0]) != (int) ec_compressed_size)
+        goto End;
+
+    SHA256(&vchOutQ[0], vchOutQ.size(), &sharedSOut.e[0]);
+
+    // -- R' = R + cG
+    if (!(bnc = BN_bin2bn(&sharedSOut.e[0], ec_secret_size, BN_new()))
+        || !(C = EC_POINT_new(ecgrp))
+        || !EC_POINT_mul(ecgrp, C, bnc, NULL, NULL, bnCtx)
+        || !(bnR = BN_bin2bn(&pkSpend[0], pkSpend.size(), BN_new()))
+        || !(R = EC_POINT_bn2point(ecgrp, bnR, NULL, bnCtx))
+        || !(Rout = EC_POINT_new(ecgrp))
+        || !EC_POINT_add(ecgrp, Rout, R, C, bnCtx)
+        || !(bnOutR = EC_POINT_point2bn(ecgrp, Rout, POINT_CONVERSION_COMPRESSED, BN_new(), bnCtx)))
+        goto End;
+
+    pkOut.resize(ec_compressed_size);
+    fOk = BN_num_bytes(bnOutR) == (int) ec_compressed_size
+        && BN_bn2bin(bnOutR, &pkOut[0]) == (int) ec_compressed_size;
+
+End:
+    if (bnOutR)  BN_free(bnOutR);
+    if (Rout)    EC_POINT_free(Rout);
+    if (R)       EC_POINT_free(R);
+    if (bnR)     BN_free(bnR);
+    if (C)       EC_POINT_free(C);
+    if (bnc)     BN_free(bnc);
+    if (bnOutQ)  BN_free(bnOutQ);
+    if (Q)       EC_POINT_free(Q);
+    if (bnQ)     BN_free(bnQ);
+    if (bnEphem) BN_free(bnEphem);
+    if (bnCtx)   BN_CTX_free(bnCtx);
+    if (ecgrp)   EC_GROUP_free(ecgrp);
+    return fOk;
+}
+
+// How FindStealthTransactions scanned before: one OpenSSL StealthSecret
+// per ephemeral key, other output and owned address.
+static void StealthScanOpenSSL(benchmark::State& state)
+{
+    CBenchStealth& bench = GetBenchStealth();
+    ec_secret sShared;
+    ec_point pkOut;
+    while (state.KeepRunning()) {
+        for (unsigned int i = 0; i < bench.vEphem.size(); i++)
+            for (unsigned int j = 0; j < BENCH_OUTPUTS; j++)
+                for (unsigned int k = 0; k < bench.vScanSecret.size(); k++)
+                    StealthSecretOpenSSL(bench.vScanSecret[k], bench.vEphem[i], bench.vSpendPubkey[k], sShared, pkOut);
+    }
+}
+
+// The same loop on the libsecp256k1 StealthSecret
+static void StealthScanPerOutput(benchmark::State& state)
+{
+    CBenchStealth& bench = GetBenchStealth();
+    ec_secret sShared;
+    ec_point pkOut;
+    while (state.KeepRunning()) {
+        for (unsigned int i = 0; i < bench.vEphem.size(); i++)
+            for (unsigned int j = 0; j < BENCH_OUTPUTS; j++)
+                for (unsigned int k = 0; k < bench.vScanSecret.size(); k++)
+                    StealthSecret(bench.vScanSecret[k], bench.vEphem[i], bench.vSpendPubkey[k], sShared, pkOut);
+    }
+}
+
+static void StealthScanDerive(benchmark::State& state)
+{
+    CBenchStealth& bench = GetBenchStealth();
+    std::vector<CStealthScanner::Derived> vDerived;
+    while (state.KeepRunning()) {
+        for (unsigned int i = 0; i < bench.vEphem.size(); i++)
+            bench.scanner.Derive(bench.vEphem[i], vDerived);
+    }
+}
+
+static void StealthScanDeriveBatch(benchmark::State& state)
+{
+    CBenchStealth& bench = GetBenchStealth();
+    std::vector<std::vector<CStealthScanner::Derived> > vDerived;
+    while (state.KeepRunning())
+        bench.scanner.DeriveBatch(bench.vEphem, vDerived, boost::thread::hardware_concurrency());
+}
+
+BENCHMARK(StealthScanOpenSSL);
+BENCHMARK(StealthScanPerOutput);
+BENCHMARK(StealthScanDerive);
+BENCHMARK(StealthScanDeriveBatch);
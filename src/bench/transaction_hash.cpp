@@ -0,0 +1,268 @@
+// Copyright (c) 2015-2016 Silk Network
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "blockfile.h"
+#include "checkpoints.h"
+#include "keystore.h"
+#include "main.h"
+#include "primitives/block.h"
+#include "primitives/transaction.h"
+#include "txdb-leveldb.h"
+#include "util.h"
+
+#include <iostream>
+
+#include <boost/filesystem.hpp>
+
+// Size of the synthetic block used by the benchmarks below.
+static const unsigned int BENCH_BLOCK_TXS = 2000;
+
+// Fee paid by each transaction of the block
+static const CAmount BENCH_TX_FEE = CENT;
+
+/**
+ * The block's transactions accepted to the pool one by one, as they arrive
+ * from peers, and then the block itself received, checked and connected.
+ * Every transaction spends two outputs of its own funding transaction, in
+ * a block file and tx index of a temporary data directory. Counts the txids
+ * hashed now, and the txid lookups along the way, each of which hashed the
+ * transaction before the txid was cached.
+ */
+class CBenchTxidPaths
+{
+public:
+    CTxHashCounts countsPool;
+    CTxHashCounts countsCheck;
+    CTxHashCounts countsConnect;
+
+    CBenchTxidPaths()
+    {
+        boost::filesystem::path pathDir = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path("bench_darksilk_%%%%%%%%");
+        boost::filesystem::create_directories(pathDir);
+        std::map<std::string, std::string> mapArgsOld = mapArgs;
+        mapArgs["-datadir"] = pathDir.string();
+        ClearDatadirCache();
+        blockFileReader.CloseAll();
+
+        LOCK(cs_main);
+        // Past the last checkpoint, so that ConnectBlock checks signatures
+        int nBestHeightOld = nBestHeight;
+        nBestHeight = std::max(nBestHeight, Checkpoints::GetTotalBlocksEstimate());
+
+        CBasicKeyStore keystore;
+        CKey key;
+        key.MakeNewKey(true);
+        keystore.AddKey(key);
+        CScript scriptPubKey = GetScriptForDestination(key.GetPubKey().GetID());
+        unsigned int nTime = GetAdjustedTime() - 60 * 60;
+
+        // One more funding transaction for the coinstake
+        std::vector<CTransaction> vFunding;
+        {
+            CTxDB txdb("cr+");
+            CAutoFile fileout(fopen(BlockFilePath(1).string().c_str(), "wb"), SER_DISK, CLIENT_VERSION);
+            assert(!fileout.IsNull());
+            for (unsigned int i = 0; i <= BENCH_BLOCK_TXS; i++) {
+                CMutableTransaction tx;
+                tx.nTime = nTime;
+                tx.vin.resize(1);
+                tx.vin[0].prevout = COutPoint(GetRandHash(), 0);
+                tx.vout.resize(2);
+                for (unsigned int j = 0; j < tx.vout.size(); j++) {
+                    tx.vout[j].nValue = COIN;
+                    tx.vout[j].scriptPubKey = scriptPubKey;
+                }
+                vFunding.push_back(CTransaction(tx));
+                CDiskTxPos pos(1, 0, ftell(fileout));
+                fileout << vFunding.back();
+                txdb.UpdateTxIndex(vFunding.back().GetHash(), CTxIndex(pos, tx.vout.size()));
+            }
+        }
+
+        // The block: coinbase, coinstake, then the spending transactions
+        CBlock block;
+        block.nTime = nTime + 30 * 60;
+        CMutableTransaction txCoinBase;
+        txCoinBase.nTime = block.nTime;
+        txCoinBase.vin.resize(1);
+        txCoinBase.vin[0].prevout.SetNull();
+        txCoinBase.vin[0].scriptSig = CScript() << std::vector<unsigned char>(4, 1);
+        txCoinBase.vout.resize(1);
+        txCoinBase.vout[0].SetEmpty();
+        block.vtx.push_back(CTransaction(txCoinBase));
+
+        CMutableTransaction txCoinStake;
+        txCoinStake.nTime = block.nTime;
+        txCoinStake.vin.push_back(CTxIn(vFunding[BENCH_BLOCK_TXS].GetHash(), 0));
+        txCoinStake.vout.resize(2);
+        txCoinStake.vout[0].SetEmpty();
+        txCoinStake.vout[1] = CTxOut(COIN, scriptPubKey);
+        SignSignature(keystore, vFunding[BENCH_BLOCK_TXS], txCoinStake, 0);
+        block.vtx.push_back(CTransaction(txCoinStake));
+
+        std::vector<CDataStream> vMsgTx;
+        for (unsigned int i = 0; i < BENCH_BLOCK_TXS; i++) {
+            CMutableTransaction tx;
+            tx.nTime = block.nTime;
+            tx.vin.push_back(CTxIn(vFunding[i].GetHash(), 0));
+            tx.vin.push_back(CTxIn(vFunding[i].GetHash(), 1));
+            tx.vout.resize(2);
+            tx.vout[0] = CTxOut(COIN / 2, scriptPubKey);
+            tx.vout[1] = CTxOut(COIN + COIN / 2 - BENCH_TX_FEE, scriptPubKey);
+            for (unsigned int j = 0; j < tx.vin.size(); j++)
+                SignSignature(keystore, vFunding[i], tx, j);
+            block.vtx.push_back(CTransaction(tx));
+
+            vMsgTx.push_back(CDataStream(SER_NETWORK, PROTOCOL_VERSION));
+            vMsgTx.back() << block.vtx.back();
+        }
+        block.hashMerkleRoot = block.BuildMerkleTree();
+        CDataStream ssBlock(SER_NETWORK, PROTOCOL_VERSION);
+        ssBlock << block;
+
+        // Accepted to the pool, each as read from a "tx" message
+        StartCounting();
+        for (unsigned int i = 0; i < vMsgTx.size(); i++) {
+            CTransaction tx;
+            vMsgTx[i] >> tx;
+            CValidationState state;
+            bool fAccepted = AcceptToMemoryPool(mempool, state, tx, true, NULL);
+            assert(fAccepted);
+        }
+        countsPool = StopCounting();
+        mempool.clear();
+
+        // Read from a "block" message and checked as ProcessBlock does
+        StartCounting();
+        CBlock blockRecv;
+        ssBlock >> blockRecv;
+        CValidationState state;
+        bool fChecked = blockRecv.CheckBlock(state, true, true, false);
+        assert(fChecked);
+        countsCheck = StopCounting();
+
+        // Connected on top of the chain
+        uint256 hashBlock = blockRecv.GetHash();
+        CBlockIndex* pindex = new CBlockIndex(1, 0, blockRecv);
+        pindex->phashBlock = &hashBlock;
+        pindex->nHeight = nBestHeight + 1;
+        StartCounting();
+        {
+            CTxDB txdb;
+            bool fConnected = blockRecv.ConnectBlock(txdb, pindex, false);
+            assert(fConnected);
+        }
+        countsConnect = StopCounting();
+        delete pindex;
+
+        std::cout << "# " << BENCH_BLOCK_TXS << " transactions of 2 inputs and 2 outputs; txids hashed, before caching -> now\n";
+        Print("AcceptToMemoryPool, all txs", countsPool);
+        Print("block received and CheckBlock", countsCheck);
+        Print("ConnectBlock", countsConnect);
+
+        nBestHeight = nBestHeightOld;
+        CTxDB().Close();
+        blockFileReader.CloseAll();
+        mapArgs = mapArgsOld;
+        ClearDatadirCache();
+        boost::system::error_code ec;
+        boost::filesystem::remove_all(pathDir, ec);
+    }
+
+    // Txid lookups per transaction along the pool and block paths
+    unsigned int LookupsPerTx() const
+    {
+        return (countsPool.nLookups + countsCheck.nLookups + countsConnect.nLookups) / BENCH_BLOCK_TXS;
+    }
+
+private:
+    static void StartCounting()
+    {
+        txHashCounts.nComputed = 0;
+        txHashCounts.nLookups = 0;
+        fCountTxHashes = true;
+    }
+
+    static CTxHashCounts StopCounting()
+    {
+        fCountTxHashes = false;
+        return txHashCounts;
+    }
+
+    static void Print(const char* pszPath, const CTxHashCounts& counts)
+    {
+        std::cout << "#   " << pszPath << ": " << counts.nLookups << " -> " << counts.nComputed << "\n";
+    }
+};
+
+static const CBenchTxidPaths& GetBenchTxidPaths()
+{
+    static CBenchTxidPaths paths;
+    return paths;
+}
+
+static void BuildSyntheticBlock(std::vector<CMutableTransaction>& vtx)
+{
+    vtx.resize(BENCH_BLOCK_TXS);
+    for (unsigned int i = 0; i < BENCH_BLOCK_TXS; i++) {
+        CMutableTransaction& tx = vtx[i];
+        tx.nTime = 1444948732 + i;
+        tx.vin.resize(2);
+        tx.vout.resize(2);
+        for (unsigned int j = 0; j < tx.vin.size(); j++) {
+            tx.vin[j].prevout = COutPoint(GetRandHash(), j);
+            tx.vin[j].scriptSig = CScript() << std::vector<unsigned char>(72, j) << std::vector<unsigned char>(33, i & 0xff);
+        }
+        for (unsigned int j = 0; j < tx.vout.size(); j++) {
+            tx.vout[j].nValue = (i + 1) * COIN;
+            tx.vout[j].scriptPubKey = CScript() << OP_DUP << OP_HASH160 << std::vector<unsigned char>(20, j) << OP_EQUALVERIFY << OP_CHECKSIG;
+        }
+    }
+}
+
+// Recompute the txid on every lookup, as CTransaction::GetHash() used to.
+static void TxidLookupsUncached(benchmark::State& state, unsigned int nLookups)
+{
+    std::vector<CMutableTransaction> vtx;
+    BuildSyntheticBlock(vtx);
+
+    uint256 hashAcc = 0;
+    while (state.KeepRunning()) {
+        for (unsigned int i = 0; i < vtx.size(); i++)
+            for (unsigned int n = 0; n < nLookups; n++)
+                hashAcc ^= vtx[i].GetHash();
+    }
+    assert(hashAcc != 1);
+}
+
+// Hash each transaction once when it is built (as on deserialization) and
+// serve every later lookup from the cache.
+static void TxidLookupsCached(benchmark::State& state, unsigned int nLookups)
+{
+    std::vector<CMutableTransaction> vtxMutable;
+    BuildSyntheticBlock(vtxMutable);
+
+    uint256 hashAcc = 0;
+    while (state.KeepRunning()) {
+        std::vector<CTransaction> vtx(vtxMutable.begin(), vtxMutable.end());
+        for (unsigned int i = 0; i < vtx.size(); i++)
+            for (unsigned int n = 0; n < nLookups; n++)
+                hashAcc ^= vtx[i].GetHash();
+    }
+    assert(hashAcc != 1);
+}
+
+// One lookup, where caching only adds the cost of hashing up front, and as
+// many as a transaction measurably gets through the pool and the block.
+static void TxidOneLookupUncached(benchmark::State& state) { TxidLookupsUncached(state, 1); }
+static void TxidOneLookupCached(benchmark::State& state) { TxidLookupsCached(state, 1); }
+static void TxidPathLookupsUncached(benchmark::State& state) { TxidLookupsUncached(state, GetBenchTxidPaths().LookupsPerTx()); }
+static void TxidPathLookupsCached(benchmark::State& state) { TxidLookupsCached(state, GetBenchTxidPaths().LookupsPerTx()); }
+
+BENCHMARK(TxidOneLookupUncached);
+BENCHMARK(TxidOneLookupCached);
+BENCHMARK(TxidPathLookupsUncached);
+BENCHMARK(TxidPathLookupsCached);
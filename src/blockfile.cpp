@@ -0,0 +1,127 @@
+// Copyright (c) 2015-2016 Silk Network
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockfile.h"
+
+#include "util.h"
+
+#include <boost/filesystem.hpp>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+
+using namespace std;
+
+CBlockFileReader blockFileReader;
+
+boost::filesystem::path BlockFilePath(unsigned int nFile)
+{
+    string strBlockFn = strprintf("blk%04u.dat", nFile);
+    return GetDataDir() / strBlockFn;
+}
+
+CBlockFileReader::CBlockFile::CBlockFile() : file(NULL), pbegin(NULL), pend(NULL)
+{
+}
+
+CBlockFileReader::CBlockFile::~CBlockFile()
+{
+    pregion.reset();
+    if (file)
+        fclose(file);
+}
+
+CBlockFileReader::CBlockFileReader()
+    : nUseCounter(0), nMaxOpen(DEFAULT_BLOCKFILE_POOL), fMapFiles(false), nAppendFile(0)
+{
+}
+
+CBlockFileReader::~CBlockFileReader()
+{
+    CloseAll();
+}
+
+void CBlockFileReader::Configure(unsigned int nMaxOpenIn, bool fMapFilesIn)
+{
+    LOCK(cs);
+    nMaxOpen = max(nMaxOpenIn, 1U);
+    fMapFiles = fMapFilesIn;
+    mapOpen.clear();
+}
+
+void CBlockFileReader::SetAppendFile(unsigned int nFile)
+{
+    LOCK(cs);
+    nAppendFile = nFile;
+}
+
+void CBlockFileReader::Close(unsigned int nFile)
+{
+    LOCK(cs);
+    mapOpen.erase(nFile);
+}
+
+void CBlockFileReader::CloseAll()
+{
+    LOCK(cs);
+    mapOpen.clear();
+}
+
+boost::shared_ptr<CBlockFileReader::CBlockFile> CBlockFileReader::Acquire(unsigned int nFile)
+{
+    if ((nFile < 1) || (nFile == (unsigned int) -1))
+        return boost::shared_ptr<CBlockFile>();
+
+    LOCK(cs);
+    FileMap::iterator it = mapOpen.find(nFile);
+    if (it != mapOpen.end())
+    {
+        it->second.second = ++nUseCounter;
+        return it->second.first;
+    }
+
+    boost::filesystem::path path = BlockFilePath(nFile);
+    boost::shared_ptr<CBlockFile> pfile(new CBlockFile());
+
+    // Only map files that will not grow any more: the mapping is sized once.
+    if (fMapFiles)
+    {
+        boost::system::error_code ec;
+        uintmax_t nSize = boost::filesystem::file_size(path, ec);
+        if (!ec && nSize > 0 && (nFile < nAppendFile || nSize >= MAX_BLOCKFILE_SIZE))
+        {
+            try {
+                boost::interprocess::file_mapping mapping(path.string().c_str(), boost::interprocess::read_only);
+                pfile->pregion.reset(new boost::interprocess::mapped_region(mapping, boost::interprocess::read_only, 0, nSize));
+                pfile->pbegin = static_cast<const char*>(pfile->pregion->get_address());
+                pfile->pend = pfile->pbegin + pfile->pregion->get_size();
+            }
+            catch (const std::exception& e) {
+                LogPrintf("CBlockFileReader : cannot map %s, reading it through stdio : %s\n", path.string(), e.what());
+                pfile->pregion.reset();
+                pfile->pbegin = pfile->pend = NULL;
+            }
+        }
+    }
+
+    if (!pfile->IsMapped())
+    {
+        pfile->file = fopen(path.string().c_str(), "rb");
+        if (!pfile->file)
+            return boost::shared_ptr<CBlockFile>();
+    }
+
+    // Evict the least recently used file. Readers still holding it keep it
+    // open until they are done.
+    if (mapOpen.size() >= nMaxOpen)
+    {
+        FileMap::iterator itOldest = mapOpen.begin();
+        for (FileMap::iterator mi = mapOpen.begin(); mi != mapOpen.end(); ++mi)
+            if (mi->second.second < itOldest->second.second)
+                itOldest = mi;
+        mapOpen.erase(itOldest);
+    }
+
+    mapOpen[nFile] = make_pair(pfile, ++nUseCounter);
+    return pfile;
+}
@@ -0,0 +1,114 @@
+// Copyright (c) 2015-2016 Silk Network
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef DARKSILK_BLOCKFILE_H
+#define DARKSILK_BLOCKFILE_H
+
+#include "serialize.h"
+#include "streams.h"
+#include "sync.h"
+
+#include <map>
+#include <stdio.h>
+
+#include <boost/filesystem/path.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/shared_ptr.hpp>
+
+namespace boost { namespace interprocess { class mapped_region; } }
+
+/** A blk*.dat file is not appended to once it has grown past this size. */
+static const unsigned int MAX_BLOCKFILE_SIZE = 0x7F000000 - MAX_SIZE;
+
+/** Default number of block files kept open for reading */
+static const unsigned int DEFAULT_BLOCKFILE_POOL = 16;
+
+boost::filesystem::path BlockFilePath(unsigned int nFile);
+
+/** Read access to the blk*.dat files.
+ *
+ * Keeps a bounded, least-recently-used pool of open files so repeated reads
+ * of blocks and transactions do not pay an fopen/fclose pair each. Files that
+ * are no longer appended to can also be mapped read-only, in which case
+ * objects are deserialized straight from the mapping through a CSpanStream.
+ */
+class CBlockFileReader
+{
+private:
+    class CBlockFile
+    {
+    public:
+        FILE* file;
+        boost::scoped_ptr<boost::interprocess::mapped_region> pregion;
+        const char* pbegin;
+        const char* pend;
+        CCriticalSection cs; // guards the position of file
+
+        CBlockFile();
+        ~CBlockFile();
+        bool IsMapped() const { return pbegin != NULL; }
+    };
+
+    typedef std::map<unsigned int, std::pair<boost::shared_ptr<CBlockFile>, uint64_t> > FileMap;
+
+    CCriticalSection cs;
+    FileMap mapOpen;
+    uint64_t nUseCounter;
+    unsigned int nMaxOpen;
+    bool fMapFiles;
+    unsigned int nAppendFile;
+
+    boost::shared_ptr<CBlockFile> Acquire(unsigned int nFile);
+
+public:
+    CBlockFileReader();
+    ~CBlockFileReader();
+
+    /** Set the pool size and whether finalized files may be mapped. Closes open files. */
+    void Configure(unsigned int nMaxOpenIn, bool fMapFilesIn);
+
+    /** Files below nFile will not be appended to any more and may be mapped. */
+    void SetAppendFile(unsigned int nFile);
+
+    /** Drop nFile from the pool, e.g. before it is rewritten. */
+    void Close(unsigned int nFile);
+    void CloseAll();
+
+    /** Deserialize obj from nFile at offset nPos. Returns false if the file
+     *  cannot be opened; deserialization errors are thrown. */
+    template<typename T>
+    bool Read(unsigned int nFile, unsigned int nPos, T& obj, int nType, int nVersion)
+    {
+        boost::shared_ptr<CBlockFile> pfile = Acquire(nFile);
+        if (!pfile)
+            return false;
+
+        if (pfile->IsMapped())
+        {
+            if (nPos > (size_t)(pfile->pend - pfile->pbegin))
+                return false;
+            CSpanStream stream(pfile->pbegin + nPos, pfile->pend, nType, nVersion);
+            stream >> obj;
+            return true;
+        }
+
+        LOCK(pfile->cs);
+        if (fseek(pfile->file, nPos, SEEK_SET) != 0)
+            return false;
+        CAutoFile filein(pfile->file, nType, nVersion);
+        try {
+            filein >> obj;
+        }
+        catch (...) {
+            filein.release();
+            throw;
+        }
+        filein.release();
+        return true;
+    }
+};
+
+extern CBlockFileReader blockFileReader;
+
+#endif // DARKSILK_BLOCKFILE_H
@@ -6,6 +6,8 @@
 #include <boost/algorithm/string/replace.hpp>
 
 #include "chain.h"
+#include "blockfile.h"
+#include "checkqueue.h"
 #include "wallet/wallet.h"
 #include "checkpoints.h"
 #include "anon/stormnode/spork.h"
@@ -15,26 +17,13 @@
 #ifdef ENABLE_WALLET
 
 extern std::map<COutPoint, uint256> mapLockedInputs;
-CBlockIndex* pblockindexFBBHLast;
 
 static unsigned int nCurrentBlockFile = 1;
 
 
 CBlockIndex* FindBlockByHeight(int nHeight)
 {
-    CBlockIndex *pblockindex;
-    if (nHeight < nBestHeight / 2)
-        pblockindex = pindexGenesisBlock;
-    else
-        pblockindex = pindexBest;
-    if (pblockindexFBBHLast && abs(nHeight - pblockindex->nHeight) > abs(nHeight - pblockindexFBBHLast->nHeight))
-        pblockindex = pblockindexFBBHLast;
-    while (pblockindex->nHeight > nHeight)
-        pblockindex = pblockindex->pprev;
-    while (pblockindex->nHeight < nHeight)
-        pblockindex = pblockindex->pnext;
-    pblockindexFBBHLast = pblockindex;
-    return pblockindex;
+    return chainActive[nHeight];
 }
 
 // darksilk: attempt to generate suitable proof-of-stake
@@ -53,8 +42,9 @@ bool CBlock::SignBlock(CWallet& wallet, CAmount nFees)
     static int64_t nLastCoinStakeSearchTime = GetAdjustedTime(); // startup timestamp
 
     CKey key;
-    CTransaction txCoinStake;
-    txCoinStake.nTime &= ~STAKE_TIMESTAMP_MASK;
+    CMutableTransaction txStakeTemplate;
+    txStakeTemplate.nTime &= ~STAKE_TIMESTAMP_MASK;
+    CTransaction txCoinStake(txStakeTemplate);
 
     int64_t nSearchTime = txCoinStake.nTime; // search to current time
 
@@ -67,7 +57,9 @@ bool CBlock::SignBlock(CWallet& wallet, CAmount nFees)
             {
                 // make sure coinstake would meet timestamp protocol
                 //    as it would be the same as the block timestamp
-                vtx[0].nTime = nTime = txCoinStake.nTime;
+                CMutableTransaction txCoinBase(vtx[0]);
+                txCoinBase.nTime = nTime = txCoinStake.nTime;
+                vtx[0] = txCoinBase;
 
                 // we have to make sure that we have no future timestamps in
                 //    our transactions set
@@ -102,7 +94,7 @@ bool CBlock::AcceptBlock()
         return error("AcceptBlock() : block already in mapBlockIndex");
 
     // Get prev block index
-    map<uint256, CBlockIndex*>::iterator mi = mapBlockIndex.find(hashPrevBlock);
+    BlockMap::iterator mi = mapBlockIndex.find(hashPrevBlock);
     if (mi == mapBlockIndex.end())
         return DoS(10, error("AcceptBlock() : prev block not found"));
     CBlockIndex* pindexPrev = (*mi).second;
@@ -188,8 +180,43 @@ bool CBlock::AcceptBlock()
     return true;
 }
 
+bool static BuildAddrIndex(const CScript &script, std::vector<uint160>& addrIds);
+
+// The address index entries ConnectBlock writes for tx: the addresses of
+// the transactions it spends from and of its own outputs
+bool static GetAddrIndexIds(CTxDB& txdb, CTransaction& tx, std::vector<uint160>& addrIds)
+{
+    if (!tx.IsCoinBase())
+    {
+        MapPrevTx mapInputs;
+        map<uint256, CTxIndex> mapQueuedChangesT;
+        bool fInvalid;
+        CTransactionPoS txPoS;
+        if (!txPoS.FetchInputs(tx, txdb, mapQueuedChangesT, true, false, mapInputs, fInvalid))
+            return false;
+        for (MapPrevTx::const_iterator mi = mapInputs.begin(); mi != mapInputs.end(); ++mi)
+            BOOST_FOREACH(const CTxOut& atxout, (*mi).second.second.vout)
+                BuildAddrIndex(atxout.scriptPubKey, addrIds);
+    }
+    BOOST_FOREACH(const CTxOut& atxout, tx.vout)
+        BuildAddrIndex(atxout.scriptPubKey, addrIds);
+    return true;
+}
+
 bool CBlock::DisconnectBlock(CTxDB& txdb, CBlockIndex* pindex)
 {
+    // Drop the address index entries of the block, or its transactions
+    // would be listed again at the height the next branch mines them
+    BOOST_FOREACH(CTransaction& tx, vtx)
+    {
+        uint256 hashTx = tx.GetHash();
+        std::vector<uint160> addrIds;
+        if (!GetAddrIndexIds(txdb, tx, addrIds))
+            LogPrintf("DisconnectBlock(): inputs of %s not found for the address index\n", hashTx.ToString());
+        BOOST_FOREACH(const uint160& addrId, addrIds)
+            txdb.EraseAddrIndex(addrId, pindex->nHeight, hashTx);
+    }
+
     // Disconnect in reverse order
     CTransactionPoS txPoS;
     for (int i = vtx.size()-1; i >= 0; i--)
@@ -247,7 +274,7 @@ bool static BuildAddrIndex(const CScript &script, std::vector<uint160>& addrIds)
     }
 }
 
-void CBlock::RebuildAddressIndex(CTxDB& txdb)
+void CBlock::RebuildAddressIndex(CTxDB& txdb, int nHeight)
 {
     BOOST_FOREACH(CTransaction& tx, vtx)
     {
@@ -272,7 +299,7 @@ void CBlock::RebuildAddressIndex(CTxDB& txdb)
                     {
                                     BOOST_FOREACH(uint160 addrId, addrIds)
                             {
-                            if(!txdb.WriteAddrIndex(addrId, hashTx))
+                            if(!txdb.WriteAddrIndex(addrId, nHeight, hashTx))
                             LogPrintf("RebuildAddressIndex(): txins WriteAddrIndex failed addrId: %s txhash: %s\n", addrId.ToString().c_str(), hashTx.ToString().c_str());
                                     }
                     }
@@ -286,7 +313,7 @@ void CBlock::RebuildAddressIndex(CTxDB& txdb)
             {
             BOOST_FOREACH(uint160 addrId, addrIds)
             {
-                if(!txdb.WriteAddrIndex(addrId, hashTx))
+                if(!txdb.WriteAddrIndex(addrId, nHeight, hashTx))
                     LogPrintf("RebuildAddressIndex(): txouts WriteAddrIndex failed addrId: %s txhash: %s\n", addrId.ToString().c_str(), hashTx.ToString().c_str());
                     }
             }
@@ -296,6 +323,15 @@ void CBlock::RebuildAddressIndex(CTxDB& txdb)
 
 static int64_t nTimeConnect = 0;
 
+int nScriptCheckThreads = 0;
+static CCheckQueue<CScriptCheck> scriptcheckqueue(128);
+
+void ThreadScriptCheck()
+{
+    RenameThread("darksilk-scriptch");
+    scriptcheckqueue.Thread();
+}
+
 bool CBlock::ConnectBlock(CTxDB& txdb, CBlockIndex* pindex, bool fJustCheck)
 {   
     CValidationState state;
@@ -328,6 +364,12 @@ bool CBlock::ConnectBlock(CTxDB& txdb, CBlockIndex* pindex, bool fJustCheck)
     int nTxCacheHits = 0;
     int nInputs = 0;
     int64_t nTimeStart = GetTimeMicros();
+
+    // Signatures are verified by the script check threads while the inputs
+    // of later transactions are fetched. Returning early waits for them.
+    CCheckQueueControl<CScriptCheck> control(nScriptCheckThreads ? &scriptcheckqueue : NULL);
+    std::vector<CScriptCheck> vChecks;
+
     BOOST_FOREACH(CTransaction& tx, vtx)
     {
         uint256 hashTx = tx.GetHash();
@@ -371,8 +413,10 @@ bool CBlock::ConnectBlock(CTxDB& txdb, CBlockIndex* pindex, bool fJustCheck)
 
         //if(setValidatedTx.find(hashTx) == setValidatedTx.end())
         //{
-                if (!txPoS.ConnectInputs(tx, txdb, mapInputs, mapQueuedChanges, posThisTx, pindex, true, false, flags))
+                vChecks.clear();
+                if (!txPoS.ConnectInputs(tx, txdb, mapInputs, mapQueuedChanges, posThisTx, pindex, true, false, flags, true, nScriptCheckThreads ? &vChecks : NULL))
                     return false;
+                control.Add(vChecks);
         //else
         //    setValidatedTx.insert(hashTx);
         //}
@@ -385,6 +429,9 @@ bool CBlock::ConnectBlock(CTxDB& txdb, CBlockIndex* pindex, bool fJustCheck)
         mapQueuedChanges[hashTx] = CTxIndex(posThisTx, tx.vout.size());
     }
 
+    if (!control.Wait())
+        return DoS(100, error("ConnectBlock() : script verification failed"));
+
     int64_t nTime1 = GetTimeMicros(); nTimeConnect += nTime1 - nTimeStart;
     if(fDebug)
     {
@@ -450,7 +497,7 @@ bool CBlock::ConnectBlock(CTxDB& txdb, CBlockIndex* pindex, bool fJustCheck)
                 {
                                 BOOST_FOREACH(uint160 addrId, addrIds)
                         {
-                        if(!txdb.WriteAddrIndex(addrId, hashTx))
+                        if(!txdb.WriteAddrIndex(addrId, pindex->nHeight, hashTx))
                         LogPrintf("ConnectBlock(): txins WriteAddrIndex failed addrId: %s txhash: %s\n", addrId.ToString().c_str(), hashTx.ToString().c_str());
                                 }
                 }
@@ -465,7 +512,7 @@ bool CBlock::ConnectBlock(CTxDB& txdb, CBlockIndex* pindex, bool fJustCheck)
             {
                 BOOST_FOREACH(uint160 addrId, addrIds)
                 {
-                    if(!txdb.WriteAddrIndex(addrId, hashTx))
+                    if(!txdb.WriteAddrIndex(addrId, pindex->nHeight, hashTx))
                         LogPrintf("ConnectBlock(): txouts WriteAddrIndex failed addrId: %s txhash: %s\n", addrId.ToString().c_str(), hashTx.ToString().c_str());
                 }
             }
@@ -516,18 +563,9 @@ bool Reorganize(CTxDB& txdb, CBlockIndex* pindexNew)
     LogPrintf("REORGANIZE\n");
 
     // Find the fork
-    CBlockIndex* pfork = pindexBest;
-    CBlockIndex* plonger = pindexNew;
-    while (pfork != plonger)
-    {
-        while (plonger->nHeight > pfork->nHeight)
-            if (!(plonger = plonger->pprev))
-                return error("Reorganize() : plonger->pprev is null");
-        if (pfork == plonger)
-            break;
-        if (!(pfork = pfork->pprev))
-            return error("Reorganize() : pfork->pprev is null");
-    }
+    CBlockIndex* pfork = const_cast<CBlockIndex*>(chainActive.FindFork(pindexNew));
+    if (!pfork)
+        return error("Reorganize() : no common ancestor with the active chain");
 
     // List of what to disconnect
     vector<CBlockIndex*> vDisconnect;
@@ -596,6 +634,7 @@ bool Reorganize(CTxDB& txdb, CBlockIndex* pindexNew)
     BOOST_FOREACH(CBlockIndex* pindex, vConnect)
         if (pindex->pprev)
             pindex->pprev->pnext = pindex;
+    chainActive.SetTip(pindexNew);
 
     // Resurrect memory transactions that were in the disconnected branch
     BOOST_FOREACH(CTransaction& tx, vResurrect)
@@ -623,6 +662,26 @@ uint256 CBlockIndex::GetBlockTrust() const
     return ((CBigNum(1)<<256) / (bnTarget+1)).getuint256();
 }
 
+CBlockIndex* CBlockIndexArena::Alloc(const CBlockIndex& index)
+{
+    if (nUsed == CHUNK_SIZE)
+    {
+        vChunks.push_back(new CBlockIndex[CHUNK_SIZE]);
+        nUsed = 0;
+    }
+    CBlockIndex* pindex = &vChunks.back()[nUsed++];
+    *pindex = index;
+    return pindex;
+}
+
+void CBlockIndexArena::clear()
+{
+    BOOST_FOREACH(CBlockIndex* pchunk, vChunks)
+        delete[] pchunk;
+    vChunks.clear();
+    nUsed = CHUNK_SIZE;
+}
+
 /// CChain implementation
 void CChain::SetTip(CBlockIndex *pindex) {
     if (pindex == NULL) {
@@ -636,6 +695,51 @@ void CChain::SetTip(CBlockIndex *pindex) {
     }
 }
 
+// Hashes of pindex and its ancestors at exponentially larger steps back.
+// Ancestors that are in chain are found by height, the rest by walking pprev.
+static void GetLocatorHashes(const CChain& chain, const CBlockIndex* pindex, std::vector<uint256>& vHave)
+{
+    int nStep = 1;
+    vHave.clear();
+    vHave.reserve(32);
+    while (pindex) {
+        vHave.push_back(pindex->GetBlockHash());
+        if (pindex->nHeight == 0)
+            break;
+        int nHeight = std::max(pindex->nHeight - nStep, 0);
+        if (chain.Contains(pindex)) {
+            pindex = chain[nHeight];
+        } else {
+            while (pindex->nHeight > nHeight && !chain.Contains(pindex))
+                pindex = pindex->pprev;
+            if (pindex->nHeight > nHeight)
+                pindex = chain[nHeight];
+        }
+        if (vHave.size() > 10)
+            nStep *= 2;
+    }
+    vHave.push_back(Params().HashGenesisBlock());
+}
+
+CBlockLocator CChain::GetLocator(const CBlockIndex *pindex) const {
+    std::vector<uint256> vHave;
+    GetLocatorHashes(*this, pindex ? pindex : Tip(), vHave);
+    return CBlockLocator(vHave);
+}
+
+const CBlockIndex *CChain::FindFork(const CBlockIndex *pindex) const {
+    // Only the part of pindex's branch that is off this chain is walked;
+    // membership of each block is an O(1) height lookup.
+    while (pindex && !Contains(pindex))
+        pindex = pindex->pprev;
+    return pindex;
+}
+
+void CBlockLocator::Set(const CBlockIndex* pindex)
+{
+    GetLocatorHashes(chainActive, pindex, vHave);
+}
+
 FILE* AppendBlockFile(unsigned int& nFileRet)
 {
     nFileRet = 0;
@@ -647,9 +751,10 @@ FILE* AppendBlockFile(unsigned int& nFileRet)
         if (fseek(file, 0, SEEK_END) != 0)
             return NULL;
         // FAT32 file size max 4GB, fseek and ftell max 2GB, so we must stay under 2GB
-        if (ftell(file) < (long)(0x7F000000 - MAX_SIZE))
+        if (ftell(file) < (long)MAX_BLOCKFILE_SIZE)
         {
             nFileRet = nCurrentBlockFile;
+            blockFileReader.SetAppendFile(nCurrentBlockFile);
             return file;
         }
         fclose(file);
@@ -807,8 +912,7 @@ bool CBlock::SetBestChainInner(CTxDB& txdb, CBlockIndex *pindexNew)
     pindexNew->pprev->pnext = pindexNew;
 
     // Delete redundant memory transactions
-    BOOST_FOREACH(CTransaction& tx, vtx)
-        mempool.remove(tx);
+    mempool.removeForBlock(vtx, pindexNew->nHeight);
 
     return true;
 }
@@ -857,16 +961,14 @@ bool CBlock::ReadFromDisk(unsigned int nFile, unsigned int nBlockPos, bool fRead
 {
     SetNull();
 
-    // Open history file to read
-    CAutoFile filein = CAutoFile(OpenBlockFile(nFile, nBlockPos, "rb"), SER_DISK, CLIENT_VERSION);
-    if (!filein)
-        return error("CBlock::ReadFromDisk() : OpenBlockFile failed");
+    int nType = SER_DISK;
     if (!fReadTransactions)
-        filein.nType |= SER_BLOCKHEADERONLY;
+        nType |= SER_BLOCKHEADERONLY;
 
     // Read block
     try {
-        filein >> *this;
+        if (!blockFileReader.Read(nFile, nBlockPos, *this, nType, CLIENT_VERSION))
+            return error("CBlock::ReadFromDisk() : cannot read block file %u", nFile);
     }
     catch (std::exception &e) {
         return error("%s() : deserialize or I/O error", __PRETTY_FUNCTION__);
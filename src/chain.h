@@ -6,6 +6,7 @@
 #define DARKSILK_CHAIN_H
 
 #include <boost/foreach.hpp>
+#include <boost/unordered_map.hpp>
 
 #include <vector>
 
@@ -15,11 +16,22 @@
 
 class CTxDB;
 
-extern std::map<uint256, CBlockIndex*> mapBlockIndex;
+/** Block hashes are already uniformly distributed, so any 64 bits of them
+ *  make a good bucket hash. */
+struct BlockHasher
+{
+    size_t operator()(const uint256& hash) const { return hash.GetLow64(); }
+};
+
+typedef boost::unordered_map<uint256, CBlockIndex*, BlockHasher> BlockMap;
+
+class CBlockIndexArena;
+
+extern BlockMap mapBlockIndex;
+extern CBlockIndexArena blockIndexArena;
 extern CBlockIndex* pindexBest;
 extern bool fUseFastIndex;
 extern CBlockIndex* pindexGenesisBlock;
-extern CBlockIndex* pblockindexFBBHLast;
 
 bool IsInitialBlockDownload();
 CBlockIndex* FindBlockByHeight(int nHeight);
@@ -439,7 +451,7 @@ public:
 
     explicit CBlockLocator(uint256 hashBlock)
     {
-        std::map<uint256, CBlockIndex*>::iterator mi = mapBlockIndex.find(hashBlock);
+        BlockMap::iterator mi = mapBlockIndex.find(hashBlock);
         if (mi != mapBlockIndex.end())
             Set((*mi).second);
     }
@@ -468,22 +480,8 @@ public:
         return vHave.empty();
     }
 
-    void Set(const CBlockIndex* pindex)
-    {
-        vHave.clear();
-        int nStep = 1;
-        while (pindex)
-        {
-            vHave.push_back(pindex->GetBlockHash());
-
-            // Exponentially larger steps back
-            for (int i = 0; pindex && i < nStep; i++)
-                pindex = pindex->pprev;
-            if (vHave.size() > 10)
-                nStep *= 2;
-        }
-        vHave.push_back(Params().HashGenesisBlock());
-    }
+    //! Reads chainActive: hold cs_main whenever blocks can be connected
+    void Set(const CBlockIndex* pindex);
 
     int GetDistanceBack()
     {
@@ -492,7 +490,7 @@ public:
         int nStep = 1;
         BOOST_FOREACH(const uint256& hash, vHave)
         {
-            std::map<uint256, CBlockIndex*>::iterator mi = mapBlockIndex.find(hash);
+            BlockMap::iterator mi = mapBlockIndex.find(hash);
             if (mi != mapBlockIndex.end())
             {
                 CBlockIndex* pindex = (*mi).second;
@@ -511,7 +509,7 @@ public:
         // Find the first block the caller has in the main chain
         BOOST_FOREACH(const uint256& hash, vHave)
         {
-            std::map<uint256, CBlockIndex*>::iterator mi = mapBlockIndex.find(hash);
+            BlockMap::iterator mi = mapBlockIndex.find(hash);
             if (mi != mapBlockIndex.end())
             {
                 CBlockIndex* pindex = (*mi).second;
@@ -527,7 +525,7 @@ public:
         // Find the first block the caller has in the main chain
         BOOST_FOREACH(const uint256& hash, vHave)
         {
-            std::map<uint256, CBlockIndex*>::iterator mi = mapBlockIndex.find(hash);
+            BlockMap::iterator mi = mapBlockIndex.find(hash);
             if (mi != mapBlockIndex.end())
             {
                 CBlockIndex* pindex = (*mi).second;
@@ -604,6 +602,38 @@ public:
     const CBlockIndex *FindFork(const CBlockIndex *pindex) const;
 };
 
+/** Owns the CBlockIndex entries of mapBlockIndex.
+ *
+ * Entries are handed out from large chunks rather than allocated one at a
+ * time, which keeps the index compact and makes loading it cheaper. Entries
+ * never move and are only freed all at once by clear().
+ */
+class CBlockIndexArena
+{
+private:
+    std::vector<CBlockIndex*> vChunks;
+    size_t nUsed; // entries handed out from the last chunk
+
+    CBlockIndexArena(const CBlockIndexArena&);
+    CBlockIndexArena& operator=(const CBlockIndexArena&);
+
+public:
+    static const size_t CHUNK_SIZE = 4096;
+
+    CBlockIndexArena() : nUsed(CHUNK_SIZE) {}
+    ~CBlockIndexArena() { clear(); }
+
+    /** A new entry initialized as a copy of index. */
+    CBlockIndex* Alloc(const CBlockIndex& index);
+    CBlockIndex* Alloc() { return Alloc(CBlockIndex()); }
+
+    size_t size() const { return vChunks.empty() ? 0 : (vChunks.size() - 1) * CHUNK_SIZE + nUsed; }
+    void clear();
+};
+
+/** The currently-connected chain of blocks, kept in step with pindexBest. */
+extern CChain chainActive;
+
 struct CBlockTemplate
 {
     CBlock block;
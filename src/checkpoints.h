@@ -7,10 +7,9 @@
 
 #include <map>
 
+#include "chain.h"
 #include "uint256.h"
 
-class CBlockIndex;
-
 /** Block-chain checkpoints are compiled-in sanity checks.
  * They are updated every release or three.
  */
@@ -23,7 +22,7 @@ namespace Checkpoints {
     int GetTotalBlocksEstimate();
 
     // Returns last CBlockIndex* in mapBlockIndex that is a checkpoint
-    CBlockIndex* GetLastCheckpoint(const std::map<uint256, CBlockIndex*>& mapBlockIndex);
+    CBlockIndex* GetLastCheckpoint(const BlockMap& mapBlockIndex);
 
     const CBlockIndex* AutoSelectSyncCheckpoint();
     bool CheckSync(int nHeight);
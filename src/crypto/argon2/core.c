@@ -244,76 +244,85 @@ static void *fill_segment_thr(void *thread_data)
 #endif
 {
     argon2_thread_data *my_data = (argon2_thread_data *)thread_data;
-    fill_segment(my_data->instance_ptr, my_data->pos);
+    argon2_position_t position = my_data->pos;
+    for (; position.lane < my_data->instance_ptr->lanes;
+         position.lane += my_data->lane_step) {
+        fill_segment(my_data->instance_ptr, position);
+    }
     argon2_thread_exit();
     return 0;
 }
 
-int fill_memory_blocks(argon2_instance_t *instance) {
-    uint32_t r, s;
-    argon2_thread_handle_t *thread = NULL;
-    argon2_thread_data *thr_data = NULL;
+/* Single-threaded version: no thread is started at all */
+static int fill_memory_blocks_st(argon2_instance_t *instance) {
+    uint32_t r, s, l;
 
-    if (instance == NULL || instance->lanes == 0) {
-        return ARGON2_THREAD_FAIL;
-    }
+    for (r = 0; r < instance->passes; ++r) {
+        for (s = 0; s < ARGON2_SYNC_POINTS; ++s) {
+            for (l = 0; l < instance->lanes; ++l) {
+                argon2_position_t position;
+                position.pass = r;
+                position.lane = l;
+                position.slice = (uint8_t)s;
+                position.index = 0;
+                fill_segment(instance, position);
+            }
+        }
 
-    /* 1. Allocating space for threads */
-    thread = calloc(instance->lanes, sizeof(argon2_thread_handle_t));
-    if (thread == NULL) {
-        return ARGON2_MEMORY_ALLOCATION_ERROR;
+#ifdef GENKAT
+        internal_kat(instance, r); /* Print all memory blocks */
+#endif
     }
+    return ARGON2_OK;
+}
 
-    thr_data = calloc(instance->lanes, sizeof(argon2_thread_data));
-    if (thr_data == NULL) {
-        free(thread);
-        return ARGON2_MEMORY_ALLOCATION_ERROR;
+/* Multi-threaded version: each slice is split over instance->threads
+ * threads, each filling every threads-th lane, so the number of threads
+ * started does not grow with the number of lanes */
+static int fill_memory_blocks_mt(argon2_instance_t *instance) {
+    uint32_t r, s, t;
+    uint32_t threads = instance->threads;
+    argon2_thread_handle_t *thread = NULL;
+    argon2_thread_data *thr_data = NULL;
+    int rc = ARGON2_OK;
+
+    /* 1. Allocating space for threads */
+    thread = calloc(threads, sizeof(argon2_thread_handle_t));
+    thr_data = calloc(threads, sizeof(argon2_thread_data));
+    if (thread == NULL || thr_data == NULL) {
+        rc = ARGON2_MEMORY_ALLOCATION_ERROR;
+        goto fail;
     }
 
     for (r = 0; r < instance->passes; ++r) {
         for (s = 0; s < ARGON2_SYNC_POINTS; ++s) {
-            int rc;
-            uint32_t l;
+            uint32_t started = 0;
 
             /* 2. Calling threads */
-            for (l = 0; l < instance->lanes; ++l) {
-                argon2_position_t position;
-
-                /* 2.1 Join a thread if limit is exceeded */
-                if (l >= instance->threads) {
-                    rc = argon2_thread_join(thread[l - instance->threads]);
-                    if (rc) {
-                        return ARGON2_THREAD_FAIL;
-                    }
-                }
-
-                /* 2.2 Create thread */
-                position.pass = r;
-                position.lane = l;
-                position.slice = (uint8_t)s;
-                position.index = 0;
-                thr_data[l].instance_ptr =
-                    instance; /* preparing the thread input */
-                memcpy(&(thr_data[l].pos), &position,
-                       sizeof(argon2_position_t));
-                rc = argon2_thread_create(&thread[l], &fill_segment_thr,
-                                          (void *)&thr_data[l]);
-                if (rc) {
-                    return ARGON2_THREAD_FAIL;
+            for (t = 0; t < threads; ++t) {
+                thr_data[t].instance_ptr = instance;
+                thr_data[t].pos.pass = r;
+                thr_data[t].pos.lane = t;
+                thr_data[t].pos.slice = (uint8_t)s;
+                thr_data[t].pos.index = 0;
+                thr_data[t].lane_step = threads;
+                if (argon2_thread_create(&thread[t], &fill_segment_thr,
+                                         (void *)&thr_data[t])) {
+                    rc = ARGON2_THREAD_FAIL;
+                    break;
                 }
-
-                /* fill_segment(instance, position); */
-                /*Non-thread equivalent of the lines above */
+                ++started;
             }
 
-            /* 3. Joining remaining threads */
-            for (l = instance->lanes - instance->threads; l < instance->lanes;
-                 ++l) {
-                rc = argon2_thread_join(thread[l]);
-                if (rc) {
-                    return ARGON2_THREAD_FAIL;
+            /* 3. Joining the threads before the next slice */
+            for (t = 0; t < started; ++t) {
+                if (argon2_thread_join(thread[t])) {
+                    rc = ARGON2_THREAD_FAIL;
                 }
             }
+            if (rc != ARGON2_OK) {
+                goto fail;
+            }
         }
 
 #ifdef GENKAT
@@ -321,13 +330,23 @@ int fill_memory_blocks(argon2_instance_t *instance) {
 #endif
     }
 
-    if (thread != NULL) {
-        free(thread);
+fail:
+    free(thread);
+    free(thr_data);
+    return rc;
+}
+
+int fill_memory_blocks(argon2_instance_t *instance) {
+    if (instance == NULL || instance->lanes == 0) {
+        return ARGON2_THREAD_FAIL;
     }
-    if (thr_data != NULL) {
-        free(thr_data);
+
+    if (instance->threads > instance->lanes) {
+        instance->threads = instance->lanes;
     }
-    return ARGON2_OK;
+
+    return instance->threads <= 1 ? fill_memory_blocks_st(instance)
+                                  : fill_memory_blocks_mt(instance);
 }
 
 int validate_inputs(const argon2_context *context) {
@@ -572,7 +591,7 @@ int initialize(argon2_instance_t *instance, argon2_context *context) {
         if (ARGON2_OK != result) {
             return result;
         }
-        memcpy(&(instance->memory), p, sizeof(instance->memory));
+        memcpy(&(instance->memory), &p, sizeof(instance->memory));
     } else {
         result = allocate_memory(&(instance->memory), instance->memory_blocks);
         if (ARGON2_OK != result) {
@@ -98,10 +98,12 @@ typedef struct Argon2_position_t {
     uint32_t index;
 } argon2_position_t;
 
-/*Struct that holds the inputs for thread handling FillSegment*/
+/*Struct that holds the inputs for thread handling FillSegment: the thread
+ * fills lanes pos.lane, pos.lane + lane_step, ... of slice pos.slice*/
 typedef struct Argon2_thread_data {
     argon2_instance_t *instance_ptr;
     argon2_position_t pos;
+    uint32_t lane_step;
 } argon2_thread_data;
 
 /*************************Argon2 core
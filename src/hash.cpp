@@ -6,6 +6,41 @@
 
 #include "hash.h"
 
+#include <boost/thread/tss.hpp>
+
+unsigned int nArgon2Threads = 1;
+
+static boost::thread_specific_ptr<std::vector<uint8_t> > argon2Arena;
+
+int Argon2ArenaAllocate(uint8_t **memory, size_t bytes_to_allocate)
+{
+    std::vector<uint8_t>* parena = argon2Arena.get();
+    if (parena == NULL)
+    {
+        parena = new std::vector<uint8_t>();
+        argon2Arena.reset(parena);
+    }
+
+    // Every block is written before it is read, so a reused matrix needs no
+    // clearing; only a grown one is zero-filled.
+    if (parena->size() < bytes_to_allocate)
+    {
+        try {
+            parena->resize(bytes_to_allocate);
+        } catch (const std::bad_alloc&) {
+            return ARGON2_MEMORY_ALLOCATION_ERROR;
+        }
+    }
+
+    *memory = &(*parena)[0];
+    return ARGON2_OK;
+}
+
+void Argon2ArenaFree(uint8_t *memory, size_t bytes_to_allocate)
+{
+    // Kept for the next hash on this thread, freed when the thread exits
+}
+
 int HMAC_SHA512_Init(HMAC_SHA512_CTX *pctx, const void *pkey, size_t len)
 {
     unsigned char key[128];
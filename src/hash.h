@@ -97,6 +97,14 @@ inline uint256 HashBlake2b(const T1 pbegin, const T1 pend)
     return hash1;
 }
 
+/** Threads filling the Argon2d lanes of one hash (-argonthreads) */
+extern unsigned int nArgon2Threads;
+
+/** Argon2 allocator handing out one zero-filled matrix per thread, kept
+ *  and reused by every later hash on that thread */
+int Argon2ArenaAllocate(uint8_t **memory, size_t bytes_to_allocate);
+void Argon2ArenaFree(uint8_t *memory, size_t bytes_to_allocate);
+
 /// Argon2d Parameters
 /// Salt and password are the block header.
 /// Output length: 32 bytes.
@@ -140,9 +148,9 @@ inline int Argon2d_Hash(void *out, size_t outlen, const void *in, size_t inlen,
     context.t_cost = t_cost;
     context.m_cost = m_cost;
     context.lanes = 64;
-    context.threads = 1;
-    context.allocate_cbk = NULL;
-    context.free_cbk = NULL;
+    context.threads = nArgon2Threads;
+    context.allocate_cbk = Argon2ArenaAllocate;
+    context.free_cbk = Argon2ArenaFree;
     context.flags = ARGON2_DEFAULT_FLAGS;
 
     return argon2_core(&context, Argon2_d);
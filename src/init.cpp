@@ -14,6 +14,7 @@
 #include <openssl/crypto.h>
 
 #include "init.h"
+#include "blockfile.h"
 #include "main.h"
 #include "chainparams.h"
 #include "txdb.h"
@@ -25,6 +26,7 @@
 #include "ui_interface.h"
 #include "anon/stormnode/activestormnode.h"
 #include "sanity.h"
+#include "script/sigcache.h"
 #include "anon/stormnode/stormnode-budget.h"
 #include "anon/stormnode/stormnode-payments.h"
 #include "anon/stormnode/stormnodeman.h"
@@ -175,6 +177,7 @@ void Shutdown()
         pcoinsdbview = NULL;
         delete pblocktree;
         pblocktree = NULL;
+        blockFileReader.CloseAll();
     }
     {
         LOCK(cs_main);
@@ -194,6 +197,7 @@ void Shutdown()
     pwalletMain = NULL;
 #endif
     LogPrintf("Shutdown : done\n");
+    StopDebugLogWriter();
 }
 
 //
@@ -209,6 +213,18 @@ void HandleSIGHUP(int)
     fReopenDebugLog = true;
 }
 
+#ifndef WIN32
+void HandleCrashSignal(int sig)
+{
+    // Write out the lines still queued for debug.log and mark where the
+    // process died, then die the way we would have.
+    static const char pszCrash[] = "\n*** Fatal signal\n";
+    FlushDebugLogFromSignal();
+    WriteDebugLogRaw(pszCrash, sizeof(pszCrash) - 1);
+    raise(sig);
+}
+#endif
+
 bool static InitError(const std::string &str)
 {
     uiInterface.ThreadSafeMessageBox(str, "", CClientUIInterface::MSG_ERROR | CClientUIInterface::NOSHOWGUI);
@@ -253,12 +269,17 @@ std::string HelpMessage()
     strUsage += "  -wallet=<dir>          " + _("Specify wallet file (within data directory)") + "\n";
     strUsage += "  -dbcache=<n>           " + _("Set database cache size in megabytes (default: 25)") + "\n";
     strUsage += "  -dblogsize=<n>         " + _("Set database disk log size in megabytes (default: 100)") + "\n";
+    strUsage += "  -blockfilepool=<n>     " + strprintf(_("Number of block files kept open for reading (default: %u)"), DEFAULT_BLOCKFILE_POOL) + "\n";
+    strUsage += "  -mmapblockfiles        " + _("Map finished block files into memory for reading (default: 1 on 64-bit systems)") + "\n";
+    strUsage += "  -par=<n>               " + strprintf(_("Set the number of script verification threads (%u to %d, 0 = auto, <0 = leave that many cores free, default: %d)"), -(int)boost::thread::hardware_concurrency(), MAX_SCRIPTCHECK_THREADS, DEFAULT_SCRIPTCHECK_THREADS) + "\n";
+    strUsage += "  -argonthreads=<n>      " + _("Number of threads filling the Argon2d lanes of each block header hash, 0 for one per core (default: 1)") + "\n";
     strUsage += "  -timeout=<n>           " + _("Specify connection timeout in milliseconds (default: 5000)") + "\n";
     strUsage += "  -proxy=<ip:port>       " + _("Connect through SOCKS5 proxy") + "\n";
     strUsage += "  -tor=<ip:port>         " + _("Use proxy to reach tor hidden services (default: same as -proxy)") + "\n";
     strUsage += "  -dns                   " + _("Allow DNS lookups for -addnode, -seednode and -connect") + "\n";
     strUsage += "  -port=<port>           " + _("Listen for connections on <port> (default: 31500 or testnet: 31800)") + "\n";
     strUsage += "  -maxconnections=<n>    " + _("Maintain at most <n> connections to peers (default: 200)") + "\n";
+    strUsage += "  -msgthreads=<n>        " + strprintf(_("Number of threads processing secure messages of different peers at once, 0 to leave them to the main message handler (default: %d)"), DEFAULT_MESSAGE_WORKERS) + "\n";
     strUsage += "  -addnode=<ip>          " + _("Add a node to connect to and attempt to keep the connection open") + "\n";
     strUsage += "  -connect=<ip>          " + _("Connect only to the specified node(s)") + "\n";
     strUsage += "  -seednode=<ip>         " + _("Connect to a node to retrieve peer addresses, and disconnect") + "\n";
@@ -296,7 +317,9 @@ std::string HelpMessage()
     strUsage +=                                 " coinage, coinstake, creation, stakemodifier";
     strUsage += ", qt";
     strUsage += ".\n";
-    strUsage += "  -logtimestamps         " + _("Prepend debug output with timestamp (defaultg: 1)") + "\n";    strUsage += "  -shrinkdebugfile       " + _("Shrink debug.log file on client startup (default: 1 when no -debug)") + "\n";
+    strUsage += "  -logtimestamps         " + _("Prepend debug output with timestamp (defaultg: 1)") + "\n";
+    strUsage += "  -logratelimit=<n>      " + _("Log at most <n> lines per second for each debug category, or for one category with <category>:<n> (default: 0, no limit)") + "\n";
+    strUsage += "  -shrinkdebugfile       " + _("Shrink debug.log file on client startup (default: 1 when no -debug)") + "\n";
     strUsage += "  -printtodebuglog       " + strprintf(_("Send trace/debug info to debug.log file (default: %u)"), 1) + "\n";
     strUsage += "  -printtoconsole        " + _("Send trace/debug info to console instead of debug.log file") + "\n";
     strUsage += "  -rpcuser=<user>        " + _("Username for JSON-RPC connections") + "\n";
@@ -318,6 +341,12 @@ std::string HelpMessage()
     strUsage += "  -checklevel=<n>        " + _("How thorough the block verification is (0-6, default: 1)") + "\n";
     strUsage += "  -loadblock=<file>      " + _("Imports blocks from external blk000?.dat file") + "\n";
     strUsage += "  -maxorphanblocksMiB=<n>   " + strprintf(_("Keep at most <n> MiB of unconnectable blocks in memory (default: %u)"), DEFAULT_MAX_ORPHAN_BLOCKS) + "\n";
+    strUsage += "  -maxmempool=<n>        " + strprintf(_("Keep the transaction memory pool below <n> megabytes (default: %u)"), DEFAULT_MAX_MEMPOOL_SIZE) + "\n";
+    strUsage += "  -limitancestorcount=<n>   " + strprintf(_("Do not accept transactions with more than <n> unconfirmed ancestors, themselves included (default: %u)"), DEFAULT_ANCESTOR_LIMIT) + "\n";
+    strUsage += "  -limitancestorsize=<n>    " + strprintf(_("Do not accept transactions whose unconfirmed ancestors, themselves included, exceed <n> kilobytes (default: %u)"), DEFAULT_ANCESTOR_SIZE_LIMIT) + "\n";
+    strUsage += "  -limitdescendantcount=<n> " + strprintf(_("Do not accept transactions that give an unconfirmed ancestor more than <n> descendants, itself included (default: %u)"), DEFAULT_DESCENDANT_LIMIT) + "\n";
+    strUsage += "  -limitdescendantsize=<n>  " + strprintf(_("Do not accept transactions that take an unconfirmed ancestor's descendants past <n> kilobytes (default: %u)"), DEFAULT_DESCENDANT_SIZE_LIMIT) + "\n";
+    strUsage += "  -maxsigcachesize=<n>   " + strprintf(_("Limit the signature cache to <n> megabytes (default: %u)"), DEFAULT_MAX_SIG_CACHE_SIZE) + "\n";
 
     strUsage += "\n" + _("Block creation options:") + "\n";
     strUsage += "  -blockminsize=<n>      "   + _("Set minimum block size in bytes (default: 0)") + "\n";
@@ -434,6 +463,17 @@ bool AppInit2(boost::thread_group& threadGroup)
     sa_hup.sa_flags = 0;
     sigaction(SIGHUP, &sa_hup, NULL);
 
+    // Mark crashes in debug.log
+    struct sigaction sa_crash;
+    sa_crash.sa_handler = HandleCrashSignal;
+    sigemptyset(&sa_crash.sa_mask);
+    sa_crash.sa_flags = SA_RESETHAND | SA_NODEFER;
+    sigaction(SIGSEGV, &sa_crash, NULL);
+    sigaction(SIGBUS, &sa_crash, NULL);
+    sigaction(SIGFPE, &sa_crash, NULL);
+    sigaction(SIGILL, &sa_crash, NULL);
+    sigaction(SIGABRT, &sa_crash, NULL);
+
 #if defined (__SVR4) && defined (__sun)
     // ignore SIGPIPE on Solaris
     signal(SIGPIPE, SIG_IGN);
@@ -555,6 +595,9 @@ bool AppInit2(boost::thread_group& threadGroup)
     fPrintToConsole = GetBoolArg("-printtoconsole", false);
     fPrintToDebugLog = GetBoolArg("-printtodebuglog", true) && !fPrintToConsole;
     fLogTimestamps = GetBoolArg("-logtimestamps", true);
+    std::string strBadRate;
+    if (!InitLogRateLimits(strBadRate))
+        return InitError(strprintf(_("Invalid -logratelimit value: '%s'"), strBadRate));
 #ifdef ENABLE_WALLET
     bool fDisableWallet = GetBoolArg("-disablewallet", false);
 #endif
@@ -578,6 +621,20 @@ bool AppInit2(boost::thread_group& threadGroup)
         nTransactionFee = MIN_TX_FEE;
 #endif
 
+    // -par=0 means autodetect, but nScriptCheckThreads==0 means no concurrency
+    nScriptCheckThreads = GetArg("-par", DEFAULT_SCRIPTCHECK_THREADS);
+    if (nScriptCheckThreads <= 0)
+        nScriptCheckThreads += boost::thread::hardware_concurrency();
+    if (nScriptCheckThreads <= 1)
+        nScriptCheckThreads = 0;
+    else if (nScriptCheckThreads > MAX_SCRIPTCHECK_THREADS)
+        nScriptCheckThreads = MAX_SCRIPTCHECK_THREADS;
+
+    int nArgonThreads = GetArg("-argonthreads", 1);
+    if (nArgonThreads <= 0)
+        nArgonThreads = boost::thread::hardware_concurrency();
+    nArgon2Threads = std::max(1, std::min(nArgonThreads, 64));
+
     fConfChange = GetBoolArg("-confchange", false);
     fMinimizeCoinAge = GetBoolArg("-minimizecoinage", false);
 
@@ -617,6 +674,7 @@ bool AppInit2(boost::thread_group& threadGroup)
 
     if (GetBoolArg("-shrinkdebugfile", !fDebug))
         ShrinkDebugFile();
+    StartDebugLogWriter();
     LogPrintf("\n\n\n"); //A bit excessive???
     LogPrintf("DarkSilk version %s (%s)\n", FormatFullVersion(), CLIENT_DATE);
     LogPrintf("Using OpenSSL version %s\n", SSLeay_version(SSLEAY_VERSION));
@@ -624,6 +682,13 @@ bool AppInit2(boost::thread_group& threadGroup)
         LogPrintf("Startup time: %s\n", DateTimeStrFormat("%x %H:%M:%S", GetTime()));
     LogPrintf("Default data directory %s\n", GetDefaultDataDir().string());
     LogPrintf("Used data directory %s\n", strDataDir);
+
+    if (nScriptCheckThreads) {
+        LogPrintf("Using %u threads for script verification\n", nScriptCheckThreads);
+        for (int i=0; i<nScriptCheckThreads-1; i++)
+            threadGroup.create_thread(&ThreadScriptCheck);
+    }
+    GetSignatureCache();
     std::ostringstream strErrors;
 
     if (mapArgs.count("-sporkkey")) // spork priv key
@@ -644,6 +709,14 @@ bool AppInit2(boost::thread_group& threadGroup)
         mempool.ReadFeeEstimates(est_filein);
     fFeeEstimatesInitialized = true;
 
+    // Start the RPC server already, in warmup mode: until loading is done
+    // it only answers getrescaninfo, so a long -rescan can be followed
+    if (fServer)
+    {
+        uiInterface.InitMessage.connect(SetRPCWarmupStatus);
+        StartRPCThreads();
+    }
+
     // ********************************************************* Step 5: verify database integrity
 #ifdef ENABLE_WALLET
     if (!fDisableWallet) {
@@ -811,6 +884,8 @@ bool AppInit2(boost::thread_group& threadGroup)
 
     uiInterface.InitMessage(_("Loading block index..."));
 
+    blockFileReader.Configure(GetArg("-blockfilepool", DEFAULT_BLOCKFILE_POOL), GetBoolArg("-mmapblockfiles", sizeof(void*) >= 8));
+
     // cache size calculations
     size_t nTotalCache = (GetArg("-dbcache", nDefaultDbCache) << 20);
     if (nTotalCache < (nMinDbCache << 20))
@@ -929,7 +1004,7 @@ bool AppInit2(boost::thread_group& threadGroup)
     {
         string strMatch = mapArgs["-printblock"];
         int nFound = 0;
-        for (map<uint256, CBlockIndex*>::iterator mi = mapBlockIndex.begin(); mi != mapBlockIndex.end(); ++mi)
+        for (BlockMap::iterator mi = mapBlockIndex.begin(); mi != mapBlockIndex.end(); ++mi)
         {
             uint256 hash = (*mi).first;
             if (strncmp(hash.ToString().c_str(), strMatch.c_str(), strMatch.size()) == 0)
@@ -1018,18 +1093,25 @@ bool AppInit2(boost::thread_group& threadGroup)
         RegisterWallet(pwalletMain);
 
         CBlockIndex *pindexRescan = pindexBest;
+        bool fResumeRescan = false;
         if (GetBoolArg("-rescan", false))
             pindexRescan = pindexGenesisBlock;
         else
         {
             CWalletDB walletdb(strWalletFileName);
             CBlockLocator locator;
-            if (walletdb.ReadBestBlock(locator))
+            // A rescan cut short by a shutdown carries on where it got to
+            if (walletdb.ReadRescanPos(locator))
+            {
+                pindexRescan = locator.GetBlockIndex();
+                fResumeRescan = true;
+            }
+            else if (walletdb.ReadBestBlock(locator))
                 pindexRescan = locator.GetBlockIndex();
             else
                 pindexRescan = pindexGenesisBlock;
         }
-        if (pindexBest && pindexBest != pindexRescan)
+        if (pindexBest && (pindexBest != pindexRescan || fResumeRescan))
         {
             uiInterface.InitMessage(_("Rescanning..."));
             LogPrintf("Rescanning last %i blocks (from block %i)...\n", nBestHeight - pindexRescan->nHeight, pindexRescan->nHeight);
@@ -1227,6 +1309,14 @@ bool AppInit2(boost::thread_group& threadGroup)
 
     RandAddSeedPerfmon();
 
+    // convert an address index written in the old one-vector-per-address layout
+    {
+        uiInterface.InitMessage(_("Upgrading address index..."));
+        CTxDB txdbAddr("r+");
+        if (!txdbAddr.MigrateAddrIndex())
+            return InitError(_("Error upgrading address index"));
+    }
+
     // reindex addresses found in blockchain
     if(GetBoolArg("-reindexaddr", false))
     {
@@ -1239,7 +1329,7 @@ bool AppInit2(boost::thread_group& threadGroup)
             bool ReadFromDisk(const CBlockIndex* pindex, bool fReadTransactions=true);
             CBlock pblockAddr;
             if(pblockAddr.ReadFromDisk(pblockAddrIndex, true))
-                pblockAddr.RebuildAddressIndex(txdbAddr);
+                pblockAddr.RebuildAddressIndex(txdbAddr, pblockAddrIndex->nHeight);
             pblockAddrIndex = pblockAddrIndex->pprev;
         }
     }
@@ -1259,8 +1349,6 @@ bool AppInit2(boost::thread_group& threadGroup)
     // InitRPCMining is needed here so getwork/getblocktemplate in the GUI debug console works properly.
     InitRPCMining();
 #endif
-    if (fServer)
-        StartRPCThreads();
 
 #ifdef ENABLE_WALLET
     // Mine proof-of-stake blocks in the background
@@ -1272,6 +1360,7 @@ bool AppInit2(boost::thread_group& threadGroup)
 
     // ********************************************************* Step 12: finished
 
+    SetRPCWarmupFinished();
     uiInterface.InitMessage(_("Done loading"));
 
 #ifdef ENABLE_WALLET
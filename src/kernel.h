@@ -6,6 +6,8 @@
 
 #include "chain.h"
 
+class CTxDB;
+
 // To decrease granularity of timestamp
 // Supposed to be 2^n-1
 static const int STAKE_TIMESTAMP_MASK = 15;
@@ -24,6 +26,7 @@ uint256 ComputeStakeModifierV2(const CBlockIndex* pindexPrev, const uint256& ker
 // Check whether stake kernel meets hash target
 // Sets hashProofOfStake on success return
 bool CheckStakeKernelHash(CBlockIndex* pindexPrev, unsigned int nBits, unsigned int nTimeBlockFrom, const CTransaction& txPrev, const COutPoint& prevout, unsigned int nTimeTx, uint256& hashProofOfStake, uint256& targetProofOfStake, bool fPrintProofOfStake=false);
+bool CheckStakeKernelHash(CBlockIndex* pindexPrev, unsigned int nBits, unsigned int nTimeBlockFrom, unsigned int nTimeTxPrev, CAmount nValueIn, const COutPoint& prevout, unsigned int nTimeTx, uint256& hashProofOfStake, uint256& targetProofOfStake, bool fPrintProofOfStake=false);
 
 // Check kernel hash target and coinstake signature
 // Sets hashProofOfStake on success return
@@ -40,4 +43,25 @@ int64_t GetWeight(int64_t nIntervalBeginning, int64_t nIntervalEnd);
 // Convenient for searching a kernel
 bool CheckKernel(CBlockIndex* pindexPrev, unsigned int nBits, int64_t nTime, const COutPoint& prevout, int64_t* pBlockTime = NULL);
 
+// Everything CheckKernel() reads from disk for a staking candidate. It stays
+// valid as long as the block containing the candidate is in the main chain.
+struct CStakeCache
+{
+    CStakeCache() : nBlockTime(0), nTxTime(0), nValue(0), nHeight(0) {}
+    CStakeCache(unsigned int nBlockTimeIn, unsigned int nTxTimeIn, CAmount nValueIn, int nHeightIn)
+        : nBlockTime(nBlockTimeIn), nTxTime(nTxTimeIn), nValue(nValueIn), nHeight(nHeightIn) {}
+
+    unsigned int nBlockTime;
+    unsigned int nTxTime;
+    CAmount nValue;
+    int nHeight;
+};
+
+// Read the kernel inputs of prevout from disk
+bool CacheKernel(CTxDB& txdb, const COutPoint& prevout, CStakeCache& stakeCache);
+
+// Same as CheckKernel() but takes the kernel inputs from a cache entry,
+// so it does not touch the disk
+bool CheckKernel(CBlockIndex* pindexPrev, unsigned int nBits, int64_t nTime, const COutPoint& prevout, const CStakeCache& stakeCache);
+
 #endif // PPCOIN_KERNEL_H
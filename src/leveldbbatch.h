@@ -0,0 +1,83 @@
+// Copyright (c) 2015-2016 Silk Network
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef DARKSILK_LEVELDBBATCH_H
+#define DARKSILK_LEVELDBBATCH_H
+
+#include <leveldb/db.h>
+#include <leveldb/write_batch.h>
+
+#include <boost/unordered_map.hpp>
+
+#include <string>
+
+/** Pending writes and deletes of an open LevelDB transaction, indexed by key.
+ *
+ * Code that opens a transaction expects its own reads to see the changes it
+ * has queued. Replaying a leveldb::WriteBatch to find one key is linear in the
+ * size of the batch, which makes connecting a large block quadratic. This
+ * class keeps only the last operation per key in a hash map, so lookups are
+ * O(1), and builds the WriteBatch once when the transaction is committed.
+ */
+class CLevelDBIndexedBatch
+{
+private:
+    struct PendingOp
+    {
+        bool fErase;
+        std::string strValue;
+    };
+
+    typedef boost::unordered_map<std::string, PendingOp> PendingMap;
+    PendingMap mapPending;
+
+public:
+    void Put(const std::string& strKey, const std::string& strValue)
+    {
+        PendingOp& op = mapPending[strKey];
+        op.fErase = false;
+        op.strValue = strValue;
+    }
+
+    void Delete(const std::string& strKey)
+    {
+        PendingOp& op = mapPending[strKey];
+        op.fErase = true;
+        op.strValue.clear();
+    }
+
+    /** Returns true if the batch has a pending operation for strKey. For a
+     *  write, sets *pfDeleted = false and copies the value to *pstrValue;
+     *  for a delete, sets *pfDeleted = true and leaves *pstrValue alone. */
+    bool Lookup(const std::string& strKey, std::string* pstrValue, bool* pfDeleted) const
+    {
+        PendingMap::const_iterator it = mapPending.find(strKey);
+        if (it == mapPending.end())
+            return false;
+        *pfDeleted = it->second.fErase;
+        if (!it->second.fErase)
+            *pstrValue = it->second.strValue;
+        return true;
+    }
+
+    size_t size() const { return mapPending.size(); }
+    bool empty() const { return mapPending.empty(); }
+    void clear() { mapPending.clear(); }
+
+    /** Apply all pending operations to pdb atomically. */
+    leveldb::Status Commit(leveldb::DB* pdb, const leveldb::WriteOptions& options) const
+    {
+        leveldb::WriteBatch batch;
+        for (PendingMap::const_iterator it = mapPending.begin(); it != mapPending.end(); ++it)
+        {
+            if (it->second.fErase)
+                batch.Delete(it->first);
+            else
+                batch.Put(it->first, it->second.strValue);
+        }
+        return pdb->Write(options, &batch);
+    }
+};
+
+#endif // DARKSILK_LEVELDBBATCH_H
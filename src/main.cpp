@@ -13,6 +13,7 @@
 #include "main.h"
 #include "addrman.h"
 #include "alert.h"
+#include "blockfile.h"
 #include "chainparams.h"
 #include "checkpoints.h"
 #include "wallet/db.h"
@@ -57,7 +58,8 @@ struct COrphanTx {
     NodeId fromPeer;
 };
 
-map<uint256, CBlockIndex*> mapBlockIndex;
+BlockMap mapBlockIndex;
+CBlockIndexArena blockIndexArena;
 set<pair<COutPoint, unsigned int> > setStakeSeen;
 
 //TODO(AA)
@@ -75,6 +77,7 @@ uint256 nBestInvalidTrust = 0;
 uint256 hashBestChain = 0;
 
 CBlockIndex* pindexBest = NULL;
+CChain chainActive;
 
 int64_t nTimeBestReceived = 0;
 CConditionVariable cvBlockChange;
@@ -228,9 +231,11 @@ void RegisterWallet(CWalletInterface* pwalletIn) {
     g_signals.SetBestChain.connect(boost::bind(&CWalletInterface::SetBestChain, pwalletIn, _1));
     g_signals.Inventory.connect(boost::bind(&CWalletInterface::Inventory, pwalletIn, _1));
     g_signals.Broadcast.connect(boost::bind(&CWalletInterface::ResendWalletTransactions, pwalletIn, _1));
+    mempool.NotifyEntryRemoved.connect(boost::bind(&CWalletInterface::RemovedFromMempool, pwalletIn, _1));
 }
 
 void UnregisterWallet(CWalletInterface* pwalletIn) {
+    mempool.NotifyEntryRemoved.disconnect(boost::bind(&CWalletInterface::RemovedFromMempool, pwalletIn, _1));
     g_signals.Broadcast.disconnect(boost::bind(&CWalletInterface::ResendWalletTransactions, pwalletIn, _1));
     g_signals.Inventory.disconnect(boost::bind(&CWalletInterface::Inventory, pwalletIn, _1));
     g_signals.SetBestChain.disconnect(boost::bind(&CWalletInterface::SetBestChain, pwalletIn, _1));
@@ -240,6 +245,7 @@ void UnregisterWallet(CWalletInterface* pwalletIn) {
 }
 
 void UnregisterAllWallets() {
+    mempool.NotifyEntryRemoved.disconnect_all_slots();
     g_signals.Broadcast.disconnect_all_slots();
     g_signals.Inventory.disconnect_all_slots();
     g_signals.SetBestChain.disconnect_all_slots();
@@ -464,6 +470,7 @@ void RegisterNodeSignals(CNodeSignals& nodeSignals)
 {
     //nodeSignals.GetHeight.connect(&GetHeight); //TODO (AA): implement GetHeight
     nodeSignals.ProcessMessages.connect(&ProcessMessages);
+    nodeSignals.CanProcessConcurrently.connect(&CanProcessConcurrently);
     nodeSignals.SendMessages.connect(&SendMessages);
     nodeSignals.InitializeNode.connect(&InitializeNode);
     nodeSignals.FinalizeNode.connect(&FinalizeNode);
@@ -473,6 +480,7 @@ void UnregisterNodeSignals(CNodeSignals& nodeSignals)
 {
     //nodeSignals.GetHeight.disconnect(&GetHeight); //TODO (AA): implement GetHeight
     nodeSignals.ProcessMessages.disconnect(&ProcessMessages);
+    nodeSignals.CanProcessConcurrently.disconnect(&CanProcessConcurrently);
     nodeSignals.SendMessages.disconnect(&SendMessages);
     nodeSignals.InitializeNode.disconnect(&InitializeNode);
     nodeSignals.FinalizeNode.disconnect(&FinalizeNode);
@@ -821,7 +829,7 @@ int CMerkleTx::SetMerkleBranch(const CBlock* pblock)
     vMerkleBranch = pblock->GetMerkleBranch(nIndex);
 
     // Is the tx in a block that's in the main chain
-    map<uint256, CBlockIndex*>::iterator mi = mapBlockIndex.find(hashBlock);
+    BlockMap::iterator mi = mapBlockIndex.find(hashBlock);
     if (mi == mapBlockIndex.end())
         return 0;
     CBlockIndex* pindex = (*mi).second;
@@ -968,6 +976,13 @@ bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState &state, CTransaction
                            hash.ToString(),
                            nFees, txMinFee);
 
+           // Since the pool was last full, pay more than what it evicted
+           CAmount nPoolMinFee = pool.GetMinFee().GetFee(nSize);
+           if (fLimitFree && nFees < nPoolMinFee)
+               return error("AcceptToMemoryPool : mempool min fee not met %s, %d < %d",
+                           hash.ToString(),
+                           nFees, nPoolMinFee);
+
         // Continuously rate-limit free transactions
         // This mitigates 'penny-flooding' -- sending thousands of free transactions just to
         // be annoying or make others' transactions take longer to confirm.
@@ -991,6 +1006,19 @@ bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState &state, CTransaction
             dFreeCount += nSize;
             }
         }
+
+        // Bound the chains of unconfirmed transactions, which the pool
+        // walks whenever a transaction is linked in or removed
+        std::set<uint256> setAncestors;
+        std::string errString;
+        if (!pool.CalculateMemPoolAncestors(tx, setAncestors,
+                GetArg("-limitancestorcount", DEFAULT_ANCESTOR_LIMIT),
+                GetArg("-limitancestorsize", DEFAULT_ANCESTOR_SIZE_LIMIT) * 1000,
+                GetArg("-limitdescendantcount", DEFAULT_DESCENDANT_LIMIT),
+                GetArg("-limitdescendantsize", DEFAULT_DESCENDANT_SIZE_LIMIT) * 1000,
+                errString))
+            return tx.DoS(0, error("AcceptToMemoryPool : too-long-mempool-chain %s, %s", hash.ToString(), errString));
+
         // Check against previous transactions
         // This is done last to help prevent CPU exhaustion denial-of-service attacks.
         if (!txPoS.ConnectInputs(tx, txdb, mapInputs, mapUnused, CDiskTxPos(1,1,1), pindexBest, false, false, STANDARD_SCRIPT_VERIFY_FLAGS))
@@ -1011,10 +1039,34 @@ bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState &state, CTransaction
         {
             return error("AcceptToMemoryPool: : BUG! PLEASE REPORT THIS! ConnectInputs failed against MANDATORY but not STANDARD flags %s", hash.ToString());
         }
+
+        // Priority of the inputs already in the chain; the pool entry ages
+        // it from here without reading them again
+        double dPriorityInputs = 0;
+        CAmount nValueInChain = 0;
+        BOOST_FOREACH(const CTxIn& txin, tx.vin)
+        {
+            const CTxIndex& txindex = mapInputs[txin.prevout.hash].first;
+            if (txindex.pos == CDiskTxPos(1,1,1))
+                continue;
+            int nConf = txindex.GetDepthInMainChain();
+            if (nConf <= 0)
+                continue;
+            CAmount nValueIn = mapInputs[txin.prevout.hash].second.vout[txin.prevout.n].nValue;
+            nValueInChain += nValueIn;
+            dPriorityInputs += (double)nValueIn * nConf;
+        }
+
+        // Store transaction in memory
+        CTxMemPoolEntry entry(tx, nFees, GetTime(), tx.ComputePriority(dPriorityInputs, nSize), nBestHeight, nValueInChain);
+        pool.addUnchecked(hash, entry);
     }
 
-    // Store transaction in memory
-    pool.addUnchecked(hash, tx);
+    // Keep the pool within -maxmempool, which evicts this transaction
+    // straight away if it pays the least
+    pool.TrimToSize(GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000);
+    if (!pool.exists(hash))
+        return error("AcceptToMemoryPool : mempool full, fee too low for %s", hash.ToString());
     setValidatedTx.insert(hash);
 
     SyncWithWallets(tx, NULL);
@@ -1165,6 +1217,13 @@ bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState &state, CTransaction
                             hash.ToString(),
                             nFees, txMinFee);
 
+           // Since the pool was last full, pay more than what it evicted
+           CAmount nPoolMinFee = pool.GetMinFee().GetFee(nSize);
+           if (fLimitFree && nFees < nPoolMinFee)
+               return error("AcceptToMemoryPool : mempool min fee not met %s, %d < %d",
+                           hash.ToString(),
+                           nFees, nPoolMinFee);
+
         // Continuously rate-limit free transactions
         // This mitigates 'penny-flooding' -- sending thousands of free transactions just to
         // be annoying or make others' transactions take longer to confirm.
@@ -1332,6 +1391,13 @@ bool AcceptableInputs(CTxMemPool& pool, CValidationState &state, CTransaction &t
                             hash.ToString(),
                             nFees, txMinFee);
 
+           // Since the pool was last full, pay more than what it evicted
+           CAmount nPoolMinFee = pool.GetMinFee().GetFee(nSize);
+           if (fLimitFree && nFees < nPoolMinFee)
+               return error("AcceptToMemoryPool : mempool min fee not met %s, %d < %d",
+                           hash.ToString(),
+                           nFees, nPoolMinFee);
+
         // Continuously rate-limit free transactions
         // This mitigates 'penny-flooding' -- sending thousands of free transactions just to
         // be annoying or make others' transactions take longer to confirm.
@@ -1384,7 +1450,7 @@ int CMerkleTx::GetDepthInMainChainINTERNAL(CBlockIndex* &pindexRet) const
     AssertLockHeld(cs_main);
 
     // Find the block it claims to be in
-    map<uint256, CBlockIndex*>::iterator mi = mapBlockIndex.find(hashBlock);
+    BlockMap::iterator mi = mapBlockIndex.find(hashBlock);
     if (mi == mapBlockIndex.end())
         return 0;
     CBlockIndex* pindex = (*mi).second;
@@ -1547,7 +1613,7 @@ int CTxIndex::GetDepthInMainChain() const
     if (!block.ReadFromDisk(pos.nFile, pos.nBlockPos, false))
         return 0;
     // Find the block in the index
-    map<uint256, CBlockIndex*>::iterator mi = mapBlockIndex.find(block.GetHash());
+    BlockMap::iterator mi = mapBlockIndex.find(block.GetHash());
     if (mi == mapBlockIndex.end())
         return 0;
     CBlockIndex* pindex = (*mi).second;
@@ -1792,7 +1858,7 @@ bool DisconnectBlocksAndReprocess(int blocks)
     return true;
 }
 
-bool FindTransactionsByDestination(const CTxDestination &dest, std::vector<uint256> &vtxhash) {
+bool FindTransactionsByDestination(const CTxDestination &dest, std::vector<uint256> &vtxhash, int nSkip, int nCount) {
     uint160 addrid = 0;
     const CKeyID *pkeyid = boost::get<CKeyID>(&dest);
     if (pkeyid)
@@ -1810,7 +1876,7 @@ bool FindTransactionsByDestination(const CTxDestination &dest, std::vector<uint2
 
     LOCK(cs_main);
     CTxDB txdb("r");
-    if(!txdb.ReadAddrIndex(addrid, vtxhash))
+    if(!txdb.ReadAddrIndex(addrid, vtxhash, nSkip, nCount))
     {
     LogPrintf("FindTransactionsByDestination(): txdb.ReadAddrIndex failed\n");
     return false;
@@ -2063,6 +2129,7 @@ void static InvalidBlockFound(CBlockIndex *pindex, const CValidationState &state
 void UnloadBlockIndex()
 {
     mapBlockIndex.clear();
+    blockIndexArena.clear();
     setBlockIndexCandidates.clear();
     //chainActive.SetTip(NULL);//TODO (Amir): Implement these after chainActive
     pindexBestInvalid = NULL;
@@ -2151,7 +2218,7 @@ void PrintBlockTree()
     AssertLockHeld(cs_main);
     // pre-compute tree structure
     map<CBlockIndex*, vector<CBlockIndex*> > mapNext;
-    for (map<uint256, CBlockIndex*>::iterator mi = mapBlockIndex.begin(); mi != mapBlockIndex.end(); ++mi)
+    for (BlockMap::iterator mi = mapBlockIndex.begin(); mi != mapBlockIndex.end(); ++mi)
     {
         CBlockIndex* pindex = (*mi).second;
         mapNext[pindex->pprev].push_back(pindex);
@@ -2462,7 +2529,7 @@ void static ProcessGetData(CNode* pfrom)
             if (inv.type == MSG_BLOCK || inv.type == MSG_FILTERED_BLOCK)
             {
                 // Send block from disk
-                map<uint256, CBlockIndex*>::iterator mi = mapBlockIndex.find(inv.hash);
+                BlockMap::iterator mi = mapBlockIndex.find(inv.hash);
                 if (mi != mapBlockIndex.end())
                 {
                     CBlock block;
@@ -2966,7 +3033,7 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
         if (locator.IsNull())
         {
             // If locator is null, return the hashStop block
-            map<uint256, CBlockIndex*>::iterator mi = mapBlockIndex.find(hashStop);
+            BlockMap::iterator mi = mapBlockIndex.find(hashStop);
             if (mi == mapBlockIndex.end())
                 return true;
             pindex = (*mi).second;
@@ -3306,6 +3373,35 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
     return true;
 }
 
+// Commands whose handlers lock what they touch and read no chain state, so
+// they need no cs_main. The message workers process them while the main
+// message handler gets on with blocks and transactions. The stormnode list,
+// budget and winner commands look up blocks and input ages and stay on the
+// main handler.
+static const char* const pszConcurrentCommands[] = {
+    "smsgInv", "smsgShow", "smsgHave", "smsgWant", "smsgMsg",
+    "smsgMatch", "smsgPing", "smsgPong", "smsgDisabled", "smsgIgnore",
+};
+
+// requires LOCK(cs_vRecvMsg)
+bool CanProcessConcurrently(CNode* pfrom)
+{
+    // ProcessMessages answers getdata first, and waits while the send buffer is full
+    if (pfrom->nVersion == 0 || !pfrom->vRecvGetData.empty() || pfrom->nSendSize >= SendBufferSize())
+        return false;
+    if (pfrom->vRecvMsg.empty() || !pfrom->vRecvMsg.front().complete())
+        return false;
+
+    const CMessageHeader& hdr = pfrom->vRecvMsg.front().hdr;
+    if (!hdr.IsValid())
+        return false;
+    string strCommand = hdr.GetCommand();
+    for (unsigned int i = 0; i < ARRAYLEN(pszConcurrentCommands); i++)
+        if (strCommand == pszConcurrentCommands[i])
+            return true;
+    return false;
+}
+
 // requires LOCK(cs_vRecvMsg)
 bool ProcessMessages(CNode* pfrom)
 {
@@ -3361,7 +3457,8 @@ bool ProcessMessages(CNode* pfrom)
         if (!hdr.IsValid())
         {
             LogPrintf("\n\nPROCESSMESSAGE: ERRORS IN HEADER %s\n\n\n", hdr.GetCommand());
-            continue;
+            // Stop here: the next message may not be one a message worker can take
+            break;
         }
         string strCommand = hdr.GetCommand();
 
@@ -3377,11 +3474,12 @@ bool ProcessMessages(CNode* pfrom)
         {
             LogPrintf("ProcessMessages(%s, %u bytes) : CHECKSUM ERROR nChecksum=%08x hdr.nChecksum=%08x\n",
                strCommand, nMessageSize, nChecksum, hdr.nChecksum);
-            continue;
+            break;
         }
 
         // Process message
         bool fRet = false;
+        int64_t nStart = GetTimeMicros();
         try
         {
             fRet = ProcessMessage(pfrom, strCommand, vRecv, msg.nTime);
@@ -3413,6 +3511,8 @@ bool ProcessMessages(CNode* pfrom)
             PrintExceptionContinue(NULL, "ProcessMessages()");
         }
 
+        RecordMessageLatency(strCommand, nStart - msg.nTime, GetTimeMicros() - nStart);
+
         if (!fRet)
             LogPrintf("ProcessMessage(%s, %u bytes) FAILED\n", strCommand, nMessageSize);
 
@@ -3652,6 +3752,18 @@ CAmount CTransactionPoS::GetValueOut(CTransaction& tx) const
 
 bool CTransactionPoS::ReadFromDisk(CTransaction& tx, CDiskTxPos pos, FILE** pfileRet)
 {
+    if (!pfileRet)
+    {
+        try {
+            if (!blockFileReader.Read(pos.nFile, pos.nTxPos, tx, SER_DISK, CLIENT_VERSION))
+                return error("CTransactionPoS::ReadFromDisk() : cannot read block file %u", pos.nFile);
+        }
+        catch (std::exception &e) {
+            return error("%s() : deserialize or I/O error", __PRETTY_FUNCTION__);
+        }
+        return true;
+    }
+
     CAutoFile filein = CAutoFile(OpenBlockFile(pos.nFile, 0, pfileRet ? "rb+" : "rb"), SER_DISK, CLIENT_VERSION);
     if (!filein)
         return error("CTransactionPoS::ReadFromDisk() : OpenBlockFile failed");
@@ -3847,8 +3959,14 @@ CAmount CTransactionPoS::GetValueIn(CTransaction& tx, const MapPrevTx& inputs) c
 
 }
 
+bool CScriptCheck::operator()() const
+{
+    const CTransaction& txTo = *ptxTo;
+    return VerifyScript(txTo.vin[nIn].scriptSig, scriptPubKey, txTo, nIn, nFlags, nHashType);
+}
+
 bool CTransactionPoS::ConnectInputs(CTransaction& tx, CTxDB& txdb, MapPrevTx inputs, map<uint256, CTxIndex>& mapTestPool, const CDiskTxPos& posThisTx,
-    const CBlockIndex* pindexBlock, bool fBlock, bool fMiner, unsigned int flags, bool fValidateSig)
+    const CBlockIndex* pindexBlock, bool fBlock, bool fMiner, unsigned int flags, bool fValidateSig, std::vector<CScriptCheck>* pvChecks)
 {
     // Take over previous transactions' spent pointers
     // fBlock is true when this is called from AcceptBlock when a new best-block is added to the blockchain
@@ -3911,6 +4029,15 @@ bool CTransactionPoS::ConnectInputs(CTransaction& tx, CTxDB& txdb, MapPrevTx inp
             // still computed and checked, and any change will be caught at the next checkpoint.
             if (!(fBlock && (nBestHeight < Checkpoints::GetTotalBlocksEstimate())))
             {
+                if (pvChecks)
+                {
+                    // Leave the signature to the caller's check queue
+                    if (prevout.hash != txPrev.GetHash())
+                        return tx.DoS(100, error("ConnectInputs() : %s VerifySignature failed", tx.GetHash().ToString()));
+                    pvChecks->push_back(CScriptCheck());
+                    CScriptCheck(txPrev, tx, i, flags, 0).swap(pvChecks->back());
+                }
+                else
                 // Verify signature
                 if (!VerifySignature(txPrev, tx, i, flags, 0))
                 {
@@ -4003,12 +4130,6 @@ enum FlushStateMode {
     FLUSH_STATE_ALWAYS
 };
 
-static filesystem::path BlockFilePath(unsigned int nFile)
-{
-    string strBlockFn = strprintf("blk%04u.dat", nFile);
-    return GetDataDir() / strBlockFn;
-}
-
 boost::filesystem::path GetBlockPosFilename(const CDiskBlockPos &pos, const char *prefix)
 {
     return GetDataDir() / "blocks" / strprintf("%s%05u.dat", prefix, pos.nFile);
@@ -4202,7 +4323,7 @@ bool CBlock::SetBestChain(CTxDB& txdb, CBlockIndex* pindexNew)
     // New best block
     hashBestChain = hash;
     pindexBest = pindexNew;
-    pblockindexFBBHLast = NULL;
+    chainActive.SetTip(pindexNew);
     nBestHeight = pindexBest->nHeight;
     nBestChainTrust = pindexNew->nChainTrust;
     nTimeBestReceived = GetTime();
@@ -4255,11 +4376,9 @@ bool CBlock::AddToBlockIndex(unsigned int nFile, unsigned int nBlockPos, const u
         return error("AddToBlockIndex() : %s already exists", hash.ToString());
 
     // Construct new block index object
-    CBlockIndex* pindexNew = new CBlockIndex(nFile, nBlockPos, *this);
-    if (!pindexNew)
-        return error("AddToBlockIndex() : new CBlockIndex failed");
+    CBlockIndex* pindexNew = blockIndexArena.Alloc(CBlockIndex(nFile, nBlockPos, *this));
     pindexNew->phashBlock = &hash;
-    map<uint256, CBlockIndex*>::iterator miPrev = mapBlockIndex.find(hashPrevBlock);
+    BlockMap::iterator miPrev = mapBlockIndex.find(hashPrevBlock);
     if (miPrev != mapBlockIndex.end())
     {
         pindexNew->pprev = (*miPrev).second;
@@ -4285,7 +4404,7 @@ bool CBlock::AddToBlockIndex(unsigned int nFile, unsigned int nBlockPos, const u
     pindexNew->bnStakeModifierV2 = ComputeStakeModifierV2(pindexNew->pprev, IsProofOfWork() ? hash : vtx[1].vin[0].prevout.hash);
 
     // Add to mapBlockIndex
-    map<uint256, CBlockIndex*>::iterator mi = mapBlockIndex.insert(make_pair(hash, pindexNew)).first;
+    BlockMap::iterator mi = mapBlockIndex.insert(make_pair(hash, pindexNew)).first;
     if (pindexNew->IsProofOfStake())
         setStakeSeen.insert(make_pair(pindexNew->prevoutStake, pindexNew->nStakeTime));
     pindexNew->phashBlock = &((*mi).first);
@@ -53,6 +53,20 @@ static const unsigned int MAX_TX_SIGOPS = MAX_BLOCK_SIGOPS/5;
 static const unsigned int MAX_ORPHAN_TRANSACTIONS = MAX_BLOCK_SIZE/100;
 // Default for -maxorphanblocksmib, maximum memory used by orphan blocks
 static const unsigned int DEFAULT_MAX_ORPHAN_BLOCKS = 512;
+// Default for -maxmempool, maximum megabytes of memory used by the memory pool
+static const unsigned int DEFAULT_MAX_MEMPOOL_SIZE = 300;
+// Default for -limitancestorcount, max number of in-pool ancestors of a transaction, itself included
+static const unsigned int DEFAULT_ANCESTOR_LIMIT = 25;
+// Default for -limitancestorsize, max kilobytes of a transaction and its in-pool ancestors
+static const unsigned int DEFAULT_ANCESTOR_SIZE_LIMIT = 101;
+// Default for -limitdescendantcount, max number of in-pool descendants of a transaction, itself included
+static const unsigned int DEFAULT_DESCENDANT_LIMIT = 25;
+// Default for -limitdescendantsize, max kilobytes of a transaction and its in-pool descendants
+static const unsigned int DEFAULT_DESCENDANT_SIZE_LIMIT = 101;
+// Maximum number of script-checking threads allowed
+static const int MAX_SCRIPTCHECK_THREADS = 16;
+// -par default (number of script-checking threads, 0 = auto)
+static const int DEFAULT_SCRIPTCHECK_THREADS = 0;
 /// The maximum number of entries in an 'inv' protocol message
 static const unsigned int MAX_INV_SZ = 50000;
 // Threshold for nLockTime: below this value it is interpreted as block number, otherwise as UNIX timestamp.
@@ -75,16 +89,10 @@ static const unsigned char REJECT_DUST = 0x41;
 static const unsigned char REJECT_INSUFFICIENTFEE = 0x42;
 static const unsigned char REJECT_CHECKPOINT = 0x43;
 
-struct BlockHasher
-{
-    size_t operator()(const uint256& hash) const { return hash.GetLow64(); }
-};
-
 extern CScript COINBASE_FLAGS;
 extern CCriticalSection cs_main;
 extern CTxMemPool mempool;
-typedef std::map<uint256, CBlockIndex*, BlockHasher> BlockMap; //TODO (Amir): Change to boost::unordered_map.
-extern std::map<uint256, CBlockIndex*> mapBlockIndex;
+extern BlockMap mapBlockIndex;
 extern std::set<std::pair<COutPoint, unsigned int> > setStakeSeen;
 extern CBlockIndex* pindexGenesisBlock;
 extern int nStakeMinConfirmations;
@@ -98,12 +106,14 @@ extern uint256 hashBestChain;
 extern CBlockIndex* pindexBest;
 extern uint64_t nLastBlockTx;
 extern uint64_t nLastBlockSize;
+extern int64_t nLastBlockBuildTime; // microseconds the last CreateNewBlock spent on transactions
 extern int64_t nLastCoinStakeSearchInterval;
 extern const std::string strMessageMagic;
 extern int64_t nTimeBestReceived;
 extern CConditionVariable cvBlockChange;
 extern bool fImporting;
 extern bool fReindex;
+extern int nScriptCheckThreads;
 struct COrphanBlock;
 extern std::map<uint256, COrphanBlock*> mapOrphanBlocks;
 extern bool fTxIndex;
@@ -168,8 +178,12 @@ void PrintBlockTree();
 
 
 bool ProcessMessages(CNode* pfrom);
+/** Whether the next message of a node may be processed off the main message handler */
+bool CanProcessConcurrently(CNode* pfrom);
 bool SendMessages(CNode* pto, bool fSendTrickle);
 void ThreadImport(std::vector<boost::filesystem::path> vImportFiles);
+/** Run an instance of the script checking thread */
+void ThreadScriptCheck();
 
 bool CheckProofOfWork(uint256 hash, unsigned int nBits);
 unsigned int GetNextTargetRequired(const CBlockIndex* pindexLast, bool fProofOfStake);
@@ -189,7 +203,8 @@ bool AcceptableInputs(CTxMemPool& pool, CValidationState &state, CTransaction &t
 
 CAmount GetBlockValue(int nBits, int nHeight, const CAmount& nFees);
 
-bool FindTransactionsByDestination(const CTxDestination &dest, std::vector<uint256> &vtxhash);
+/** Find the transactions touching dest in chain order, paginated as in CTxDB::ReadAddrIndex */
+bool FindTransactionsByDestination(const CTxDestination &dest, std::vector<uint256> &vtxhash, int nSkip = 0, int nCount = -1);
 
 int GetInputAge(CTxIn& vin);
 /// Abort with a message
@@ -278,6 +293,36 @@ typedef std::map<uint256, std::pair<CTxIndex, CTransaction> > MapPrevTx;
 
 CAmount GetMinFee(const CTransaction& tx, unsigned int nBytes, bool fAllowFree, enum GetMinFee_mode mode);
 
+/** Closure representing one script verification.
+ *  Note that this stores a reference to the spending transaction, which
+ *  must outlive the check. */
+class CScriptCheck
+{
+private:
+    CScript scriptPubKey;
+    const CTransaction* ptxTo;
+    unsigned int nIn;
+    unsigned int nFlags;
+    int nHashType;
+
+public:
+    CScriptCheck() : ptxTo(0), nIn(0), nFlags(0), nHashType(0) {}
+    CScriptCheck(const CTransaction& txFromIn, const CTransaction& txToIn, unsigned int nInIn, unsigned int nFlagsIn, int nHashTypeIn) :
+        scriptPubKey(txFromIn.vout[txToIn.vin[nInIn].prevout.n].scriptPubKey),
+        ptxTo(&txToIn), nIn(nInIn), nFlags(nFlagsIn), nHashType(nHashTypeIn) {}
+
+    bool operator()() const;
+
+    void swap(CScriptCheck& check)
+    {
+        scriptPubKey.swap(check.scriptPubKey);
+        std::swap(ptxTo, check.ptxTo);
+        std::swap(nIn, check.nIn);
+        std::swap(nFlags, check.nFlags);
+        std::swap(nHashType, check.nHashType);
+    }
+};
+
 class CTransactionPoS
 {
 public:
@@ -330,10 +375,12 @@ public:
     //    @param[in] pindexBlock
     //    @param[in] fBlock   true if called from ConnectBlock
     //    @param[in] fMiner   true if called from CreateNewBlock
+    //    @param[out] pvChecks    if not NULL, script checks are appended here instead of being run
     //    @return Returns true if all checks succeed
     bool ConnectInputs(CTransaction& tx, CTxDB& txdb, MapPrevTx inputs,
                        std::map<uint256, CTxIndex>& mapTestPool, const CDiskTxPos& posThisTx,
-                       const CBlockIndex* pindexBlock, bool fBlock, bool fMiner, unsigned int flags = STANDARD_SCRIPT_VERIFY_FLAGS, bool fValidateSig = true);
+                       const CBlockIndex* pindexBlock, bool fBlock, bool fMiner, unsigned int flags = STANDARD_SCRIPT_VERIFY_FLAGS, bool fValidateSig = true,
+                       std::vector<CScriptCheck>* pvChecks = NULL);
 
     bool GetCoinAge(CTransaction& tx, CTxDB& txdb, const CBlockIndex* pindexPrev, uint64_t& nCoinAge) const;
 
@@ -553,6 +600,7 @@ class CWalletInterface {
 protected:
     virtual void SyncTransaction(const CTransaction &tx, const CBlock *pblock, bool fConnect) =0;
     virtual void EraseFromWallet(const uint256 &hash) =0;
+    virtual void RemovedFromMempool(const uint256 &hash) =0;
     virtual void SetBestChain(const CBlockLocator &locator) =0;
     virtual bool UpdatedTransaction(const uint256 &hash) =0;
     virtual void Inventory(const uint256 &hash) =0;
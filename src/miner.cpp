@@ -77,6 +77,7 @@ public:
 
 uint64_t nLastBlockTx = 0;
 uint64_t nLastBlockSize = 0;
+int64_t nLastBlockBuildTime = 0;
 int64_t nLastCoinStakeSearchInterval = 0;
 
 // We want to sort transactions by priority and fee, so:
@@ -103,6 +104,64 @@ public:
     }
 };
 
+/** The transactions CreateNewBlock picked last time. While neither the
+ *  memory pool nor the chain tip changes, the next block reuses them. */
+class CMinerTemplate
+{
+public:
+    CBlockIndex* pindexPrev;
+    unsigned int nTransactionsUpdated;
+    bool fProofOfStake;
+    bool fValid;
+    vector<CTransaction> vtx;
+    CAmount nFees;
+    uint64_t nBlockSize;
+
+    CMinerTemplate() : pindexPrev(NULL), nTransactionsUpdated(0), fProofOfStake(false), fValid(false), nFees(0), nBlockSize(0) {}
+
+    bool IsCurrent(CBlockIndex* pindexPrevIn, unsigned int nTransactionsUpdatedIn, bool fProofOfStakeIn) const
+    {
+        return fValid && pindexPrev == pindexPrevIn && nTransactionsUpdated == nTransactionsUpdatedIn && fProofOfStake == fProofOfStakeIn;
+    }
+};
+
+static CMinerTemplate minerTemplate;
+
+/** Pool transactions whose inputs connected on top of pindexPrev, with
+ *  their legacy and P2SH sigop count. Until the tip moves only the
+ *  transactions new to the pool are read and connected again. */
+class CMinerInputCache
+{
+public:
+    CBlockIndex* pindexPrev;
+    map<uint256, unsigned int> mapSigOps;
+
+    CMinerInputCache() : pindexPrev(NULL) {}
+
+    void SetTip(CBlockIndex* pindexPrevIn)
+    {
+        if (pindexPrev == pindexPrevIn)
+            return;
+        pindexPrev = pindexPrevIn;
+        mapSigOps.clear();
+    }
+
+    // Forget what left the pool since the last template
+    void Prune(const CTxMemPool& pool)
+    {
+        map<uint256, unsigned int>::iterator it = mapSigOps.begin();
+        while (it != mapSigOps.end())
+        {
+            if (pool.mapTx.count(it->first))
+                ++it;
+            else
+                mapSigOps.erase(it++);
+        }
+    }
+};
+
+static CMinerInputCache minerInputs;
+
 // CreateNewBlock: create new block (without proof-of-work/proof-of-stake)
 CBlock* CreateNewBlock(CReserveKey& reservekey, bool fProofOfStake, CAmount* pFees)
 {
@@ -115,7 +174,6 @@ CBlock* CreateNewBlock(CReserveKey& reservekey, bool fProofOfStake, CAmount* pFe
     int nHeight = pindexPrev->nHeight + 1;
 
     // Create coinbase tx
-    // TODO (AA): Use CMutableTransaction txNew;
     CMutableTransaction txNew;
     txNew.vin.resize(1);
     txNew.vin[0].prevout.SetNull();
@@ -174,43 +232,54 @@ CBlock* CreateNewBlock(CReserveKey& reservekey, bool fProofOfStake, CAmount* pFe
         LOCK2(cs_main, mempool.cs);
         CTxDB txdb("r");
 
-        // Priority order to process transactions
-        list<COrphan> vOrphan; // list memory doesn't move
-        map<uint256, vector<COrphan*> > mapDependers;
-
-        // This vector will be sorted into a priority queue:
-        vector<TxPriority> vecPriority;
-        vecPriority.reserve(mempool.mapTx.size());
-        for (map<uint256, CTransaction>::iterator mi = mempool.mapTx.begin(); mi != mempool.mapTx.end(); ++mi)
+        int64_t nBuildStart = GetTimeMicros();
+        uint64_t nBlockSize = 1000;
+        uint64_t nBlockTx = 0;
+        unsigned int nTransactionsUpdated = mempool.GetTransactionsUpdated();
+        bool fReused = minerTemplate.IsCurrent(pindexPrev, nTransactionsUpdated, fProofOfStake);
+        if (fReused)
         {
-            CTransaction& tx = (*mi).second;
-            if (tx.IsCoinBase() || tx.IsCoinStake() || !IsFinalTx(tx, nHeight))
-                continue;
+            pblock->vtx.insert(pblock->vtx.end(), minerTemplate.vtx.begin(), minerTemplate.vtx.end());
+            nFees = minerTemplate.nFees;
+            nBlockSize = minerTemplate.nBlockSize;
+            nBlockTx = minerTemplate.vtx.size();
+        }
+        else
+        {
+            minerInputs.SetTip(pindexPrev);
+            minerInputs.Prune(mempool);
+
+            // Priority order to process transactions
+            list<COrphan> vOrphan; // list memory doesn't move
+            map<uint256, vector<COrphan*> > mapDependers;
 
-            COrphan* porphan = NULL;
-            double dPriority = 0;
-            CAmount nTotalIn = 0;
-            bool fMissingInputs = false;
-            BOOST_FOREACH(const CTxIn& txin, tx.vin)
+            // Transactions left out only because of the clock may get in next time
+            bool fSkippedForTime = false;
+
+            // This vector will be sorted into a priority queue:
+            vector<TxPriority> vecPriority;
+            vecPriority.reserve(mempool.mapTx.size());
+            for (indexed_transaction_set::iterator mi = mempool.mapTx.begin(); mi != mempool.mapTx.end(); ++mi)
             {
-                // Read prev transaction
-                CTransaction txPrev;
-                CTxIndex txindex;
-                CTransactionPoS txPoS;
-                if (!txPoS.ReadFromDisk(txPrev, txdb, txin.prevout, txindex))
+                CTransaction& tx = const_cast<CTransaction&>(mi->GetTx());
+                if (tx.IsCoinBase() || tx.IsCoinStake())
+                    continue;
+                if (!IsFinalTx(tx, nHeight))
+                {
+                    fSkippedForTime = true;
+                    continue;
+                }
+
+                // Fee and priority were worked out when the transaction
+                // entered the pool
+                double dPriority = mi->GetPriority(pindexPrev->nHeight);
+                double dFeePerKb = double(mi->GetFee()) / (double(mi->GetTxSize())/1000.0);
+
+                COrphan* porphan = NULL;
+                BOOST_FOREACH(const CTxIn& txin, tx.vin)
                 {
-                    // This should never happen; all transactions in the memory
-                    // pool should connect to either transactions in the chain
-                    // or other transactions in the memory pool.
                     if (!mempool.mapTx.count(txin.prevout.hash))
-                    {
-                        LogPrintf("ERROR: mempool transaction missing input\n");
-                        if (fDebug) assert("mempool transaction missing input" == 0);
-                        fMissingInputs = true;
-                        if (porphan)
-                            vOrphan.pop_back();
-                        break;
-                    }
+                        continue;
 
                     // Has to wait for dependencies
                     if (!porphan)
@@ -218,144 +287,154 @@ CBlock* CreateNewBlock(CReserveKey& reservekey, bool fProofOfStake, CAmount* pFe
                         // Use list for automatic deletion
                         vOrphan.push_back(COrphan(&tx));
                         porphan = &vOrphan.back();
+                        porphan->dPriority = dPriority;
+                        porphan->dFeePerKb = dFeePerKb;
                     }
                     mapDependers[txin.prevout.hash].push_back(porphan);
                     porphan->setDependsOn.insert(txin.prevout.hash);
-                    nTotalIn += mempool.mapTx[txin.prevout.hash].vout[txin.prevout.n].nValue;
-                    continue;
                 }
-                CAmount nValueIn = txPrev.vout[txin.prevout.n].nValue;
-                nTotalIn += nValueIn;
-
-                int nConf = txindex.GetDepthInMainChain();
-                dPriority += (double)nValueIn * nConf;
+                if (!porphan)
+                    vecPriority.push_back(TxPriority(dPriority, dFeePerKb, &tx));
             }
-            if (fMissingInputs) continue;
 
-            // Priority is sum(valuein * age) / txsize
-            unsigned int nTxSize = ::GetSerializeSize(tx, SER_NETWORK, PROTOCOL_VERSION);
-            dPriority /= nTxSize;
+            // Collect transactions into block
+            map<uint256, CTxIndex> mapTestPool;
+            int nBlockSigOps = 100;
+            bool fSortedByFee = (nBlockPrioritySize <= 0);
 
-            // This is a more accurate fee-per-kilobyte than is used by the client code, because the
-            // client code rounds up the size to the nearest 1K. That's good, because it gives an
-            // incentive to create smaller transactions.
-            CTransactionPoS txPoS;
-            double dFeePerKb =  double(nTotalIn-txPoS.GetValueOut(tx)) / (double(nTxSize)/1000.0);
+            TxPriorityCompare comparer(fSortedByFee);
+            std::make_heap(vecPriority.begin(), vecPriority.end(), comparer);
 
-            if (porphan)
+            while (!vecPriority.empty())
             {
-                porphan->dPriority = dPriority;
-                porphan->dFeePerKb = dFeePerKb;
-            }
-            else
-                vecPriority.push_back(TxPriority(dPriority, dFeePerKb, &(*mi).second));
-        }
-
-        // Collect transactions into block
-        map<uint256, CTxIndex> mapTestPool;
-        uint64_t nBlockSize = 1000;
-        uint64_t nBlockTx = 0;
-        int nBlockSigOps = 100;
-        bool fSortedByFee = (nBlockPrioritySize <= 0);
-
-        TxPriorityCompare comparer(fSortedByFee);
-        std::make_heap(vecPriority.begin(), vecPriority.end(), comparer);
-
-        while (!vecPriority.empty())
-        {
-            // Take highest priority transaction off the priority queue:
-            double dPriority = vecPriority.front().get<0>();
-            double dFeePerKb = vecPriority.front().get<1>();
-            CTransaction& tx = *(vecPriority.front().get<2>());
-
-            std::pop_heap(vecPriority.begin(), vecPriority.end(), comparer);
-            vecPriority.pop_back();
-
-            // Size limits
-            unsigned int nTxSize = ::GetSerializeSize(tx, SER_NETWORK, PROTOCOL_VERSION);
-            if (nBlockSize + nTxSize >= nBlockMaxSize)
-                continue;
-
-            // Legacy limits on sigOps:
-            unsigned int nTxSigOps = GetLegacySigOpCount(tx);
-            if (nBlockSigOps + nTxSigOps >= MAX_BLOCK_SIGOPS)
-                continue;
+                // Take highest priority transaction off the priority queue:
+                double dPriority = vecPriority.front().get<0>();
+                double dFeePerKb = vecPriority.front().get<1>();
+                CTransaction& tx = *(vecPriority.front().get<2>());
 
-            // Timestamp limit
-            if (tx.nTime > GetAdjustedTime() || (fProofOfStake && tx.nTime > pblock->vtx[0].nTime))
-                continue;
-
-            // Skip free transactions if we're past the minimum block size:
-            if (fSortedByFee && (dFeePerKb < nMinTxFee) && (nBlockSize + nTxSize >= nBlockMinSize))
-                continue;
+                std::pop_heap(vecPriority.begin(), vecPriority.end(), comparer);
+                vecPriority.pop_back();
 
-            // Prioritize by fee once past the priority size or we run out of high-priority
-            // transactions:
-            if (!fSortedByFee &&
-                ((nBlockSize + nTxSize >= nBlockPrioritySize) || (dPriority < COIN * 144 / 250)))
-            {
-                fSortedByFee = true;
-                comparer = TxPriorityCompare(fSortedByFee);
-                std::make_heap(vecPriority.begin(), vecPriority.end(), comparer);
-            }
-
-            // Connecting shouldn't fail due to dependency on other memory pool transactions
-            // because we're already processing them in order of dependency
-            map<uint256, CTxIndex> mapTestPoolTmp(mapTestPool);
-            MapPrevTx mapInputs;
+                // Size limits
+                unsigned int nTxSize = ::GetSerializeSize(tx, SER_NETWORK, PROTOCOL_VERSION);
+                if (nBlockSize + nTxSize >= nBlockMaxSize)
+                    continue;
 
-            bool fInvalid;
-            CTransactionPoS txPoS;
-            if (!txPoS.FetchInputs(tx, txdb, mapTestPoolTmp, false, true, mapInputs, fInvalid))
-                continue;
+                // Legacy limits on sigOps:
+                unsigned int nTxSigOps = GetLegacySigOpCount(tx);
+                if (nBlockSigOps + nTxSigOps >= MAX_BLOCK_SIGOPS)
+                    continue;
 
-            CAmount nTxFees = txPoS.GetValueIn(tx, mapInputs) - txPoS.GetValueOut(tx);
+                // Timestamp limit
+                if (tx.nTime > GetAdjustedTime() || (fProofOfStake && tx.nTime > pblock->vtx[0].nTime))
+                {
+                    fSkippedForTime = true;
+                    continue;
+                }
 
-            nTxSigOps += GetP2SHSigOpCount(tx, mapInputs);
-            if (nBlockSigOps + nTxSigOps >= MAX_BLOCK_SIGOPS)
-                continue;
+                // Skip free transactions if we're past the minimum block size:
+                if (fSortedByFee && (dFeePerKb < nMinTxFee) && (nBlockSize + nTxSize >= nBlockMinSize))
+                    continue;
 
-            // Note that flags: we don't want to set mempool/IsStandard()
-            // policy here, but we still have to ensure that the block we
-            // create only contains transactions that are valid in new blocks.
-            if (!txPoS.ConnectInputs(tx, txdb, mapInputs, mapTestPoolTmp, CDiskTxPos(1,1,1), pindexPrev, false, true, MANDATORY_SCRIPT_VERIFY_FLAGS))
-                continue;
+                // Prioritize by fee once past the priority size or we run out of high-priority
+                // transactions:
+                if (!fSortedByFee &&
+                    ((nBlockSize + nTxSize >= nBlockPrioritySize) || (dPriority < COIN * 144 / 250)))
+                {
+                    fSortedByFee = true;
+                    comparer = TxPriorityCompare(fSortedByFee);
+                    std::make_heap(vecPriority.begin(), vecPriority.end(), comparer);
+                }
 
-            mapTestPoolTmp[tx.GetHash()] = CTxIndex(CDiskTxPos(1,1,1), tx.vout.size());
-            swap(mapTestPool, mapTestPoolTmp);
+                uint256 hash = tx.GetHash();
+                CAmount nTxFees = mempool.mapTx.find(hash)->GetFee();
+                map<uint256, unsigned int>::const_iterator itInputs = minerInputs.mapSigOps.find(hash);
+                if (itInputs != minerInputs.mapSigOps.end())
+                {
+                    // Connected on this tip before, and the pool holds no
+                    // conflicting spends, so only the limits need checking
+                    nTxSigOps = itInputs->second;
+                    if (nBlockSigOps + nTxSigOps >= MAX_BLOCK_SIGOPS)
+                        continue;
+                    mapTestPool[hash] = CTxIndex(CDiskTxPos(1,1,1), tx.vout.size());
+                }
+                else
+                {
+                    // Connecting shouldn't fail due to dependency on other memory pool transactions
+                    // because we're already processing them in order of dependency
+                    map<uint256, CTxIndex> mapTestPoolTmp(mapTestPool);
+                    MapPrevTx mapInputs;
+
+                    bool fInvalid;
+                    CTransactionPoS txPoS;
+                    if (!txPoS.FetchInputs(tx, txdb, mapTestPoolTmp, false, true, mapInputs, fInvalid))
+                        continue;
+
+                    nTxFees = txPoS.GetValueIn(tx, mapInputs) - txPoS.GetValueOut(tx);
+
+                    nTxSigOps += GetP2SHSigOpCount(tx, mapInputs);
+                    if (nBlockSigOps + nTxSigOps >= MAX_BLOCK_SIGOPS)
+                        continue;
+
+                    // Note that flags: we don't want to set mempool/IsStandard()
+                    // policy here, but we still have to ensure that the block we
+                    // create only contains transactions that are valid in new blocks.
+                    if (!txPoS.ConnectInputs(tx, txdb, mapInputs, mapTestPoolTmp, CDiskTxPos(1,1,1), pindexPrev, false, true, MANDATORY_SCRIPT_VERIFY_FLAGS))
+                        continue;
+
+                    mapTestPoolTmp[hash] = CTxIndex(CDiskTxPos(1,1,1), tx.vout.size());
+                    swap(mapTestPool, mapTestPoolTmp);
+                    minerInputs.mapSigOps[hash] = nTxSigOps;
+                }
 
-            // Added
-            pblock->vtx.push_back(tx);
-            nBlockSize += nTxSize;
-            ++nBlockTx;
-            nBlockSigOps += nTxSigOps;
-            nFees += nTxFees;
+                // Added
+                pblock->vtx.push_back(tx);
+                nBlockSize += nTxSize;
+                ++nBlockTx;
+                nBlockSigOps += nTxSigOps;
+                nFees += nTxFees;
 
-            if (fDebug && GetBoolArg("-printpriority", false))
-            {
-                LogPrintf("priority %.1f feeperkb %.1f txid %s\n",
-                       dPriority, dFeePerKb, tx.GetHash().ToString());
-            }
+                if (fDebug && GetBoolArg("-printpriority", false))
+                {
+                    LogPrintf("priority %.1f feeperkb %.1f txid %s\n",
+                           dPriority, dFeePerKb, tx.GetHash().ToString());
+                }
 
-            // Add transactions that depend on this one to the priority queue
-            uint256 hash = tx.GetHash();
-            if (mapDependers.count(hash))
-            {
-                BOOST_FOREACH(COrphan* porphan, mapDependers[hash])
+                // Add transactions that depend on this one to the priority queue
+                if (mapDependers.count(hash))
                 {
-                    if (!porphan->setDependsOn.empty())
+                    BOOST_FOREACH(COrphan* porphan, mapDependers[hash])
                     {
-                        porphan->setDependsOn.erase(hash);
-                        if (porphan->setDependsOn.empty())
+                        if (!porphan->setDependsOn.empty())
                         {
-                            vecPriority.push_back(TxPriority(porphan->dPriority, porphan->dFeePerKb, porphan->ptx));
-                            std::push_heap(vecPriority.begin(), vecPriority.end(), comparer);
+                            porphan->setDependsOn.erase(hash);
+                            if (porphan->setDependsOn.empty())
+                            {
+                                vecPriority.push_back(TxPriority(porphan->dPriority, porphan->dFeePerKb, porphan->ptx));
+                                std::push_heap(vecPriority.begin(), vecPriority.end(), comparer);
+                            }
                         }
                     }
                 }
             }
+
+            // Keep the selection for the next block on the same tip and pool,
+            // unless a transaction only missed out because of the clock.
+            minerTemplate.pindexPrev = pindexPrev;
+            minerTemplate.nTransactionsUpdated = nTransactionsUpdated;
+            minerTemplate.fProofOfStake = fProofOfStake;
+            minerTemplate.fValid = !fSkippedForTime;
+            minerTemplate.vtx.assign(pblock->vtx.begin() + 1, pblock->vtx.end());
+            minerTemplate.nFees = nFees;
+            minerTemplate.nBlockSize = nBlockSize;
         }
 
+        nLastBlockTx = nBlockTx;
+        nLastBlockSize = nBlockSize;
+        nLastBlockBuildTime = GetTimeMicros() - nBuildStart;
+        LogPrint("miner", "CreateNewBlock(): %s template with %u of %u pool transactions in %.2fms\n",
+            fReused ? "reused" : "built", nBlockTx, mempool.mapTx.size(), nLastBlockBuildTime * 0.001);
+
         CAmount blockValue = GetBlockValue(pindexPrev->nBits, pindexPrev->nHeight, nFees);
         CAmount stormnodePayment = GetStormnodePayment(pindexPrev->nHeight+1, blockValue);
 
@@ -364,7 +443,11 @@ CBlock* CreateNewBlock(CReserveKey& reservekey, bool fProofOfStake, CAmount* pFe
                       nBlockSize, nHeight, fProofOfStake, blockValue, stormnodePayment);
 
         if (!fProofOfStake)
-            pblock->vtx[0].vout[0].nValue = GetProofOfWorkReward(nFees);
+        {
+            CMutableTransaction txCoinBase(pblock->vtx[0]);
+            txCoinBase.vout[0].nValue = GetProofOfWorkReward(nFees);
+            pblock->vtx[0] = txCoinBase;
+        }
 
         if (pFees)
             *pFees = nFees;
@@ -392,8 +475,10 @@ void IncrementExtraNonce(CBlock* pblock, CBlockIndex* pindexPrev, unsigned int&
     ++nExtraNonce;
 
     unsigned int nHeight = pindexPrev->nHeight+1; // Height first in coinbase required for block.version=2
-    pblock->vtx[0].vin[0].scriptSig = (CScript() << nHeight << CBigNum(nExtraNonce)) + COINBASE_FLAGS;
-    assert(pblock->vtx[0].vin[0].scriptSig.size() <= 100);
+    CMutableTransaction txCoinBase(pblock->vtx[0]);
+    txCoinBase.vin[0].scriptSig = (CScript() << nHeight << CBigNum(nExtraNonce)) + COINBASE_FLAGS;
+    assert(txCoinBase.vin[0].scriptSig.size() <= 100);
+    pblock->vtx[0] = txCoinBase;
 
     pblock->hashMerkleRoot = pblock->BuildMerkleTree();
 }
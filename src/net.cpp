@@ -17,6 +17,13 @@
 #include <fcntl.h>
 #endif
 
+// Native I2P listen sockets are re-created for every accepted connection,
+// so those builds keep polling with select()
+#if defined(__linux__) && !defined(USE_NATIVE_I2P)
+#define USE_EPOLL
+#include <sys/epoll.h>
+#endif
+
 #ifdef USE_UPNP
 #include <miniupnpc/miniwget.h>
 #include <miniupnpc/miniupnpc.h>
@@ -96,6 +103,23 @@ CCriticalSection cs_nLastNodeId;
 static CSemaphore *semOutbound = NULL;
 boost::condition_variable messageHandlerCondition;
 
+// Nodes handed to the message workers, each holding a reference; a node
+// is in setMessageWork from when it is queued until a worker is done with it
+static boost::mutex csMessageWork;
+static boost::condition_variable condMessageWork;
+static deque<CNode*> vMessageWork;
+static set<CNode*> setMessageWork;
+static int nMessageWorkers = 0;
+
+// Messages a worker processes for one node before it lets the others have a turn
+static const int MESSAGE_WORK_BATCH = 16;
+
+// Received message latency, by command. Commands are chosen by the peer,
+// so past a limit they are counted together.
+static const unsigned int MAX_MESSAGE_LATENCY_COMMANDS = 64;
+static CCriticalSection cs_mapMessageLatency;
+static map<string, CMessageLatency> mapMessageLatency;
+
 // Signals for message handling
 static CNodeSignals n_signals;
 CNodeSignals& GetNodeSignals() { return n_signals; }
@@ -385,6 +409,59 @@ CNode* FindNode(const CService& addr)
     return NULL;
 }
 
+#ifdef USE_EPOLL
+// Readiness of the listening and connected sockets
+static int hSocketEvents = -1;
+
+// requires LOCK(cs_vSend)
+static void SocketEventsWatch(CNode* pnode, int nOp)
+{
+    if (hSocketEvents == -1 || pnode->hSocket == INVALID_SOCKET)
+        return;
+    struct epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events = EPOLLIN | EPOLLRDHUP | EPOLLET | (pnode->fWatchSend ? (uint32_t)EPOLLOUT : 0u);
+    event.data.ptr = pnode;
+    if (epoll_ctl(hSocketEvents, nOp, pnode->hSocket, &event) != 0 && nOp == EPOLL_CTL_ADD)
+        LogPrintf("socket epoll_ctl error %d\n", errno);
+}
+
+static void SocketEventsInit()
+{
+    hSocketEvents = epoll_create1(EPOLL_CLOEXEC);
+    if (hSocketEvents == -1)
+    {
+        LogPrintf("epoll_create1 failed with error %d, polling sockets with select()\n", errno);
+        return;
+    }
+    BOOST_FOREACH(SOCKET hListenSocket, vhListenSocket)
+    {
+        struct epoll_event event;
+        memset(&event, 0, sizeof(event));
+        event.events = EPOLLIN | EPOLLET;
+        event.data.ptr = NULL;
+        if (epoll_ctl(hSocketEvents, EPOLL_CTL_ADD, hListenSocket, &event) != 0)
+            LogPrintf("socket epoll_ctl error %d\n", errno);
+    }
+
+    LOCK(cs_vNodes);
+    BOOST_FOREACH(CNode* pnode, vNodes)
+    {
+        LOCK(pnode->cs_vSend);
+        SocketEventsWatch(pnode, EPOLL_CTL_ADD);
+    }
+}
+#endif
+
+// requires LOCK(cs_vNodes)
+static void SocketEventsAdd(CNode* pnode)
+{
+#ifdef USE_EPOLL
+    LOCK(pnode->cs_vSend);
+    SocketEventsWatch(pnode, EPOLL_CTL_ADD);
+#endif
+}
+
 CNode* ConnectNode(CAddress addrConnect, const char *pszDest, bool sandStormnode)
 {
     if (pszDest == NULL) {
@@ -435,6 +512,7 @@ CNode* ConnectNode(CAddress addrConnect, const char *pszDest, bool sandStormnode
         {
             LOCK(cs_vNodes);
             vNodes.push_back(pnode);
+            SocketEventsAdd(pnode);
 #ifdef USE_NATIVE_I2P
             if (addrConnect.IsNativeI2P())
                 ++nI2PNodeCount;
@@ -662,6 +740,7 @@ void AddIncomingConnection(SOCKET hSocket, const CAddress& addr)
         {
             LOCK(cs_vNodes);
             vNodes.push_back(pnode);
+            SocketEventsAdd(pnode);
             ++nI2PNodeCount;
         }
     }
@@ -766,92 +845,376 @@ void SocketSendData(CNode *pnode)
         assert(pnode->nSendSize == 0);
     }
     pnode->vSendMsg.erase(pnode->vSendMsg.begin(), it);
+
+#ifdef USE_EPOLL
+    // Ask to hear when the socket is writable only while there is something left to send
+    if (pnode->vSendMsg.empty() == pnode->fWatchSend)
+    {
+        pnode->fWatchSend = !pnode->fWatchSend;
+        SocketEventsWatch(pnode, EPOLL_CTL_MOD);
+    }
+#endif
 }
 
 static list<CNode*> vNodesDisconnected;
-
-void ThreadSocketHandler()
-{
-    unsigned int nPrevNodeCount = 0;
+static unsigned int nPrevNodeCount = 0;
 #ifdef USE_NATIVE_I2P
-    int nPrevI2PNodeCount = 0;
+static int nPrevI2PNodeCount = 0;
 #endif
-    while (true)
+
+static void DisconnectNodes()
+{
     {
-        //
-        // Disconnect nodes
-        //
+        LOCK(cs_vNodes);
+        // Disconnect unused nodes
+        vector<CNode*>::iterator it = vNodes.begin();
+        while (it != vNodes.end())
         {
-            LOCK(cs_vNodes);
-            // Disconnect unused nodes
-            vector<CNode*> vNodesCopy = vNodes;
-            BOOST_FOREACH(CNode* pnode, vNodesCopy)
+            CNode* pnode = *it;
+            if (!pnode->fDisconnect &&
+                !(pnode->GetRefCount() <= 0 && pnode->vRecvMsg.empty() && pnode->nSendSize == 0 && pnode->ssSend.empty()))
             {
-                if (pnode->fDisconnect ||
-                    (pnode->GetRefCount() <= 0 && pnode->vRecvMsg.empty() && pnode->nSendSize == 0 && pnode->ssSend.empty()))
-                {
-                    // remove from vNodes
-                    vNodes.erase(remove(vNodes.begin(), vNodes.end(), pnode), vNodes.end());
+                it++;
+                continue;
+            }
 
-                    // release outbound grant (if any)
-                    pnode->grantOutbound.Release();
+            // remove from vNodes
+            it = vNodes.erase(it);
 
-                    // close socket and cleanup
-                    pnode->CloseSocketDisconnect();
+            // release outbound grant (if any)
+            pnode->grantOutbound.Release();
 
-                    // hold in disconnected pool until all refs are released
-                    if (pnode->fNetworkNode || pnode->fInbound)
-                        pnode->Release();
-                    vNodesDisconnected.push_back(pnode);
+            // close socket and cleanup
+            pnode->CloseSocketDisconnect();
+
+            // hold in disconnected pool until all refs are released
+            if (pnode->fNetworkNode || pnode->fInbound)
+                pnode->Release();
+            vNodesDisconnected.push_back(pnode);
 #ifdef USE_NATIVE_I2P
-                    if (pnode->addr.IsNativeI2P())
-                        --nI2PNodeCount;
+            if (pnode->addr.IsNativeI2P())
+                --nI2PNodeCount;
 #endif
-                }
-            }
         }
+    }
+    {
+        // Delete disconnected nodes
+        list<CNode*>::iterator it = vNodesDisconnected.begin();
+        while (it != vNodesDisconnected.end())
         {
-            // Delete disconnected nodes
-            list<CNode*> vNodesDisconnectedCopy = vNodesDisconnected;
-            BOOST_FOREACH(CNode* pnode, vNodesDisconnectedCopy)
+            CNode* pnode = *it;
+            bool fDelete = false;
+            // wait until threads are done using it
+            if (pnode->GetRefCount() <= 0)
             {
-                // wait until threads are done using it
-                if (pnode->GetRefCount() <= 0)
+                TRY_LOCK(pnode->cs_vSend, lockSend);
+                if (lockSend)
                 {
-                    bool fDelete = false;
-                    {
-                        TRY_LOCK(pnode->cs_vSend, lockSend);
-                        if (lockSend)
-                        {
-                            TRY_LOCK(pnode->cs_vRecvMsg, lockRecv);
-                            if (lockRecv)
-                            {
-                                TRY_LOCK(pnode->cs_inventory, lockInv);
-                                if (lockInv)
-                                    fDelete = true;
-                            }
-                        }
-                    }
-                    if (fDelete)
+                    TRY_LOCK(pnode->cs_vRecvMsg, lockRecv);
+                    if (lockRecv)
                     {
-                        vNodesDisconnected.remove(pnode);
-                        delete pnode;
+                        TRY_LOCK(pnode->cs_inventory, lockInv);
+                        if (lockInv)
+                            fDelete = true;
                     }
                 }
             }
+            if (fDelete)
+            {
+                it = vNodesDisconnected.erase(it);
+                delete pnode;
+            }
+            else
+                it++;
         }
-        if(vNodes.size() != nPrevNodeCount) {
-            nPrevNodeCount = vNodes.size();
-            uiInterface.NotifyNumConnectionsChanged(nPrevNodeCount);
-        }
+    }
+    if(vNodes.size() != nPrevNodeCount) {
+        nPrevNodeCount = vNodes.size();
+        uiInterface.NotifyNumConnectionsChanged(nPrevNodeCount);
+    }
 #ifdef USE_NATIVE_I2P
-        if (nPrevI2PNodeCount != nI2PNodeCount)
+    if (nPrevI2PNodeCount != nI2PNodeCount)
+    {
+        nPrevI2PNodeCount = nI2PNodeCount;
+        uiInterface.NotifyNumI2PConnectionsChanged(nI2PNodeCount);
+    }
+#endif
+}
+
+// Accept one pending connection; returns false when there was none
+static bool AcceptConnection(SOCKET hListenSocket)
+{
+    struct sockaddr_storage sockaddr;
+    socklen_t len = sizeof(sockaddr);
+    SOCKET hSocket = accept(hListenSocket, (struct sockaddr*)&sockaddr, &len);
+    CAddress addr;
+    int nInbound = 0;
+
+    if (hSocket == INVALID_SOCKET)
+    {
+        int nErr = WSAGetLastError();
+        if (nErr != WSAEWOULDBLOCK)
+            LogPrintf("socket error accept failed: %d\n", nErr);
+        return false;
+    }
+
+    if (!addr.SetSockAddr((const struct sockaddr*)&sockaddr))
+        LogPrintf("Warning: Unknown socket family\n");
+
+    {
+        LOCK(cs_vNodes);
+        BOOST_FOREACH(CNode* pnode, vNodes)
+            if (pnode->fInbound)
+                nInbound++;
+    }
+
+    if (nInbound >= GetArg("-maxconnections", 200) - MAX_OUTBOUND_CONNECTIONS)
+    {
+        closesocket(hSocket);
+    }
+    else if (CNode::IsBanned(addr))
+    {
+        LogPrintf("connection from %s dropped (banned)\n", addr.ToString());
+        closesocket(hSocket);
+    }
+    else
+    {
+        LogPrint("net", "accepted connection %s\n", addr.ToString());
+        CNode* pnode = new CNode(hSocket, addr, "", true);
+        pnode->AddRef();
+        {
+            LOCK(cs_vNodes);
+            vNodes.push_back(pnode);
+            SocketEventsAdd(pnode);
+        }
+    }
+    return true;
+}
+
+// requires LOCK(cs_vRecvMsg)
+// Read one chunk; returns true if it filled the buffer, so more may be waiting
+static bool SocketRecvData(CNode* pnode)
+{
+    if (pnode->GetTotalRecvSize() > ReceiveFloodSize()) {
+        if (!pnode->fDisconnect)
+            LogPrintf("socket recv flood control disconnect (%u bytes)\n", pnode->GetTotalRecvSize());
+        pnode->CloseSocketDisconnect();
+        return false;
+    }
+
+    // typical socket buffer is 8K-64K
+    char pchBuf[0x10000];
+    int nBytes = recv(pnode->hSocket, pchBuf, sizeof(pchBuf), MSG_DONTWAIT);
+    if (nBytes > 0)
+    {
+        if (!pnode->ReceiveMsgBytes(pchBuf, nBytes))
+            pnode->CloseSocketDisconnect();
+        pnode->nLastRecv = GetTime();
+        pnode->nRecvBytes += nBytes;
+        pnode->RecordBytesRecv(nBytes);
+        return nBytes == (int)sizeof(pchBuf) && !pnode->fDisconnect;
+    }
+    else if (nBytes == 0)
+    {
+        // socket closed gracefully
+        if (!pnode->fDisconnect)
+            LogPrint("net", "socket closed\n");
+        pnode->CloseSocketDisconnect();
+    }
+    else if (nBytes < 0)
+    {
+        // error
+        int nErr = WSAGetLastError();
+        if (nErr != WSAEWOULDBLOCK && nErr != WSAEMSGSIZE && nErr != WSAEINTR && nErr != WSAEINPROGRESS)
+        {
+            if (!pnode->fDisconnect)
+                LogPrintf("socket recv error %d\n", nErr);
+            pnode->CloseSocketDisconnect();
+        }
+    }
+    return false;
+}
+
+static void InactivityCheck(CNode* pnode)
+{
+    int64_t nTime = GetTime();
+    if (nTime - pnode->nTimeConnected > 60)
+    {
+        if (pnode->nLastRecv == 0 || pnode->nLastSend == 0)
+        {
+            LogPrint("net", "socket no message in first 60 seconds, %d %d\n", pnode->nLastRecv != 0, pnode->nLastSend != 0);
+            pnode->fDisconnect = true;
+        }
+        else if (nTime - pnode->nLastSend > TIMEOUT_INTERVAL)
+        {
+            LogPrintf("socket sending timeout: %ds\n", nTime - pnode->nLastSend);
+            pnode->fDisconnect = true;
+        }
+        else if (pnode->nPingNonceSent && pnode->nPingUsecStart + TIMEOUT_INTERVAL * 1000000 < GetTimeMicros())
+        {
+            LogPrintf("ping timeout: %fs\n", 0.000001 * (GetTimeMicros() - pnode->nPingUsecStart));
+            pnode->fDisconnect = true;
+        }
+    }
+}
+
+#ifdef USE_EPOLL
+// What is left to do on a ready socket
+static const int SOCKET_RECV = 1;
+static const int SOCKET_SEND = 2;
+static const int SOCKET_RECV_DEFERRED = 4; // until the send queue drains
+// Chunks read from one socket before the others get their turn
+static const int SOCKET_RECV_CHUNKS = 4;
+// Milliseconds between disconnect and inactivity sweeps
+static const int SOCKET_HOUSEKEEPING_INTERVAL = 200;
+
+// Do what is left on a ready socket; returns what still is
+static int SocketServiceNode(CNode* pnode, int nReady)
+{
+    if (pnode->hSocket == INVALID_SOCKET)
+        return 0;
+
+    {
+        TRY_LOCK(pnode->cs_vSend, lockSend);
+        if (!lockSend)
+            return nReady;
+        if ((nReady & SOCKET_SEND) && !pnode->vSendMsg.empty())
+            SocketSendData(pnode);
+        // do not read, if draining write queue
+        if (!pnode->vSendMsg.empty())
+            return (nReady & (SOCKET_RECV | SOCKET_RECV_DEFERRED)) ? SOCKET_RECV_DEFERRED : 0;
+    }
+
+    if (nReady & (SOCKET_RECV | SOCKET_RECV_DEFERRED))
+    {
+        TRY_LOCK(pnode->cs_vRecvMsg, lockRecv);
+        if (!lockRecv)
+            return SOCKET_RECV;
+        // Readiness is edge-triggered, so read until the socket runs dry
+        for (int i = 0; i < SOCKET_RECV_CHUNKS; i++)
+            if (!SocketRecvData(pnode))
+                return 0;
+        return SOCKET_RECV;
+    }
+    return 0;
+}
+
+static void ThreadSocketEvents()
+{
+    static const int MAX_EVENTS = 256;
+    struct epoll_event events[MAX_EVENTS];
+    // Ready nodes not served in full, e.g. because another thread held
+    // their lock. Each holds a reference so it is not deleted meanwhile.
+    map<CNode*, int> mapReady;
+    int64_t nNextHousekeeping = 0;
+
+    while (true)
+    {
+        int64_t nNow = GetTimeMillis();
+        if (nNow >= nNextHousekeeping)
+        {
+            DisconnectNodes();
+            {
+                LOCK(cs_vNodes);
+                BOOST_FOREACH(CNode* pnode, vNodes)
+                    InactivityCheck(pnode);
+            }
+            nNextHousekeeping = nNow + SOCKET_HOUSEKEEPING_INTERVAL;
+        }
+
+        // Sleep until a socket is ready, or only briefly if one still is
+        int nTimeout = nNextHousekeeping - nNow;
+        for (map<CNode*, int>::iterator it = mapReady.begin(); it != mapReady.end(); it++)
+            if (it->second & (SOCKET_RECV | SOCKET_SEND))
+                nTimeout = 1;
+        int nEvents = epoll_wait(hSocketEvents, events, MAX_EVENTS, nTimeout);
+        boost::this_thread::interruption_point();
+        if (nEvents < 0)
         {
-            nPrevI2PNodeCount = nI2PNodeCount;
-            uiInterface.NotifyNumI2PConnectionsChanged(nI2PNodeCount);
+            if (errno != EINTR)
+            {
+                LogPrintf("socket epoll_wait error %d\n", errno);
+                MilliSleep(50);
+            }
+            nEvents = 0;
         }
+
+        vector<CNode*> vNodesNew;
+        for (int i = 0; i < nEvents; i++)
+        {
+            CNode* pnode = (CNode*)events[i].data.ptr;
+            if (pnode == NULL)
+            {
+                // Accept new connections
+                BOOST_FOREACH(SOCKET hListenSocket, vhListenSocket)
+                    if (hListenSocket != INVALID_SOCKET)
+                        while (AcceptConnection(hListenSocket));
+                continue;
+            }
+
+            int nReady = 0;
+            if (events[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR))
+                nReady |= SOCKET_RECV;
+            if (events[i].events & EPOLLOUT)
+                nReady |= SOCKET_SEND;
+            map<CNode*, int>::iterator it = mapReady.find(pnode);
+            if (it == mapReady.end())
+            {
+                mapReady.insert(make_pair(pnode, nReady));
+                vNodesNew.push_back(pnode);
+            }
+            else
+                it->second |= nReady;
+        }
+        if (!vNodesNew.empty())
+        {
+            LOCK(cs_vNodes);
+            BOOST_FOREACH(CNode* pnode, vNodesNew)
+                pnode->AddRef();
+        }
+
+        //
+        // Service each ready socket
+        //
+        vector<CNode*> vNodesDone;
+        map<CNode*, int>::iterator it = mapReady.begin();
+        while (it != mapReady.end())
+        {
+            boost::this_thread::interruption_point();
+
+            it->second = SocketServiceNode(it->first, it->second);
+            if (it->second == 0)
+            {
+                vNodesDone.push_back(it->first);
+                mapReady.erase(it++);
+            }
+            else
+                it++;
+        }
+        if (!vNodesDone.empty())
+        {
+            LOCK(cs_vNodes);
+            BOOST_FOREACH(CNode* pnode, vNodesDone)
+                pnode->Release();
+        }
+    }
+}
 #endif
 
+void ThreadSocketHandler()
+{
+#ifdef USE_EPOLL
+    if (hSocketEvents != -1)
+    {
+        ThreadSocketEvents();
+        return;
+    }
+#endif
+
+    while (true)
+    {
+        DisconnectNodes();
+
         //
         // Find which sockets have data to receive
         //
@@ -930,50 +1293,7 @@ void ThreadSocketHandler()
         //
         BOOST_FOREACH(SOCKET hListenSocket, vhListenSocket)
         if (hListenSocket != INVALID_SOCKET && FD_ISSET(hListenSocket, &fdsetRecv))
-        {
-            struct sockaddr_storage sockaddr;
-            socklen_t len = sizeof(sockaddr);
-            SOCKET hSocket = accept(hListenSocket, (struct sockaddr*)&sockaddr, &len);
-            CAddress addr;
-            int nInbound = 0;
-
-            if (hSocket != INVALID_SOCKET)
-                if (!addr.SetSockAddr((const struct sockaddr*)&sockaddr))
-                    LogPrintf("Warning: Unknown socket family\n");
-
-            {
-                LOCK(cs_vNodes);
-                BOOST_FOREACH(CNode* pnode, vNodes)
-                    if (pnode->fInbound)
-                        nInbound++;
-            }
-
-            if (hSocket == INVALID_SOCKET)
-            {
-                int nErr = WSAGetLastError();
-                if (nErr != WSAEWOULDBLOCK)
-                    LogPrintf("socket error accept failed: %d\n", nErr);
-            }
-            else if (nInbound >= GetArg("-maxconnections", 200) - MAX_OUTBOUND_CONNECTIONS)
-            {
-                closesocket(hSocket);
-            }
-            else if (CNode::IsBanned(addr))
-            {
-                LogPrintf("connection from %s dropped (banned)\n", addr.ToString());
-                closesocket(hSocket);
-            }
-            else
-            {
-                LogPrint("net", "accepted connection %s\n", addr.ToString());
-                CNode* pnode = new CNode(hSocket, addr, "", true);
-                pnode->AddRef();
-                {
-                    LOCK(cs_vNodes);
-                    vNodes.push_back(pnode);
-                }
-            }
-        }
+            AcceptConnection(hListenSocket);
 
 #ifdef USE_NATIVE_I2P
         //
@@ -1066,44 +1386,7 @@ void ThreadSocketHandler()
             {
                 TRY_LOCK(pnode->cs_vRecvMsg, lockRecv);
                 if (lockRecv)
-                {
-                    if (pnode->GetTotalRecvSize() > ReceiveFloodSize()) {
-                        if (!pnode->fDisconnect)
-                            LogPrintf("socket recv flood control disconnect (%u bytes)\n", pnode->GetTotalRecvSize());
-                        pnode->CloseSocketDisconnect();
-                    }
-                    else {
-                        // typical socket buffer is 8K-64K
-                        char pchBuf[0x10000];
-                        int nBytes = recv(pnode->hSocket, pchBuf, sizeof(pchBuf), MSG_DONTWAIT);
-                        if (nBytes > 0)
-                        {
-                            if (!pnode->ReceiveMsgBytes(pchBuf, nBytes))
-                                pnode->CloseSocketDisconnect();
-                            pnode->nLastRecv = GetTime();
-                            pnode->nRecvBytes += nBytes;
-                            pnode->RecordBytesRecv(nBytes);
-                        }
-                        else if (nBytes == 0)
-                        {
-                            // socket closed gracefully
-                            if (!pnode->fDisconnect)
-                                LogPrint("net", "socket closed\n");
-                            pnode->CloseSocketDisconnect();
-                        }
-                        else if (nBytes < 0)
-                        {
-                            // error
-                            int nErr = WSAGetLastError();
-                            if (nErr != WSAEWOULDBLOCK && nErr != WSAEMSGSIZE && nErr != WSAEINTR && nErr != WSAEINPROGRESS)
-                            {
-                                if (!pnode->fDisconnect)
-                                    LogPrintf("socket recv error %d\n", nErr);
-                                pnode->CloseSocketDisconnect();
-                            }
-                        }
-                    }
-                }
+                    SocketRecvData(pnode);
             }
 
             //
@@ -1121,25 +1404,7 @@ void ThreadSocketHandler()
             //
             // Inactivity checking
             //
-            int64_t nTime = GetTime();
-            if (nTime - pnode->nTimeConnected > 60)
-            {
-                if (pnode->nLastRecv == 0 || pnode->nLastSend == 0)
-                {
-                    LogPrint("net", "socket no message in first 60 seconds, %d %d\n", pnode->nLastRecv != 0, pnode->nLastSend != 0);
-                    pnode->fDisconnect = true;
-                }
-                else if (nTime - pnode->nLastSend > TIMEOUT_INTERVAL)
-                {
-                    LogPrintf("socket sending timeout: %ds\n", nTime - pnode->nLastSend);
-                    pnode->fDisconnect = true;
-                }
-                else if (pnode->nPingNonceSent && pnode->nPingUsecStart + TIMEOUT_INTERVAL * 1000000 < GetTimeMicros())
-                {
-                    LogPrintf("ping timeout: %fs\n", 0.000001 * (GetTimeMicros() - pnode->nPingUsecStart));
-                    pnode->fDisconnect = true;
-                }
-            }
+            InactivityCheck(pnode);
         }
         {
             LOCK(cs_vNodes);
@@ -1598,6 +1863,99 @@ void static StartSync(const vector<CNode*> &vNodes) {
     }
 }
 
+static unsigned int LatencyBucket(int64_t nMicros)
+{
+    unsigned int nBucket = 0;
+    while (nBucket < MESSAGE_LATENCY_BUCKETS - 1 && nMicros >= ((int64_t)1 << nBucket))
+        nBucket++;
+    return nBucket;
+}
+
+void CMessageLatency::Add(int64_t nWait, int64_t nProcess)
+{
+    nCount++;
+    nWaitTotal += nWait;
+    nProcessTotal += nProcess;
+    nProcessMax = max(nProcessMax, nProcess);
+    vWait[LatencyBucket(nWait)]++;
+    vProcess[LatencyBucket(nProcess)]++;
+}
+
+void RecordMessageLatency(const string& strCommand, int64_t nWait, int64_t nProcess)
+{
+    LOCK(cs_mapMessageLatency);
+    map<string, CMessageLatency>::iterator it = mapMessageLatency.find(strCommand);
+    if (it == mapMessageLatency.end())
+    {
+        if (mapMessageLatency.size() >= MAX_MESSAGE_LATENCY_COMMANDS)
+            it = mapMessageLatency.insert(make_pair(string("*other*"), CMessageLatency())).first;
+        else
+            it = mapMessageLatency.insert(make_pair(strCommand, CMessageLatency())).first;
+    }
+    it->second.Add(max((int64_t)0, nWait), nProcess);
+}
+
+void GetMessageLatency(map<string, CMessageLatency>& mapLatency)
+{
+    LOCK(cs_mapMessageLatency);
+    mapLatency = mapMessageLatency;
+}
+
+// requires LOCK(cs_vRecvMsg)
+static bool NodeHasConcurrentWork(CNode* pnode)
+{
+    if (nMessageWorkers == 0 || pnode->fDisconnect)
+        return false;
+    boost::optional<bool> fConcurrent = n_signals.CanProcessConcurrently(pnode);
+    return fConcurrent && *fConcurrent;
+}
+
+// Process the messages of one node after another, for as long as they may
+// run off the main message handler. Messages of a node stay in order since
+// whoever holds its cs_vRecvMsg only ever processes the first one.
+static void ThreadMessageWorker()
+{
+    SetThreadPriority(THREAD_PRIORITY_BELOW_NORMAL);
+    while (true)
+    {
+        CNode* pnode;
+        {
+            boost::unique_lock<boost::mutex> lock(csMessageWork);
+            while (vMessageWork.empty())
+                condMessageWork.wait(lock);
+            pnode = vMessageWork.front();
+            vMessageWork.pop_front();
+        }
+
+        bool fMore = false;
+        {
+            LOCK(pnode->cs_vRecvMsg);
+            for (int i = 0; i < MESSAGE_WORK_BATCH && NodeHasConcurrentWork(pnode); i++)
+            {
+                if (!n_signals.ProcessMessages(pnode))
+                    pnode->CloseSocketDisconnect();
+                boost::this_thread::interruption_point();
+            }
+            fMore = NodeHasConcurrentWork(pnode);
+        }
+
+        {
+            boost::unique_lock<boost::mutex> lock(csMessageWork);
+            if (fMore)
+                vMessageWork.push_back(pnode);
+            else
+                setMessageWork.erase(pnode);
+        }
+        if (!fMore)
+        {
+            LOCK(cs_vNodes);
+            pnode->Release();
+            // The main message handler may have work for it now
+            messageHandlerCondition.notify_one();
+        }
+    }
+}
+
 void ThreadMessageHandler()
 {
     boost::mutex condition_mutex;
@@ -1628,6 +1986,7 @@ void ThreadMessageHandler()
             pnodeTrickle = vNodesCopy[GetRand(vNodesCopy.size())];
 
         bool fSleep = true;
+        vector<CNode*> vNodesWork;
 
         BOOST_FOREACH(CNode* pnode, vNodesCopy)
         {
@@ -1639,10 +1998,13 @@ void ThreadMessageHandler()
                 TRY_LOCK(pnode->cs_vRecvMsg, lockRecv);
                 if (lockRecv)
                 {
-                    if (!n_signals.ProcessMessages(pnode))
+                    if (!NodeHasConcurrentWork(pnode) && !n_signals.ProcessMessages(pnode))
                         pnode->CloseSocketDisconnect();
 
-                    if (pnode->nSendSize < SendBufferSize())
+                    // Leave what does not need cs_main to the workers
+                    if (NodeHasConcurrentWork(pnode))
+                        vNodesWork.push_back(pnode);
+                    else if (pnode->nSendSize < SendBufferSize())
                     {
                         if (!pnode->vRecvGetData.empty() || (!pnode->vRecvMsg.empty() && pnode->vRecvMsg[0].complete()))
                         {
@@ -1662,6 +2024,22 @@ void ThreadMessageHandler()
             boost::this_thread::interruption_point();
         }
 
+        if (!vNodesWork.empty())
+        {
+            boost::unique_lock<boost::mutex> lockWork(csMessageWork);
+            BOOST_FOREACH(CNode* pnode, vNodesWork)
+            {
+                if (!setMessageWork.insert(pnode).second)
+                    continue;
+                {
+                    LOCK(cs_vNodes);
+                    pnode->AddRef();
+                }
+                vMessageWork.push_back(pnode);
+                condMessageWork.notify_one();
+            }
+        }
+
         {
             LOCK(cs_vNodes);
             BOOST_FOREACH(CNode* pnode, vNodesCopy)
@@ -1887,6 +2265,11 @@ void StartNode(boost::thread_group& threadGroup)
 
     Discover(threadGroup);
 
+#ifdef USE_EPOLL
+    if (hSocketEvents == -1)
+        SocketEventsInit();
+#endif
+
     //
     // Start threads
     //
@@ -1911,6 +2294,11 @@ void StartNode(boost::thread_group& threadGroup)
     // Process messages
     threadGroup.create_thread(boost::bind(&TraceThread<void (*)()>, "msghand", &ThreadMessageHandler));
 
+    // Process messages that do not need the main message handler, for different peers at once
+    nMessageWorkers = max(0, min(MAX_MESSAGE_WORKERS, (int)GetArg("-msgthreads", DEFAULT_MESSAGE_WORKERS)));
+    for (int i = 0; i < nMessageWorkers; i++)
+        threadGroup.create_thread(boost::bind(&TraceThread<void (*)()>, "msgwork", &ThreadMessageWorker));
+
     // Dump network addresses
     threadGroup.create_thread(boost::bind(&LoopForever<void (*)()>, "dumpaddr", &DumpAddresses, DUMP_ADDRESSES_INTERVAL * 1000));
 }
@@ -1951,6 +2339,11 @@ public:
                     printf("closesocket(hI2PListenSocket) failed with error %d\n", WSAGetLastError());
 #endif
 
+#ifdef USE_EPOLL
+        if (hSocketEvents != -1)
+            close(hSocketEvents);
+#endif
+
 #ifdef WIN32
         // Shutdown Windows Sockets
         WSACleanup();
@@ -54,6 +54,37 @@ static const bool DEFAULT_UPNP = USE_UPNP;
 static const bool DEFAULT_UPNP = false;
 #endif
 
+/** -msgthreads default: threads processing messages off the main message handler */
+static const int DEFAULT_MESSAGE_WORKERS = 2;
+/** Maximum for -msgthreads */
+static const int MAX_MESSAGE_WORKERS = 16;
+
+/** Buckets of the message latency histograms. Bucket i counts latencies under
+ *  2^i microseconds that no lower bucket took; the last one also takes the rest. */
+static const unsigned int MESSAGE_LATENCY_BUCKETS = 24;
+
+/** How long the received messages of one command waited and took to process. */
+struct CMessageLatency
+{
+    uint64_t nCount;
+    int64_t nWaitTotal;    // microseconds from receipt until processing started
+    int64_t nProcessTotal; // microseconds spent processing
+    int64_t nProcessMax;
+    uint64_t vWait[MESSAGE_LATENCY_BUCKETS];
+    uint64_t vProcess[MESSAGE_LATENCY_BUCKETS];
+
+    CMessageLatency() : nCount(0), nWaitTotal(0), nProcessTotal(0), nProcessMax(0)
+    {
+        for (unsigned int i = 0; i < MESSAGE_LATENCY_BUCKETS; i++)
+            vWait[i] = vProcess[i] = 0;
+    }
+
+    void Add(int64_t nWait, int64_t nProcess);
+};
+
+void RecordMessageLatency(const std::string& strCommand, int64_t nWait, int64_t nProcess);
+void GetMessageLatency(std::map<std::string, CMessageLatency>& mapLatency);
+
 inline unsigned int ReceiveFloodSize() { return 1000*GetArg("-maxreceivebuffer", 5*1000); }
 inline unsigned int SendBufferSize() { return 1000*GetArg("-maxsendbuffer", 1*1000); }
 
@@ -79,6 +110,8 @@ struct CNodeSignals
 {
     boost::signals2::signal<int ()> GetHeight;
     boost::signals2::signal<bool (CNode*)> ProcessMessages;
+    // Whether the next message of a node may be processed on a message worker thread
+    boost::signals2::signal<bool (CNode*)> CanProcessConcurrently;
     boost::signals2::signal<bool (CNode*, bool)> SendMessages;
     boost::signals2::signal<void (NodeId, const CNode*)> InitializeNode;
     boost::signals2::signal<void (NodeId)> FinalizeNode;
@@ -252,6 +285,7 @@ public:
     uint64_t nSendBytes;
     std::deque<CSerializeData> vSendMsg;
     CCriticalSection cs_vSend;
+    bool fWatchSend; // socket handler is waiting for the socket to become writable (under cs_vSend)
 
     std::deque<CInv> vRecvGetData;
     std::deque<CNetMessage> vRecvMsg;
@@ -363,6 +397,7 @@ public:
         nRefCount = 0;
         nSendSize = 0;
         nSendOffset = 0;
+        fWatchSend = false;
         hashContinue = 0;
         pindexLastGetBlocksBegin = 0;
         hashLastGetBlocksEnd = 0;
@@ -258,7 +258,7 @@ public:
     bool AcceptBlock();
     bool SignBlock(CWallet& keystore, CAmount nFees);
     bool CheckBlockSignature() const;
-    void RebuildAddressIndex(CTxDB& txdb);
+    void RebuildAddressIndex(CTxDB& txdb, int nHeight);
 
 private:
     bool SetBestChainInner(CTxDB& txdb, CBlockIndex *pindexNew);
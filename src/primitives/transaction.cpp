@@ -5,8 +5,52 @@
 
 #include "primitives/transaction.h"
 
-CTransaction::CTransaction(const CMutableTransaction &tx) : nVersion(tx.nVersion), nTime(tx.nTime), vin(tx.vin), vout(tx.vout), nLockTime(tx.nLockTime)
+bool fCountTxHashes = false;
+CTxHashCounts txHashCounts;
+
+void CTransaction::UpdateHash() const
+{
+    if (fCountTxHashes)
+        txHashCounts.nComputed++;
+    *const_cast<uint256*>(&hash) = SerializeHash(*this);
+}
+
+// The null transaction is only ever a placeholder for deserialization or
+// assignment, which set the hash; like upstream, it is not hashed itself.
+CTransaction::CTransaction() : hash(0), nVersion(CTransaction::CURRENT_VERSION), nTime(GetAdjustedTime()), vin(), vout(), nLockTime(0), nDoS(0)
+{
+}
+
+CTransaction::CTransaction(int nVersion, unsigned int nTime, const std::vector<CTxIn>& vin, const std::vector<CTxOut>& vout, unsigned int nLockTime)
+    : nVersion(nVersion), nTime(nTime), vin(vin), vout(vout), nLockTime(nLockTime), nDoS(0)
 {
+    UpdateHash();
+}
+
+CTransaction::CTransaction(const CMutableTransaction &tx) : nVersion(tx.nVersion), nTime(tx.nTime), vin(tx.vin), vout(tx.vout), nLockTime(tx.nLockTime), nDoS(tx.nDoS)
+{
+    UpdateHash();
+}
+
+CTransaction::CTransaction(const CTransaction &tx) : hash(tx.hash), nVersion(tx.nVersion), nTime(tx.nTime), vin(tx.vin), vout(tx.vout), nLockTime(tx.nLockTime), nDoS(tx.nDoS)
+{
+}
+
+CTransaction& CTransaction::operator=(const CTransaction &tx)
+{
+    *const_cast<int*>(&nVersion) = tx.nVersion;
+    *const_cast<unsigned int*>(&nTime) = tx.nTime;
+    *const_cast<std::vector<CTxIn>*>(&vin) = tx.vin;
+    *const_cast<std::vector<CTxOut>*>(&vout) = tx.vout;
+    *const_cast<unsigned int*>(&nLockTime) = tx.nLockTime;
+    *const_cast<uint256*>(&hash) = tx.hash;
+    nDoS = tx.nDoS;
+    return *this;
+}
+
+void CTransaction::SetNull()
+{
+    *this = CTransaction();
 }
 
 std::string CTransaction::ToString() const
@@ -28,6 +72,13 @@ std::string CTransaction::ToString() const
 }
 
 double CTransaction::ComputePriority(double dPriorityInputs, unsigned int nTxSize) const
+{
+    nTxSize = CalculateModifiedSize(nTxSize);
+    if (nTxSize == 0) return 0.0;
+    return dPriorityInputs / nTxSize;
+}
+
+unsigned int CTransaction::CalculateModifiedSize(unsigned int nTxSize) const
 {
     // In order to avoid disincentivizing cleaning up the UTXO set we don't count
     // the constant overhead for each txin and up to 110 bytes of scriptSig (which
@@ -42,8 +93,7 @@ double CTransaction::ComputePriority(double dPriorityInputs, unsigned int nTxSiz
         if (nTxSize > offset)
             nTxSize -= offset;
     }
-    if (nTxSize == 0) return 0.0;
-    return dPriorityInputs / nTxSize;
+    return nTxSize;
 }
 
 bool CTransaction::CheckTransaction(CValidationState &state)
@@ -124,6 +174,10 @@ CMutableTransaction::CMutableTransaction(const CTransaction& tx) :
 
 uint256 CMutableTransaction::GetHash() const
 {
+    if (fCountTxHashes) {
+        txHashCounts.nComputed++;
+        txHashCounts.nLookups++;
+    }
     return SerializeHash(*this);
 }
 
@@ -250,65 +250,88 @@ public:
 };
 
 
+/// Txid hash counts for the benchmarks, kept only while fCountTxHashes is set
+/// (from a single thread). nComputed counts the transaction hashes computed;
+/// nLookups counts the txids asked for, each of which was a hash computation
+/// before CTransaction cached its txid.
+struct CTxHashCounts
+{
+    uint64_t nComputed;
+    uint64_t nLookups;
+};
+extern bool fCountTxHashes;
+extern CTxHashCounts txHashCounts;
+
 /// The basic transaction that is broadcasted on the network and contained in
 /// blocks.  A transaction can contain multiple inputs and outputs.
+///
+/// CTransaction is immutable: its txid is computed once when it is built from
+/// a CMutableTransaction or deserialized, and GetHash() returns the cached
+/// value. Build or modify transactions through CMutableTransaction.
 class CTransaction
 {
+private:
+    /// Memory only.
+    const uint256 hash;
+    void UpdateHash() const;
+
 public:
     static const int CURRENT_VERSION=1;
-    int nVersion;
-    unsigned int nTime;
-    std::vector<CTxIn> vin;
-    std::vector<CTxOut> vout;
-    unsigned int nLockTime;
+
+    // The local variables are made const to prevent unintended modification
+    // without updating the cached hash value. However, CTransaction is not
+    // actually immutable; deserialization and assignment are implemented,
+    // and bypass the constness. This is safe, as they update the entire
+    // structure, including the hash.
+    const int nVersion;
+    const unsigned int nTime;
+    const std::vector<CTxIn> vin;
+    const std::vector<CTxOut> vout;
+    const unsigned int nLockTime;
 
     // Denial-of-service detection:
     mutable int nDoS;
     bool DoS(int nDoSIn, bool fIn) const { nDoS += nDoSIn; return fIn; }
 
-    CTransaction()
-    {
-        SetNull();
-    }
+    /// Construct a CTransaction that qualifies as IsNull()
+    CTransaction();
 
-    CTransaction(int nVersion, unsigned int nTime, const std::vector<CTxIn>& vin, const std::vector<CTxOut>& vout, unsigned int nLockTime)
-        : nVersion(nVersion), nTime(nTime), vin(vin), vout(vout), nLockTime(nLockTime), nDoS(0)
-    {
-    }
+    CTransaction(int nVersion, unsigned int nTime, const std::vector<CTxIn>& vin, const std::vector<CTxOut>& vout, unsigned int nLockTime);
 
     /// Convert a CMutableTransaction into a CTransaction.
     CTransaction(const CMutableTransaction &tx);
 
+    /// Copy the transaction along with its cached hash.
+    CTransaction(const CTransaction &tx);
+    CTransaction& operator=(const CTransaction& tx);
+
     ADD_SERIALIZE_METHODS;
 
     template <typename Stream, typename Operation>
     inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion) {
-        READWRITE(this->nVersion);
+        READWRITE(*const_cast<int*>(&this->nVersion));
         nVersion = this->nVersion;
-        READWRITE(nTime);
-        READWRITE(vin);
-        READWRITE(vout);
-        READWRITE(nLockTime);
+        READWRITE(*const_cast<unsigned int*>(&nTime));
+        READWRITE(*const_cast<std::vector<CTxIn>*>(&vin));
+        READWRITE(*const_cast<std::vector<CTxOut>*>(&vout));
+        READWRITE(*const_cast<unsigned int*>(&nLockTime));
+        if (ser_action.ForRead())
+            UpdateHash();
     }
 
-    void SetNull()
-    {
-        nVersion = CTransaction::CURRENT_VERSION;
-        nTime = GetAdjustedTime();
-        vin.clear();
-        vout.clear();
-        nLockTime = 0;
-        nDoS = 0;  // Denial-of-service prevention
-    }
+    /// Reset to an empty transaction stamped with the current adjusted time.
+    void SetNull();
 
     bool IsNull() const
     {
         return (vin.empty() && vout.empty());
     }
 
-    uint256 GetHash() const
+    const uint256& GetHash() const
     {
-        return SerializeHash(*this); //TODO (Amir): Use a cached result (need member variables to const).
+        if (fCountTxHashes)
+            txHashCounts.nLookups++;
+        return hash;
     }
 
     bool IsCoinBase() const
@@ -326,20 +349,17 @@ public:
     CAmount GetValueOut() const;
     // Compute priority, given priority of inputs and (optionally) tx size
     double ComputePriority(double dPriorityInputs, unsigned int nTxSize=0) const;
+    // Compute modified tx size for priority calculation (optionally given tx size)
+    unsigned int CalculateModifiedSize(unsigned int nTxSize=0) const;
 
     friend bool operator==(const CTransaction& a, const CTransaction& b)
     {
-        //TODO (Amir): Use a cached hash (need member variables to const).
-        return (a.nVersion  == b.nVersion &&
-                a.nTime     == b.nTime &&
-                a.vin       == b.vin &&
-                a.vout      == b.vout &&
-                a.nLockTime == b.nLockTime);
+        return a.hash == b.hash;
     }
 
     friend bool operator!=(const CTransaction& a, const CTransaction& b)
     {
-        return !(a == b);
+        return a.hash != b.hash;
     }
 
     bool CheckTransaction(CValidationState &state);
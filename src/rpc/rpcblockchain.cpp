@@ -8,6 +8,7 @@
 #include "main.h"
 #include "kernel.h"
 #include "checkpoints.h"
+#include "script/sigcache.h"
 
 using namespace json_spirit;
 using namespace std;
@@ -206,9 +207,45 @@ Value getdifficulty(const Array& params, bool fHelp)
 }
 
 
-Value getrawmempool(const Array& params, bool fHelp)
+Value getsigcacheinfo(const Array& params, bool fHelp)
 {
     if (fHelp || params.size() != 0)
+        throw runtime_error(
+            "getsigcacheinfo\n"
+            "\nReturns the size and hit counters of the signature cache.\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"bytes\" : n,       (numeric) memory allocated for the cache\n"
+            "  \"capacity\" : n,    (numeric) number of signatures the cache can hold\n"
+            "  \"lookups\" : n,     (numeric) signature checks that consulted the cache\n"
+            "  \"hits\" : n,        (numeric) lookups that skipped ECDSA verification\n"
+            "  \"hitrate\" : x.xxx, (numeric) hits / lookups\n"
+            "  \"inserts\" : n,     (numeric) verified signatures added to the cache\n"
+            "  \"evictions\" : n    (numeric) signatures dropped to make room\n"
+            "}\n"
+            "\nExamples\n"
+            + HelpExampleCli("getsigcacheinfo", "")
+            + HelpExampleRpc("getsigcacheinfo", "")
+        );
+
+    CSignatureCacheStats stats;
+    GetSignatureCache().GetStats(stats);
+
+    Object obj;
+    obj.push_back(Pair("bytes",     (uint64_t)stats.nBytes));
+    obj.push_back(Pair("capacity",  (uint64_t)stats.nCapacity));
+    obj.push_back(Pair("lookups",   (uint64_t)stats.nLookups));
+    obj.push_back(Pair("hits",      (uint64_t)stats.nHits));
+    obj.push_back(Pair("hitrate",   stats.nLookups ? (double)stats.nHits / stats.nLookups : 0.0));
+    obj.push_back(Pair("inserts",   (uint64_t)stats.nInserts));
+    obj.push_back(Pair("evictions", (uint64_t)stats.nEvictions));
+    return obj;
+}
+
+
+Value getrawmempool(const Array& params, bool fHelp)
+{
+    if (fHelp || params.size() > 1)
         throw runtime_error(
             "getrawmempool ( verbose )\n"
             "\nReturns all transaction ids in memory pool as a json array of string transaction ids.\n"
@@ -238,6 +275,36 @@ Value getrawmempool(const Array& params, bool fHelp)
             + HelpExampleRpc("getrawmempool", "true")
         );
 
+    bool fVerbose = false;
+    if (params.size() > 0)
+        fVerbose = params[0].get_bool();
+
+    if (fVerbose)
+    {
+        LOCK(mempool.cs);
+        Object o;
+        BOOST_FOREACH(const CTxMemPoolEntry& e, mempool.mapTx)
+        {
+            Object info;
+            info.push_back(Pair("size", (int)e.GetTxSize()));
+            info.push_back(Pair("fee", ValueFromAmount(e.GetFee())));
+            info.push_back(Pair("time", e.GetTime()));
+            info.push_back(Pair("height", (int)e.GetHeight()));
+            info.push_back(Pair("startingpriority", e.GetPriority(e.GetHeight())));
+            info.push_back(Pair("currentpriority", e.GetPriority(nBestHeight)));
+            set<string> setDepends;
+            BOOST_FOREACH(const CTxIn& txin, e.GetTx().vin)
+            {
+                if (mempool.mapTx.count(txin.prevout.hash))
+                    setDepends.insert(txin.prevout.hash.ToString());
+            }
+            Array depends(setDepends.begin(), setDepends.end());
+            info.push_back(Pair("depends", depends));
+            o.push_back(Pair(e.GetHash().ToString(), info));
+        }
+        return o;
+    }
+
     vector<uint256> vtxid;
     mempool.queryHashes(vtxid);
 
@@ -267,7 +334,7 @@ Value getblockhash(const Array& params, bool fHelp)
     if (nHeight < 0 || nHeight > nBestHeight)
         throw runtime_error("Block number out of range.");
 
-    CBlockIndex* pblockindex = FindBlockByHeight(nHeight);
+    CBlockIndex* pblockindex = chainActive[nHeight];
     return pblockindex->phashBlock->GetHex();
 }
 
@@ -345,13 +412,7 @@ Value getblockbynumber(const Array& params, bool fHelp)
         throw runtime_error("Block number out of range.");
 
     CBlock block;
-    CBlockIndex* pblockindex = mapBlockIndex[hashBestChain];
-    while (pblockindex->nHeight > nHeight)
-        pblockindex = pblockindex->pprev;
-
-    uint256 hash = *pblockindex->phashBlock;
-
-    pblockindex = mapBlockIndex[hash];
+    CBlockIndex* pblockindex = chainActive[nHeight];
     block.ReadFromDisk(pblockindex, true);
 
     return blockToJSON(block, pblockindex, params.size() > 1 ? params[1].get_bool() : false);
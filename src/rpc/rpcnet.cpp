@@ -368,6 +368,55 @@ Value getnettotals(const Array& params, bool fHelp)
     return obj;
 }
 
+Value getmessagelatency(const Array& params, bool fHelp)
+{
+    if (fHelp || params.size() > 0)
+        throw runtime_error(
+            "getmessagelatency\n"
+            "\nReturns how long received messages waited and took to process, per command.\n"
+            "Histogram bucket i counts messages under 2^i microseconds that no lower bucket took,\n"
+            "the last bucket also takes the rest.\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"command\": {                (json object) one per received command\n"
+            "    \"count\": n,               (numeric) messages processed\n"
+            "    \"waitavg\": n,             (numeric) average microseconds from receipt to processing\n"
+            "    \"processavg\": n,          (numeric) average microseconds of processing\n"
+            "    \"processmax\": n,          (numeric) longest processing in microseconds\n"
+            "    \"wait\": [ n, ... ],       (array) histogram of the wait\n"
+            "    \"process\": [ n, ... ]     (array) histogram of the processing\n"
+            "  }, ...\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getmessagelatency", "")
+            + HelpExampleRpc("getmessagelatency", "")
+       );
+
+    map<string, CMessageLatency> mapLatency;
+    GetMessageLatency(mapLatency);
+
+    Object obj;
+    for (map<string, CMessageLatency>::const_iterator it = mapLatency.begin(); it != mapLatency.end(); ++it)
+    {
+        const CMessageLatency& latency = it->second;
+        Object entry;
+        Array wait, process;
+        for (unsigned int i = 0; i < MESSAGE_LATENCY_BUCKETS; i++)
+        {
+            wait.push_back((uint64_t)latency.vWait[i]);
+            process.push_back((uint64_t)latency.vProcess[i]);
+        }
+        entry.push_back(Pair("count", (uint64_t)latency.nCount));
+        entry.push_back(Pair("waitavg", latency.nCount ? latency.nWaitTotal / (int64_t)latency.nCount : 0));
+        entry.push_back(Pair("processavg", latency.nCount ? latency.nProcessTotal / (int64_t)latency.nCount : 0));
+        entry.push_back(Pair("processmax", latency.nProcessMax));
+        entry.push_back(Pair("wait", wait));
+        entry.push_back(Pair("process", process));
+        obj.push_back(Pair(it->first, entry));
+    }
+    return obj;
+}
+
 static Array GetNetworksInfo()
 {
     Array networks;
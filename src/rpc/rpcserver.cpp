@@ -246,9 +246,11 @@ static const CRPCCommand vRPCCommands[] =
     { "getaddednodeinfo",       &getaddednodeinfo,       true,      true,      false },
     { "ping",                   &ping,                   true,      false,     false },
     { "getnettotals",           &getnettotals,           true,      true,      false },
+    { "getmessagelatency",      &getmessagelatency,      true,      true,      false },
     { "getdifficulty",          &getdifficulty,          true,      false,     false },
     { "getinfo",                &getinfo,                true,      false,     false },
     { "getrawmempool",          &getrawmempool,          true,      false,     false },
+    { "getsigcacheinfo",        &getsigcacheinfo,        true,      false,     false },
     { "getblock",               &getblock,               false,     false,     false },
     { "getblockbynumber",       &getblockbynumber,       false,     false,     false },
     { "getblockhash",           &getblockhash,           false,     false,     false },
@@ -331,8 +333,10 @@ static const CRPCCommand vRPCCommands[] =
     { "importstealthaddress",   &importstealthaddress,   false,      false,    true},
     { "sendtostealthaddress",   &sendtostealthaddress,   false,      false,    true},
     { "scanforalltxns",         &scanforalltxns,         false,      false,    true},
+    { "getrescaninfo",          &getrescaninfo,          true,      true,      true },
     { "smsgenable",             &smsgenable,             false,     false,     false },
     { "smsgdisable",            &smsgdisable,            false,     false,     false },
+    { "smsggetinfo",            &smsggetinfo,            false,     false,     false },
     { "smsglocalkeys",          &smsglocalkeys,          false,     false,     false },
     { "smsgoptions",            &smsgoptions,            false,     false,     false },
     { "smsgscanchain",          &smsgscanchain,          false,     false,     false },
@@ -910,6 +914,11 @@ json_spirit::Value CRPCTable::execute(const std::string &strMethod, const json_s
         throw JSONRPCError(RPC_METHOD_NOT_FOUND, "Method not found (disabled)");
 #endif
 
+    // Only the progress of the startup rescan is available while loading
+    string strWarmupStatus;
+    if (RPCIsInWarmup(&strWarmupStatus) && strMethod != "getrescaninfo")
+        throw JSONRPCError(RPC_IN_WARMUP, strWarmupStatus);
+
     // Observe safe mode
     string strWarning = GetWarnings("rpc");
     if (strWarning != "" && !GetBoolArg("-disablesafemode", false) &&
@@ -58,6 +58,37 @@ Value smsgdisable(const Array& params, bool fHelp)
     return result;
 }
 
+Value smsggetinfo(const Array& params, bool fHelp)
+{
+    if (fHelp || params.size() != 0)
+        throw runtime_error(
+            "smsggetinfo \n"
+            "Display the state of secure messaging and how fast incoming messages are scanned.");
+    
+    Object result;
+    result.push_back(Pair("enabled", fSecMsgEnabled));
+    
+    {
+        LOCK(cs_smsg);
+        uint32_t nReceiveEnabled = 0;
+        for (std::vector<SecMsgAddress>::iterator it = smsgAddresses.begin(); it != smsgAddresses.end(); ++it)
+            if (it->fReceiveEnabled)
+                nReceiveEnabled++;
+        result.push_back(Pair("addresses", (int)smsgAddresses.size()));
+        result.push_back(Pair("receiving", (int)nReceiveEnabled));
+        result.push_back(Pair("buckets", (int)smsgBuckets.size()));
+    } // cs_smsg
+    
+    SecMsgScanStats stats = SecureMsgGetScanStats();
+    result.push_back(Pair("scanned", (uint64_t)stats.nMessages));
+    result.push_back(Pair("received", (uint64_t)stats.nReceived));
+    result.push_back(Pair("scantime", (double)stats.nTimeMicros / 1000000));
+    result.push_back(Pair("scanrate", stats.nTimeMicros > 0 ? (double)stats.nMessages * 1000000 / stats.nTimeMicros : 0.0));
+    result.push_back(Pair("scanthreads", stats.nThreads));
+    
+    return result;
+}
+
 Value smsgoptions(const Array& params, bool fHelp)
 {
     if (fHelp || params.size() > 3)
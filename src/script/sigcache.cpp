@@ -0,0 +1,215 @@
+// Copyright (c) 2009-2016 The Bitcoin Developers
+// Copyright (c) 2015-2016 Silk Network
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "script/sigcache.h"
+
+#include "pubkey.h"
+#include "util.h"
+
+#include <algorithm>
+#include <limits>
+
+#include <string.h>
+
+#include <boost/thread/once.hpp>
+
+using namespace std;
+
+static void EntryToKey(const uint256& entry, uint64_t k[4])
+{
+    memcpy(k, entry.begin(), 32);
+    // An all-zero key marks an empty slot
+    if (!(k[0] | k[1] | k[2] | k[3]))
+        k[0] = 1;
+}
+
+CSignatureCache::CSignatureCache(size_t nMaxBytes) : pbuckets(NULL), pshards(NULL), nBucketsPerShard(0)
+{
+    // The salt fills a whole SHA256 block so every entry starts from its midstate
+    unsigned char salt[64];
+    GetRandBytes(salt, 32);
+    memset(salt + 32, 0, 32);
+    hasherSalted.Write(salt, sizeof(salt));
+
+    pshards = new CShard[SHARDS];
+    for (unsigned int i = 0; i < SHARDS; i++) {
+        pshards[i].nRand = GetRand(std::numeric_limits<uint64_t>::max()) | 1;
+        pshards[i].nLookups = 0;
+        pshards[i].nHits = 0;
+        pshards[i].nInserts = 0;
+        pshards[i].nEvictions = 0;
+    }
+
+    nBucketsPerShard = nMaxBytes / sizeof(CBucket) / SHARDS;
+    if (nBucketsPerShard == 0)
+        return;
+    pbuckets = new CBucket[nBucketsPerShard * SHARDS];
+    for (size_t i = 0; i < nBucketsPerShard * SHARDS; i++) {
+        pbuckets[i].nSeq = 0;
+        for (unsigned int j = 0; j < SLOTS; j++)
+            for (unsigned int w = 0; w < 4; w++)
+                pbuckets[i].key[j][w] = 0;
+    }
+}
+
+CSignatureCache::~CSignatureCache()
+{
+    delete[] pbuckets;
+    delete[] pshards;
+}
+
+void CSignatureCache::ComputeEntry(uint256& entry, const uint256& hash, const std::vector<unsigned char>& vchSig, const CPubKey& pubkey) const
+{
+    CSHA256 hasher = hasherSalted;
+    hasher.Write(hash.begin(), 32).Write(pubkey.begin(), pubkey.size());
+    if (!vchSig.empty())
+        hasher.Write(&vchSig[0], vchSig.size());
+    hasher.Finalize(entry.begin());
+}
+
+void CSignatureCache::BucketsOf(const uint64_t k[4], size_t& nBucket1, size_t& nBucket2) const
+{
+    size_t nBase = ShardOf(k) * nBucketsPerShard;
+    nBucket1 = nBase + k[0] % nBucketsPerShard;
+    nBucket2 = nBase + k[1] % nBucketsPerShard;
+}
+
+bool CSignatureCache::BucketContains(const CBucket& bucket, const uint64_t k[4]) const
+{
+    uint32_t nSeq = bucket.nSeq.load(boost::memory_order_acquire);
+    if (nSeq & 1)
+        return false;
+    bool fFound = false;
+    for (unsigned int i = 0; i < SLOTS && !fFound; i++)
+        fFound = bucket.key[i][0].load(boost::memory_order_relaxed) == k[0] &&
+                 bucket.key[i][1].load(boost::memory_order_relaxed) == k[1] &&
+                 bucket.key[i][2].load(boost::memory_order_relaxed) == k[2] &&
+                 bucket.key[i][3].load(boost::memory_order_relaxed) == k[3];
+    // A writer got in between: what we read may be torn, so call it a miss
+    boost::atomic_thread_fence(boost::memory_order_acquire);
+    return fFound && bucket.nSeq.load(boost::memory_order_relaxed) == nSeq;
+}
+
+void CSignatureCache::SlotWrite(CBucket& bucket, unsigned int nSlot, const uint64_t k[4])
+{
+    uint32_t nSeq = bucket.nSeq.load(boost::memory_order_relaxed);
+    bucket.nSeq.store(nSeq + 1, boost::memory_order_relaxed);
+    boost::atomic_thread_fence(boost::memory_order_release);
+    for (unsigned int w = 0; w < 4; w++)
+        bucket.key[nSlot][w].store(k[w], boost::memory_order_relaxed);
+    bucket.nSeq.store(nSeq + 2, boost::memory_order_release);
+}
+
+bool CSignatureCache::BucketInsert(CBucket& bucket, const uint64_t k[4])
+{
+    for (unsigned int i = 0; i < SLOTS; i++) {
+        if (bucket.key[i][0].load(boost::memory_order_relaxed) == 0 &&
+            bucket.key[i][1].load(boost::memory_order_relaxed) == 0 &&
+            bucket.key[i][2].load(boost::memory_order_relaxed) == 0 &&
+            bucket.key[i][3].load(boost::memory_order_relaxed) == 0) {
+            SlotWrite(bucket, i, k);
+            return true;
+        }
+    }
+    return false;
+}
+
+bool CSignatureCache::Get(const uint256& entry)
+{
+    if (!pbuckets)
+        return false;
+    uint64_t k[4];
+    EntryToKey(entry, k);
+    size_t nBucket1, nBucket2;
+    BucketsOf(k, nBucket1, nBucket2);
+
+    CShard& shard = pshards[ShardOf(k)];
+    shard.nLookups.fetch_add(1, boost::memory_order_relaxed);
+    if (BucketContains(pbuckets[nBucket1], k) || BucketContains(pbuckets[nBucket2], k)) {
+        shard.nHits.fetch_add(1, boost::memory_order_relaxed);
+        return true;
+    }
+    return false;
+}
+
+void CSignatureCache::Set(const uint256& entry)
+{
+    if (!pbuckets)
+        return;
+    uint64_t k[4];
+    EntryToKey(entry, k);
+    size_t nBucket1, nBucket2;
+    BucketsOf(k, nBucket1, nBucket2);
+
+    CShard& shard = pshards[ShardOf(k)];
+    boost::mutex::scoped_lock lock(shard.cs);
+
+    if (BucketContains(pbuckets[nBucket1], k) || BucketContains(pbuckets[nBucket2], k))
+        return;
+    shard.nInserts.fetch_add(1, boost::memory_order_relaxed);
+    if (BucketInsert(pbuckets[nBucket1], k) || BucketInsert(pbuckets[nBucket2], k))
+        return;
+
+    // Both buckets are full: displace random entries to their other bucket.
+    // Random because that helps foil would-be DoS attackers who might try to
+    // pre-generate and re-use a set of valid signatures just-slightly-greater
+    // than our cache size.
+    uint64_t kCur[4] = { k[0], k[1], k[2], k[3] };
+    size_t nBucket = (shard.nRand & 1) ? nBucket1 : nBucket2;
+    for (unsigned int nKick = 0; nKick < MAX_KICKS; nKick++) {
+        shard.nRand ^= shard.nRand << 13;
+        shard.nRand ^= shard.nRand >> 7;
+        shard.nRand ^= shard.nRand << 17;
+        CBucket& bucket = pbuckets[nBucket];
+        unsigned int nSlot = (unsigned int)(shard.nRand >> 32) % SLOTS;
+
+        uint64_t kVictim[4];
+        for (unsigned int w = 0; w < 4; w++)
+            kVictim[w] = bucket.key[nSlot][w].load(boost::memory_order_relaxed);
+        SlotWrite(bucket, nSlot, kCur);
+        memcpy(kCur, kVictim, sizeof(kCur));
+
+        size_t nVictim1, nVictim2;
+        BucketsOf(kCur, nVictim1, nVictim2);
+        nBucket = (nVictim1 == nBucket) ? nVictim2 : nVictim1;
+        if (BucketInsert(pbuckets[nBucket], kCur))
+            return;
+    }
+    shard.nEvictions.fetch_add(1, boost::memory_order_relaxed);
+}
+
+void CSignatureCache::GetStats(CSignatureCacheStats& stats) const
+{
+    stats = CSignatureCacheStats();
+    stats.nBytes = (uint64_t)nBucketsPerShard * SHARDS * sizeof(CBucket);
+    stats.nCapacity = (uint64_t)nBucketsPerShard * SHARDS * SLOTS;
+    for (unsigned int i = 0; i < SHARDS; i++) {
+        stats.nLookups += pshards[i].nLookups.load(boost::memory_order_relaxed);
+        stats.nHits += pshards[i].nHits.load(boost::memory_order_relaxed);
+        stats.nInserts += pshards[i].nInserts.load(boost::memory_order_relaxed);
+        stats.nEvictions += pshards[i].nEvictions.load(boost::memory_order_relaxed);
+    }
+}
+
+static CSignatureCache* psignatureCache = NULL;
+static boost::once_flag signatureCacheOnce = BOOST_ONCE_INIT;
+
+static void CreateSignatureCache()
+{
+    int64_t nMaxMB = GetArg("-maxsigcachesize", DEFAULT_MAX_SIG_CACHE_SIZE);
+    nMaxMB = std::max((int64_t)0, std::min((int64_t)MAX_MAX_SIG_CACHE_SIZE, nMaxMB));
+    psignatureCache = new CSignatureCache((size_t)nMaxMB << 20);
+
+    CSignatureCacheStats stats;
+    psignatureCache->GetStats(stats);
+    LogPrintf("Using %u MiB for the signature cache, room for %u signatures\n",
+              (unsigned int)(stats.nBytes >> 20), (unsigned int)stats.nCapacity);
+}
+
+CSignatureCache& GetSignatureCache()
+{
+    boost::call_once(signatureCacheOnce, CreateSignatureCache);
+    return *psignatureCache;
+}
@@ -0,0 +1,108 @@
+// Copyright (c) 2009-2016 The Bitcoin Developers
+// Copyright (c) 2015-2016 Silk Network
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef DARKSILK_SCRIPT_SIGCACHE_H
+#define DARKSILK_SCRIPT_SIGCACHE_H
+
+#include "crypto/sha256.h"
+#include "uint256.h"
+
+#include <vector>
+
+#include <stdint.h>
+
+#include <boost/atomic.hpp>
+#include <boost/thread/mutex.hpp>
+
+class CPubKey;
+
+/** Default for -maxsigcachesize, in megabytes. */
+static const unsigned int DEFAULT_MAX_SIG_CACHE_SIZE = 32;
+/** Upper bound for -maxsigcachesize, in megabytes. */
+static const unsigned int MAX_MAX_SIG_CACHE_SIZE = 16384;
+
+/** Hit and size counters of a signature cache. */
+struct CSignatureCacheStats
+{
+    uint64_t nBytes;
+    uint64_t nCapacity;
+    uint64_t nLookups;
+    uint64_t nHits;
+    uint64_t nInserts;
+    uint64_t nEvictions;
+
+    CSignatureCacheStats() : nBytes(0), nCapacity(0), nLookups(0), nHits(0), nInserts(0), nEvictions(0) {}
+};
+
+/**
+ * Fixed-size cache of valid (signature hash, signature, public key) triples.
+ *
+ * Entries are salted SHA256 hashes of the triple, so they are uniformly
+ * distributed and cannot be aimed at a bucket by an attacker. Each entry can
+ * live in one of two buckets of its shard (bucketized cuckoo hashing); a full
+ * pair of buckets displaces a random entry to its other bucket, and after a
+ * few displacements the last one is evicted.
+ *
+ * Lookups take no lock: every bucket carries a sequence number that writers
+ * make odd while they change it, and a lookup that sees it change treats the
+ * bucket as a miss. Writers serialize on the mutex of their shard only.
+ */
+class CSignatureCache
+{
+public:
+    static const unsigned int SHARDS = 16;
+    static const unsigned int SLOTS = 4;
+    static const unsigned int MAX_KICKS = 8;
+
+    /** Allocate buckets for at most nMaxBytes; 0 disables the cache. */
+    CSignatureCache(size_t nMaxBytes);
+    ~CSignatureCache();
+
+    /** Compute the salted cache entry of a signature. */
+    void ComputeEntry(uint256& entry, const uint256& hash, const std::vector<unsigned char>& vchSig, const CPubKey& pubkey) const;
+
+    bool Get(const uint256& entry);
+    void Set(const uint256& entry);
+
+    void GetStats(CSignatureCacheStats& stats) const;
+
+private:
+    struct CBucket
+    {
+        boost::atomic<uint32_t> nSeq;
+        boost::atomic<uint64_t> key[SLOTS][4];
+    };
+
+    struct CShard
+    {
+        boost::mutex cs;
+        uint64_t nRand;
+        boost::atomic<uint64_t> nLookups;
+        boost::atomic<uint64_t> nHits;
+        boost::atomic<uint64_t> nInserts;
+        boost::atomic<uint64_t> nEvictions;
+        char padding[64]; // keep the counters of neighbouring shards apart
+    };
+
+    CSHA256 hasherSalted;
+    CBucket* pbuckets;
+    CShard* pshards;
+    size_t nBucketsPerShard;
+
+    CSignatureCache(const CSignatureCache&);
+    CSignatureCache& operator=(const CSignatureCache&);
+
+    unsigned int ShardOf(const uint64_t k[4]) const { return (unsigned int)(k[3] % SHARDS); }
+    void BucketsOf(const uint64_t k[4], size_t& nBucket1, size_t& nBucket2) const;
+
+    bool BucketContains(const CBucket& bucket, const uint64_t k[4]) const;
+    bool BucketInsert(CBucket& bucket, const uint64_t k[4]);
+    void SlotWrite(CBucket& bucket, unsigned int nSlot, const uint64_t k[4]);
+};
+
+/** The signature cache used by CheckSig, sized by -maxsigcachesize on first use. */
+CSignatureCache& GetSignatureCache();
+
+#endif // DARKSILK_SCRIPT_SIGCACHE_H
@@ -219,66 +219,23 @@ bool SecMsgDB::Open(const char* pszMode)
 };
 
 
-class SecMsgBatchScanner : public leveldb::WriteBatch::Handler
-{
-public:
-    std::string needle;
-    bool* deleted;
-    std::string* foundValue;
-    bool foundEntry;
-
-    SecMsgBatchScanner() : foundEntry(false) {}
-
-    virtual void Put(const leveldb::Slice& key, const leveldb::Slice& value)
-    {
-        if (key.ToString() == needle)
-        {
-            foundEntry = true;
-            *deleted = false;
-            *foundValue = value.ToString();
-        };
-    };
-
-    virtual void Delete(const leveldb::Slice& key)
-    {
-        if (key.ToString() == needle)
-        {
-            foundEntry = true;
-            *deleted = true;
-        };
-    };
-};
-
 // When performing a read, if we have an active batch we need to check it first
 // before reading from the database, as the rest of the code assumes that once
-// a database transaction begins reads are consistent with it. It would be good
-// to change that assumption in future and avoid the performance hit, though in
-// practice it does not appear to be large.
+// a database transaction begins reads are consistent with it.
 bool SecMsgDB::ScanBatch(const CDataStream& key, std::string* value, bool* deleted) const
 {
     if (!activeBatch)
         return false;
 
     *deleted = false;
-    SecMsgBatchScanner scanner;
-    scanner.needle = key.str();
-    scanner.deleted = deleted;
-    scanner.foundValue = value;
-    leveldb::Status s = activeBatch->Iterate(&scanner);
-    if (!s.ok())
-    {
-        LogPrintf("SecMsgDB ScanBatch error: %s\n", s.ToString().c_str());
-        return false;
-    };
-
-    return scanner.foundEntry;
+    return activeBatch->Lookup(key.str(), value, deleted);
 }
 
 bool SecMsgDB::TxnBegin()
 {
     if (activeBatch)
         return true;
-    activeBatch = new leveldb::WriteBatch();
+    activeBatch = new CLevelDBIndexedBatch();
     return true;
 };
 
@@ -289,7 +246,7 @@ bool SecMsgDB::TxnCommit()
 
     leveldb::WriteOptions writeOptions;
     writeOptions.sync = true;
-    leveldb::Status status = pdb->Write(writeOptions, activeBatch);
+    leveldb::Status status = activeBatch->Commit(pdb, writeOptions);
     delete activeBatch;
     activeBatch = NULL;
 
@@ -1984,7 +1941,7 @@ static bool ScanBlock(CBlock& block, CTxDB& txdb, SecMsgDB& addrpkdb,
         {
             for (uint32_t i = 0; i < tx.vin.size(); i++)
             {
-                CScript *script = &tx.vin[i].scriptSig;
+                const CScript *script = &tx.vin[i].scriptSig;
                 CScript::const_iterator pc = script->begin();
                 CScript::const_iterator pend = script->end();
 
@@ -2148,6 +2105,52 @@ bool SecureMsgScanBlockChain()
     return true;
 };
 
+static bool SecureMsgReadBucketFile(FILE* fp, std::vector<std::vector<uint8_t> >& vMessages, std::vector<SecMsgScanItem>& vItems)
+{
+    /*
+    Read all messages in a bucket file, each header and payload kept together in vMessages.
+    returns false if memory could not be allocated.
+    */
+
+    for (;;)
+    {
+        std::vector<uint8_t> vchData(SMSG_HDR_LEN);
+        errno = 0;
+        if (fread(&vchData[0], sizeof(uint8_t), SMSG_HDR_LEN, fp) != (size_t)SMSG_HDR_LEN)
+        {
+            if (errno != 0)
+            {
+                LogPrintf("fread header failed: %s\n", strerror(errno));
+            } else
+            {
+                //LogPrintf("End of file.\n");
+            };
+            break;
+        };
+
+        uint32_t nPayload = ((SecureMessage*) &vchData[0])->nPayload;
+        try { vchData.resize(SMSG_HDR_LEN + nPayload); } catch (std::exception& e)
+        {
+            LogPrintf("SecureMsgReadBucketFile(): Could not resize vchData, %u, %s\n", nPayload, e.what());
+            return false;
+        };
+
+        if (fread(&vchData[SMSG_HDR_LEN], sizeof(uint8_t), nPayload, fp) != nPayload)
+        {
+            LogPrintf("fread data failed: %s\n", strerror(errno));
+            break;
+        };
+
+        vMessages.push_back(std::vector<uint8_t>());
+        vMessages.back().swap(vchData);
+    };
+
+    for (std::vector<std::vector<uint8_t> >::iterator it = vMessages.begin(); it != vMessages.end(); ++it)
+        vItems.push_back(SecMsgScanItem(&(*it)[0], &(*it)[SMSG_HDR_LEN], it->size() - SMSG_HDR_LEN));
+
+    return true;
+};
+
 bool SecureMsgScanBuckets()
 {
     if (fDebugSmsg)
@@ -2173,9 +2176,6 @@ bool SecureMsgScanBuckets()
         return 0; // not an error
     };
 
-    SecureMessage smsg;
-    std::vector<uint8_t> vchData;
-
     for (fs::directory_iterator itd(pathSmsgDir) ; itd != itend ; ++itd)
     {
         if (!fs::is_regular_file(itd->status()))
@@ -2233,51 +2233,21 @@ bool SecureMsgScanBuckets()
                 continue;
             };
 
-            for (;;)
+            std::vector<std::vector<uint8_t> > vMessages;
+            std::vector<SecMsgScanItem> vItems;
+            if (!SecureMsgReadBucketFile(fp, vMessages, vItems))
             {
-                errno = 0;
-                if (fread(&smsg.hash[0], sizeof(uint8_t), SMSG_HDR_LEN, fp) != (size_t)SMSG_HDR_LEN)
-                {
-                    if (errno != 0)
-                    {
-                        LogPrintf("fread header failed: %s\n", strerror(errno));
-                    } else
-                    {
-                        //LogPrintf("End of file.\n");
-                    };
-                    break;
-                };
-
-                try { vchData.resize(smsg.nPayload); } catch (std::exception& e)
-                {
-                    LogPrintf("SecureMsgWalletUnlocked(): Could not resize vchData, %u, %s\n", smsg.nPayload, e.what());
-                    fclose(fp);
-                    return 1;
-                };
-
-                if (fread(&vchData[0], sizeof(uint8_t), smsg.nPayload, fp) != smsg.nPayload)
-                {
-                    LogPrintf("fread data failed: %s\n", strerror(errno));
-                    break;
-                };
-
-                // -- don't report to gui,
-                int rv = SecureMsgScanMessage(&smsg.hash[0], &vchData[0], smsg.nPayload, false);
-
-                if (rv == 0)
-                {
-                    nFoundMessages++;
-                } else
-                if (rv != 0)
-                {
-                    // SecureMsgScanMessage failed
-                };
-
-                nMessages ++;
+                fclose(fp);
+                return 1;
             };
-
             fclose(fp);
 
+            // -- don't report to gui,
+            uint32_t nReceived;
+            SecureMsgScanMessages(vItems, false, &nReceived);
+            nMessages += vItems.size();
+            nFoundMessages += nReceived;
+
             // -- remove wl file when scanned
             try {
                 fs::remove((*itd).path());
@@ -2327,9 +2297,6 @@ int SecureMsgWalletUnlocked()
         return 0; // not an error
     };
 
-    SecureMessage smsg;
-    std::vector<uint8_t> vchData;
-
     for (fs::directory_iterator itd(pathSmsgDir) ; itd != itend ; ++itd)
     {
         if (!fs::is_regular_file(itd->status()))
@@ -2378,51 +2345,21 @@ int SecureMsgWalletUnlocked()
                 continue;
             };
 
-            for (;;)
+            std::vector<std::vector<uint8_t> > vMessages;
+            std::vector<SecMsgScanItem> vItems;
+            if (!SecureMsgReadBucketFile(fp, vMessages, vItems))
             {
-                errno = 0;
-                if (fread(&smsg.hash[0], sizeof(uint8_t), SMSG_HDR_LEN, fp) != (size_t)SMSG_HDR_LEN)
-                {
-                    if (errno != 0)
-                    {
-                        LogPrintf("fread header failed: %s\n", strerror(errno));
-                    } else
-                    {
-                        //LogPrintf("End of file.\n");
-                    };
-                    break;
-                };
-
-                try { vchData.resize(smsg.nPayload); } catch (std::exception& e)
-                {
-                    LogPrintf("SecureMsgWalletUnlocked(): Could not resize vchData, %u, %s\n", smsg.nPayload, e.what());
-                    fclose(fp);
-                    return 1;
-                };
-
-                if (fread(&vchData[0], sizeof(uint8_t), smsg.nPayload, fp) != smsg.nPayload)
-                {
-                    LogPrintf("fread data failed: %s\n", strerror(errno));
-                    break;
-                };
-
-                // -- don't report to gui,
-                int rv = SecureMsgScanMessage(&smsg.hash[0], &vchData[0], smsg.nPayload, false);
-
-                if (rv == 0)
-                {
-                    nFoundMessages++;
-                } else
-                if (rv != 0)
-                {
-                    // SecureMsgScanMessage failed
-                };
-
-                nMessages ++;
+                fclose(fp);
+                return 1;
             };
-
             fclose(fp);
 
+            // -- don't report to gui,
+            uint32_t nReceived;
+            SecureMsgScanMessages(vItems, false, &nReceived);
+            nMessages += vItems.size();
+            nFoundMessages += nReceived;
+
             // -- remove wl file when scanned
             try {
                 fs::remove((*itd).path());
@@ -2477,6 +2414,194 @@ int SecureMsgWalletKeyChanged(std::string sAddress, std::string sLabel, ChangeTy
     return 0;
 };
 
+// -- messages matched per thread before another thread is worth starting
+const unsigned int SMSG_SCAN_PER_THREAD = 16;
+const int SMSG_SCAN_MAX_THREADS = 8;
+
+static CCriticalSection cs_smsgScanStats;
+static SecMsgScanStats smsgScanStats;
+
+class SecMsgScanKeys
+{
+// -- Private keys of the receiving addresses, fetched from the wallet once per batch
+public:
+    std::vector<std::string>    vAddress;
+    std::vector<bool>           vReceiveAnon;
+    std::vector<BIGNUM*>        vSecret;
+
+    ~SecMsgScanKeys()
+    {
+        for (std::vector<BIGNUM*>::iterator it = vSecret.begin(); it != vSecret.end(); ++it)
+            BN_clear_free(*it);
+    };
+
+    void Load()
+    {
+        LOCK(cs_smsg);
+        for (std::vector<SecMsgAddress>::iterator it = smsgAddresses.begin(); it != smsgAddresses.end(); ++it)
+        {
+            if (!it->fReceiveEnabled)
+                continue;
+
+            CDarkSilkAddress coinAddress(it->sAddress);
+            CKeyID ckid;
+            CKey key;
+            if (!coinAddress.GetKeyID(ckid)
+                || !pwalletMain->GetKey(ckid, key))
+            {
+                if (fDebugSmsg)
+                    LogPrintf("%s: Could not get private key for %s.\n", __func__, it->sAddress.c_str());
+                continue;
+            };
+
+            vAddress.push_back(coinAddress.ToString());
+            vReceiveAnon.push_back(it->fReceiveAnon);
+            vSecret.push_back(BN_bin2bn(key.begin(), 32, NULL));
+        };
+    };
+};
+
+class SecMsgMatcher
+{
+// -- Per thread state for matching messages, nothing mutable is shared between threads
+private:
+    EC_GROUP*   group;
+    BN_CTX*     ctx;
+    EC_POINT*   pointR;
+    EC_POINT*   pointP;
+    BIGNUM*     bnX;
+
+public:
+    SecMsgMatcher()
+    {
+        group   = EC_GROUP_new_by_curve_name(NID_secp256k1);
+        ctx     = BN_CTX_new();
+        pointR  = EC_POINT_new(group);
+        pointP  = EC_POINT_new(group);
+        bnX     = BN_new();
+    };
+
+    ~SecMsgMatcher()
+    {
+        BN_clear_free(bnX);
+        EC_POINT_clear_free(pointP);
+        EC_POINT_free(pointR);
+        BN_CTX_free(ctx);
+        EC_GROUP_free(group);
+    };
+
+    int Match(const SecMsgScanKeys& keys, const SecMsgScanItem& item)
+    {
+        /*
+        Find the receive key the message MAC was made with.
+        Does the same ECDH, key derivation and HMAC as SecureMsgDecrypt, but
+        R is parsed once per message instead of once per address.
+
+        returns index into keys, -1 if none matched.
+        */
+
+        SecureMessage* psmsg = (SecureMessage*) item.pHeader;
+        if (psmsg->version[0] != 1
+            || !EC_POINT_oct2point(group, pointR, psmsg->cpkR, 33, ctx))
+            return -1;
+
+        uint8_t chP[32];
+        uint8_t chHashed[64];
+        uint8_t MAC[32];
+        int nFound = -1;
+        for (unsigned int k = 0; k < keys.vSecret.size(); ++k)
+        {
+            // -- P = k * R, the shared secret is the x coordinate as ECDH_compute_key returns it
+            if (!EC_POINT_mul(group, pointP, NULL, pointR, keys.vSecret[k], ctx)
+                || !EC_POINT_get_affine_coordinates_GFp(group, pointP, bnX, NULL, ctx))
+                continue;
+            int nLen = BN_num_bytes(bnX);
+            memset(chP, 0, sizeof(chP));
+            BN_bn2bin(bnX, chP + sizeof(chP) - nLen);
+
+            // -- key_m is the last 32 bytes of SHA512(P)
+            SHA512(chP, sizeof(chP), chHashed);
+
+            uint32_t nBytes = 32;
+            bool fHmacOk = true;
+            HMAC_CTX hctx;
+            HMAC_CTX_init(&hctx);
+            if (!HMAC_Init_ex(&hctx, &chHashed[32], 32, EVP_sha256(), NULL)
+                || !HMAC_Update(&hctx, (uint8_t*) &psmsg->timestamp, sizeof(psmsg->timestamp))
+                || !HMAC_Update(&hctx, item.pPayload, item.nPayload)
+                || !HMAC_Final(&hctx, MAC, &nBytes)
+                || nBytes != 32)
+                fHmacOk = false;
+            HMAC_CTX_cleanup(&hctx);
+
+            if (fHmacOk && memcmp(MAC, psmsg->mac, 32) == 0)
+            {
+                nFound = k;
+                break;
+            };
+        };
+
+        OPENSSL_cleanse(chP, sizeof(chP));
+        OPENSSL_cleanse(chHashed, sizeof(chHashed));
+        return nFound;
+    };
+};
+
+static void SecureMsgMatchThread(const SecMsgScanKeys* pkeys, std::vector<SecMsgScanItem>* pvItems, unsigned int nFirst, unsigned int nStride)
+{
+    SecMsgMatcher matcher;
+    for (unsigned int i = nFirst; i < pvItems->size(); i += nStride)
+        (*pvItems)[i].nKey = matcher.Match(*pkeys, (*pvItems)[i]);
+};
+
+static int SecureMsgSaveInbox(uint8_t *pHeader, uint8_t *pPayload, uint32_t nPayload, const std::string& addressTo, bool reportToGui)
+{
+    SecureMessage* psmsg = (SecureMessage*) pHeader;
+    std::string sPrefix("im");
+    uint8_t chKey[18];
+    memcpy(&chKey[0],  sPrefix.data(),    2);
+    memcpy(&chKey[2],  &psmsg->timestamp, 8);
+    memcpy(&chKey[10], pPayload,          8);
+
+    SecMsgStored smsgInbox;
+    smsgInbox.timeReceived  = GetTime();
+    smsgInbox.status        = (SMSG_MASK_UNREAD) & 0xFF;
+    smsgInbox.sAddrTo       = addressTo;
+
+    // -- data may not be contiguous
+    try {
+        smsgInbox.vchMessage.resize(SMSG_HDR_LEN + nPayload);
+    } catch (std::exception& e) {
+        LogPrintf("SecureMsgScanMessage(): Could not resize vchData, %u, %s\n", SMSG_HDR_LEN + nPayload, e.what());
+        return 1;
+    };
+    memcpy(&smsgInbox.vchMessage[0], pHeader, SMSG_HDR_LEN);
+    memcpy(&smsgInbox.vchMessage[SMSG_HDR_LEN], pPayload, nPayload);
+
+    {
+        LOCK(cs_smsgDB);
+        SecMsgDB dbInbox;
+
+        if (dbInbox.Open("cw"))
+        {
+            if (dbInbox.ExistsSmesg(chKey))
+            {
+                if (fDebugSmsg)
+                    LogPrintf("Message already exists in inbox db.\n");
+            } else
+            {
+                dbInbox.WriteSmesg(chKey, smsgInbox);
+
+                if (reportToGui)
+                    NotifySecMsgInboxChanged(smsgInbox);
+                LogPrintf("SecureMsg saved to inbox, received with %s.\n", addressTo.c_str());
+            };
+        };
+    } // cs_smsgDB
+
+    return 0;
+};
+
 int SecureMsgScanMessage(uint8_t *pHeader, uint8_t *pPayload, uint32_t nPayload, bool reportToGui)
 {
     /*
@@ -2489,111 +2614,114 @@ int SecureMsgScanMessage(uint8_t *pHeader, uint8_t *pPayload, uint32_t nPayload,
     returns
         0 success,
         1 error
-        2 no match
         3 wallet is locked - message stored for scanning later.
     */
 
+    std::vector<SecMsgScanItem> vItems;
+    vItems.push_back(SecMsgScanItem(pHeader, pPayload, nPayload));
+    return SecureMsgScanMessages(vItems, reportToGui);
+};
+
+int SecureMsgScanMessages(std::vector<SecMsgScanItem>& vItems, bool reportToGui, uint32_t* pnReceived)
+{
+    /*
+    Check which of a batch of messages belong to this node, add those to the inbox db.
+
+    The private keys of the receiving addresses are fetched once for the
+    whole batch, and messages are matched on their MAC alone across a pool
+    of threads. Only matching messages are fully decrypted, when needed.
+
+    returns
+        0 success,
+        1 error
+        3 wallet is locked - messages stored for scanning later.
+    */
+
     if (fDebugSmsg)
-        LogPrintf("SecureMsgScanMessage()\n");
+        LogPrintf("SecureMsgScanMessages() %u messages\n", vItems.size());
+
+    if (pnReceived)
+        *pnReceived = 0;
+
+    if (vItems.empty())
+        return 0;
 
     if (pwalletMain->IsLocked())
     {
         if (fDebugSmsg)
-            LogPrintf("ScanMessage: Wallet is locked, storing message to scan later.\n");
-
-        int rv;
-        if ((rv = SecureMsgStoreUnscanned(pHeader, pPayload, nPayload)) != 0)
-            return 1;
+            LogPrintf("ScanMessage: Wallet is locked, storing messages to scan later.\n");
 
+        for (std::vector<SecMsgScanItem>::iterator it = vItems.begin(); it != vItems.end(); ++it)
+        {
+            if (SecureMsgStoreUnscanned(it->pHeader, it->pPayload, it->nPayload) != 0)
+                return 1;
+        };
         return 3;
     };
 
-    std::string addressTo;
-    MessageData msg; // placeholder
-    bool fOwnMessage = false;
+    int64_t nStart = GetTimeMicros();
 
-    for (std::vector<SecMsgAddress>::iterator it = smsgAddresses.begin(); it != smsgAddresses.end(); ++it)
+    SecMsgScanKeys keys;
+    keys.Load();
+
+    int nThreads = std::min((int)(vItems.size() / SMSG_SCAN_PER_THREAD), std::min((int)boost::thread::hardware_concurrency(), SMSG_SCAN_MAX_THREADS));
+    if (nThreads <= 1 || keys.vSecret.empty())
+    {
+        nThreads = 1;
+        SecureMsgMatchThread(&keys, &vItems, 0, 1);
+    } else
     {
-        if (!it->fReceiveEnabled)
+        boost::thread_group threadsMatch;
+        for (int i = 0; i < nThreads; ++i)
+            threadsMatch.create_thread(boost::bind(&SecureMsgMatchThread, &keys, &vItems, i, nThreads));
+        threadsMatch.join_all();
+    };
+
+    uint32_t nReceived = 0;
+    int rv = 0;
+    for (std::vector<SecMsgScanItem>::iterator it = vItems.begin(); it != vItems.end(); ++it)
+    {
+        if (it->nKey < 0)
             continue;
 
-        CDarkSilkAddress coinAddress(it->sAddress);
-        addressTo = coinAddress.ToString();
+        std::string addressTo = keys.vAddress[it->nKey];
+        if (fDebugSmsg)
+            LogPrintf("Decrypted message with %s.\n", addressTo.c_str());
 
-        if (!it->fReceiveAnon)
+        if (!keys.vReceiveAnon[it->nKey])
         {
             // -- have to do full decrypt to see address from
-            if (SecureMsgDecrypt(false, addressTo, pHeader, pPayload, nPayload, msg) == 0)
-            {
-                if (fDebugSmsg)
-                    LogPrintf("Decrypted message with %s.\n", addressTo.c_str());
+            MessageData msg;
+            if (SecureMsgDecrypt(false, addressTo, it->pHeader, it->pPayload, it->nPayload, msg) != 0
+                || msg.sFromAddress.compare("anon") == 0)
+                continue;
+        };
 
-                if (msg.sFromAddress.compare("anon") != 0)
-                    fOwnMessage = true;
-                break;
-            };
-        } else
+        if (SecureMsgSaveInbox(it->pHeader, it->pPayload, it->nPayload, addressTo, reportToGui) != 0)
         {
-
-            if (SecureMsgDecrypt(true, addressTo, pHeader, pPayload, nPayload, msg) == 0)
-            {
-                if (fDebugSmsg)
-                    LogPrintf("Decrypted message with %s.\n", addressTo.c_str());
-
-                fOwnMessage = true;
-                break;
-            };
-        }
+            rv = 1;
+            continue;
+        };
+        nReceived++;
     };
 
-    if (fOwnMessage)
     {
-        // -- save to inbox
-        SecureMessage* psmsg = (SecureMessage*) pHeader;
-        std::string sPrefix("im");
-        uint8_t chKey[18];
-        memcpy(&chKey[0],  sPrefix.data(),    2);
-        memcpy(&chKey[2],  &psmsg->timestamp, 8);
-        memcpy(&chKey[10], pPayload,          8);
-
-        SecMsgStored smsgInbox;
-        smsgInbox.timeReceived  = GetTime();
-        smsgInbox.status        = (SMSG_MASK_UNREAD) & 0xFF;
-        smsgInbox.sAddrTo       = addressTo;
-
-        // -- data may not be contiguous
-        try {
-            smsgInbox.vchMessage.resize(SMSG_HDR_LEN + nPayload);
-        } catch (std::exception& e) {
-            LogPrintf("SecureMsgScanMessage(): Could not resize vchData, %u, %s\n", SMSG_HDR_LEN + nPayload, e.what());
-            return 1;
-        };
-        memcpy(&smsgInbox.vchMessage[0], pHeader, SMSG_HDR_LEN);
-        memcpy(&smsgInbox.vchMessage[SMSG_HDR_LEN], pPayload, nPayload);
-
-        {
-            LOCK(cs_smsgDB);
-            SecMsgDB dbInbox;
-
-            if (dbInbox.Open("cw"))
-            {
-                if (dbInbox.ExistsSmesg(chKey))
-                {
-                    if (fDebugSmsg)
-                        LogPrintf("Message already exists in inbox db.\n");
-                } else
-                {
-                    dbInbox.WriteSmesg(chKey, smsgInbox);
+        LOCK(cs_smsgScanStats);
+        smsgScanStats.nMessages   += vItems.size();
+        smsgScanStats.nReceived   += nReceived;
+        smsgScanStats.nTimeMicros += GetTimeMicros() - nStart;
+        smsgScanStats.nThreads     = nThreads;
+    }
 
-                    if (reportToGui)
-                        NotifySecMsgInboxChanged(smsgInbox);
-                    LogPrintf("SecureMsg saved to inbox, received with %s.\n", addressTo.c_str());
-                };
-            };
-        } // cs_smsgDB
-    };
+    if (pnReceived)
+        *pnReceived = nReceived;
+    return rv;
+};
 
-    return 0;
+SecMsgScanStats SecureMsgGetScanStats()
+{
+    LOCK(cs_smsgScanStats);
+    return smsgScanStats;
 };
 
 int SecureMsgGetLocalKey(CKeyID& ckid, CPubKey& cpkOut)
@@ -2845,6 +2973,7 @@ int SecureMsgReceive(CNode* pfrom, std::vector<uint8_t>& vchData)
     };
 
     uint32_t n = 12;
+    std::vector<SecMsgScanItem> vItems;
 
     for (uint32_t i = 0; i < nBunch; ++i)
     {
@@ -2878,15 +3007,17 @@ int SecureMsgReceive(CNode* pfrom, std::vector<uint8_t>& vchData)
                 // message dropped
                 break; // continue?
             };
-
-            if (SecureMsgScanMessage(&vchData[n], &vchData[n + SMSG_HDR_LEN], psmsg->nPayload, true) != 0)
-            {
-                // message recipient is not this node (or failed)
-            };
         } // cs_smsg
-        
+
+        vItems.push_back(SecMsgScanItem(&vchData[n], &vchData[n + SMSG_HDR_LEN], psmsg->nPayload));
         n += SMSG_HDR_LEN + psmsg->nPayload;
     };
+
+    // -- scan the whole bunch at once
+    if (SecureMsgScanMessages(vItems, true) != 0)
+    {
+        // message recipient is not this node (or failed)
+    };
     
     {
         LOCK(cs_smsg);
@@ -3163,90 +3294,144 @@ int SecureMsgValidate(uint8_t *pHeader, uint8_t *pPayload, uint32_t nPayload)
     return rv;
 };
 
-int SecureMsgSetHash(uint8_t *pHeader, uint8_t *pPayload, uint32_t nPayload)
+class SecMsgPowSearch
 {
-    /*  proof of work and checksum
+// -- State shared by the threads searching for a proof of work nonce
+public:
+    SecMsgPowSearch(const uint8_t* pHeaderIn, const uint8_t* pPayloadIn, uint32_t nPayloadIn)
+    {
+        pHeader     = pHeaderIn;
+        pPayload    = pPayloadIn;
+        nPayload    = nPayloadIn;
+        fFound      = false;
+        fStop       = false;
+        nonse       = 0;
+        nHashes     = 0;
+    };
 
-        May run in a thread, if shutdown detected, return.
+    const uint8_t*  pHeader;
+    const uint8_t*  pPayload;
+    uint32_t        nPayload;
 
-        returns:
-            0 success
-            1 error
-            2 stopped due to node shutdown
+    boost::mutex    mutex;
+    bool            fFound;
+    volatile bool   fStop;
+    uint32_t        nonse;          // winning nonce, when fFound
+    uint8_t         sha256Hash[32]; // and its hash
+    uint64_t        nHashes;
+};
+
+static void SecureMsgPowThread(SecMsgPowSearch* psearch, uint32_t nFirst, uint32_t nStride)
+{
+    /*
+    Try nonces nFirst, nFirst + nStride, ... until one works, another thread
+    finds one, or secure messaging is stopped.
 
+    The HMAC key is derived from the nonce, so no hashing state carries over
+    from one nonce to the next. Each thread does keep its own copy of the
+    header to write nonces into and its own HMAC_CTX, the payload is shared.
     */
 
-    SecureMessage* psmsg = (SecureMessage*) pHeader;
+    uint8_t header[SMSG_HDR_LEN];
+    memcpy(header, psearch->pHeader, SMSG_HDR_LEN);
+    SecureMessage* psmsg = (SecureMessage*) header;
 
-    int64_t nStart = GetTimeMillis();
+    const EVP_MD* md = EVP_sha256();
     uint8_t civ[32];
     uint8_t sha256Hash[32];
+    uint64_t nHashes = 0;
 
-    bool found = false;
     HMAC_CTX ctx;
     HMAC_CTX_init(&ctx);
 
-    uint32_t nonse = 0;
-
-    //CBigNum bnTarget(2);
-    //bnTarget = bnTarget.pow(256 - 40);
-
-    // -- break for HMAC_CTX_cleanup
-    for (;;)
+    for (uint64_t n = nFirst; n <= 4294967295U; n += nStride)
     {
-        if (!fSecMsgEnabled)
-           break;
+        if ((nHashes & 0x3FF) == 0
+            && (psearch->fStop || !fSecMsgEnabled))
+            break;
 
-        //psmsg->timestamp = GetTime();
-        //memcpy(&psmsg->timestamp, &now, 8);
+        uint32_t nonse = (uint32_t) n;
         memcpy(&psmsg->nonse[0], &nonse, 4);
 
         for (int i = 0; i < 32; i+=4)
             memcpy(civ+i, &nonse, 4);
 
         uint32_t nBytes;
-        if (!HMAC_Init_ex(&ctx, &civ[0], 32, EVP_sha256(), NULL)
-            || !HMAC_Update(&ctx, (uint8_t*) pHeader+4, SMSG_HDR_LEN-4)
-            || !HMAC_Update(&ctx, (uint8_t*) pPayload, nPayload)
-            || !HMAC_Update(&ctx, pPayload, nPayload)
+        if (!HMAC_Init_ex(&ctx, &civ[0], 32, md, NULL)
+            || !HMAC_Update(&ctx, header+4, SMSG_HDR_LEN-4)
+            || !HMAC_Update(&ctx, psearch->pPayload, psearch->nPayload)
+            || !HMAC_Update(&ctx, psearch->pPayload, psearch->nPayload)
             || !HMAC_Final(&ctx, sha256Hash, &nBytes)
-            //|| !HMAC_Final(&ctx, &vchHash[0], &nBytes)
             || nBytes != 32)
             break;
-
-        /*
-        if (CBigNum(vchHash) <= bnTarget)
-        {
-            found = true;
-            if (fDebugSmsg)
-                LogPrintf("Match %u\n", nonse);
-            break;
-        };
-        */
+        nHashes++;
 
         if (sha256Hash[31] == 0
             && sha256Hash[30] == 0
             && (~(sha256Hash[29]) & ((1<<0) || (1<<1) || (1<<2)) ))
-        //    && sha256Hash[29] == 0)
         {
-            found = true;
-            //if (fDebugSmsg)
-            //    LogPrintf("Match %u\n", nonse);
+            boost::unique_lock<boost::mutex> lock(psearch->mutex);
+            if (!psearch->fFound)
+            {
+                psearch->fFound = true;
+                psearch->nonse = nonse;
+                memcpy(psearch->sha256Hash, sha256Hash, 32);
+            };
+            psearch->fStop = true;
             break;
-        }
+        };
+    };
+
+    HMAC_CTX_cleanup(&ctx);
 
-        //if (nonse >= UINT32_MAX)
-        if (nonse >= 4294967295U)
+    boost::unique_lock<boost::mutex> lock(psearch->mutex);
+    psearch->nHashes += nHashes;
+};
+
+int SecureMsgSetHash(uint8_t *pHeader, uint8_t *pPayload, uint32_t nPayload, int nThreads, uint64_t* pnHashes)
+{
+    /*  proof of work and checksum
+
+        The nonce space is split across nThreads threads, all cores if nThreads <= 0.
+        The first nonce found by any thread is kept.
+
+        May run in a thread, if shutdown detected, return.
+
+        returns:
+            0 success
+            1 error
+            2 stopped due to node shutdown
+
+    */
+
+    SecureMessage* psmsg = (SecureMessage*) pHeader;
+
+    int64_t nStart = GetTimeMillis();
+
+    if (nThreads <= 0)
+        nThreads = std::max((int)boost::thread::hardware_concurrency(), 1);
+
+    SecMsgPowSearch search(pHeader, pPayload, nPayload);
+    if (nThreads == 1)
+    {
+        SecureMsgPowThread(&search, 0, 1);
+    } else
+    {
+        boost::thread_group threadsPow;
+        for (int i = 0; i < nThreads; ++i)
+            threadsPow.create_thread(boost::bind(&SecureMsgPowThread, &search, i, nThreads));
+        try {
+            threadsPow.join_all();
+        } catch (boost::thread_interrupted&)
         {
-            if (fDebugSmsg)
-                LogPrintf("No match %u\n", nonse);
-            break;
-            //return 1;
-        }
-        nonse++;
+            search.fStop = true;
+            threadsPow.join_all();
+            throw;
+        };
     };
 
-    HMAC_CTX_cleanup(&ctx);
+    if (pnHashes)
+        *pnHashes = search.nHashes;
 
     if (!fSecMsgEnabled)
     {
@@ -3255,18 +3440,18 @@ int SecureMsgSetHash(uint8_t *pHeader, uint8_t *pPayload, uint32_t nPayload)
         return 2;
     };
 
-    if (!found)
+    if (!search.fFound)
     {
         if (fDebugSmsg)
-            LogPrintf("SecureMsgSetHash() failed, took %d ms, nonse %u\n", GetTimeMillis() - nStart, nonse);
+            LogPrintf("SecureMsgSetHash() failed, took %d ms, %u hashes\n", GetTimeMillis() - nStart, search.nHashes);
         return 1;
     };
 
-    memcpy(psmsg->hash, sha256Hash, 4);
-    //memcpy(psmsg->hash, &vchHash[0], 4);
+    memcpy(&psmsg->nonse[0], &search.nonse, 4);
+    memcpy(psmsg->hash, search.sha256Hash, 4);
 
     if (fDebugSmsg)
-        LogPrintf("SecureMsgSetHash() took %d ms, nonse %u\n", GetTimeMillis() - nStart, nonse);
+        LogPrintf("SecureMsgSetHash() took %d ms, nonse %u, %u hashes on %d threads\n", GetTimeMillis() - nStart, search.nonse, search.nHashes, nThreads);
 
     return 0;
 };
@@ -8,6 +8,7 @@
 #include <leveldb/db.h>
 #include <leveldb/write_batch.h>
 
+#include "leveldbbatch.h"
 #include "net.h"
 #include "wallet/db.h"
 #include "wallet/wallet.h"
@@ -228,6 +229,42 @@ public:
     bool fScanIncoming;
 };
 
+class SecMsgScanItem
+{
+// -- A message to be matched against the owned addresses
+public:
+    SecMsgScanItem(uint8_t* pHeaderIn, uint8_t* pPayloadIn, uint32_t nPayloadIn)
+    {
+        pHeader     = pHeaderIn;
+        pPayload    = pPayloadIn;
+        nPayload    = nPayloadIn;
+        nKey        = -1;
+    };
+
+    uint8_t*    pHeader;
+    uint8_t*    pPayload;
+    uint32_t    nPayload;
+    int         nKey;           // receive key the MAC matched, -1 if none
+};
+
+class SecMsgScanStats
+{
+// -- Totals over every message scanned since startup
+public:
+    SecMsgScanStats()
+    {
+        nMessages   = 0;
+        nReceived   = 0;
+        nTimeMicros = 0;
+        nThreads    = 0;
+    };
+
+    uint64_t    nMessages;      // messages trial-decrypted
+    uint64_t    nReceived;      // messages addressed to this node
+    int64_t     nTimeMicros;    // time spent scanning
+    int         nThreads;       // threads used for the last batch
+};
+
 
 class SecMsgCrypter
 {
@@ -324,7 +361,7 @@ public:
     bool EraseSmesg(uint8_t* chKey);
 
     leveldb::DB *pdb;       // points to the global instance
-    leveldb::WriteBatch *activeBatch;
+    CLevelDBIndexedBatch *activeBatch;
 
 };
 
@@ -355,6 +392,8 @@ int SecureMsgWalletUnlocked();
 int SecureMsgWalletKeyChanged(std::string sAddress, std::string sLabel, ChangeType mode);
 
 int SecureMsgScanMessage(uint8_t *pHeader, uint8_t *pPayload, uint32_t nPayload, bool reportToGui);
+int SecureMsgScanMessages(std::vector<SecMsgScanItem>& vItems, bool reportToGui, uint32_t* pnReceived = NULL);
+SecMsgScanStats SecureMsgGetScanStats();
 
 int SecureMsgGetStoredKey(CKeyID& ckid, CPubKey& cpkOut);
 int SecureMsgGetLocalKey(CKeyID& ckid, CPubKey& cpkOut);
@@ -375,7 +414,7 @@ int SecureMsgStore(SecureMessage& smsg, bool fUpdateBucket);
 int SecureMsgSend(std::string &addressFrom, std::string &addressTo, std::string &message, std::string &sError);
 
 int SecureMsgValidate(uint8_t *pHeader, uint8_t *pPayload, uint32_t nPayload);
-int SecureMsgSetHash(uint8_t *pHeader, uint8_t *pPayload, uint32_t nPayload);
+int SecureMsgSetHash(uint8_t *pHeader, uint8_t *pPayload, uint32_t nPayload, int nThreads = 0, uint64_t* pnHashes = NULL);
 
 int SecureMsgEncrypt(SecureMessage &smsg, const std::string &addressFrom, const std::string &addressTo, const std::string &message);
 
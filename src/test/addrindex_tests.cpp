@@ -0,0 +1,46 @@
+#include <boost/test/unit_test.hpp>
+
+#include "txdb-leveldb.h"
+
+#include <string>
+
+using namespace std;
+
+static string SerializeAddrIndexKey(const CAddrIndexKey& key)
+{
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << make_pair(string("ati"), key);
+    return ss.str();
+}
+
+BOOST_AUTO_TEST_SUITE(addrindex_tests)
+
+BOOST_AUTO_TEST_CASE(key_roundtrip)
+{
+    CAddrIndexKey key(uint160(7), 0x01020304, uint256(9));
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << key;
+    CAddrIndexKey keyRead;
+    ss >> keyRead;
+    BOOST_CHECK(keyRead.addrHash == key.addrHash);
+    BOOST_CHECK_EQUAL(keyRead.nHeight, key.nHeight);
+    BOOST_CHECK(keyRead.txHash == key.txHash);
+}
+
+BOOST_AUTO_TEST_CASE(keys_sort_by_address_then_height)
+{
+    // Byte order of the serialized keys is the order LevelDB iterates in.
+    uint256 txLow(1), txHigh(~uint256(0));
+    BOOST_CHECK(SerializeAddrIndexKey(CAddrIndexKey(uint160(1), 255, txHigh)) <
+                SerializeAddrIndexKey(CAddrIndexKey(uint160(1), 256, txLow)));
+    BOOST_CHECK(SerializeAddrIndexKey(CAddrIndexKey(uint160(1), 70000, txHigh)) <
+                SerializeAddrIndexKey(CAddrIndexKey(uint160(2), 0, txLow)));
+
+    // Every entry of an address starts with the address prefix.
+    CDataStream ssPrefix(SER_DISK, CLIENT_VERSION);
+    ssPrefix << make_pair(string("ati"), uint160(1));
+    string strKey = SerializeAddrIndexKey(CAddrIndexKey(uint160(1), 12345, txLow));
+    BOOST_CHECK(strKey.compare(0, ssPrefix.size(), ssPrefix.str()) == 0);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
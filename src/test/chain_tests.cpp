@@ -0,0 +1,113 @@
+#include <boost/test/unit_test.hpp>
+
+#include "chain.h"
+
+#include <vector>
+
+using namespace std;
+
+// Links each entry of vIndex to the one before it, the first to pprev, with distinct hashes.
+static void BuildBranch(vector<CBlockIndex>& vIndex, vector<uint256>& vHash, CBlockIndex* pprev, int nFirstHeight, uint64_t nSalt)
+{
+    vHash.resize(vIndex.size());
+    for (unsigned int i = 0; i < vIndex.size(); i++) {
+        vHash[i] = uint256(nSalt + i);
+        vIndex[i].phashBlock = &vHash[i];
+        vIndex[i].nHeight = nFirstHeight + i;
+        vIndex[i].pprev = i == 0 ? pprev : &vIndex[i - 1];
+    }
+}
+
+BOOST_AUTO_TEST_SUITE(chain_tests)
+
+BOOST_AUTO_TEST_CASE(chain_height_lookup_and_fork)
+{
+    vector<CBlockIndex> vMain(1000);
+    vector<uint256> vMainHash;
+    BuildBranch(vMain, vMainHash, NULL, 0, 1);
+
+    // A side branch forking off after height 600
+    vector<CBlockIndex> vSide(50);
+    vector<uint256> vSideHash;
+    BuildBranch(vSide, vSideHash, &vMain[600], 601, 100000);
+
+    CChain chain;
+    chain.SetTip(&vMain.back());
+    BOOST_CHECK_EQUAL(chain.Height(), 999);
+    BOOST_CHECK(chain.Genesis() == &vMain[0]);
+    BOOST_CHECK(chain.Tip() == &vMain[999]);
+    for (int i = 0; i < 1000; i++)
+        BOOST_CHECK(chain[i] == &vMain[i]);
+    BOOST_CHECK(chain[-1] == NULL);
+    BOOST_CHECK(chain[1000] == NULL);
+    BOOST_CHECK(chain.Next(&vMain[10]) == &vMain[11]);
+    BOOST_CHECK(!chain.Contains(&vSide[0]));
+
+    BOOST_CHECK(chain.FindFork(&vSide.back()) == &vMain[600]);
+    BOOST_CHECK(chain.FindFork(&vMain[700]) == &vMain[700]);
+
+    // Switching to the side branch only rewrites the heights above the fork
+    chain.SetTip(&vSide.back());
+    BOOST_CHECK_EQUAL(chain.Height(), 650);
+    BOOST_CHECK(chain[600] == &vMain[600]);
+    BOOST_CHECK(chain[601] == &vSide[0]);
+    BOOST_CHECK(!chain.Contains(&vMain[601]));
+    BOOST_CHECK(chain.FindFork(&vMain[999]) == &vMain[600]);
+}
+
+BOOST_AUTO_TEST_CASE(chain_locator)
+{
+    vector<CBlockIndex> vMain(1000);
+    vector<uint256> vMainHash;
+    BuildBranch(vMain, vMainHash, NULL, 0, 1);
+
+    CChain chain;
+    chain.SetTip(&vMain.back());
+
+    // The locator steps back one block at a time for the first ten entries,
+    // then at exponentially larger steps, and ends at genesis.
+    CBlockLocator locator = chain.GetLocator();
+    vector<uint256> vHave;
+    CDataStream ss(SER_GETHASH, 0);
+    ss << locator;
+    ss >> vHave;
+    BOOST_REQUIRE(vHave.size() > 12);
+    for (int i = 0; i <= 10; i++)
+        BOOST_CHECK(vHave[i] == vMainHash[999 - i]);
+    BOOST_CHECK(vHave[11] == vMainHash[988]);
+    BOOST_CHECK(vHave[12] == vMainHash[986]);
+    BOOST_CHECK(vHave[vHave.size() - 2] == vMainHash[0]);
+}
+
+BOOST_AUTO_TEST_CASE(block_index_arena)
+{
+    CBlockIndexArena arena;
+    BlockMap mapIndex;
+    vector<CBlockIndex*> vIndex;
+
+    // Fill more than one chunk and check nothing handed out earlier moved
+    unsigned int nEntries = CBlockIndexArena::CHUNK_SIZE * 2 + 10;
+    for (unsigned int i = 0; i < nEntries; i++) {
+        CBlockIndex* pindex = arena.Alloc();
+        pindex->nHeight = i;
+        BlockMap::iterator mi = mapIndex.insert(make_pair(uint256(i + 1), pindex)).first;
+        pindex->phashBlock = &mi->first;
+        vIndex.push_back(pindex);
+    }
+    BOOST_CHECK_EQUAL(arena.size(), nEntries);
+    BOOST_CHECK_EQUAL(mapIndex.size(), nEntries);
+
+    for (unsigned int i = 0; i < nEntries; i++) {
+        BlockMap::iterator mi = mapIndex.find(uint256(i + 1));
+        BOOST_REQUIRE(mi != mapIndex.end());
+        BOOST_CHECK(mi->second == vIndex[i]);
+        BOOST_CHECK_EQUAL(mi->second->nHeight, (int)i);
+        BOOST_CHECK(mi->second->GetBlockHash() == uint256(i + 1));
+    }
+    BOOST_CHECK(mapIndex.find(uint256(nEntries + 1)) == mapIndex.end());
+
+    arena.clear();
+    BOOST_CHECK_EQUAL(arena.size(), 0U);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,86 @@
+#include <boost/test/unit_test.hpp>
+
+#include "checkqueue.h"
+
+#include <boost/thread.hpp>
+
+using namespace std;
+
+// Counts how often it ran; fails if told to
+struct CFakeCheck
+{
+    static boost::mutex cs;
+    static unsigned int nRun;
+    bool fOk;
+
+    CFakeCheck() : fOk(true) {}
+    CFakeCheck(bool fOkIn) : fOk(fOkIn) {}
+
+    bool operator()()
+    {
+        boost::mutex::scoped_lock lock(cs);
+        nRun++;
+        return fOk;
+    }
+
+    void swap(CFakeCheck& check) { std::swap(fOk, check.fOk); }
+};
+
+boost::mutex CFakeCheck::cs;
+unsigned int CFakeCheck::nRun = 0;
+
+BOOST_AUTO_TEST_SUITE(checkqueue_tests)
+
+BOOST_AUTO_TEST_CASE(checkqueue_runs_all_and_reports_failure)
+{
+    CCheckQueue<CFakeCheck> queue(16);
+    boost::thread_group threadGroup;
+    for (int i = 0; i < 3; i++)
+        threadGroup.create_thread(boost::bind(&CCheckQueue<CFakeCheck>::Thread, &queue));
+
+    // Every check runs when all succeed
+    CFakeCheck::nRun = 0;
+    {
+        CCheckQueueControl<CFakeCheck> control(&queue);
+        for (int i = 0; i < 100; i++) {
+            vector<CFakeCheck> vChecks(i % 7, CFakeCheck(true));
+            control.Add(vChecks);
+        }
+        BOOST_CHECK(control.Wait());
+    }
+    unsigned int nExpected = 0;
+    for (int i = 0; i < 100; i++)
+        nExpected += i % 7;
+    BOOST_CHECK_EQUAL(CFakeCheck::nRun, nExpected);
+
+    // One failure fails the whole batch
+    {
+        CCheckQueueControl<CFakeCheck> control(&queue);
+        vector<CFakeCheck> vChecks(1000, CFakeCheck(true));
+        vChecks[500] = CFakeCheck(false);
+        control.Add(vChecks);
+        BOOST_CHECK(!control.Wait());
+    }
+
+    // and does not stick to the next one, even when it is left early
+    {
+        CCheckQueueControl<CFakeCheck> control(&queue);
+        vector<CFakeCheck> vChecks(10, CFakeCheck(false));
+        control.Add(vChecks);
+    }
+    {
+        CCheckQueueControl<CFakeCheck> control(&queue);
+        vector<CFakeCheck> vChecks(10, CFakeCheck(true));
+        control.Add(vChecks);
+        BOOST_CHECK(control.Wait());
+    }
+
+    // Without a queue nothing is deferred
+    CCheckQueueControl<CFakeCheck> control(NULL);
+    BOOST_CHECK(control.Wait());
+
+    threadGroup.interrupt_all();
+    threadGroup.join_all();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
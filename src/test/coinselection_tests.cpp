@@ -0,0 +1,102 @@
+#include <boost/test/unit_test.hpp>
+
+#include "wallet/coinselection.h"
+
+#include "util.h"
+
+#include <vector>
+
+using namespace std;
+
+BOOST_AUTO_TEST_SUITE(coinselection_tests)
+
+static void add_input(vector<CSelectionInput>& vInputs, CAmount nValue, uint64_t nCost = 1)
+{
+    vInputs.push_back(CSelectionInput(nValue, nCost, vInputs.size()));
+}
+
+static CAmount selected_value(const vector<CSelectionInput>& vInputs, const vector<char>& vfSelected, unsigned int& nCount)
+{
+    CAmount nTotal = 0;
+    nCount = 0;
+    for (unsigned int i = 0; i < vInputs.size(); i++)
+        if (vfSelected[i]) {
+            nTotal += vInputs[i].nValue;
+            nCount++;
+        }
+    return nTotal;
+}
+
+BOOST_AUTO_TEST_CASE(bnb_exact)
+{
+    vector<CSelectionInput> vInputs;
+    add_input(vInputs, 1 * CENT);
+    add_input(vInputs, 2 * CENT);
+    add_input(vInputs, 5 * CENT);
+    add_input(vInputs, 10 * CENT);
+    add_input(vInputs, 20 * CENT);
+    SortSelectionInputs(vInputs);
+    BOOST_CHECK_EQUAL(vInputs[0].nValue, 20 * CENT);
+
+    vector<char> vfSelected;
+    CAmount nValue;
+    unsigned int nCount;
+
+    // 7 = 5+2, not 5+1+1 or anything larger
+    BOOST_CHECK(SelectCoinsBnB(vInputs, 7 * CENT, 0, vfSelected, nValue));
+    BOOST_CHECK_EQUAL(nValue, 7 * CENT);
+    BOOST_CHECK_EQUAL(selected_value(vInputs, vfSelected, nCount), 7 * CENT);
+    BOOST_CHECK_EQUAL(nCount, 2U);
+
+    // 34 cannot be made exactly, but fits a window of one cent
+    BOOST_CHECK(!SelectCoinsBnB(vInputs, 34 * CENT, 0, vfSelected, nValue));
+    BOOST_CHECK(SelectCoinsBnB(vInputs, 34 * CENT, CENT, vfSelected, nValue));
+    BOOST_CHECK_EQUAL(nValue, 35 * CENT);
+
+    // More than the wallet holds
+    BOOST_CHECK(!SelectCoinsBnB(vInputs, 39 * CENT, CENT, vfSelected, nValue));
+}
+
+BOOST_AUTO_TEST_CASE(bnb_cost)
+{
+    // 30 is 20+10 or 10+10+10; the three cheap coins win when the 20 is expensive
+    vector<CSelectionInput> vInputs;
+    add_input(vInputs, 20 * CENT, 10);
+    add_input(vInputs, 10 * CENT, 2);
+    add_input(vInputs, 10 * CENT, 2);
+    add_input(vInputs, 10 * CENT, 2);
+    SortSelectionInputs(vInputs);
+
+    vector<char> vfSelected;
+    CAmount nValue;
+    unsigned int nCount;
+    BOOST_CHECK(SelectCoinsBnB(vInputs, 30 * CENT, 0, vfSelected, nValue));
+    selected_value(vInputs, vfSelected, nCount);
+    BOOST_CHECK_EQUAL(nCount, 3U);
+
+    // Identical coins do not blow up the search
+    vInputs.clear();
+    for (int i = 0; i < 100; i++)
+        add_input(vInputs, COIN);
+    BOOST_CHECK(SelectCoinsBnB(vInputs, 50 * COIN, 0, vfSelected, nValue, 1000));
+    BOOST_CHECK_EQUAL(selected_value(vInputs, vfSelected, nCount), 50 * COIN);
+    BOOST_CHECK(!SelectCoinsBnB(vInputs, 50 * COIN + 1, 0, vfSelected, nValue, 1000));
+}
+
+BOOST_AUTO_TEST_CASE(policies)
+{
+    vector<CAmount> vDenoms;
+    vDenoms.push_back(10 * COIN + 10000);
+    vDenoms.push_back(1 * COIN + 1000);
+    CDenominatedOnlyPolicy policyDenom(vDenoms);
+    BOOST_CHECK(policyDenom.Accept(1 * COIN + 1000));
+    BOOST_CHECK(!policyDenom.Accept(1 * COIN));
+
+    // A day old coin costs its value in coin-days, a new one next to nothing
+    CPreserveCoinAgePolicy policyAge;
+    BOOST_CHECK_EQUAL(policyAge.Cost(COIN, 0, 24 * 60 * 60), (uint64_t)COIN + 1);
+    BOOST_CHECK_EQUAL(policyAge.Cost(COIN, 100, 100), 1U);
+    BOOST_CHECK(policyAge.Cost(COIN, 0, 7 * 24 * 60 * 60) > policyAge.Cost(2 * COIN, 0, 24 * 60 * 60));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
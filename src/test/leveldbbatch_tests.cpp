@@ -0,0 +1,67 @@
+#include <boost/test/unit_test.hpp>
+
+#include "leveldbbatch.h"
+
+#include <leveldb/env.h>
+#include <memenv/memenv.h>
+
+#include <string>
+
+using namespace std;
+
+BOOST_AUTO_TEST_SUITE(leveldbbatch_tests)
+
+BOOST_AUTO_TEST_CASE(lookup_sees_last_operation)
+{
+    CLevelDBIndexedBatch batch;
+    string strValue = "untouched";
+    bool fDeleted = false;
+
+    BOOST_CHECK(!batch.Lookup("a", &strValue, &fDeleted));
+    BOOST_CHECK(strValue == "untouched");
+
+    batch.Put("a", "1");
+    batch.Put("a", "2");
+    BOOST_CHECK(batch.Lookup("a", &strValue, &fDeleted));
+    BOOST_CHECK(!fDeleted);
+    BOOST_CHECK(strValue == "2");
+
+    batch.Delete("a");
+    strValue = "untouched";
+    BOOST_CHECK(batch.Lookup("a", &strValue, &fDeleted));
+    BOOST_CHECK(fDeleted);
+    BOOST_CHECK(strValue == "untouched");
+
+    batch.Put("a", "3");
+    BOOST_CHECK(batch.Lookup("a", &strValue, &fDeleted));
+    BOOST_CHECK(!fDeleted);
+    BOOST_CHECK(strValue == "3");
+    BOOST_CHECK_EQUAL(batch.size(), 1U);
+}
+
+BOOST_AUTO_TEST_CASE(commit_applies_pending_operations)
+{
+    leveldb::Env* penv = leveldb::NewMemEnv(leveldb::Env::Default());
+    leveldb::Options options;
+    options.env = penv;
+    options.create_if_missing = true;
+    leveldb::DB* pdb = NULL;
+    BOOST_REQUIRE(leveldb::DB::Open(options, "/leveldbbatch_tests", &pdb).ok());
+    BOOST_REQUIRE(pdb->Put(leveldb::WriteOptions(), "gone", "x").ok());
+
+    CLevelDBIndexedBatch batch;
+    batch.Put("kept", "1");
+    batch.Put("kept", "2");
+    batch.Delete("gone");
+    BOOST_CHECK(batch.Commit(pdb, leveldb::WriteOptions()).ok());
+
+    string strValue;
+    BOOST_CHECK(pdb->Get(leveldb::ReadOptions(), "kept", &strValue).ok());
+    BOOST_CHECK(strValue == "2");
+    BOOST_CHECK(pdb->Get(leveldb::ReadOptions(), "gone", &strValue).IsNotFound());
+
+    delete pdb;
+    delete penv;
+}
+
+BOOST_AUTO_TEST_SUITE_END()
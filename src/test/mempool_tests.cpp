@@ -0,0 +1,166 @@
+#include <boost/test/unit_test.hpp>
+
+#include "txmempool.h"
+
+#include <vector>
+
+using namespace std;
+
+// A transaction spending output n of hashPrev, paying nValue to a single output
+static CTransaction MakeTx(const uint256& hashPrev, unsigned int n, CAmount nValue)
+{
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].prevout = COutPoint(hashPrev, n);
+    tx.vin[0].scriptSig = CScript() << OP_11;
+    tx.vout.resize(1);
+    tx.vout[0].nValue = nValue;
+    tx.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+    return CTransaction(tx);
+}
+
+BOOST_AUTO_TEST_SUITE(mempool_tests)
+
+BOOST_AUTO_TEST_CASE(mempool_indexes)
+{
+    CTxMemPool pool(CFeeRate(0));
+
+    vector<CTransaction> vtx;
+    for (int i = 0; i < 5; i++) {
+        vtx.push_back(MakeTx(uint256(i + 1), 0, COIN));
+        // Fees grow with i, entry times shrink
+        pool.addUnchecked(vtx[i].GetHash(), CTxMemPoolEntry(vtx[i], 1000 * (i + 1), 100 - i, 0.0, 1));
+    }
+    BOOST_CHECK_EQUAL(pool.size(), 5U);
+
+    int i = 0;
+    BOOST_FOREACH(const CTxMemPoolEntry& entry, pool.mapTx.get<fee_rate>())
+        BOOST_CHECK(entry.GetHash() == vtx[i++].GetHash());
+    i = 4;
+    BOOST_FOREACH(const CTxMemPoolEntry& entry, pool.mapTx.get<entry_time>())
+        BOOST_CHECK(entry.GetHash() == vtx[i--].GetHash());
+
+    // The spent outpoints point back at the pooled transactions
+    map<COutPoint, CInPoint>::iterator it = pool.mapNextTx.find(COutPoint(uint256(3), 0));
+    BOOST_REQUIRE(it != pool.mapNextTx.end());
+    BOOST_CHECK(it->second.ptx->GetHash() == vtx[2].GetHash());
+
+    pool.remove(vtx[2]);
+    BOOST_CHECK(!pool.exists(vtx[2].GetHash()));
+    BOOST_CHECK(pool.mapNextTx.find(COutPoint(uint256(3), 0)) == pool.mapNextTx.end());
+    BOOST_CHECK_EQUAL(pool.mapTx.get<fee_rate>().size(), 4U);
+}
+
+BOOST_AUTO_TEST_CASE(mempool_priority_ages)
+{
+    CTransaction tx = MakeTx(uint256(1), 0, COIN);
+    unsigned int nModSize = tx.CalculateModifiedSize();
+    CTxMemPoolEntry entry(tx, 0, 0, 10.0, 100, 5 * COIN);
+
+    BOOST_CHECK_EQUAL(entry.GetPriority(100), 10.0);
+    BOOST_CHECK_CLOSE(entry.GetPriority(110), 10.0 + 10.0 * 5 * COIN / nModSize, 1e-9);
+}
+
+BOOST_AUTO_TEST_CASE(mempool_trim_evicts_cheapest_package)
+{
+    CTxMemPool pool(CFeeRate(0));
+
+    // A cheap parent with a well paying child, and a transaction paying in between
+    CTransaction txParent = MakeTx(uint256(1), 0, COIN);
+    CTransaction txChild = MakeTx(txParent.GetHash(), 0, COIN);
+    CTransaction txOther = MakeTx(uint256(2), 0, COIN);
+    pool.addUnchecked(txParent.GetHash(), CTxMemPoolEntry(txParent, 100, 0, 0.0, 1));
+    pool.addUnchecked(txChild.GetHash(), CTxMemPoolEntry(txChild, 100000, 0, 0.0, 1));
+    pool.addUnchecked(txOther.GetHash(), CTxMemPoolEntry(txOther, 10000, 0, 0.0, 1));
+
+    // The child's fee counts towards its parent
+    CTxMemPoolEntry parent = *pool.mapTx.find(txParent.GetHash());
+    BOOST_CHECK_EQUAL(parent.GetFeesWithDescendants(), 100100);
+    BOOST_CHECK_EQUAL(parent.GetSizeWithDescendants(), 2 * parent.GetTxSize());
+    BOOST_CHECK(pool.mapTx.get<fee_rate>().begin()->GetHash() == txOther.GetHash());
+
+    size_t nUsage = pool.DynamicMemoryUsage();
+    BOOST_CHECK(nUsage > 0);
+    BOOST_CHECK_EQUAL(pool.TrimToSize(nUsage), 0U);
+    BOOST_CHECK(pool.GetMinFee() == CFeeRate(0));
+
+    // The child pays for its parent, so the package outbids txOther
+    BOOST_CHECK_EQUAL(pool.TrimToSize(nUsage - 1), 1U);
+    BOOST_CHECK(!pool.exists(txOther.GetHash()));
+    BOOST_CHECK(pool.exists(txParent.GetHash()));
+    BOOST_CHECK(pool.exists(txChild.GetHash()));
+
+    // Paying less than what was evicted no longer gets a transaction in
+    BOOST_CHECK(pool.GetMinFee().GetFee(parent.GetTxSize()) > 5000);
+
+    // The child cannot be mined without its parent, so both go
+    BOOST_CHECK_EQUAL(pool.TrimToSize(0), 2U);
+    BOOST_CHECK(pool.mapNextTx.find(COutPoint(txParent.GetHash(), 0)) == pool.mapNextTx.end());
+    BOOST_CHECK_EQUAL(pool.size(), 0U);
+    BOOST_CHECK_EQUAL(pool.DynamicMemoryUsage(), 0U);
+}
+
+BOOST_AUTO_TEST_CASE(mempool_descendant_state)
+{
+    CTxMemPool pool(CFeeRate(0));
+
+    // A chain of three; mining the first leaves the other two linked
+    CTransaction tx1 = MakeTx(uint256(1), 0, COIN);
+    CTransaction tx2 = MakeTx(tx1.GetHash(), 0, COIN);
+    CTransaction tx3 = MakeTx(tx2.GetHash(), 0, COIN);
+    pool.addUnchecked(tx1.GetHash(), CTxMemPoolEntry(tx1, 1000, 0, 0.0, 1));
+    pool.addUnchecked(tx2.GetHash(), CTxMemPoolEntry(tx2, 2000, 0, 0.0, 1));
+    pool.addUnchecked(tx3.GetHash(), CTxMemPoolEntry(tx3, 3000, 0, 0.0, 1));
+    BOOST_CHECK_EQUAL(pool.mapTx.find(tx1.GetHash())->GetFeesWithDescendants(), 6000);
+    BOOST_CHECK_EQUAL(pool.mapTx.find(tx2.GetHash())->GetFeesWithDescendants(), 5000);
+
+    pool.remove(tx3);
+    BOOST_CHECK_EQUAL(pool.mapTx.find(tx1.GetHash())->GetFeesWithDescendants(), 3000);
+    BOOST_CHECK_EQUAL(pool.mapTx.find(tx2.GetHash())->GetFeesWithDescendants(), 2000);
+
+    // Put back after a reorg, a parent picks up the children already there
+    pool.remove(tx1);
+    pool.addUnchecked(tx3.GetHash(), CTxMemPoolEntry(tx3, 3000, 0, 0.0, 1));
+    pool.addUnchecked(tx1.GetHash(), CTxMemPoolEntry(tx1, 1000, 0, 0.0, 1));
+    BOOST_CHECK_EQUAL(pool.mapTx.find(tx1.GetHash())->GetFeesWithDescendants(), 6000);
+    BOOST_CHECK_EQUAL(pool.mapTx.find(tx2.GetHash())->GetFeesWithDescendants(), 5000);
+    BOOST_CHECK_EQUAL(pool.mapTx.find(tx1.GetHash())->GetCountWithDescendants(), 3U);
+}
+
+BOOST_AUTO_TEST_CASE(mempool_chain_limits)
+{
+    CTxMemPool pool(CFeeRate(0));
+    set<uint256> setAncestors;
+    string errString;
+
+    // A chain of five, then a transaction that would be the sixth
+    vector<CTransaction> vtx;
+    vtx.push_back(MakeTx(uint256(1), 0, COIN));
+    for (int i = 1; i < 5; i++)
+        vtx.push_back(MakeTx(vtx[i - 1].GetHash(), 0, COIN));
+    BOOST_FOREACH(const CTransaction& tx, vtx)
+        pool.addUnchecked(tx.GetHash(), CTxMemPoolEntry(tx, 1000, 0, 0.0, 1));
+    CTransaction txNext = MakeTx(vtx[4].GetHash(), 0, COIN);
+    BOOST_CHECK_EQUAL(pool.mapTx.find(vtx[0].GetHash())->GetCountWithDescendants(), 5U);
+
+    BOOST_CHECK(pool.CalculateMemPoolAncestors(txNext, setAncestors, 6, 1000000, 6, 1000000, errString));
+    BOOST_CHECK_EQUAL(setAncestors.size(), 5U);
+
+    // Each limit on its own turns it away
+    setAncestors.clear();
+    BOOST_CHECK(!pool.CalculateMemPoolAncestors(txNext, setAncestors, 5, 1000000, 6, 1000000, errString));
+    setAncestors.clear();
+    BOOST_CHECK(!pool.CalculateMemPoolAncestors(txNext, setAncestors, 6, 1000000, 5, 1000000, errString));
+    uint64_t nChainSize = pool.mapTx.find(vtx[0].GetHash())->GetSizeWithDescendants();
+    setAncestors.clear();
+    BOOST_CHECK(!pool.CalculateMemPoolAncestors(txNext, setAncestors, 6, nChainSize, 6, 1000000, errString));
+    setAncestors.clear();
+    BOOST_CHECK(!pool.CalculateMemPoolAncestors(txNext, setAncestors, 6, 1000000, 6, nChainSize, errString));
+
+    // Spending a confirmed output only, it has no ancestors to walk
+    setAncestors.clear();
+    BOOST_CHECK(pool.CalculateMemPoolAncestors(MakeTx(uint256(2), 0, COIN), setAncestors, 1, 1000, 1, 1000, errString));
+    BOOST_CHECK(setAncestors.empty());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
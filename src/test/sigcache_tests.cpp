@@ -0,0 +1,81 @@
+#include <boost/test/unit_test.hpp>
+
+#include "script/sigcache.h"
+
+#include "pubkey.h"
+#include "util.h"
+
+#include <vector>
+
+using namespace std;
+
+BOOST_AUTO_TEST_SUITE(sigcache_tests)
+
+BOOST_AUTO_TEST_CASE(sigcache_entries)
+{
+    CSignatureCache cache(1 << 20);
+    vector<unsigned char> vchPubKey(33, 0x11);
+    vchPubKey[0] = 0x02;
+    CPubKey pubkey(vchPubKey.begin(), vchPubKey.end());
+    vector<unsigned char> vchSig(71, 0x22);
+    uint256 hash = GetRandHash();
+
+    // Every part of the signature goes into the entry
+    uint256 entry, entryOther;
+    cache.ComputeEntry(entry, hash, vchSig, pubkey);
+    cache.ComputeEntry(entryOther, hash, vchSig, pubkey);
+    BOOST_CHECK(entry == entryOther);
+    vchSig[70] ^= 1;
+    cache.ComputeEntry(entryOther, hash, vchSig, pubkey);
+    BOOST_CHECK(entry != entryOther);
+
+    // and the salt differs between caches
+    CSignatureCache cacheOther(1 << 20);
+    vchSig[70] ^= 1;
+    cacheOther.ComputeEntry(entryOther, hash, vchSig, pubkey);
+    BOOST_CHECK(entry != entryOther);
+
+    BOOST_CHECK(!cache.Get(entry));
+    cache.Set(entry);
+    BOOST_CHECK(cache.Get(entry));
+    cache.Set(entry);
+
+    CSignatureCacheStats stats;
+    cache.GetStats(stats);
+    BOOST_CHECK(stats.nBytes <= (1 << 20));
+    BOOST_CHECK_EQUAL(stats.nLookups, 2U);
+    BOOST_CHECK_EQUAL(stats.nHits, 1U);
+    BOOST_CHECK_EQUAL(stats.nInserts, 1U);
+}
+
+BOOST_AUTO_TEST_CASE(sigcache_full)
+{
+    // Fill the cache twice over; it keeps a good share of what it can hold
+    CSignatureCache cache(1 << 16);
+    CSignatureCacheStats stats;
+    cache.GetStats(stats);
+    BOOST_REQUIRE(stats.nCapacity > 0);
+
+    vector<uint256> vEntries;
+    for (uint64_t i = 0; i < 2 * stats.nCapacity; i++) {
+        vEntries.push_back(GetRandHash());
+        cache.Set(vEntries.back());
+    }
+    unsigned int nFound = 0;
+    for (unsigned int i = 0; i < vEntries.size(); i++)
+        if (cache.Get(vEntries[i]))
+            nFound++;
+    BOOST_CHECK(nFound <= stats.nCapacity);
+    BOOST_CHECK(nFound > stats.nCapacity * 9 / 10);
+
+    cache.GetStats(stats);
+    BOOST_CHECK_EQUAL(stats.nInserts, vEntries.size());
+    BOOST_CHECK_EQUAL(stats.nEvictions, vEntries.size() - nFound);
+
+    // A zero size cache holds nothing
+    CSignatureCache cacheEmpty(0);
+    cacheEmpty.Set(vEntries[0]);
+    BOOST_CHECK(!cacheEmpty.Get(vEntries[0]));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,64 @@
+#include <boost/test/unit_test.hpp>
+
+#include "anon/stealth/stealth.h"
+
+#include <vector>
+
+using namespace std;
+
+BOOST_AUTO_TEST_SUITE(stealth_tests)
+
+BOOST_AUTO_TEST_CASE(stealth_scanner_matches_sender)
+{
+    // Three addresses the wallet owns
+    vector<ec_secret> vScan(3), vSpend(3);
+    vector<ec_point> vScanPubkey(3), vSpendPubkey(3);
+    CStealthScanner scanner;
+    for (int i = 0; i < 3; i++) {
+        BOOST_REQUIRE(GenerateRandomSecret(vScan[i]) == 0);
+        BOOST_REQUIRE(GenerateRandomSecret(vSpend[i]) == 0);
+        BOOST_REQUIRE(SecretToPublicKey(vScan[i], vScanPubkey[i]) == 0);
+        BOOST_REQUIRE(SecretToPublicKey(vSpend[i], vSpendPubkey[i]) == 0);
+        BOOST_CHECK(scanner.AddAddress(data_chunk(vScan[i].e, vScan[i].e + ec_secret_size), vSpendPubkey[i]));
+    }
+    BOOST_CHECK(!scanner.AddAddress(data_chunk(31, 1), vSpendPubkey[0]));
+    BOOST_CHECK_EQUAL(scanner.size(), 3U);
+
+    // The sender pays the second address
+    ec_secret sEphem, sShared;
+    ec_point pkEphem, pkSendTo;
+    BOOST_REQUIRE(GenerateRandomSecret(sEphem) == 0);
+    BOOST_REQUIRE(SecretToPublicKey(sEphem, pkEphem) == 0);
+    BOOST_REQUIRE(StealthSecret(sEphem, vScanPubkey[1], vSpendPubkey[1], sShared, pkSendTo) == 0);
+    BOOST_CHECK_EQUAL(pkSendTo.size(), ec_compressed_size);
+
+    vector<CStealthScanner::Derived> vDerived;
+    BOOST_REQUIRE(scanner.Derive(pkEphem, vDerived));
+    BOOST_REQUIRE_EQUAL(vDerived.size(), 3U);
+    for (int i = 0; i < 3; i++) {
+        BOOST_CHECK_EQUAL(vDerived[i].nAddress, (size_t)i);
+        BOOST_CHECK_EQUAL(vDerived[i].pkSpendR == pkSendTo, i == 1);
+    }
+    BOOST_CHECK(memcmp(vDerived[1].sShared.e, sShared.e, ec_secret_size) == 0);
+
+    // The receiver can spend it
+    ec_secret sSpendR;
+    ec_point pkSpendR;
+    BOOST_REQUIRE(StealthSecretSpend(vScan[1], pkEphem, vSpend[1], sSpendR) == 0);
+    BOOST_REQUIRE(SecretToPublicKey(sSpendR, pkSpendR) == 0);
+    BOOST_CHECK(pkSpendR == pkSendTo);
+
+    // Batches give the same as one key at a time
+    vector<ec_point> vEphem(1, pkEphem);
+    vEphem.push_back(vScanPubkey[0]);
+    vEphem.push_back(ec_point(33, 0)); // not a point
+    vector<vector<CStealthScanner::Derived> > vBatch;
+    scanner.DeriveBatch(vEphem, vBatch, 4);
+    BOOST_REQUIRE_EQUAL(vBatch.size(), 3U);
+    BOOST_REQUIRE_EQUAL(vBatch[0].size(), 3U);
+    BOOST_CHECK(vBatch[0][1].pkSpendR == pkSendTo);
+    BOOST_CHECK_EQUAL(vBatch[1].size(), 3U);
+    BOOST_CHECK(vBatch[2].empty());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,55 @@
+#include <boost/test/unit_test.hpp>
+
+#include "primitives/transaction.h"
+#include "streams.h"
+#include "version.h"
+
+using namespace std;
+
+static CMutableTransaction BuildTestTransaction()
+{
+    CMutableTransaction tx;
+    tx.nTime = 1444948732;
+    tx.vin.resize(1);
+    tx.vin[0].prevout = COutPoint(uint256(1), 0);
+    tx.vin[0].scriptSig = CScript() << OP_1;
+    tx.vout.resize(2);
+    tx.vout[0].nValue = 10 * COIN;
+    tx.vout[0].scriptPubKey = CScript() << OP_TRUE;
+    tx.vout[1].nValue = 5 * COIN;
+    tx.vout[1].scriptPubKey = CScript() << OP_TRUE;
+    return tx;
+}
+
+BOOST_AUTO_TEST_SUITE(transaction_tests)
+
+BOOST_AUTO_TEST_CASE(cached_hash_matches_serialization)
+{
+    CMutableTransaction mtx = BuildTestTransaction();
+    CTransaction tx(mtx);
+    BOOST_CHECK(tx.GetHash() == mtx.GetHash());
+    BOOST_CHECK(tx.GetHash() == SerializeHash(tx));
+
+    // Deserializing refreshes the cached hash.
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << tx;
+    CTransaction txRead;
+    ss >> txRead;
+    BOOST_CHECK(txRead.GetHash() == tx.GetHash());
+    BOOST_CHECK(txRead == tx);
+
+    // Assignment carries the hash along with the data.
+    mtx.vout[1].nValue = 4 * COIN;
+    CTransaction txChanged(mtx);
+    BOOST_CHECK(txChanged != tx);
+    txRead = txChanged;
+    BOOST_CHECK(txRead.GetHash() == mtx.GetHash());
+    BOOST_CHECK(txRead.GetHash() == SerializeHash(txRead));
+
+    // SetNull resets to an empty transaction with a matching hash.
+    txRead.SetNull();
+    BOOST_CHECK(txRead.IsNull());
+    BOOST_CHECK(txRead.GetHash() == SerializeHash(txRead));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
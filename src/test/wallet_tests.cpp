@@ -292,4 +292,68 @@ BOOST_AUTO_TEST_CASE(coin_selection_tests)
     }
 }
 
+BOOST_AUTO_TEST_CASE(unspent_set_follows_wallet)
+{
+    // An output is in setUnspent while it is ours and not both marked spent
+    // and spent by a transaction in the wallet
+    if (!bitdb.IsMock())
+        bitdb.MakeMock();
+    CWallet wallet("wallet_unspent_tests.dat");
+    CKey key;
+    key.MakeNewKey(true);
+    BOOST_REQUIRE(wallet.AddKeyPubKey(key, key.GetPubKey()));
+    CScript scriptMine;
+    scriptMine.SetDestination(key.GetPubKey().GetID());
+
+    // Received: one output ours, one not
+    CMutableTransaction txFund;
+    txFund.vin.resize(1);
+    txFund.vin[0].prevout = COutPoint(uint256(1), 0);
+    txFund.vout.push_back(CTxOut(COIN, scriptMine));
+    txFund.vout.push_back(CTxOut(COIN, CScript() << OP_TRUE));
+    CTransaction txFundFinal(txFund);
+    uint256 hashFund = txFundFinal.GetHash();
+    BOOST_REQUIRE(wallet.AddToWallet(CWalletTx(&wallet, txFundFinal)));
+    BOOST_CHECK(wallet.IsInUnspentSet(COutPoint(hashFund, 0)));
+    BOOST_CHECK(!wallet.IsInUnspentSet(COutPoint(hashFund, 1)));
+
+    // Spent by a coinstake of ours: gone once it is also marked spent
+    CMutableTransaction txStake;
+    txStake.vin.push_back(CTxIn(hashFund, 0));
+    txStake.vout.resize(1);
+    txStake.vout[0].SetEmpty();
+    txStake.vout.push_back(CTxOut(2 * COIN, scriptMine));
+    CTransaction txStakeFinal(txStake);
+    uint256 hashStake = txStakeFinal.GetHash();
+    BOOST_REQUIRE(wallet.AddToWallet(CWalletTx(&wallet, txStakeFinal)));
+    BOOST_CHECK(wallet.IsInUnspentSet(COutPoint(hashStake, 1)));
+    BOOST_CHECK(!wallet.IsInUnspentSet(COutPoint(hashStake, 0)));
+    BOOST_CHECK(wallet.IsInUnspentSet(COutPoint(hashFund, 0)));
+    {
+        LOCK(wallet.cs_wallet);
+        wallet.mapWallet[hashFund].MarkSpent(0);
+    }
+    wallet.MarkDirty();
+    BOOST_CHECK(!wallet.IsInUnspentSet(COutPoint(hashFund, 0)));
+
+    // Disconnecting the coinstake gives the input back
+    wallet.DisableTransaction(txStakeFinal);
+    BOOST_CHECK(wallet.IsInUnspentSet(COutPoint(hashFund, 0)));
+
+    // So does erasing the spender, and its own outputs go
+    {
+        LOCK(wallet.cs_wallet);
+        wallet.mapWallet[hashFund].MarkSpent(0);
+    }
+    wallet.MarkDirty();
+    BOOST_CHECK(!wallet.IsInUnspentSet(COutPoint(hashFund, 0)));
+    wallet.EraseFromWallet(hashStake);
+    BOOST_CHECK(!wallet.IsInUnspentSet(COutPoint(hashStake, 1)));
+    BOOST_CHECK(wallet.IsInUnspentSet(COutPoint(hashFund, 0)));
+
+    // Outputs of an erased transaction go with it
+    wallet.EraseFromWallet(hashFund);
+    BOOST_CHECK(!wallet.IsInUnspentSet(COutPoint(hashFund, 0)));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -7,6 +7,7 @@
 #include <boost/version.hpp>
 #include <boost/filesystem.hpp>
 #include <boost/filesystem/fstream.hpp>
+#include <boost/scoped_ptr.hpp>
 
 #include <leveldb/env.h>
 #include <leveldb/cache.h>
@@ -14,6 +15,8 @@
 
 #include <memenv/memenv.h>
 
+#include <deque>
+#include <list>
 #include <map>
 
 #include "txdb-leveldb.h"
@@ -146,14 +149,14 @@ void CTxDB::Close()
 bool CTxDB::TxnBegin()
 {
     assert(!activeBatch);
-    activeBatch = new leveldb::WriteBatch();
+    activeBatch = new CLevelDBIndexedBatch();
     return true;
 }
 
 bool CTxDB::TxnCommit()
 {
     assert(activeBatch);
-    leveldb::Status status = pdb->Write(leveldb::WriteOptions(), activeBatch);
+    leveldb::Status status = activeBatch->Commit(pdb, leveldb::WriteOptions());
     delete activeBatch;
     activeBatch = NULL;
     if (!status.ok()) {
@@ -163,75 +166,165 @@ bool CTxDB::TxnCommit()
     return true;
 }
 
-class CBatchScanner : public leveldb::WriteBatch::Handler {
-public:
-    std::string needle;
-    bool *deleted;
-    std::string *foundValue;
-    bool foundEntry;
-
-    CBatchScanner() : foundEntry(false) {}
-
-    virtual void Put(const leveldb::Slice& key, const leveldb::Slice& value) {
-        if (key.ToString() == needle) {
-            foundEntry = true;
-            *deleted = false;
-            *foundValue = value.ToString();
-        }
-    }
-
-    virtual void Delete(const leveldb::Slice& key) {
-        if (key.ToString() == needle) {
-            foundEntry = true;
-            *deleted = true;
-        }
-    }
-};
-
 // When performing a read, if we have an active batch we need to check it first
 // before reading from the database, as the rest of the code assumes that once
-// a database transaction begins reads are consistent with it. It would be good
-// to change that assumption in future and avoid the performance hit, though in
-// practice it does not appear to be large.
+// a database transaction begins reads are consistent with it.
 bool CTxDB::ScanBatch(const CDataStream &key, string *value, bool *deleted) const {
     assert(activeBatch);
     *deleted = false;
-    CBatchScanner scanner;
-    scanner.needle = key.str();
-    scanner.deleted = deleted;
-    scanner.foundValue = value;
-    leveldb::Status status = activeBatch->Iterate(&scanner);
-    if (!status.ok()) {
-        throw runtime_error(status.ToString());
-    }
-    return scanner.foundEntry;
+    return activeBatch->Lookup(key.str(), value, deleted);
 }
 
-bool CTxDB::WriteAddrIndex(uint160 addrHash, uint256 txHash)
+bool CTxDB::WriteAddrIndex(uint160 addrHash, int nHeight, uint256 txHash)
 {
-    std::vector<uint256> txHashes;
-    if(!ReadAddrIndex(addrHash, txHashes))
-    {
-	txHashes.push_back(txHash);
-        return Write(make_pair(string("adr"), addrHash), txHashes);
-    }
-    else
+    // Writing an entry that already exists just rewrites the same key.
+    return Write(make_pair(string("ati"), CAddrIndexKey(addrHash, nHeight, txHash)), (unsigned char)0);
+}
+
+bool CTxDB::EraseAddrIndex(uint160 addrHash, int nHeight, uint256 txHash)
+{
+    return Erase(make_pair(string("ati"), CAddrIndexKey(addrHash, nHeight, txHash)));
+}
+
+static string AddrIndexPrefix(const uint160& addrHash)
+{
+    CDataStream ssPrefix(SER_DISK, CLIENT_VERSION);
+    ssPrefix << make_pair(string("ati"), addrHash);
+    return ssPrefix.str();
+}
+
+static uint256 AddrIndexTxHash(const leveldb::Slice& slKey)
+{
+    CDataStream ssKey(SER_DISK, CLIENT_VERSION);
+    ssKey.write(slKey.data(), slKey.size());
+    string strType;
+    CAddrIndexKey key;
+    ssKey >> strType >> key;
+    return key.txHash;
+}
+
+unsigned int CTxDB::CountAddrIndex(uint160 addrHash)
+{
+    // Entries left behind by a reorganization before DisconnectBlock erased
+    // them list a transaction at more than one height; count it once
+    string strPrefix = AddrIndexPrefix(addrHash);
+    set<uint256> setSeen;
+    leveldb::Iterator *iterator = pdb->NewIterator(leveldb::ReadOptions());
+    for (iterator->Seek(strPrefix); iterator->Valid() && iterator->key().starts_with(strPrefix); iterator->Next())
+        setSeen.insert(AddrIndexTxHash(iterator->key()));
+    delete iterator;
+    return setSeen.size();
+}
+
+bool CTxDB::ReadAddrIndex(uint160 addrHash, std::vector<uint256>& txHashes, int nSkip, int nCount)
+{
+    txHashes.clear();
+    if (nSkip < 0)
+        nSkip = max(0, (int)CountAddrIndex(addrHash) + nSkip);
+
+    string strPrefix = AddrIndexPrefix(addrHash);
+    set<uint256> setSeen;
+    leveldb::Iterator *iterator = pdb->NewIterator(leveldb::ReadOptions());
+    for (iterator->Seek(strPrefix); iterator->Valid() && iterator->key().starts_with(strPrefix); iterator->Next())
     {
-	if(std::find(txHashes.begin(), txHashes.end(), txHash) == txHashes.end()) 
-    	{
-    	    txHashes.push_back(txHash);
-            return Write(make_pair(string("adr"), addrHash), txHashes);
-	}
-	else
-	{
-	    return true; // already have this tx hash
-	}
+        uint256 txHash = AddrIndexTxHash(iterator->key());
+        if (!setSeen.insert(txHash).second)
+            continue;
+        if (nSkip > 0) {
+            nSkip--;
+            continue;
+        }
+        if (nCount >= 0 && txHashes.size() >= (unsigned int)nCount)
+            break;
+
+        txHashes.push_back(txHash);
     }
+    leveldb::Status status = iterator->status();
+    delete iterator;
+    if (!status.ok())
+        return error("ReadAddrIndex() : %s", status.ToString());
+    return true;
 }
 
-bool CTxDB::ReadAddrIndex(uint160 addrHash, std::vector<uint256>& txHashes)
+bool CTxDB::MigrateAddrIndex()
 {
-    return Read(make_pair(string("adr"), addrHash), txHashes);
+    // The old layout stored a vector of tx hashes under ("adr", addrHash).
+    // Heights are recovered from the block each tx index entry points at.
+    CDataStream ssStartKey(SER_DISK, CLIENT_VERSION);
+    ssStartKey << make_pair(string("adr"), uint160(0));
+
+    leveldb::Iterator *iterator = pdb->NewIterator(leveldb::ReadOptions());
+    iterator->Seek(ssStartKey.str());
+    bool fFound = false;
+    if (iterator->Valid()) {
+        CDataStream ssKey(SER_DISK, CLIENT_VERSION);
+        ssKey.write(iterator->key().data(), iterator->key().size());
+        string strType;
+        ssKey >> strType;
+        fFound = (strType == "adr");
+    }
+    if (!fFound) {
+        delete iterator;
+        return true;
+    }
+
+    LogPrintf("Upgrading address index to one key per entry...\n");
+    int64_t nStart = GetTimeMillis();
+
+    map<pair<unsigned int, unsigned int>, int> mapBlockHeight;
+    BOOST_FOREACH(const PAIRTYPE(uint256, CBlockIndex*)& item, mapBlockIndex)
+        mapBlockHeight[make_pair(item.second->nFile, item.second->nBlockPos)] = item.second->nHeight;
+
+    unsigned int nAddresses = 0, nEntries = 0, nDropped = 0;
+    TxnBegin();
+    for (; iterator->Valid(); iterator->Next())
+    {
+        boost::this_thread::interruption_point();
+        CDataStream ssKey(SER_DISK, CLIENT_VERSION);
+        ssKey.write(iterator->key().data(), iterator->key().size());
+        string strType;
+        ssKey >> strType;
+        if (strType != "adr")
+            break;
+        uint160 addrHash;
+        ssKey >> addrHash;
+
+        CDataStream ssValue(SER_DISK, CLIENT_VERSION);
+        ssValue.write(iterator->value().data(), iterator->value().size());
+        vector<uint256> txHashes;
+        ssValue >> txHashes;
+
+        BOOST_FOREACH(const uint256& txHash, txHashes)
+        {
+            CTxIndex txindex;
+            map<pair<unsigned int, unsigned int>, int>::const_iterator mi;
+            if (!ReadTxIndex(txHash, txindex) ||
+                (mi = mapBlockHeight.find(make_pair(txindex.pos.nFile, txindex.pos.nBlockPos))) == mapBlockHeight.end())
+            {
+                // Not in the main chain any more; it could not be fetched anyway.
+                nDropped++;
+                continue;
+            }
+            WriteAddrIndex(addrHash, mi->second, txHash);
+            nEntries++;
+        }
+        Erase(make_pair(string("adr"), addrHash));
+
+        if (++nAddresses % 10000 == 0) {
+            if (!TxnCommit()) {
+                delete iterator;
+                return error("MigrateAddrIndex() : TxnCommit failed");
+            }
+            TxnBegin();
+        }
+    }
+    delete iterator;
+    if (!TxnCommit())
+        return error("MigrateAddrIndex() : TxnCommit failed");
+
+    LogPrintf("Upgraded address index: %u addresses, %u entries, %u dropped, %dms\n",
+        nAddresses, nEntries, nDropped, GetTimeMillis() - nStart);
+    return true;
 }
 
 bool CTxDB::ReadTxIndex(uint256 hash, CTxIndex& txindex)
@@ -322,20 +415,134 @@ CBlockIndex *InsertBlockIndex(uint256 hash)
         return NULL;
 
     // Return existing
-    map<uint256, CBlockIndex*>::iterator mi = mapBlockIndex.find(hash);
+    BlockMap::iterator mi = mapBlockIndex.find(hash);
     if (mi != mapBlockIndex.end())
         return (*mi).second;
 
     // Create new
-    CBlockIndex* pindexNew = new CBlockIndex();
-    if (!pindexNew)
-        throw runtime_error("LoadBlockIndex() : new CBlockIndex failed");
+    CBlockIndex* pindexNew = blockIndexArena.Alloc();
     mi = mapBlockIndex.insert(make_pair(hash, pindexNew)).first;
     pindexNew->phashBlock = &((*mi).first);
 
     return pindexNew;
 }
 
+// Block index entries handed to a decoding thread at a time
+static const unsigned int BLOCKINDEX_LOAD_BATCH = 1024;
+
+// Most threads used to decode the block index at startup
+static const int MAX_BLOCKINDEX_LOAD_THREADS = 8;
+
+/** Raw "blockindex" values copied out of the database, and what a decoding
+ *  thread made of them. */
+struct CBlockIndexLoadBatch
+{
+    string strData;           // the values back to back
+    vector<size_t> vEnd;      // end of each value in strData
+    vector<CDiskBlockIndex> vIndex;
+    vector<uint256> vHash;
+    vector<uint256> vTrust;   // GetBlockTrust() of each entry
+    int nBadIndex;            // first entry failing CheckIndex, or -1
+    string strError;          // set if an entry could not be decoded
+
+    CBlockIndexLoadBatch() : nBadIndex(-1) {}
+
+    void Decode()
+    {
+        vIndex.resize(vEnd.size());
+        vHash.resize(vEnd.size());
+        vTrust.resize(vEnd.size());
+        try {
+            size_t nBegin = 0;
+            for (unsigned int i = 0; i < vEnd.size(); i++)
+            {
+                CSpanStream ssValue(strData.data() + nBegin, strData.data() + vEnd[i], SER_DISK, CLIENT_VERSION);
+                ssValue >> vIndex[i];
+                vHash[i] = vIndex[i].GetBlockHash();
+                vTrust[i] = vIndex[i].GetBlockTrust();
+                if (nBadIndex < 0 && !vIndex[i].CheckIndex())
+                    nBadIndex = i;
+                nBegin = vEnd[i];
+            }
+        }
+        catch (const std::exception& e) {
+            strError = e.what();
+        }
+        string().swap(strData);
+    }
+};
+
+/** Decodes batches of block index entries on a pool of threads while the
+ *  database is still being scanned. With no threads, batches are decoded
+ *  as they are pushed. */
+class CBlockIndexDecoder
+{
+private:
+    boost::mutex mutex;
+    boost::condition_variable cond;
+    deque<CBlockIndexLoadBatch*> queue;
+    bool fDone;
+    boost::thread_group threads;
+
+    void Worker()
+    {
+        RenameThread("darksilk-loadidx");
+        while (true)
+        {
+            CBlockIndexLoadBatch* pbatch;
+            {
+                boost::unique_lock<boost::mutex> lock(mutex);
+                while (queue.empty() && !fDone)
+                    cond.wait(lock);
+                if (queue.empty())
+                    return;
+                pbatch = queue.front();
+                queue.pop_front();
+            }
+            pbatch->Decode();
+        }
+    }
+
+public:
+    CBlockIndexDecoder(int nThreads) : fDone(false)
+    {
+        for (int i = 0; i < nThreads; i++)
+            threads.create_thread(boost::bind(&CBlockIndexDecoder::Worker, this));
+    }
+
+    ~CBlockIndexDecoder()
+    {
+        {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            queue.clear();
+        }
+        Finish();
+    }
+
+    void Push(CBlockIndexLoadBatch* pbatch)
+    {
+        if (threads.size() == 0)
+        {
+            pbatch->Decode();
+            return;
+        }
+        boost::unique_lock<boost::mutex> lock(mutex);
+        queue.push_back(pbatch);
+        cond.notify_one();
+    }
+
+    /** Wait until every pushed batch is decoded. */
+    void Finish()
+    {
+        {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            fDone = true;
+        }
+        cond.notify_all();
+        threads.join_all();
+    }
+};
+
 bool CTxDB::LoadBlockIndex()
 {
     if (mapBlockIndex.size() > 0) {
@@ -346,84 +553,132 @@ bool CTxDB::LoadBlockIndex()
     // The block index is an in-memory structure that maps hashes to on-disk
     // locations where the contents of the block can be found. Here, we scan it
     // out of the DB and into mapBlockIndex.
-    leveldb::Iterator *iterator = pdb->NewIterator(leveldb::ReadOptions());
-    // Seek to start key.
-    CDataStream ssStartKey(SER_DISK, CLIENT_VERSION);
-    ssStartKey << make_pair(string("blockindex"), uint256(0));
-    iterator->Seek(ssStartKey.str());
-    // Now read each entry.
-    while (iterator->Valid())
+    //
+    // This thread copies the raw entries out of the DB in batches, a pool of
+    // threads deserializes, hashes and checks them meanwhile, and the entries
+    // are linked together and given their chain trust in one pass at the end.
+    int64_t nStart = GetTimeMillis();
+    int nThreads = min((int)boost::thread::hardware_concurrency(), MAX_BLOCKINDEX_LOAD_THREADS);
+    list<CBlockIndexLoadBatch> listBatches;
+    unsigned int nEntries = 0;
+    int64_t nScanTime;
     {
-        boost::this_thread::interruption_point();
-        // Unpack keys and values.
-        CDataStream ssKey(SER_DISK, CLIENT_VERSION);
-        ssKey.write(iterator->key().data(), iterator->key().size());
-        CDataStream ssValue(SER_DISK, CLIENT_VERSION);
-        ssValue.write(iterator->value().data(), iterator->value().size());
-        string strType;
-        ssKey >> strType;
-        // Did we reach the end of the data to read?
-        if (strType != "blockindex")
-            break;
-        CDiskBlockIndex diskindex;
-        ssValue >> diskindex;
-
-        uint256 blockHash = diskindex.GetBlockHash();
-
-        // Construct block index object
-        CBlockIndex* pindexNew    = InsertBlockIndex(blockHash);
-        pindexNew->pprev          = InsertBlockIndex(diskindex.hashPrev);
-        pindexNew->pnext          = InsertBlockIndex(diskindex.hashNext);
-        pindexNew->nFile          = diskindex.nFile;
-        pindexNew->nBlockPos      = diskindex.nBlockPos;
-        pindexNew->nHeight        = diskindex.nHeight;
-        pindexNew->nMint          = diskindex.nMint;
-        pindexNew->nMoneySupply   = diskindex.nMoneySupply;
-        pindexNew->nFlags         = diskindex.nFlags;
-        pindexNew->nStakeModifier = diskindex.nStakeModifier;
-        pindexNew->bnStakeModifierV2 = diskindex.bnStakeModifierV2;
-        pindexNew->prevoutStake   = diskindex.prevoutStake;
-        pindexNew->nStakeTime     = diskindex.nStakeTime;
-        pindexNew->hashProof      = diskindex.hashProof;
-        pindexNew->nVersion       = diskindex.nVersion;
-        pindexNew->hashMerkleRoot = diskindex.hashMerkleRoot;
-        pindexNew->nTime          = diskindex.nTime;
-        pindexNew->nBits          = diskindex.nBits;
-        pindexNew->nNonce         = diskindex.nNonce;
-
-        // Watch for genesis block
-        if (pindexGenesisBlock == NULL && blockHash == Params().HashGenesisBlock())
-            pindexGenesisBlock = pindexNew;
-
-        if (!pindexNew->CheckIndex()) {
-            delete iterator;
-            return error("LoadBlockIndex() : CheckIndex failed at %d", pindexNew->nHeight);
+        CBlockIndexDecoder decoder(nThreads > 1 ? nThreads : 0);
+        boost::scoped_ptr<leveldb::Iterator> iterator(pdb->NewIterator(leveldb::ReadOptions()));
+        // Seek to start key.
+        CDataStream ssStartKey(SER_DISK, CLIENT_VERSION);
+        ssStartKey << make_pair(string("blockindex"), uint256(0));
+        iterator->Seek(ssStartKey.str());
+        // Now read each entry.
+        CBlockIndexLoadBatch* pbatch = NULL;
+        for (; iterator->Valid(); iterator->Next())
+        {
+            // Did we reach the end of the data to read?
+            leveldb::Slice slKey = iterator->key();
+            CSpanStream ssKey(slKey.data(), slKey.data() + slKey.size(), SER_DISK, CLIENT_VERSION);
+            string strType;
+            ssKey >> strType;
+            if (strType != "blockindex")
+                break;
+
+            if (!pbatch)
+            {
+                boost::this_thread::interruption_point();
+                listBatches.push_back(CBlockIndexLoadBatch());
+                pbatch = &listBatches.back();
+            }
+            leveldb::Slice slValue = iterator->value();
+            pbatch->strData.append(slValue.data(), slValue.size());
+            pbatch->vEnd.push_back(pbatch->strData.size());
+            nEntries++;
+            if (pbatch->vEnd.size() == BLOCKINDEX_LOAD_BATCH)
+            {
+                decoder.Push(pbatch);
+                pbatch = NULL;
+            }
         }
+        if (pbatch)
+            decoder.Push(pbatch);
+        nScanTime = GetTimeMillis() - nStart;
+        decoder.Finish();
+    }
+    LogPrintf("LoadBlockIndex(): read %u block index entries in %dms, decoded in %dms on %d threads\n",
+        nEntries, nScanTime, GetTimeMillis() - nStart, max(nThreads, 1));
 
-        // DarkSilk: build setStakeSeen
-        if (pindexNew->IsProofOfStake())
-            setStakeSeen.insert(make_pair(pindexNew->prevoutStake, pindexNew->nStakeTime));
+    boost::this_thread::interruption_point();
 
-        iterator->Next();
+    // Construct block index objects
+    int64_t nLinkStart = GetTimeMillis();
+    mapBlockIndex.reserve(nEntries);
+    int nMaxHeight = 0;
+    while (!listBatches.empty())
+    {
+        const CBlockIndexLoadBatch& batch = listBatches.front();
+        if (!batch.strError.empty())
+            return error("LoadBlockIndex() : cannot decode block index entry : %s", batch.strError);
+
+        for (unsigned int i = 0; i < batch.vIndex.size(); i++)
+        {
+            const CDiskBlockIndex& diskindex = batch.vIndex[i];
+            const uint256& blockHash = batch.vHash[i];
+
+            CBlockIndex* pindexNew    = InsertBlockIndex(blockHash);
+            pindexNew->pprev          = InsertBlockIndex(diskindex.hashPrev);
+            pindexNew->pnext          = InsertBlockIndex(diskindex.hashNext);
+            pindexNew->nFile          = diskindex.nFile;
+            pindexNew->nBlockPos      = diskindex.nBlockPos;
+            pindexNew->nHeight        = diskindex.nHeight;
+            pindexNew->nMint          = diskindex.nMint;
+            pindexNew->nMoneySupply   = diskindex.nMoneySupply;
+            pindexNew->nFlags         = diskindex.nFlags;
+            pindexNew->nStakeModifier = diskindex.nStakeModifier;
+            pindexNew->bnStakeModifierV2 = diskindex.bnStakeModifierV2;
+            pindexNew->prevoutStake   = diskindex.prevoutStake;
+            pindexNew->nStakeTime     = diskindex.nStakeTime;
+            pindexNew->hashProof      = diskindex.hashProof;
+            pindexNew->nVersion       = diskindex.nVersion;
+            pindexNew->hashMerkleRoot = diskindex.hashMerkleRoot;
+            pindexNew->nTime          = diskindex.nTime;
+            pindexNew->nBits          = diskindex.nBits;
+            pindexNew->nNonce         = diskindex.nNonce;
+            // The block's own trust until the pass below adds its ancestors'
+            pindexNew->nChainTrust    = batch.vTrust[i];
+
+            // Watch for genesis block
+            if (pindexGenesisBlock == NULL && blockHash == Params().HashGenesisBlock())
+                pindexGenesisBlock = pindexNew;
+
+            if ((int)i == batch.nBadIndex)
+                return error("LoadBlockIndex() : CheckIndex failed at %d", pindexNew->nHeight);
+
+            // DarkSilk: build setStakeSeen
+            if (pindexNew->IsProofOfStake())
+                setStakeSeen.insert(make_pair(pindexNew->prevoutStake, pindexNew->nStakeTime));
+
+            nMaxHeight = max(nMaxHeight, pindexNew->nHeight);
+        }
+        listBatches.pop_front();
     }
-    delete iterator;
 
     boost::this_thread::interruption_point();
 
-    // Calculate nChainTrust
-    vector<pair<int, CBlockIndex*> > vSortedByHeight;
-    vSortedByHeight.reserve(mapBlockIndex.size());
+    // Calculate nChainTrust, visiting the entries in height order. Heights
+    // are dense, so a counting sort is enough.
+    vector<unsigned int> vHeightStart(nMaxHeight + 2, 0);
     BOOST_FOREACH(const PAIRTYPE(uint256, CBlockIndex*)& item, mapBlockIndex)
+        vHeightStart[item.second->nHeight + 1]++;
+    for (int nHeight = 1; nHeight <= nMaxHeight + 1; nHeight++)
+        vHeightStart[nHeight] += vHeightStart[nHeight - 1];
+    vector<CBlockIndex*> vSortedByHeight(mapBlockIndex.size());
+    BOOST_FOREACH(const PAIRTYPE(uint256, CBlockIndex*)& item, mapBlockIndex)
+        vSortedByHeight[vHeightStart[item.second->nHeight]++] = item.second;
+    BOOST_FOREACH(CBlockIndex* pindex, vSortedByHeight)
     {
-        CBlockIndex* pindex = item.second;
-        vSortedByHeight.push_back(make_pair(pindex->nHeight, pindex));
-    }
-    sort(vSortedByHeight.begin(), vSortedByHeight.end());
-    BOOST_FOREACH(const PAIRTYPE(int, CBlockIndex*)& item, vSortedByHeight)
-    {
-        CBlockIndex* pindex = item.second;
-        pindex->nChainTrust = (pindex->pprev ? pindex->pprev->nChainTrust : 0) + pindex->GetBlockTrust();
+        if (pindex->pprev)
+            pindex->nChainTrust += pindex->pprev->nChainTrust;
     }
+    LogPrintf("LoadBlockIndex(): linked %u block index entries and computed chain trust in %dms\n",
+        mapBlockIndex.size(), GetTimeMillis() - nLinkStart);
 
     // Load hashBestChain pointer to end of best chain
     if (!ReadHashBestChain(hashBestChain))
@@ -435,6 +690,7 @@ bool CTxDB::LoadBlockIndex()
     if (!mapBlockIndex.count(hashBestChain))
         return error("CTxDB::LoadBlockIndex() : hashBestChain not found in the block index");
     pindexBest = mapBlockIndex[hashBestChain];
+    chainActive.SetTip(pindexBest);
     nBestHeight = pindexBest->nHeight;
     nBestChainTrust = pindexBest->nChainTrust;
 
@@ -455,6 +711,7 @@ bool CTxDB::LoadBlockIndex()
     if (nCheckDepth > nBestHeight)
         nCheckDepth = nBestHeight;
     LogPrintf("Verifying last %i blocks at level %i\n", nCheckDepth, nCheckLevel);
+    int64_t nVerifyStart = GetTimeMillis();
     CBlockIndex* pindexFork = NULL;
     map<pair<unsigned int, unsigned int>, CBlockIndex*> mapBlockPos;
     for (CBlockIndex* pindex = pindexBest; pindex && pindex->pprev; pindex = pindex->pprev)
@@ -567,6 +824,7 @@ bool CTxDB::LoadBlockIndex()
             }
         }
     }
+    LogPrintf("LoadBlockIndex(): verified in %dms\n", GetTimeMillis() - nVerifyStart);
     if (pindexFork)
     {
         boost::this_thread::interruption_point();
@@ -13,6 +13,7 @@
 #include <string>
 #include <vector>
 
+#include "leveldbbatch.h"
 #include "main.h"
 #include "streams.h"
 
@@ -22,6 +23,38 @@ class CTxIndex;
 class CDiskTxPos;
 class CDiskBlockIndex;
 
+// One address index entry, stored as its own key under ("ati", addrHash,
+// height, txHash) with an empty value. Keeping one key per entry makes
+// updates a blind write and lets readers page through an address with a
+// prefix scan. The height is serialized big-endian so the entries of an
+// address come back in chain order.
+class CAddrIndexKey
+{
+public:
+    uint160 addrHash;
+    int nHeight;
+    uint256 txHash;
+
+    CAddrIndexKey() : addrHash(0), nHeight(0), txHash(0) {}
+    CAddrIndexKey(const uint160& addrHashIn, int nHeightIn, const uint256& txHashIn)
+        : addrHash(addrHashIn), nHeight(nHeightIn), txHash(txHashIn) {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion) {
+        READWRITE(addrHash);
+        unsigned char chHeight[4];
+        unsigned int nHeightU = nHeight;
+        for (int i = 0; i < 4; i++)
+            chHeight[i] = (nHeightU >> (24 - 8 * i)) & 0xff;
+        READWRITE(FLATDATA(chHeight));
+        if (ser_action.ForRead())
+            nHeight = (chHeight[0] << 24) | (chHeight[1] << 16) | (chHeight[2] << 8) | chHeight[3];
+        READWRITE(txHash);
+    }
+};
+
 // Class that provides access to a LevelDB. Note that this class is frequently
 // instantiated on the stack and then destroyed again, so instantiation has to
 // be very cheap. Unfortunately that means, a CTxDB instance is actually just a
@@ -52,7 +85,9 @@ private:
 
     // A batch stores up writes and deletes for atomic application. When this
     // field is non-NULL, writes/deletes go there instead of directly to disk.
-    leveldb::WriteBatch *activeBatch;
+    // Pending operations are indexed by key so reads inside a transaction
+    // do not have to replay the whole batch.
+    CLevelDBIndexedBatch *activeBatch;
     leveldb::Options options;
     bool fReadOnly;
     int nVersion;
@@ -190,8 +225,15 @@ public:
         return Write(std::string("version"), nVersion);
     }
 
-    bool ReadAddrIndex(uint160 addrHash, std::vector<uint256>& txHashes);
-    bool WriteAddrIndex(uint160 addrHash, uint256 txHash);
+    // Reads the transactions of addrHash in chain order, skipping the first
+    // nSkip (counted from the end if negative) and returning at most nCount
+    // (all if negative). Only sees committed data, not an active batch.
+    bool ReadAddrIndex(uint160 addrHash, std::vector<uint256>& txHashes, int nSkip = 0, int nCount = -1);
+    unsigned int CountAddrIndex(uint160 addrHash);
+    bool WriteAddrIndex(uint160 addrHash, int nHeight, uint256 txHash);
+    bool EraseAddrIndex(uint160 addrHash, int nHeight, uint256 txHash);
+    // Converts entries in the old one-vector-per-address layout.
+    bool MigrateAddrIndex();
     bool ReadTxIndex(uint256 hash, CTxIndex& txindex);
     bool UpdateTxIndex(uint256 hash, const CTxIndex& txindex);
     bool AddTxIndex(const CTransaction& tx, const CDiskTxPos& pos, int nHeight);
@@ -6,11 +6,64 @@
 
 #include "txmempool.h"
 
+#include "util.h"
+
+#include <cmath>
+
 using namespace std;
 
+CTxMemPoolEntry::CTxMemPoolEntry():
+    nFee(0), nTxSize(0), nModSize(0), nUsageSize(0), nTime(0), dPriority(0.0), nHeight(0), nValueInChain(0),
+    nCountWithDescendants(0), nSizeWithDescendants(0), nFeesWithDescendants(0)
+{
+}
+
+CTxMemPoolEntry::CTxMemPoolEntry(const CTransaction& _tx, const CAmount& _nFee,
+                                 int64_t _nTime, double _dPriority,
+                                 unsigned int _nHeight, CAmount _nValueInChain):
+    tx(_tx), nFee(_nFee), nTime(_nTime), dPriority(_dPriority), nHeight(_nHeight), nValueInChain(_nValueInChain)
+{
+    nTxSize = ::GetSerializeSize(tx, SER_NETWORK, PROTOCOL_VERSION);
+    nModSize = tx.CalculateModifiedSize(nTxSize);
+
+    // Rough count: the entry and its three index nodes, the scripts (about
+    // the serialized size), and one mapNextTx node per input
+    nUsageSize = sizeof(CTxMemPoolEntry) + 8 * sizeof(void*) + nTxSize +
+        tx.vin.size() * (sizeof(CTxIn) + sizeof(std::pair<const COutPoint, CInPoint>) + 4 * sizeof(void*)) +
+        tx.vout.size() * sizeof(CTxOut);
+
+    // The pool adds whatever spends this transaction once it is linked in
+    nCountWithDescendants = 1;
+    nSizeWithDescendants = nTxSize;
+    nFeesWithDescendants = nFee;
+}
+
+CTxMemPoolEntry::CTxMemPoolEntry(const CTxMemPoolEntry& other)
+{
+    *this = other;
+}
+
+double CTxMemPoolEntry::GetPriority(unsigned int currentHeight) const
+{
+    if (nModSize == 0 || currentHeight <= nHeight)
+        return dPriority;
+    double deltaPriority = ((double)(currentHeight - nHeight) * nValueInChain) / nModSize;
+    return dPriority + deltaPriority;
+}
+
+void CTxMemPoolEntry::UpdateDescendantState(int64_t nModifyCount, int64_t nModifySize, CAmount nModifyFee)
+{
+    nCountWithDescendants += nModifyCount;
+    nSizeWithDescendants += nModifySize;
+    nFeesWithDescendants += nModifyFee;
+}
+
 CTxMemPool::CTxMemPool(const CFeeRate& _minRelayFee) :
     nTransactionsUpdated(0),
-    minRelayFee(_minRelayFee)
+    minRelayFee(_minRelayFee),
+    nUsage(0),
+    dRollingMinFee(0),
+    nLastRollingFeeUpdate(0)
 {
     // Sanity checks off by default for performance, because otherwise
     // accepting transactions becomes O(N^2) where N is the number
@@ -42,16 +95,161 @@ void CTxMemPool::AddTransactionsUpdated(unsigned int n)
     nTransactionsUpdated += n;
 }
 
-bool CTxMemPool::addUnchecked(const uint256& hash, CTransaction &tx)
+void CTxMemPool::CalculateAncestors(const uint256& hash, std::set<uint256>& setAncestors, const uint256* pExclude) const
+{
+    std::vector<uint256> vToVisit(1, hash);
+    while (!vToVisit.empty())
+    {
+        indexed_transaction_set::const_iterator it = mapTx.find(vToVisit.back());
+        vToVisit.pop_back();
+        if (it == mapTx.end())
+            continue;
+        BOOST_FOREACH(const CTxIn& txin, it->GetTx().vin)
+        {
+            const uint256& hashParent = txin.prevout.hash;
+            if (pExclude && hashParent == *pExclude)
+                continue;
+            if (mapTx.count(hashParent) && setAncestors.insert(hashParent).second)
+                vToVisit.push_back(hashParent);
+        }
+    }
+}
+
+void CTxMemPool::CalculateDescendants(const uint256& hash, std::set<uint256>& setDescendants) const
+{
+    std::vector<uint256> vToVisit(1, hash);
+    while (!vToVisit.empty())
+    {
+        uint256 hashVisit = vToVisit.back();
+        vToVisit.pop_back();
+        indexed_transaction_set::const_iterator it = mapTx.find(hashVisit);
+        if (it == mapTx.end())
+            continue;
+        for (unsigned int i = 0; i < it->GetTx().vout.size(); i++)
+        {
+            std::map<COutPoint, CInPoint>::const_iterator itNext = mapNextTx.find(COutPoint(hashVisit, i));
+            if (itNext == mapNextTx.end())
+                continue;
+            uint256 hashChild = itNext->second.ptx->GetHash();
+            if (setDescendants.insert(hashChild).second)
+                vToVisit.push_back(hashChild);
+        }
+    }
+}
+
+bool CTxMemPool::CalculateMemPoolAncestors(const CTransaction& tx, std::set<uint256>& setAncestors,
+                                           uint64_t nLimitAncestorCount, uint64_t nLimitAncestorSize,
+                                           uint64_t nLimitDescendantCount, uint64_t nLimitDescendantSize,
+                                           std::string& errString) const
+{
+    LOCK(cs);
+    uint64_t nTxSize = ::GetSerializeSize(tx, SER_NETWORK, PROTOCOL_VERSION);
+    uint64_t nAncestorSize = nTxSize;
+
+    std::vector<uint256> vToVisit;
+    BOOST_FOREACH(const CTxIn& txin, tx.vin)
+        if (mapTx.count(txin.prevout.hash) && setAncestors.insert(txin.prevout.hash).second)
+            vToVisit.push_back(txin.prevout.hash);
+
+    while (!vToVisit.empty())
+    {
+        indexed_transaction_set::const_iterator it = mapTx.find(vToVisit.back());
+        vToVisit.pop_back();
+
+        if (setAncestors.size() + 1 > nLimitAncestorCount)
+        {
+            errString = strprintf("too many unconfirmed ancestors [limit: %u]", nLimitAncestorCount);
+            return false;
+        }
+        nAncestorSize += it->GetTxSize();
+        if (nAncestorSize > nLimitAncestorSize)
+        {
+            errString = strprintf("exceeds ancestor size limit [limit: %u]", nLimitAncestorSize);
+            return false;
+        }
+        if (it->GetCountWithDescendants() + 1 > nLimitDescendantCount)
+        {
+            errString = strprintf("too many descendants for tx %s [limit: %u]", it->GetHash().ToString(), nLimitDescendantCount);
+            return false;
+        }
+        if (it->GetSizeWithDescendants() + nTxSize > nLimitDescendantSize)
+        {
+            errString = strprintf("exceeds descendant size limit for tx %s [limit: %u]", it->GetHash().ToString(), nLimitDescendantSize);
+            return false;
+        }
+
+        BOOST_FOREACH(const CTxIn& txin, it->GetTx().vin)
+            if (mapTx.count(txin.prevout.hash) && setAncestors.insert(txin.prevout.hash).second)
+                vToVisit.push_back(txin.prevout.hash);
+    }
+    return true;
+}
+
+void CTxMemPool::UpdateForLink(const uint256& hash, int nSign)
+{
+    // Adds (nSign 1) or takes (nSign -1) hash and whatever spends it to or
+    // from the descendant totals of everything it spends. A descendant that
+    // also reaches an ancestor another way is counted there already.
+    std::set<uint256> setAncestors;
+    CalculateAncestors(hash, setAncestors);
+    if (setAncestors.empty())
+        return;
+
+    std::set<uint256> setDescendants;
+    CalculateDescendants(hash, setDescendants);
+    std::vector<std::set<uint256> > vOtherAncestors(setDescendants.size());
+    unsigned int i = 0;
+    BOOST_FOREACH(const uint256& hashDesc, setDescendants)
+        CalculateAncestors(hashDesc, vOtherAncestors[i++], &hash);
+
+    indexed_transaction_set::iterator itSelf = mapTx.find(hash);
+    BOOST_FOREACH(const uint256& hashAncestor, setAncestors)
+    {
+        int64_t nModifyCount = 1;
+        int64_t nModifySize = itSelf->GetTxSize();
+        CAmount nModifyFee = itSelf->GetFee();
+        i = 0;
+        BOOST_FOREACH(const uint256& hashDesc, setDescendants)
+        {
+            if (!vOtherAncestors[i++].count(hashAncestor))
+            {
+                indexed_transaction_set::const_iterator itDesc = mapTx.find(hashDesc);
+                nModifyCount++;
+                nModifySize += itDesc->GetTxSize();
+                nModifyFee += itDesc->GetFee();
+            }
+        }
+        mapTx.modify(mapTx.find(hashAncestor), update_descendant_state(nSign * nModifyCount, nSign * nModifySize, nSign * nModifyFee));
+    }
+}
+
+bool CTxMemPool::addUnchecked(const uint256& hash, const CTxMemPoolEntry& entry)
 {
     // Add to memory pool without checking anything.
     // Used by main.cpp AcceptToMemoryPool(), which DOES do
     // all the appropriate checks.
     LOCK(cs);
     {
-        mapTx[hash] = tx;
+        indexed_transaction_set::iterator it = mapTx.insert(entry).first;
+        const CTransaction& tx = it->GetTx();
         for (unsigned int i = 0; i < tx.vin.size(); i++)
-            mapNextTx[tx.vin[i].prevout] = CInPoint(&mapTx[hash], i);
+            mapNextTx[tx.vin[i].prevout] = CInPoint(const_cast<CTransaction*>(&tx), i);
+
+        // Transactions put back after a reorg may already have children here
+        std::set<uint256> setDescendants;
+        CalculateDescendants(hash, setDescendants);
+        int64_t nDescendantsSize = 0;
+        CAmount nDescendantsFee = 0;
+        BOOST_FOREACH(const uint256& hashDesc, setDescendants)
+        {
+            indexed_transaction_set::const_iterator itDesc = mapTx.find(hashDesc);
+            nDescendantsSize += itDesc->GetTxSize();
+            nDescendantsFee += itDesc->GetFee();
+        }
+        mapTx.modify(it, update_descendant_state(setDescendants.size(), nDescendantsSize, nDescendantsFee));
+        UpdateForLink(hash, 1);
+
+        nUsage += entry.DynamicMemoryUsage();
         nTransactionsUpdated++;
     }
     return true;
@@ -72,10 +270,15 @@ bool CTxMemPool::remove(const CTransaction &tx, bool fRecursive)
                         remove(*it->second.ptx, true);
                 }
             }
+            UpdateForLink(hash, -1);
             BOOST_FOREACH(const CTxIn& txin, tx.vin)
                 mapNextTx.erase(txin.prevout);
-            mapTx.erase(hash);
+            // tx may be the pooled copy itself, so it is not used past here
+            indexed_transaction_set::iterator it = mapTx.find(hash);
+            nUsage -= it->DynamicMemoryUsage();
+            mapTx.erase(it);
             nTransactionsUpdated++;
+            NotifyEntryRemoved(hash);
         }
     }
     return true;
@@ -96,11 +299,79 @@ bool CTxMemPool::removeConflicts(const CTransaction &tx)
     return true;
 }
 
+void CTxMemPool::removeForBlock(const std::vector<CTransaction>& vtx, unsigned int nBlockHeight)
+{
+    LOCK(cs);
+    std::vector<CTxMemPoolEntry> entries;
+    BOOST_FOREACH(const CTransaction& tx, vtx)
+    {
+        indexed_transaction_set::iterator it = mapTx.find(tx.GetHash());
+        if (it != mapTx.end())
+            entries.push_back(*it);
+    }
+    BOOST_FOREACH(const CTransaction& tx, vtx)
+        remove(tx);
+    minerPolicyEstimator->seenBlock(entries, nBlockHeight, minRelayFee);
+}
+
+unsigned int CTxMemPool::TrimToSize(size_t nSizeLimit)
+{
+    LOCK(cs);
+    unsigned int nEvicted = 0;
+    while (!mapTx.empty() && nUsage > nSizeLimit)
+    {
+        // Whatever spends the cheapest transaction cannot be mined without
+        // it, so it goes as well. A child paying for its parent lifts the
+        // parent's score, so the pair is only evicted as a package.
+        const CTxMemPoolEntry& entry = *mapTx.get<fee_rate>().begin();
+        CTransaction tx = entry.GetTx();
+
+        // Until the pool empties out again, a transaction has to pay more
+        // than what was evicted to get in, or it would be evicted in turn
+        double dEvictedFeePerK = entry.GetEvictionScore() * 1000 + minRelayFee.GetFeePerK();
+        if (dEvictedFeePerK > dRollingMinFee)
+        {
+            dRollingMinFee = dEvictedFeePerK;
+            nLastRollingFeeUpdate = GetTime();
+        }
+
+        size_t nSizeBefore = mapTx.size();
+        remove(tx, true);
+        nEvicted += nSizeBefore - mapTx.size();
+    }
+    if (nEvicted > 0)
+        LogPrint("mempool", "CTxMemPool::TrimToSize() : evicted %u transactions, %u left using %u bytes\n",
+                 nEvicted, mapTx.size(), nUsage);
+    return nEvicted;
+}
+
+CFeeRate CTxMemPool::GetMinFee() const
+{
+    LOCK(cs);
+    if (dRollingMinFee == 0)
+        return CFeeRate(0);
+
+    int64_t nNow = GetTime();
+    if (nNow > nLastRollingFeeUpdate + 10)
+    {
+        dRollingMinFee /= pow(2.0, (nNow - nLastRollingFeeUpdate) / (double)ROLLING_FEE_HALFLIFE);
+        nLastRollingFeeUpdate = nNow;
+        if (dRollingMinFee < minRelayFee.GetFeePerK() / 2)
+        {
+            dRollingMinFee = 0;
+            return CFeeRate(0);
+        }
+    }
+    return CFeeRate((CAmount)dRollingMinFee);
+}
+
 void CTxMemPool::clear()
 {
     LOCK(cs);
     mapTx.clear();
     mapNextTx.clear();
+    nUsage = 0;
+    dRollingMinFee = 0;
     ++nTransactionsUpdated;
 }
 
@@ -110,16 +381,16 @@ void CTxMemPool::queryHashes(std::vector<uint256>& vtxid)
 
     LOCK(cs);
     vtxid.reserve(mapTx.size());
-    for (map<uint256, CTransaction>::iterator mi = mapTx.begin(); mi != mapTx.end(); ++mi)
-        vtxid.push_back((*mi).first);
+    for (indexed_transaction_set::iterator mi = mapTx.begin(); mi != mapTx.end(); ++mi)
+        vtxid.push_back(mi->GetHash());
 }
 
 bool CTxMemPool::lookup(uint256 hash, CTransaction& result) const
 {
     LOCK(cs);
-    std::map<uint256, CTransaction>::const_iterator i = mapTx.find(hash);
+    indexed_transaction_set::const_iterator i = mapTx.find(hash);
     if (i == mapTx.end()) return false;
-    result = i->second;
+    result = i->GetTx();
     return true;
 }
 
@@ -7,6 +7,11 @@
 #define DARKSILK_TXMEMPOOL_H
 
 #include <boost/circular_buffer.hpp>
+#include <boost/multi_index_container.hpp>
+#include <boost/multi_index/hashed_index.hpp>
+#include <boost/multi_index/mem_fun.hpp>
+#include <boost/multi_index/ordered_index.hpp>
+#include <boost/signals2/signal.hpp>
 
 #include "primitives/transaction.h"
 #include "sync.h"
@@ -33,24 +38,102 @@ private:
     CAmount nFee; //! Cached to avoid expensive parent-transaction lookups
     size_t nTxSize; //! ... and avoid recomputing tx size
     size_t nModSize; //! ... and modified size for priority
+    size_t nUsageSize; //! ... and its rough share of the pool's memory
     int64_t nTime; //! Local time when entering the mempool
     double dPriority; //! Priority when entering the mempool
     unsigned int nHeight; //! Chain height when entering the mempool
+    CAmount nValueInChain; //! Value of the inputs already in the chain, which age the priority
+    uint64_t nCountWithDescendants; //! Number of transactions in the pool spending this one, plus one
+    uint64_t nSizeWithDescendants; //! ... their size and this transaction's
+    CAmount nFeesWithDescendants; //! ... and their fees
 
 public:
     CTxMemPoolEntry(const CTransaction& _tx, const CAmount& _nFee,
-                    int64_t _nTime, double _dPriority, unsigned int _nHeight);
+                    int64_t _nTime, double _dPriority, unsigned int _nHeight,
+                    CAmount _nValueInChain = 0);
     CTxMemPoolEntry();
     CTxMemPoolEntry(const CTxMemPoolEntry& other);
 
     const CTransaction& GetTx() const { return this->tx; }
+    const uint256& GetHash() const { return tx.GetHash(); }
     double GetPriority(unsigned int currentHeight) const;
     CAmount GetFee() const { return nFee; }
+    CFeeRate GetFeeRate() const { return CFeeRate(nFee, nTxSize); }
     size_t GetTxSize() const { return nTxSize; }
+    size_t DynamicMemoryUsage() const { return nUsageSize; }
     int64_t GetTime() const { return nTime; }
     unsigned int GetHeight() const { return nHeight; }
+
+    uint64_t GetCountWithDescendants() const { return nCountWithDescendants; }
+    uint64_t GetSizeWithDescendants() const { return nSizeWithDescendants; }
+    CAmount GetFeesWithDescendants() const { return nFeesWithDescendants; }
+    void UpdateDescendantState(int64_t nModifyCount, int64_t nModifySize, CAmount nModifyFee);
+
+    /** Fee per byte this transaction is worth keeping for: its own, or that
+     *  of the package with its descendants if they pay more (child pays
+     *  for parent) */
+    double GetEvictionScore() const
+    {
+        double dOwn = (double)nFee / nTxSize;
+        double dPackage = (double)nFeesWithDescendants / nSizeWithDescendants;
+        return std::max(dOwn, dPackage);
+    }
 };
 
+// Changes the descendant totals of a pool entry through mapTx.modify
+struct update_descendant_state
+{
+    int64_t nModifyCount;
+    int64_t nModifySize;
+    CAmount nModifyFee;
+
+    update_descendant_state(int64_t nModifyCountIn, int64_t nModifySizeIn, CAmount nModifyFeeIn) :
+        nModifyCount(nModifyCountIn), nModifySize(nModifySizeIn), nModifyFee(nModifyFeeIn) {}
+
+    void operator()(CTxMemPoolEntry& e) { e.UpdateDescendantState(nModifyCount, nModifySize, nModifyFee); }
+};
+
+/** Lowest eviction score first, ties broken by txid so the order is total */
+struct CompareTxMemPoolEntryByScore
+{
+    bool operator()(const CTxMemPoolEntry& a, const CTxMemPoolEntry& b) const
+    {
+        double f1 = a.GetEvictionScore();
+        double f2 = b.GetEvictionScore();
+        if (f1 == f2)
+            return a.GetHash() < b.GetHash();
+        return f1 < f2;
+    }
+};
+
+struct TxidHasher
+{
+    size_t operator()(const uint256& hash) const { return hash.GetLow64(); }
+};
+
+// Tags for the secondary indexes of CTxMemPool::mapTx
+struct fee_rate {};
+struct entry_time {};
+
+typedef boost::multi_index_container<
+    CTxMemPoolEntry,
+    boost::multi_index::indexed_by<
+        // by txid
+        boost::multi_index::hashed_unique<
+            boost::multi_index::const_mem_fun<CTxMemPoolEntry, const uint256&, &CTxMemPoolEntry::GetHash>,
+            TxidHasher>,
+        // by eviction score, cheapest first
+        boost::multi_index::ordered_non_unique<
+            boost::multi_index::tag<fee_rate>,
+            boost::multi_index::identity<CTxMemPoolEntry>,
+            CompareTxMemPoolEntryByScore>,
+        // by entry time, oldest first
+        boost::multi_index::ordered_non_unique<
+            boost::multi_index::tag<entry_time>,
+            boost::multi_index::const_mem_fun<CTxMemPoolEntry, int64_t, &CTxMemPoolEntry::GetTime> >
+    >
+> indexed_transaction_set;
+
 /**
  * Keep track of fee/priority for transactions confirmed within N blocks
  */
@@ -391,11 +474,21 @@ private:
     bool fSanityCheck;
     unsigned int nTransactionsUpdated;
     CFeeRate minRelayFee; //! Passed to constructor to avoid dependency on main
+    size_t nUsage; //! Sum of DynamicMemoryUsage() of the entries
+
+    //! Fee per kB a transaction must pay since the pool last had to evict;
+    //! halves every ROLLING_FEE_HALFLIFE seconds
+    mutable double dRollingMinFee;
+    mutable int64_t nLastRollingFeeUpdate;
+
+    void CalculateAncestors(const uint256& hash, std::set<uint256>& setAncestors, const uint256* pExclude = NULL) const;
+    void CalculateDescendants(const uint256& hash, std::set<uint256>& setDescendants) const;
+    void UpdateForLink(const uint256& hash, int nSign);
 
 public:
     mutable CCriticalSection cs;
-    std::map<uint256, CTransaction> mapTx;
-    std::map<COutPoint, CInPoint> mapNextTx;
+    indexed_transaction_set mapTx;
+    std::map<COutPoint, CInPoint> mapNextTx; //! Index by spent outpoint
     CMinerPolicyEstimator* minerPolicyEstimator;
 
     //CTxMemPool();
@@ -404,9 +497,30 @@ public:
 
     void setSanityCheck(bool _fSanityCheck) { fSanityCheck = _fSanityCheck; }
 
-    bool addUnchecked(const uint256& hash, CTransaction &tx);
+    /** Collect the in-pool ancestors of tx, which is not in the pool yet.
+     *  Fails, with the reason in errString, if tx would have more than
+     *  nLimitAncestorCount transactions or nLimitAncestorSize bytes in its
+     *  ancestor package (itself included), or would take any ancestor past
+     *  nLimitDescendantCount or nLimitDescendantSize. The walk stops at
+     *  the first limit exceeded, so it is bounded by the limits. */
+    bool CalculateMemPoolAncestors(const CTransaction& tx, std::set<uint256>& setAncestors,
+                                   uint64_t nLimitAncestorCount, uint64_t nLimitAncestorSize,
+                                   uint64_t nLimitDescendantCount, uint64_t nLimitDescendantSize,
+                                   std::string& errString) const;
+    bool addUnchecked(const uint256& hash, const CTxMemPoolEntry& entry);
     bool remove(const CTransaction &tx, bool fRecursive = false);
     bool removeConflicts(const CTransaction &tx);
+    /** Remove the transactions of a newly connected block and feed the fee estimator */
+    void removeForBlock(const std::vector<CTransaction>& vtx, unsigned int nBlockHeight);
+    /** Evict the transactions with the lowest eviction score, together with
+     *  everything spending them, until the pool fits in nSizeLimit bytes.
+     *  Returns the number of transactions evicted. */
+    unsigned int TrimToSize(size_t nSizeLimit);
+    /** Fee rate below which transactions are not accepted, raised by TrimToSize */
+    CFeeRate GetMinFee() const;
+
+    /** Called with cs held for every transaction leaving the pool */
+    boost::signals2::signal<void (const uint256&)> NotifyEntryRemoved;
     void clear();
     void queryHashes(std::vector<uint256>& vtxid);
     unsigned int GetTransactionsUpdated() const;
@@ -427,9 +541,19 @@ public:
     }
 
     bool lookup(uint256 hash, CTransaction& result) const;
+
+    /** Approximate memory used by the pool, in bytes */
+    size_t DynamicMemoryUsage() const
+    {
+        LOCK(cs);
+        return nUsage;
+    }
 };
 
 
+/// Seconds in which the rolling minimum fee of a full pool halves
+static const int64_t ROLLING_FEE_HALFLIFE = 60 * 60 * 12;
+
 /// Fake height value used in CCoins to signify they are only in the memory pool (since 0.8)
 static const unsigned int MEMPOOL_HEIGHT = 0x7FFFFFFF;
 
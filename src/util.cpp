@@ -39,6 +39,8 @@ namespace boost {
 #include <boost/filesystem/fstream.hpp>
 #include <boost/foreach.hpp>
 #include <boost/thread.hpp>
+#include <boost/atomic.hpp>
+#include <boost/lockfree/queue.hpp>
 #include <openssl/crypto.h>
 #include <openssl/rand.h>
 #include <openssl/err.h>
@@ -69,6 +71,10 @@ namespace boost {
 # include <sys/prctl.h>
 #endif
 
+#ifndef WIN32
+#include <unistd.h>
+#endif
+
 using namespace std;
 
 //Dark  features
@@ -237,6 +243,64 @@ static boost::once_flag debugPrintInitFlag = BOOST_ONCE_INIT;
 // in a thread-safe manner the first time it is called:
 static FILE* fileout = NULL;
 static boost::mutex* mutexDebugLog = NULL;
+// Descriptor of fileout, for signal handlers, which may only write(2)
+static volatile int nDebugLogFd = -1;
+
+// Lines queued before the writer thread is woken up early
+static const unsigned int LOG_QUEUE_WAKE = 1024;
+// Milliseconds the writer thread sleeps between batches
+static const int LOG_WRITE_INTERVAL = 50;
+// Bytes collected before they are handed to fwrite()
+static const size_t LOG_WRITE_BATCH = 64 * 1024;
+
+/** A line waiting to be written to debug.log */
+struct CLogLine
+{
+    int64_t nTime;
+    std::string str;
+};
+
+/** Queue of debug.log lines and the thread writing them out.
+ *
+ * Any thread may queue a line without taking a lock. While the writer
+ * thread runs, it writes the queue out in batches, one fwrite per batch;
+ * before it starts and after it stops, the logging thread writes the
+ * queue itself.
+ *
+ * A line is always in the queue, in plineWriting or in the published
+ * part of pchBatch until it has been flushed, so a crash handler can
+ * write out everything not yet in debug.log (see FlushDebugLogFromSignal).
+ */
+struct CDebugLogWriter
+{
+    boost::lockfree::queue<CLogLine*> queue;
+    boost::atomic<unsigned int> nQueued;
+    boost::atomic<bool> fRunning;
+    boost::thread* pthread;
+
+    boost::mutex mutexWake;
+    boost::condition_variable condWake;
+    bool fStop; // guarded by mutexWake
+
+    // Only written while holding mutexDebugLog
+    bool fStartedNewLine;
+    int64_t nLastTime;
+    std::string strLastTime;
+    // The line being copied into the batch; not freed until it is copied
+    boost::atomic<CLogLine*> plineWriting;
+    // The batch never moves: a signal handler may read its first nBatch bytes
+    char pchBatch[LOG_WRITE_BATCH];
+    boost::atomic<size_t> nBatch;
+
+    CDebugLogWriter() : queue(LOG_QUEUE_WAKE), nQueued(0), fRunning(false), pthread(NULL),
+        fStop(false), fStartedNewLine(true), nLastTime(-1), plineWriting(NULL), nBatch(0) {}
+};
+static CDebugLogWriter* plogWriter = NULL;
+
+static void FlushDebugLogAtExit()
+{
+    FlushDebugLog();
+}
 
 static void DebugPrintInit()
 {
@@ -245,9 +309,310 @@ static void DebugPrintInit()
 
     boost::filesystem::path pathDebug = GetDataDir() / "debug.log";
     fileout = fopen(pathDebug.string().c_str(), "a");
-    if (fileout) setbuf(fileout, NULL); // unbuffered
+    if (fileout != NULL)
+        nDebugLogFd = fileno(fileout);
 
     mutexDebugLog = new boost::mutex();
+    plogWriter = new CDebugLogWriter();
+    atexit(FlushDebugLogAtExit);
+}
+
+// Write out and flush the batch. Caller holds mutexDebugLog.
+static void WriteDebugLogBatch(CDebugLogWriter& writer)
+{
+    if (writer.nBatch == 0)
+        return;
+    fwrite(writer.pchBatch, 1, writer.nBatch, fileout);
+    fflush(fileout);
+    writer.nBatch = 0;
+}
+
+// Copy into the batch, writing it out whenever it fills. Caller holds mutexDebugLog.
+static void AppendDebugLogBatch(CDebugLogWriter& writer, const char* psz, size_t nLen)
+{
+    while (nLen > 0)
+    {
+        size_t nUsed = writer.nBatch;
+        if (nUsed == LOG_WRITE_BATCH)
+        {
+            WriteDebugLogBatch(writer);
+            continue;
+        }
+        size_t nCopy = std::min(nLen, LOG_WRITE_BATCH - nUsed);
+        memcpy(writer.pchBatch + nUsed, psz, nCopy);
+        writer.nBatch = nUsed + nCopy;
+        psz += nCopy;
+        nLen -= nCopy;
+    }
+}
+
+// Write out every queued line. Caller holds mutexDebugLog.
+static void WriteDebugLogQueue()
+{
+    CDebugLogWriter& writer = *plogWriter;
+
+    // reopen the log file, if requested
+    if (fReopenDebugLog) {
+        fReopenDebugLog = false;
+        boost::filesystem::path pathDebug = GetDataDir() / "debug.log";
+        // A failed freopen closes fileout all the same: open a new
+        // stream, or go on writing to stderr
+        if (freopen(pathDebug.string().c_str(), "a", fileout) == NULL)
+        {
+            fileout = fopen(pathDebug.string().c_str(), "a");
+            if (fileout == NULL)
+                fileout = stderr;
+            fprintf(fileout, "Failed to reopen %s: %s\n", pathDebug.string().c_str(), strerror(errno));
+        }
+        nDebugLogFd = fileno(fileout);
+    }
+
+    CLogLine* pline;
+    while (writer.queue.pop(pline))
+    {
+        writer.plineWriting = pline;
+        writer.nQueued--;
+
+        // Debug print useful for profiling
+        if (fLogTimestamps && writer.fStartedNewLine)
+        {
+            if (pline->nTime != writer.nLastTime)
+            {
+                writer.nLastTime = pline->nTime;
+                writer.strLastTime = DateTimeStrFormat("%Y-%m-%d %H:%M:%S ", pline->nTime);
+            }
+            AppendDebugLogBatch(writer, writer.strLastTime.data(), writer.strLastTime.size());
+        }
+        if (!pline->str.empty() && pline->str[pline->str.size()-1] == '\n')
+            writer.fStartedNewLine = true;
+        else
+            writer.fStartedNewLine = false;
+
+        AppendDebugLogBatch(writer, pline->str.data(), pline->str.size());
+        writer.plineWriting = NULL;
+        delete pline;
+    }
+
+    WriteDebugLogBatch(writer);
+}
+
+void FlushDebugLog(bool fWait)
+{
+    if (fileout == NULL || plogWriter == NULL)
+        return;
+
+    boost::unique_lock<boost::mutex> lock(*mutexDebugLog, boost::defer_lock);
+    if (fWait)
+        lock.lock();
+    else if (!lock.try_lock())
+        return;
+
+    WriteDebugLogQueue();
+}
+
+#ifndef WIN32
+void WriteDebugLogRaw(const char* psz, size_t nLen)
+{
+    int fd = nDebugLogFd;
+    if (fd < 0)
+        fd = STDERR_FILENO;
+    while (nLen > 0)
+    {
+        ssize_t nWritten = write(fd, psz, nLen);
+        if (nWritten <= 0)
+            return;
+        psz += nWritten;
+        nLen -= nWritten;
+    }
+}
+
+void FlushDebugLogFromSignal()
+{
+    if (plogWriter == NULL)
+        return;
+    CDebugLogWriter& writer = *plogWriter;
+
+    // Oldest first: the batch, the line being copied into it, the queue.
+    // A line the writer was copying may come out twice; none is lost.
+    // Popping from the lock-free queue neither blocks nor allocates, and
+    // the lines are not freed. They are written without timestamps, as
+    // formatting the time is not async-signal-safe.
+    WriteDebugLogRaw(writer.pchBatch, writer.nBatch);
+    CLogLine* pline = writer.plineWriting;
+    if (pline != NULL)
+        WriteDebugLogRaw(pline->str.data(), pline->str.size());
+    while (writer.queue.pop(pline))
+        WriteDebugLogRaw(pline->str.data(), pline->str.size());
+}
+#endif
+
+static void ThreadDebugLogWriter()
+{
+    RenameThread("darksilk-log");
+
+    CDebugLogWriter& writer = *plogWriter;
+    while (true)
+    {
+        {
+            boost::unique_lock<boost::mutex> lock(writer.mutexWake);
+            if (writer.fStop)
+                break;
+            if (writer.nQueued < LOG_QUEUE_WAKE)
+                writer.condWake.timed_wait(lock, boost::posix_time::milliseconds(LOG_WRITE_INTERVAL));
+        }
+        FlushDebugLog();
+    }
+}
+
+void StartDebugLogWriter()
+{
+    if (!fPrintToDebugLog || fPrintToConsole)
+        return;
+
+    boost::call_once(&DebugPrintInit, debugPrintInitFlag);
+    if (fileout == NULL || plogWriter->pthread != NULL)
+        return;
+
+    // Not part of the node's thread group: it has to keep running while
+    // that group is interrupted and joined at shutdown.
+    plogWriter->fStop = false;
+    plogWriter->pthread = new boost::thread(&ThreadDebugLogWriter);
+    plogWriter->fRunning = true;
+}
+
+void StopDebugLogWriter()
+{
+    if (plogWriter == NULL || plogWriter->pthread == NULL)
+        return;
+
+    // Lines logged from here on are written by the thread logging them
+    plogWriter->fRunning = false;
+    {
+        boost::unique_lock<boost::mutex> lock(plogWriter->mutexWake);
+        plogWriter->fStop = true;
+    }
+    plogWriter->condWake.notify_one();
+    plogWriter->pthread->join();
+    delete plogWriter->pthread;
+    plogWriter->pthread = NULL;
+
+    FlushDebugLog();
+}
+
+/** Token bucket for the lines one debug category may log per second */
+struct CLogRateLimit
+{
+    int64_t nRate;       // lines per second, 0 for no limit
+    double dTokens;
+    int64_t nLastRefill; // microseconds
+    uint64_t nSuppressed;
+};
+
+/** Rate limits set with -logratelimit, see InitLogRateLimits() */
+struct CLogRateLimits
+{
+    boost::mutex cs;
+    int64_t nDefaultRate;
+    std::map<std::string, int64_t> mapRate;
+    std::map<std::string, CLogRateLimit> mapLimit; // guarded by cs
+};
+static CLogRateLimits* plogRateLimits = NULL;
+
+static bool ParseLogRate(const std::string& str, int64_t& nRate)
+{
+    if (str.empty() || str.size() > 9 || str.find_first_not_of("0123456789") != std::string::npos)
+        return false;
+    nRate = atoi64(str);
+    return true;
+}
+
+bool InitLogRateLimits(std::string& strBad)
+{
+    if (!mapMultiArgs.count("-logratelimit"))
+        return true;
+
+    CLogRateLimits* plimits = new CLogRateLimits();
+    plimits->nDefaultRate = 0;
+    bool fLimit = false;
+    BOOST_FOREACH(const std::string& strArg, mapMultiArgs["-logratelimit"])
+    {
+        int64_t nRate;
+        std::string::size_type nColon = strArg.rfind(':');
+        if (nColon == std::string::npos)
+        {
+            if (!ParseLogRate(strArg, nRate))
+            {
+                strBad = strArg;
+                delete plimits;
+                return false;
+            }
+            plimits->nDefaultRate = nRate;
+        }
+        else
+        {
+            if (nColon == 0 || !ParseLogRate(strArg.substr(nColon + 1), nRate))
+            {
+                strBad = strArg;
+                delete plimits;
+                return false;
+            }
+            plimits->mapRate[strArg.substr(0, nColon)] = nRate;
+        }
+        fLimit |= nRate > 0;
+    }
+
+    if (!fLimit)
+    {
+        delete plimits;
+        return true;
+    }
+
+    // Set once during startup, before any other thread logs
+    plogRateLimits = plimits;
+    return true;
+}
+
+bool LogAcceptRate(const char* category)
+{
+    if (category == NULL || plogRateLimits == NULL)
+        return true;
+
+    uint64_t nSuppressed = 0;
+    {
+        boost::mutex::scoped_lock lock(plogRateLimits->cs);
+
+        std::map<std::string, CLogRateLimit>::iterator it = plogRateLimits->mapLimit.find(category);
+        if (it == plogRateLimits->mapLimit.end())
+        {
+            CLogRateLimit limit;
+            std::map<std::string, int64_t>::const_iterator mi = plogRateLimits->mapRate.find(category);
+            limit.nRate = mi != plogRateLimits->mapRate.end() ? mi->second : plogRateLimits->nDefaultRate;
+            limit.dTokens = limit.nRate;
+            limit.nLastRefill = GetTimeMicros();
+            limit.nSuppressed = 0;
+            it = plogRateLimits->mapLimit.insert(std::make_pair(std::string(category), limit)).first;
+        }
+
+        CLogRateLimit& limit = it->second;
+        if (limit.nRate == 0)
+            return true;
+
+        int64_t nNow = GetTimeMicros();
+        limit.dTokens = std::min((double)limit.nRate, limit.dTokens + (nNow - limit.nLastRefill) * limit.nRate / 1000000.0);
+        limit.nLastRefill = nNow;
+        if (limit.dTokens < 1.0)
+        {
+            limit.nSuppressed++;
+            return false;
+        }
+        limit.dTokens -= 1.0;
+        nSuppressed = limit.nSuppressed;
+        limit.nSuppressed = 0;
+    }
+
+    if (nSuppressed > 0)
+        LogPrintStr(strprintf("%s: %u lines suppressed by -logratelimit\n", category, nSuppressed));
+    return true;
 }
 
 bool LogAcceptCategory(const char* category)
@@ -288,31 +653,22 @@ int LogPrintStr(const std::string &str)
     }
     else if (fPrintToDebugLog)
     {
-        static bool fStartedNewLine = true;
         boost::call_once(&DebugPrintInit, debugPrintInitFlag);
 
         if (fileout == NULL)
             return ret;
 
-        boost::mutex::scoped_lock scoped_lock(*mutexDebugLog);
-
-        // reopen the log file, if requested
-        if (fReopenDebugLog) {
-            fReopenDebugLog = false;
-            boost::filesystem::path pathDebug = GetDataDir() / "debug.log";
-            if (freopen(pathDebug.string().c_str(),"a",fileout) != NULL)
-                setbuf(fileout, NULL); // unbuffered
-        }
-
-        // Debug print useful for profiling
-        if (fLogTimestamps && fStartedNewLine)
-            ret += fprintf(fileout, "%s ", DateTimeStrFormat("%Y-%m-%d %H:%M:%S", GetTime()).c_str());
-        if (!str.empty() && str[str.size()-1] == '\n')
-            fStartedNewLine = true;
-        else
-            fStartedNewLine = false;
-
-        ret = fwrite(str.data(), 1, str.size(), fileout);
+        CLogLine* pline = new CLogLine();
+        pline->nTime = fLogTimestamps ? GetTime() : 0;
+        pline->str = str;
+        plogWriter->queue.push(pline);
+        unsigned int nQueued = ++plogWriter->nQueued;
+        ret = str.size();
+
+        if (!plogWriter->fRunning)
+            FlushDebugLog();
+        else if (nQueued == LOG_QUEUE_WAKE)
+            plogWriter->condWake.notify_one();
     }
 
     return ret;
@@ -147,8 +147,23 @@ extern volatile bool fReopenDebugLog;
 bool IsLogOpen();
 /* Return true if log accepts specified category */
 bool LogAcceptCategory(const char* category);
+/* Return true if the rate limit of category lets another line through */
+bool LogAcceptRate(const char* category);
+/* Read -logratelimit; returns false and the offending value if one is invalid */
+bool InitLogRateLimits(std::string& strBad);
 /* Send a string to the log output */
 int LogPrintStr(const std::string &str);
+/* Write debug.log lines from a background thread instead of the logging thread */
+void StartDebugLogWriter();
+void StopDebugLogWriter();
+/* Write out queued debug.log lines; with fWait false, give up if another thread is writing */
+void FlushDebugLog(bool fWait = true);
+#ifndef WIN32
+/* Write psz straight to debug.log's descriptor, bypassing the queue; async-signal-safe */
+void WriteDebugLogRaw(const char* psz, size_t nLen);
+/* Write out everything not yet in debug.log from a crash handler; async-signal-safe */
+void FlushDebugLogFromSignal();
+#endif
 
 std::string GenerateRandomString(unsigned int len = 24);
 void WriteConfigFile(FILE* configFile);
@@ -165,7 +180,7 @@ unsigned int RandomIntegerRange(unsigned int nMin, unsigned int nMax);
     template<TINYFORMAT_ARGTYPES(n)>                                          \
     static inline int LogPrint(const char* category, const char* format, TINYFORMAT_VARARGS(n))  \
     {                                                                                \
-        if(!LogAcceptCategory(category)) return 0;                                   \
+        if(!LogAcceptCategory(category) || !LogAcceptRate(category)) return 0;       \
         return LogPrintStr(tfm::format(format, TINYFORMAT_PASSARGS(n)));             \
     }                                                                                \
     /*   Log error and return false */                                               \
@@ -190,7 +205,7 @@ TINYFORMAT_FOREACH_ARGNUM(MAKE_ERROR_AND_LOG_FUNC)
  */
 static inline int LogPrint(const char* category, const char* format)
 {
-    if(!LogAcceptCategory(category)) return 0;
+    if(!LogAcceptCategory(category) || !LogAcceptRate(category)) return 0;
     return LogPrintStr(format);
 }
 static inline bool error(const char* format)
@@ -238,6 +253,7 @@ void FileCommit(FILE *fileout);
 bool RenameOver(boost::filesystem::path src, boost::filesystem::path dest);
 boost::filesystem::path GetDefaultDataDir();
 const boost::filesystem::path &GetDataDir(bool fNetSpecific = true);
+void ClearDatadirCache();
 boost::filesystem::path GetConfigFile();
 boost::filesystem::path GetPidFile();
 #ifndef WIN32
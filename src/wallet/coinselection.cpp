@@ -0,0 +1,149 @@
+// Copyright (c) 2009-2016 The Bitcoin Developers
+// Copyright (c) 2015-2016 Silk Network
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "wallet/coinselection.h"
+
+#include "util.h"
+
+#include <algorithm>
+
+using namespace std;
+
+uint64_t CPreserveCoinAgePolicy::Cost(CAmount nValue, int64_t nTime, int64_t nSpendTime) const
+{
+    // Coin-days destroyed, plus one so that young coins still count as inputs
+    int64_t nTimeWeight = max((int64_t)0, nSpendTime - nTime);
+    uint64_t nDays = (uint64_t)(nValue / (24 * 60 * 60)) * nTimeWeight + (uint64_t)(nValue % (24 * 60 * 60)) * nTimeWeight / (24 * 60 * 60);
+    return nDays + 1;
+}
+
+bool CDenominatedOnlyPolicy::Accept(CAmount nValue) const
+{
+    return find(vDenominations.begin(), vDenominations.end(), nValue) != vDenominations.end();
+}
+
+struct CompareSelectionValue
+{
+    bool operator()(const CSelectionInput& a, const CSelectionInput& b) const
+    {
+        return a.nValue > b.nValue;
+    }
+};
+
+void SortSelectionInputs(vector<CSelectionInput>& vInputs)
+{
+    stable_sort(vInputs.begin(), vInputs.end(), CompareSelectionValue());
+}
+
+bool SelectCoinsBnB(const vector<CSelectionInput>& vInputs, CAmount nTarget, CAmount nTolerance,
+                    vector<char>& vfSelected, CAmount& nValueRet, unsigned int nMaxTries)
+{
+    const size_t nInputs = vInputs.size();
+
+    // vRemaining[i] is the value of vInputs[i..], to prune branches that cannot reach the target
+    vector<CAmount> vRemaining(nInputs + 1, 0);
+    for (size_t i = nInputs; i > 0; i--)
+        vRemaining[i - 1] = vRemaining[i] + vInputs[i - 1].nValue;
+    if (vRemaining[0] < nTarget)
+        return false;
+
+    vector<char> vfCurrent(nInputs, false);
+    CAmount nCurrent = 0;
+    uint64_t nCurrentCost = 0;
+    bool fFound = false;
+    uint64_t nBestCost = 0;
+    size_t i = 0;
+
+    for (unsigned int nTries = 0; nTries < nMaxTries; nTries++)
+    {
+        bool fBacktrack = false;
+        if (nCurrent + vRemaining[i] < nTarget || nCurrent > nTarget + nTolerance)
+            fBacktrack = true;
+        else if (fFound && nCurrentCost >= nBestCost)
+            fBacktrack = true;
+        else if (nCurrent >= nTarget)
+        {
+            fFound = true;
+            nBestCost = nCurrentCost;
+            vfSelected = vfCurrent;
+            nValueRet = nCurrent;
+            fBacktrack = true;
+        }
+
+        if (fBacktrack)
+        {
+            // Undo the last input taken and try the branch without it
+            while (i > 0 && !vfCurrent[i - 1])
+                i--;
+            if (i == 0)
+                break;
+            i--;
+            vfCurrent[i] = false;
+            nCurrent -= vInputs[i].nValue;
+            nCurrentCost -= vInputs[i].nCost;
+            i++;
+        }
+        else if (i > 0 && !vfCurrent[i - 1] && vInputs[i].nValue == vInputs[i - 1].nValue && vInputs[i].nCost == vInputs[i - 1].nCost)
+        {
+            // Taking this one instead of its left out twin gives the same subsets again
+            i++;
+        }
+        else
+        {
+            vfCurrent[i] = true;
+            nCurrent += vInputs[i].nValue;
+            nCurrentCost += vInputs[i].nCost;
+            i++;
+        }
+    }
+
+    return fFound;
+}
+
+void ApproximateBestSubset(const vector<CSelectionInput>& vInputs, CAmount nTotalLower, CAmount nTarget,
+                           vector<char>& vfBest, CAmount& nBest, int iterations)
+{
+    vector<char> vfIncluded;
+
+    vfBest.assign(vInputs.size(), true);
+    nBest = nTotalLower;
+
+    seed_insecure_rand();
+
+    for (int nRep = 0; nRep < iterations && nBest != nTarget; nRep++)
+    {
+        vfIncluded.assign(vInputs.size(), false);
+        CAmount nTotal = 0;
+        bool fReachedTarget = false;
+        for (int nPass = 0; nPass < 2 && !fReachedTarget; nPass++)
+        {
+            for (unsigned int i = 0; i < vInputs.size(); i++)
+            {
+                //The solver here uses a randomized algorithm,
+                //the randomness serves no real security purpose but is just
+                //needed to prevent degenerate behavior and it is important
+                //that the rng fast. We do not use a constant random sequence,
+                //because there may be some privacy improvement by making
+                //the selection random.
+                if (nPass == 0 ? insecure_rand()&1 : !vfIncluded[i])
+                {
+                    nTotal += vInputs[i].nValue;
+                    vfIncluded[i] = true;
+                    if (nTotal >= nTarget)
+                    {
+                        fReachedTarget = true;
+                        if (nTotal < nBest)
+                        {
+                            nBest = nTotal;
+                            vfBest = vfIncluded;
+                        }
+                        nTotal -= vInputs[i].nValue;
+                        vfIncluded[i] = false;
+                    }
+                }
+            }
+        }
+    }
+}
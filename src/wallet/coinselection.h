@@ -0,0 +1,90 @@
+// Copyright (c) 2009-2016 The Bitcoin Developers
+// Copyright (c) 2015-2016 Silk Network
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef DARKSILK_WALLET_COINSELECTION_H
+#define DARKSILK_WALLET_COINSELECTION_H
+
+#include "amount.h"
+
+#include <vector>
+
+#include <stdint.h>
+
+/** Nodes the branch and bound search may visit before it gives up. */
+static const unsigned int BNB_MAX_TRIES = 100000;
+
+/** A candidate input of a coin selection. */
+struct CSelectionInput
+{
+    CAmount nValue;
+    //! Policy cost of spending this input, see CCoinSelectionPolicy::Cost
+    uint64_t nCost;
+    //! Position of the coin in the caller's own list
+    unsigned int nIndex;
+
+    CSelectionInput(CAmount nValueIn, uint64_t nCostIn, unsigned int nIndexIn) : nValue(nValueIn), nCost(nCostIn), nIndex(nIndexIn) {}
+};
+
+/**
+ * What a coin selection strategy is allowed to spend and what it tries to
+ * minimize. Among the exact selections the one with the lowest total cost
+ * wins.
+ */
+class CCoinSelectionPolicy
+{
+public:
+    virtual ~CCoinSelectionPolicy() {}
+
+    virtual bool Accept(CAmount nValue) const { return true; }
+    virtual uint64_t Cost(CAmount nValue, int64_t nTime, int64_t nSpendTime) const = 0;
+};
+
+/** Spend as few inputs as possible. */
+class CMinInputsPolicy : public CCoinSelectionPolicy
+{
+public:
+    uint64_t Cost(CAmount nValue, int64_t nTime, int64_t nSpendTime) const { return 1; }
+};
+
+/** Spend the inputs that destroy the fewest coin-days, keeping old coins for staking. */
+class CPreserveCoinAgePolicy : public CCoinSelectionPolicy
+{
+public:
+    uint64_t Cost(CAmount nValue, int64_t nTime, int64_t nSpendTime) const;
+};
+
+/** Spend sandstorm denominations only. */
+class CDenominatedOnlyPolicy : public CCoinSelectionPolicy
+{
+public:
+    CDenominatedOnlyPolicy(const std::vector<CAmount>& vDenominationsIn) : vDenominations(vDenominationsIn) {}
+
+    bool Accept(CAmount nValue) const;
+    uint64_t Cost(CAmount nValue, int64_t nTime, int64_t nSpendTime) const { return 1; }
+
+private:
+    const std::vector<CAmount>& vDenominations;
+};
+
+/** Sort candidates largest first; equal values keep their order, so a shuffled list stays shuffled among them. */
+void SortSelectionInputs(std::vector<CSelectionInput>& vInputs);
+
+/**
+ * Depth-first branch and bound over vInputs, which must be sorted largest
+ * first, for the cheapest subset worth between nTarget and
+ * nTarget + nTolerance. Gives up after nMaxTries nodes and returns the best
+ * subset found so far, if any.
+ */
+bool SelectCoinsBnB(const std::vector<CSelectionInput>& vInputs, CAmount nTarget, CAmount nTolerance,
+                    std::vector<char>& vfSelected, CAmount& nValueRet, unsigned int nMaxTries = BNB_MAX_TRIES);
+
+/**
+ * Stochastic approximation of the smallest subset of vInputs worth at least
+ * nTarget (knapsack). nTotalLower is the value of all of vInputs.
+ */
+void ApproximateBestSubset(const std::vector<CSelectionInput>& vInputs, CAmount nTotalLower, CAmount nTarget,
+                           std::vector<char>& vfBest, CAmount& nBest, int iterations = 1000);
+
+#endif // DARKSILK_WALLET_COINSELECTION_H
@@ -904,7 +904,7 @@ Value movecmd(const Array& params, bool fHelp)
     debit.nTime = nNow;
     debit.strOtherAccount = strTo;
     debit.strComment = strComment;
-    walletdb.WriteAccountingEntry(debit);
+    pwalletMain->AddAccountingEntry(debit, walletdb);
 
     // Credit
     CAccountingEntry credit;
@@ -914,7 +914,7 @@ Value movecmd(const Array& params, bool fHelp)
     credit.nTime = nNow;
     credit.strOtherAccount = strFrom;
     credit.strComment = strComment;
-    walletdb.WriteAccountingEntry(credit);
+    pwalletMain->AddAccountingEntry(credit, walletdb);
 
     if (!walletdb.TxnCommit())
         throw JSONRPCError(RPC_DATABASE_ERROR, "database error");
@@ -1599,11 +1599,10 @@ Value listtransactions(const Array& params, bool fHelp)
 
     Array ret;
 
-    std::list<CAccountingEntry> acentries;
-    CWallet::TxItems txOrdered = pwalletMain->OrderedTxItems(acentries, strAccount);
+    const CWallet::TxItems& txOrdered = pwalletMain->wtxOrdered;
 
     // iterate backwards until we have nCount items to return:
-    for (CWallet::TxItems::reverse_iterator it = txOrdered.rbegin(); it != txOrdered.rend(); ++it)
+    for (CWallet::TxItems::const_reverse_iterator it = txOrdered.rbegin(); it != txOrdered.rend(); ++it)
     {
         CWalletTx *const pwtx = (*it).second.first;
         if (pwtx != 0)
@@ -1891,7 +1890,7 @@ Value gettransaction(const Array& params, bool fHelp)
             else
             {
                 entry.push_back(Pair("blockhash", hashBlock.GetHex()));
-                map<uint256, CBlockIndex*>::iterator mi = mapBlockIndex.find(hashBlock);
+                BlockMap::iterator mi = mapBlockIndex.find(hashBlock);
                 if (mi != mapBlockIndex.end() && (*mi).second)
                 {
                     CBlockIndex* pindex = (*mi).second;
@@ -2581,6 +2580,53 @@ Value scanforalltxns(const Array& params, bool fHelp)
     return result;
 }
 
+Value getrescaninfo(const Array& params, bool fHelp)
+{
+    if (fHelp || params.size() != 0)
+        throw runtime_error(
+            "getrescaninfo\n"
+            "\nReturns the progress of the running or last wallet rescan.\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"running\" : true|false,   (boolean) whether a rescan is under way\n"
+            "  \"startheight\" : n,        (numeric) block the rescan started at\n"
+            "  \"height\" : n,             (numeric) last block scanned\n"
+            "  \"stopheight\" : n,         (numeric) best block when last checked\n"
+            "  \"progress\" : x.xxx,       (numeric) share of the blocks scanned\n"
+            "  \"blocks\" : n,             (numeric) blocks read\n"
+            "  \"transactions\" : n,       (numeric) transactions matched against the wallet\n"
+            "  \"found\" : n,              (numeric) transactions added or updated\n"
+            "  \"elapsed\" : x.xxx,        (numeric) seconds spent\n"
+            "  \"blockspersecond\" : x.xx, (numeric) blocks read per second\n"
+            "  \"txpersecond\" : x.xx      (numeric) transactions matched per second\n"
+            "}\n"
+            "\nExamples\n"
+            + HelpExampleCli("getrescaninfo", "")
+            + HelpExampleRpc("getrescaninfo", "")
+        );
+
+    CRescanProgress progress;
+    pwalletMain->GetRescanProgress(progress);
+
+    int nSpan = progress.nStopHeight - progress.nStartHeight;
+    double dProgress = nSpan > 0 ? (double)(progress.nHeight - progress.nStartHeight) / nSpan : (progress.nStartTime ? 1.0 : 0.0);
+    double dElapsed = ((progress.fRunning ? GetTimeMillis() : progress.nLastTime) - progress.nStartTime) / 1000.0;
+
+    Object obj;
+    obj.push_back(Pair("running",         progress.fRunning));
+    obj.push_back(Pair("startheight",     progress.nStartHeight));
+    obj.push_back(Pair("height",          progress.nHeight));
+    obj.push_back(Pair("stopheight",      progress.nStopHeight));
+    obj.push_back(Pair("progress",        dProgress));
+    obj.push_back(Pair("blocks",          progress.nBlocks));
+    obj.push_back(Pair("transactions",    progress.nTransactions));
+    obj.push_back(Pair("found",           progress.nFound));
+    obj.push_back(Pair("elapsed",         dElapsed));
+    obj.push_back(Pair("blockspersecond", dElapsed > 0 ? progress.nBlocks / dElapsed : 0.0));
+    obj.push_back(Pair("txpersecond",     dElapsed > 0 ? progress.nTransactions / dElapsed : 0.0));
+    return obj;
+}
+
 Value scanforstealthtxns(const Array& params, bool fHelp)
 {
     if (fHelp || params.size() > 1)
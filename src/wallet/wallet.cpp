@@ -12,9 +12,11 @@
 #include <assert.h>
 
 #include "wallet/wallet.h"
+#include "wallet/coinselection.h"
 #include "base58.h"
 #include "checkpoints.h"
 #include "coincontrol.h"
+#include "init.h"
 #include "kernel.h"
 #include "net.h"
 #include "anon/stormnode/stormnode-budget.h"
@@ -58,15 +60,6 @@ static uint64_t CoinWeightCost(const COutput &out)
     return bnCoinDayWeight.getuint64();
 }
 
-struct CompareValueOnly
-{
-    bool operator()(const pair<CAmount, pair<const CWalletTx*, unsigned int> >& t1,
-                    const pair<CAmount, pair<const CWalletTx*, unsigned int> >& t2) const
-    {
-        return t1.first < t2.first;
-    }
-};
-
 struct LargerOrEqualThanThreshold
 {
    CAmount threshold;
@@ -461,6 +454,8 @@ void CWallet::AddToSpends(const COutPoint& outpoint, const uint256& wtxid)
     pair<TxSpends::iterator, TxSpends::iterator> range;
     range = mapTxSpends.equal_range(outpoint);
     SyncMetaData(range);
+
+    UpdateUnspent(outpoint.hash);
 }
 
 
@@ -475,6 +470,89 @@ void CWallet::AddToSpends(const uint256& wtxid)
         AddToSpends(txin.prevout, wtxid);
 }
 
+void CWallet::UpdateUnspent(const uint256& wtxid)
+{
+    AssertLockHeld(cs_wallet);
+    setUnspent.erase(setUnspent.lower_bound(COutPoint(wtxid, 0)),
+                     setUnspent.upper_bound(COutPoint(wtxid, std::numeric_limits<unsigned int>::max())));
+    balances.fValid = false;
+
+    std::map<uint256, CWalletTx>::const_iterator mi = mapWallet.find(wtxid);
+    if (mi == mapWallet.end())
+        return;
+    const CWalletTx& wtx = (*mi).second;
+
+    for (unsigned int i = 0; i < wtx.vout.size(); i++)
+    {
+        if (IsMine(wtx.vout[i]) == ISMINE_NO)
+            continue;
+
+        // Balances go by vfSpent and sandstorm by the spending transactions,
+        // so only drop outputs that both call spent
+        if (wtx.IsSpent(i))
+        {
+            bool fSpent = false;
+            pair<TxSpends::const_iterator, TxSpends::const_iterator> range;
+            range = mapTxSpends.equal_range(COutPoint(wtxid, i));
+            for (TxSpends::const_iterator it = range.first; it != range.second && !fSpent; ++it)
+                fSpent = mapWallet.count(it->second) != 0;
+            if (fSpent)
+                continue;
+        }
+        setUnspent.insert(COutPoint(wtxid, i));
+    }
+}
+
+void CWallet::CacheBalances() const
+{
+    AssertLockHeld(cs_main);
+    AssertLockHeld(cs_wallet);
+
+    // Transactions entering the pool reach the wallet through
+    // SyncTransaction, which drops the totals if they are ours
+    bool fPoolRemoved = fPoolRemovedWalletTx.exchange(false);
+    if (balances.fValid && !fPoolRemoved && balances.hashTip == hashBestChain &&
+        balances.nTxLocks == nCompleteTXLocks && balances.nRounds == nSandstormRounds)
+        return;
+
+    balances.SetNull();
+    balances.hashTip = hashBestChain;
+    balances.nTxLocks = nCompleteTXLocks;
+    balances.nRounds = nSandstormRounds;
+
+    for (set<COutPoint>::const_iterator it = setUnspent.begin(); it != setUnspent.end();
+         it = setUnspent.upper_bound(COutPoint(it->hash, std::numeric_limits<unsigned int>::max())))
+    {
+        const CWalletTx* pcoin = &mapWallet.find(it->hash)->second;
+
+        bool fTrusted = pcoin->IsTrusted();
+        if (fTrusted)
+        {
+            balances.nTrusted += pcoin->GetAvailableCredit();
+            balances.nWatchOnly += pcoin->GetAvailableWatchOnlyCredit();
+        }
+        if (!IsFinalTx(*pcoin) || (!fTrusted && pcoin->GetDepthInMainChain() == 0))
+        {
+            balances.nUnconfirmed += pcoin->GetAvailableCredit();
+            balances.nUnconfirmedWatchOnly += pcoin->GetAvailableWatchOnlyCredit();
+        }
+        balances.nImmature += pcoin->GetImmatureCredit();
+        balances.nImmatureWatchOnly += pcoin->GetImmatureWatchOnlyCredit();
+
+        if ((pcoin->IsCoinBase() || pcoin->IsCoinStake()) && pcoin->GetBlocksToMaturity() > 0 && pcoin->GetDepthInMainChain() > 0)
+        {
+            if (pcoin->IsCoinStake())
+            {
+                balances.nStake += CWallet::GetCredit(*pcoin, ISMINE_ALL);
+                balances.nWatchOnlyStake += CWallet::GetCredit(*pcoin, ISMINE_WATCH_ONLY);
+            }
+            else
+                balances.nNewMint += CWallet::GetCredit(*pcoin, ISMINE_ALL);
+        }
+    }
+    balances.fValid = true;
+}
+
 
 bool CWallet::EncryptWallet(const SecureString& strWalletPassphrase)
 {
@@ -607,29 +685,37 @@ int64_t CWallet::IncOrderPosNext(CWalletDB *pwalletdb)
     return nRet;
 }
 
-CWallet::TxItems CWallet::OrderedTxItems(std::list<CAccountingEntry>& acentries, std::string strAccount)
+bool CWallet::AddAccountingEntry(const CAccountingEntry& acentry, CWalletDB& walletdb)
 {
-    AssertLockHeld(cs_wallet); // mapWallet
-    CWalletDB walletdb(strWalletFile);
+    CAccountingEntry entry = acentry;
+    if (!walletdb.WriteAccountingEntry(entry))
+        return false;
+
+    LOCK(cs_wallet);
+    LoadAccountingEntry(entry);
+    return true;
+}
 
-    // First: get all CWalletTx and CAccountingEntry into a sorted-by-order multimap.
-    TxItems txOrdered;
+void CWallet::LoadAccountingEntry(const CAccountingEntry& acentry)
+{
+    laccentries.push_back(acentry);
+    CAccountingEntry* pacentry = &laccentries.back();
+    wtxOrdered.insert(make_pair(pacentry->nOrderPos, TxPair((CWalletTx*)0, pacentry)));
+}
 
-    // Note: maintaining indices in the database of (account,time) --> txid and (account, time) --> acentry
-    // would make this much faster for applications that do this a lot.
+void CWallet::ReindexTxItems()
+{
+    AssertLockHeld(cs_wallet); // mapWallet
+    wtxOrdered.clear();
     for (map<uint256, CWalletTx>::iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
     {
         CWalletTx* wtx = &((*it).second);
-        txOrdered.insert(make_pair(wtx->nOrderPos, TxPair(wtx, (CAccountingEntry*)0)));
+        wtxOrdered.insert(make_pair(wtx->nOrderPos, TxPair(wtx, (CAccountingEntry*)0)));
     }
-    acentries.clear();
-    walletdb.ListAccountCreditDebit(strAccount, acentries);
-    BOOST_FOREACH(CAccountingEntry& entry, acentries)
+    BOOST_FOREACH(CAccountingEntry& entry, laccentries)
     {
-        txOrdered.insert(make_pair(entry.nOrderPos, TxPair((CWalletTx*)0, &entry)));
+        wtxOrdered.insert(make_pair(entry.nOrderPos, TxPair((CWalletTx*)0, &entry)));
     }
-
-    return txOrdered;
 }
 
 void CWallet::MarkDirty()
@@ -637,7 +723,12 @@ void CWallet::MarkDirty()
     {
         LOCK(cs_wallet);
         BOOST_FOREACH(PAIRTYPE(const uint256, CWalletTx)& item, mapWallet)
+        {
             item.second.MarkDirty();
+            // Keys may have been added, so what is ours may have changed
+            UpdateUnspent(item.first);
+        }
+        mapSandstormRounds.clear();
     }
 }
 
@@ -647,8 +738,11 @@ bool CWallet::AddToWallet(const CWalletTx& wtxIn, bool fFromLoadWallet)
     if (fFromLoadWallet)
     {
         mapWallet[hash] = wtxIn;
-        mapWallet[hash].BindWallet(this);
+        CWalletTx& wtx = mapWallet[hash];
+        wtx.BindWallet(this);
+        wtxOrdered.insert(make_pair(wtx.nOrderPos, TxPair(&wtx, (CAccountingEntry*)0)));
         AddToSpends(hash);
+        UpdateUnspent(hash);
     }
     else    
     {
@@ -658,10 +752,18 @@ bool CWallet::AddToWallet(const CWalletTx& wtxIn, bool fFromLoadWallet)
         CWalletTx& wtx = (*ret.first).second;
         wtx.BindWallet(this);
         bool fInsertedNew = ret.second;
+
+        // The cached kernel inputs of its outputs may be stale now
+        mapStakeCache.erase(mapStakeCache.lower_bound(COutPoint(hash, 0)),
+                            mapStakeCache.upper_bound(COutPoint(hash, std::numeric_limits<unsigned int>::max())));
+
         if (fInsertedNew)
         {
             wtx.nTimeReceived = GetAdjustedTime();
             wtx.nOrderPos = IncOrderPosNext();
+            wtxOrdered.insert(make_pair(wtx.nOrderPos, TxPair(&wtx, (CAccountingEntry*)0)));
+            AddToSpends(hash);
+            InvalidateSandstormRounds(hash);
 
             wtx.nTimeSmart = wtx.nTimeReceived;
             if (wtxIn.hashBlock != 0)
@@ -673,9 +775,7 @@ bool CWallet::AddToWallet(const CWalletTx& wtxIn, bool fFromLoadWallet)
                     {
                         // Tolerate times up to the last timestamp in the wallet not more than 5 minutes into the future
                         int64_t latestTolerated = latestNow + 300;
-                        std::list<CAccountingEntry> acentries;
-                        TxItems txOrdered = OrderedTxItems(acentries);
-                        for (TxItems::reverse_iterator it = txOrdered.rbegin(); it != txOrdered.rend(); ++it)
+                        for (TxItems::reverse_iterator it = wtxOrdered.rbegin(); it != wtxOrdered.rend(); ++it)
                         {
                             CWalletTx *const pwtx = (*it).second.first;
                             if (pwtx == &wtx)
@@ -743,6 +843,7 @@ bool CWallet::AddToWallet(const CWalletTx& wtxIn, bool fFromLoadWallet)
 
         // Break debit/credit balance caches:
         wtx.MarkDirty();
+        UpdateUnspent(hash);
 
         // Notify UI of new or updated transaction
         NotifyTransactionChanged(this, hash, fInsertedNew ? CT_NEW : CT_UPDATED);
@@ -800,7 +901,10 @@ void CWallet::SyncTransaction(const CTransaction& tx, const CBlock* pblock, bool
     BOOST_FOREACH(const CTxIn& txin, tx.vin)
     {
         if (mapWallet.count(txin.prevout.hash))
+        {
             mapWallet[txin.prevout.hash].MarkDirty();
+            UpdateUnspent(txin.prevout.hash);
+        }
     }
 
     if (!fConnect)
@@ -821,12 +925,42 @@ void CWallet::EraseFromWallet(const uint256 &hash)
         return;
     {
         LOCK(cs_wallet);
-        if (mapWallet.erase(hash))
+        map<uint256, CWalletTx>::iterator mi = mapWallet.find(hash);
+        if (mi != mapWallet.end())
+        {
+            pair<TxItems::iterator, TxItems::iterator> range = wtxOrdered.equal_range(mi->second.nOrderPos);
+            for (TxItems::iterator it = range.first; it != range.second; ++it)
+            {
+                if (it->second.first == &mi->second)
+                {
+                    wtxOrdered.erase(it);
+                    break;
+                }
+            }
+            // The outputs it spent count as unspent again
+            vector<uint256> vPrevHashes;
+            BOOST_FOREACH(const CTxIn& txin, mi->second.vin)
+                vPrevHashes.push_back(txin.prevout.hash);
+            mapWallet.erase(mi);
+            UpdateUnspent(hash);
+            BOOST_FOREACH(const uint256& hashPrev, vPrevHashes)
+                UpdateUnspent(hashPrev);
+            InvalidateSandstormRounds(hash);
             CWalletDB(strWalletFile).EraseTx(hash);
+        }
     }
     return;
 }
 
+void CWallet::RemovedFromMempool(const uint256 &hash)
+{
+    // Called under mempool.cs, which others take after cs_wallet, so do
+    // not wait for cs_wallet; if it is busy, assume the transaction is ours
+    TRY_LOCK(cs_wallet, lockWallet);
+    if (!lockWallet || mapWallet.count(hash))
+        fPoolRemovedWalletTx = true;
+}
+
 isminetype CWallet::IsMine(const CTxIn &txin) const
 {
     {
@@ -1118,38 +1252,214 @@ bool CWalletTx::WriteToDisk()
     return CWalletDB(pwallet->strWalletFile).WriteTx(GetHash(), *this);
 }
 
-// Scan the block chain (starting in pindexStart) for transactions
-// from or to us. If fUpdate is true, found transactions that already
-// exist in the wallet will be updated.
+// A block on its way through ScanForWalletTransactions: read on the I/O
+// thread, matched against our keys on all cores, then added to the wallet.
+struct CRescanBlock
+{
+    CBlockIndex* pindex;
+    CBlock block;
+    bool fRead;
+    // Per transaction: pays one of our keys or carries a stealth ephemeral key
+    std::vector<char> vfMatch;
+
+    CRescanBlock(CBlockIndex* pindexIn) : pindex(pindexIn), fRead(false) {}
+};
+
+static bool HasStealthEphem(const CTransaction& tx)
+{
+    std::vector<uint8_t> vchEphemPK;
+    opcodetype opCode;
+    BOOST_FOREACH(const CTxOut& txout, tx.vout)
+    {
+        CScript::const_iterator itTxA = txout.scriptPubKey.begin();
+        if (txout.scriptPubKey.GetOp(itTxA, opCode, vchEphemPK)
+            && opCode == OP_RETURN
+            && txout.scriptPubKey.GetOp(itTxA, opCode, vchEphemPK)
+            && vchEphemPK.size() == ec_compressed_size)
+            return true;
+    }
+    return false;
+}
+
+static void RescanReadThread(std::vector<CRescanBlock>* pvBatch)
+{
+    RenameThread("darksilk-rescan");
+    BOOST_FOREACH(CRescanBlock& rescan, *pvBatch)
+        rescan.fRead = rescan.block.ReadFromDisk(rescan.pindex, true);
+}
+
+// Only reads the keystore, which has its own lock, so it runs without cs_wallet
+static void RescanMatchThread(const CWallet* pwallet, std::vector<CRescanBlock>* pvBatch, int nOffset, int nThreads)
+{
+    for (size_t i = nOffset; i < pvBatch->size(); i += nThreads)
+    {
+        CRescanBlock& rescan = (*pvBatch)[i];
+        rescan.vfMatch.assign(rescan.block.vtx.size(), false);
+        for (size_t j = 0; j < rescan.block.vtx.size(); j++)
+            rescan.vfMatch[j] = pwallet->IsMine(rescan.block.vtx[j]) || HasStealthEphem(rescan.block.vtx[j]);
+    }
+}
+
+// Collect the next blocks to rescan, starting at pindex, and move pindex past them
+void CWallet::NextRescanBatch(CBlockIndex*& pindex, std::vector<CRescanBlock>& vBatch) const
+{
+    LOCK2(cs_main, cs_wallet);
+    vBatch.clear();
+
+    // A reorganization since the last batch may have left pindex on a side
+    // branch, whose blocks have no pnext; carry on from the fork
+    while (pindex && pindex->pnext == NULL && pindex != pindexBest)
+        pindex = pindex->pprev;
+
+    while (pindex && vBatch.size() < RESCAN_BATCH_BLOCKS)
+    {
+        // no need to read and scan block, if block was created before
+        // our wallet birthday (as adjusted for block time variability)
+        if (!nTimeFirstKey || pindex->nTime >= nTimeFirstKey - 7200)
+            vBatch.push_back(CRescanBlock(pindex));
+        pindex = pindex->pnext;
+    }
+}
+
+// The locator reads chainActive, which SetTip reallocates under cs_main
+static CBlockLocator RescanLocator(const CBlockIndex* pindex)
+{
+    LOCK(cs_main);
+    return CBlockLocator(pindex);
+}
+
+// Scan the main chain from pindexStart on for transactions of ours.
+// Blocks are read one batch ahead on an I/O thread and matched against our
+// keys on all cores; only adding to the wallet takes cs_main and cs_wallet,
+// a batch at a time. Every RESCAN_CHECKPOINT_BLOCKS the wallet file records
+// how far the scan got, so that a rescan cut short by a shutdown resumes
+// there on the next start.
 int CWallet::ScanForWalletTransactions(CBlockIndex* pindexStart, bool fUpdate)
 {
     int ret = 0;
 
+    {
+        LOCK(cs_rescan);
+        rescanProgress.SetNull();
+        rescanProgress.fRunning = true;
+        rescanProgress.nStartHeight = pindexStart ? pindexStart->nHeight : 0;
+        rescanProgress.nHeight = rescanProgress.nStartHeight;
+        rescanProgress.nStopHeight = nBestHeight;
+        rescanProgress.nStartTime = rescanProgress.nLastTime = GetTimeMillis();
+    }
+
+    int nThreads = std::max(1, (int)boost::thread::hardware_concurrency());
+    int nCheckpointHeight = pindexStart ? pindexStart->nHeight : 0;
+    bool fInterrupted = false;
+
     CBlockIndex* pindex = pindexStart;
+    std::vector<CRescanBlock> vBatch, vNext;
+    NextRescanBatch(pindex, vNext);
+    boost::thread* pthreadRead = new boost::thread(boost::bind(&RescanReadThread, &vNext));
+    while (pthreadRead)
     {
-        LOCK2(cs_main, cs_wallet);
-        while (pindex)
+        pthreadRead->join();
+        delete pthreadRead;
+        pthreadRead = NULL;
+        vBatch.swap(vNext);
+
+        if (vBatch.empty())
+            break;
+
+        // Read the next batch while this one is matched and added
+        NextRescanBatch(pindex, vNext);
+        if (!vNext.empty())
+            pthreadRead = new boost::thread(boost::bind(&RescanReadThread, &vNext));
+
+        boost::thread_group threadGroup;
+        for (int i = 1; i < nThreads; i++)
+            threadGroup.create_thread(boost::bind(&RescanMatchThread, this, &vBatch, i, nThreads));
+        RescanMatchThread(this, &vBatch, 0, nThreads);
+        threadGroup.join_all();
+
+        int64_t nTransactions = 0;
+        int nFound = 0;
         {
-            // no need to read and scan block, if block was created before
-            // our wallet birthday (as adjusted for block time variability)
-            if (nTimeFirstKey && (pindex->nTime < (nTimeFirstKey - 7200))) {
-                pindex = pindex->pnext;
-                continue;
+            LOCK2(cs_main, cs_wallet);
+
+            std::vector<CTransaction> vtxMatch;
+            BOOST_FOREACH(const CRescanBlock& rescan, vBatch)
+                for (size_t j = 0; j < rescan.vfMatch.size(); j++)
+                    if (rescan.vfMatch[j])
+                        vtxMatch.push_back(rescan.block.vtx[j]);
+            PrepareStealthScan(vtxMatch);
+
+            uint32_t nFoundStealthBefore = nFoundStealth;
+            BOOST_FOREACH(CRescanBlock& rescan, vBatch)
+            {
+                if (!rescan.fRead)
+                    LogPrintf("ScanForWalletTransactions() : failed to read block %s\n", rescan.pindex->GetBlockHash().ToString());
+                nTransactions += rescan.block.vtx.size();
+                for (size_t j = 0; j < rescan.block.vtx.size(); j++)
+                {
+                    const CTransaction& tx = rescan.block.vtx[j];
+                    // Once a stealth payment has added a key, later transactions
+                    // may pay it too, so match the rest of the batch again
+                    if (!rescan.vfMatch[j] && nFoundStealth == nFoundStealthBefore &&
+                        !(fUpdate && mapWallet.count(tx.GetHash())) && !IsFromMe(tx))
+                        continue;
+                    if (AddToWalletIfInvolvingMe(tx, &rescan.block, fUpdate))
+                        nFound++;
+                }
             }
+            mapStealthDerived.clear();
+        }
+        ret += nFound;
+
+        CBlockIndex* pindexLast = vBatch.back().pindex;
+        {
+            LOCK(cs_rescan);
+            rescanProgress.nHeight = pindexLast->nHeight;
+            rescanProgress.nStopHeight = std::max(nBestHeight, pindexLast->nHeight);
+            rescanProgress.nBlocks += vBatch.size();
+            rescanProgress.nTransactions += nTransactions;
+            rescanProgress.nFound += nFound;
+            rescanProgress.nLastTime = GetTimeMillis();
+        }
+
+        if (fFileBacked && pindexLast->nHeight - nCheckpointHeight >= RESCAN_CHECKPOINT_BLOCKS)
+        {
+            CWalletDB(strWalletFile).WriteRescanPos(RescanLocator(pindexLast));
+            nCheckpointHeight = pindexLast->nHeight;
+        }
 
-            CBlock block;
-            block.ReadFromDisk(pindex, true);
-            BOOST_FOREACH(CTransaction& tx, block.vtx)
+        if (ShutdownRequested())
+        {
+            LogPrintf("ScanForWalletTransactions() : interrupted at block %d\n", pindexLast->nHeight);
+            if (fFileBacked)
+                CWalletDB(strWalletFile).WriteRescanPos(RescanLocator(pindexLast));
+            fInterrupted = true;
+            if (pthreadRead)
             {
-                if (AddToWalletIfInvolvingMe(tx, &block, fUpdate))
-                    ret++;
+                pthreadRead->join();
+                delete pthreadRead;
+                pthreadRead = NULL;
             }
-            pindex = pindex->pnext;
         }
     }
+
+    if (fFileBacked && !fInterrupted)
+        CWalletDB(strWalletFile).EraseRescanPos();
+
+    {
+        LOCK(cs_rescan);
+        rescanProgress.fRunning = false;
+        rescanProgress.nLastTime = GetTimeMillis();
+    }
     return ret;
 }
 
+void CWallet::GetRescanProgress(CRescanProgress& progress) const
+{
+    LOCK(cs_rescan);
+    progress = rescanProgress;
+}
+
 void CWallet::ReacceptWalletTransactions()
 {
     CTxDB txdb("r");
@@ -1204,6 +1514,7 @@ void CWallet::ReacceptWalletTransactions()
                     LogPrintf("ReacceptWalletTransactions found spent coin %s DRKSLK %s\n", FormatMoney(wtx.GetCredit(ISMINE_ALL)), wtx.GetHash().ToString());
                     wtx.MarkDirty();
                     wtx.WriteToDisk();
+                    UpdateUnspent(wtx.GetHash());
                 }
             }
             else
@@ -1317,18 +1628,9 @@ void CWallet::ResendWalletTransactions(bool fForce)
 
 CAmount CWallet::GetBalance() const
 {
-    CAmount nTotal = 0;
-    {
-        LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
-        {
-            const CWalletTx* pcoin = &(*it).second;
-            if (pcoin->IsTrusted())
-                nTotal += pcoin->GetAvailableCredit();
-        }
-    }
-
-    return nTotal;
+    LOCK2(cs_main, cs_wallet);
+    CacheBalances();
+    return balances.nTrusted;
 }
 
 CAmount CWallet::GetAnonymizableBalance(bool includeAlreadyAnonymized) const
@@ -1338,26 +1640,28 @@ CAmount CWallet::GetAnonymizableBalance(bool includeAlreadyAnonymized) const
     CAmount nTotal = 0;
     {
         LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
+        const CWalletTx* pcoin = NULL;
+        bool fTrusted = false;
+        BOOST_FOREACH(const COutPoint& outpoint, setUnspent)
         {
-            const CWalletTx* pcoin = &(*it).second;
-
-            if (pcoin->IsTrusted())
+            if (pcoin == NULL || pcoin->GetHash() != outpoint.hash)
             {
-                uint256 hash = (*it).first;
-                for (unsigned int i = 0; i < pcoin->vout.size(); i++)
-                {
-                    CTxIn vin = CTxIn(hash, i);
+                pcoin = &mapWallet.find(outpoint.hash)->second;
+                fTrusted = pcoin->IsTrusted();
+            }
+            if (!fTrusted) continue;
 
-                    if(IsSpent(hash, i) || !IsMine(pcoin->vout[i])) continue;
-                    if (pcoin->IsCoinBase() && pcoin->GetBlocksToMaturity() > 0) continue; // do not count immature
-                    if(pcoin->vout[i].nValue == 10000*COIN) continue; // do not count SN-like outputs
+            uint256 hash = outpoint.hash;
+            unsigned int i = outpoint.n;
+            CTxIn vin = CTxIn(hash, i);
 
-                    int rounds = GetInputSandstormRounds(vin);
-                    if(rounds >=-2 && (rounds < nSandstormRounds || (includeAlreadyAnonymized && rounds >= nSandstormRounds))) {
-                       nTotal += pcoin->vout[i].nValue;
-                    }
-                }
+            if(IsSpent(hash, i) || !IsMine(pcoin->vout[i])) continue;
+            if (pcoin->IsCoinBase() && pcoin->GetBlocksToMaturity() > 0) continue; // do not count immature
+            if(pcoin->vout[i].nValue == 10000*COIN) continue; // do not count SN-like outputs
+
+            int rounds = GetInputSandstormRounds(vin);
+            if(rounds >=-2 && (rounds < nSandstormRounds || (includeAlreadyAnonymized && rounds >= nSandstormRounds))) {
+               nTotal += pcoin->vout[i].nValue;
             }
         }
     }
@@ -1369,35 +1673,35 @@ CAmount CWallet::GetAnonymizedBalance() const
 {
     if(fLiteMode) return 0;
 
+    LOCK2(cs_main, cs_wallet);
+    CacheBalances();
+    if (balances.fAnonymizedCached)
+        return balances.nAnonymized;
+
     CAmount nTotal = 0;
+    const CWalletTx* pcoin = NULL;
+    bool fTrusted = false;
+    BOOST_FOREACH(const COutPoint& outpoint, setUnspent)
     {
-        LOCK(cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
+        if (pcoin == NULL || pcoin->GetHash() != outpoint.hash)
         {
-            const CWalletTx* pcoin = &(*it).second;
+            pcoin = &mapWallet.find(outpoint.hash)->second;
+            fTrusted = pcoin->IsTrusted();
+        }
+        if (!fTrusted) continue;
 
-            if (pcoin->IsTrusted())
-            {
-                int nDepth = pcoin->GetDepthInMainChain();
+        unsigned int i = outpoint.n;
+        CTxIn vin = CTxIn(outpoint.hash, i);
 
-                for (unsigned int i = 0; i < pcoin->vout.size(); i++) {
-                    //isminetype mine = IsMine(pcoin->vout[i]);
-                    bool mine = IsMine(pcoin->vout[i]);
-                    //COutput out = COutput(pcoin, i, nDepth, (mine & ISMINE_SPENDABLE) != ISMINE_NO);
-                    COutput out = COutput(pcoin, i, nDepth, mine);
-                    CTxIn vin = CTxIn(out.tx->GetHash(), out.i);
-
-                    //if(IsSpent(out.tx->GetHash(), i) || !IsMine(pcoin->vout[i]) || !IsDenominated(vin)) continue;
-                    if(pcoin->IsSpent(i) || !IsMine(pcoin->vout[i]) || !IsDenominated(vin)) continue;
-                    int rounds = GetInputSandstormRounds(vin);
-                    if(rounds >= nSandstormRounds){
-                        nTotal += pcoin->vout[i].nValue;
-                    }
-                }
-            }
+        if(pcoin->IsSpent(i) || !IsMine(pcoin->vout[i]) || !IsDenominated(vin)) continue;
+        int rounds = GetInputSandstormRounds(vin);
+        if(rounds >= nSandstormRounds){
+            nTotal += pcoin->vout[i].nValue;
         }
     }
 
+    balances.nAnonymized = nTotal;
+    balances.fAnonymizedCached = true;
     return nTotal;
 }
 
@@ -1410,98 +1714,115 @@ const CWalletTx* CWallet::GetWalletTx(const uint256& hash) const
     return &(it->second);
 }
 
-// Recursively determine the rounds of a given input (How deep is the Sandstorm chain for a given input)
-int CWallet::GetRealInputSandstormRounds(CTxIn in, int rounds) const
+// Determine the rounds of a given output (How deep is the Sandstorm chain for a given input).
+// The wallet ancestors of the output are settled first, so every output is
+// computed once and no recursion is needed however long the chain is.
+int CWallet::GetRealInputSandstormRounds(const COutPoint& outpoint) const
 {
-    static std::map<uint256, CMutableTransaction> mDenomWtxes;
+    AssertLockHeld(cs_wallet);
 
-    if(rounds >= 100) return 99; // 100 rounds max
+    std::map<COutPoint, int>::const_iterator mi = mapSandstormRounds.find(outpoint);
+    if (mi != mapSandstormRounds.end())
+        return mi->second;
 
-    uint256 hash = in.prevout.hash;
-    unsigned int nout = in.prevout.n;
+    if (mapSandstormRounds.size() >= MAX_SANDSTORM_ROUNDS_CACHE)
+        mapSandstormRounds.clear();
 
-    const CWalletTx* wtx = GetWalletTx(hash);
-    if(wtx != NULL)
+    std::vector<COutPoint> vStack;
+    vStack.push_back(outpoint);
+    while (!vStack.empty())
     {
-        std::map<uint256, CMutableTransaction>::const_iterator mdwi = mDenomWtxes.find(hash);
-        // not known yet, let's add it
-        if(mdwi == mDenomWtxes.end())
-        {
-            LogPrint("sandstorm", "GetInputSandstormRounds INSERTING %s\n", hash.ToString());
-            mDenomWtxes[hash] = CMutableTransaction(*wtx);
-        }
-        // found and it's not an initial value, just return it
-        else if(mDenomWtxes[hash].vout[nout].nRounds != -10)
+        const COutPoint out = vStack.back();
+        if (mapSandstormRounds.count(out))
         {
-            return mDenomWtxes[hash].vout[nout].nRounds;
-        }
-
-        // bounds check
-        if(nout >= wtx->vout.size())
-        {
-            // should never actually hit this
-            LogPrint("sandstorm", "GetInputSandstormRounds UPDATED   %s %3d %3d\n", hash.ToString(), nout, -4);
-            return -4;
-        }
-
-        if(pwalletMain->IsCollateralAmount(wtx->vout[nout].nValue))
-        {
-            mDenomWtxes[hash].vout[nout].nRounds = -3;
-            LogPrint("sandstorm", "GetInputSandstormRounds UPDATED   %s %3d %3d\n", hash.ToString(), nout, mDenomWtxes[hash].vout[nout].nRounds);
-            return mDenomWtxes[hash].vout[nout].nRounds;
-        }
-
-        //make sure the final output is non-denominate
-        if(/*rounds == 0 && */!IsDenominatedAmount(wtx->vout[nout].nValue)) //NOT DENOM
-        {
-            mDenomWtxes[hash].vout[nout].nRounds = -2;
-            LogPrint("sandstorm", "GetInputSandstormRounds UPDATED   %s %3d %3d\n", hash.ToString(), nout, mDenomWtxes[hash].vout[nout].nRounds);
-            return mDenomWtxes[hash].vout[nout].nRounds;
+            vStack.pop_back();
+            continue;
         }
 
-        bool fAllDenoms = true;
-        BOOST_FOREACH(CTxOut out, wtx->vout)
-        {
-            fAllDenoms = fAllDenoms && IsDenominatedAmount(out.nValue);
-        }
-        // this one is denominated but there is another non-denominated output found in the same tx
-        if(!fAllDenoms)
+        int nRounds;
+        bool fPending = false;
+        const CWalletTx* wtx = GetWalletTx(out.hash);
+        if (wtx == NULL)
+            nRounds = -1; // not ours
+        else if (out.n >= wtx->vout.size())
+            nRounds = -4; // should never actually hit this
+        else if (IsCollateralAmount(wtx->vout[out.n].nValue))
+            nRounds = -3;
+        else if (!IsDenominatedAmount(wtx->vout[out.n].nValue)) // make sure the final output is non-denominate
+            nRounds = -2;
+        else
         {
-            mDenomWtxes[hash].vout[nout].nRounds = 0;
-            LogPrint("sandstorm", "GetInputSandstormRounds UPDATED   %s %3d %3d\n", hash.ToString(), nout, mDenomWtxes[hash].vout[nout].nRounds);
-            return mDenomWtxes[hash].vout[nout].nRounds;
-        }
+            bool fAllDenoms = true;
+            BOOST_FOREACH(const CTxOut& txout, wtx->vout)
+                fAllDenoms = fAllDenoms && IsDenominatedAmount(txout.nValue);
 
-        int nShortest = -10; // an initial value, should be no way to get this by calculations
-        bool fDenomFound = false;
-        // only denoms here so let's look up
-        BOOST_FOREACH(CTxIn in2, wtx->vin)
-        {
-            if(IsMine(in2))
+            // this one is denominated but there is another non-denominated output found in the same tx
+            nRounds = 0;
+            if (fAllDenoms)
             {
-                int n = GetRealInputSandstormRounds(in2, rounds+1);
-                // denom found, find the shortest chain or initially assign nShortest with the first found value
-                if(n >= 0 && (n < nShortest || nShortest == -10))
+                // only denoms here so let's look up the shortest chain of our inputs
+                int nShortest = -1;
+                BOOST_FOREACH(const CTxIn& txin, wtx->vin)
                 {
-                    nShortest = n;
-                    fDenomFound = true;
+                    if (!IsMine(txin))
+                        continue;
+                    mi = mapSandstormRounds.find(txin.prevout);
+                    if (mi == mapSandstormRounds.end())
+                    {
+                        vStack.push_back(txin.prevout);
+                        fPending = true;
+                    }
+                    else if (mi->second >= 0 && (nShortest < 0 || mi->second < nShortest))
+                        nShortest = mi->second;
                 }
+                // good, we a +1 to the shortest one but only 100 rounds max allowed;
+                // too bad if none was found, we are the first one in that chain
+                if (nShortest >= 0)
+                    nRounds = std::min(nShortest + 1, 100);
             }
         }
-        mDenomWtxes[hash].vout[nout].nRounds = fDenomFound
-                ? (nShortest >= 99 ? 100 : nShortest + 1) // good, we a +1 to the shortest one but only 100 rounds max allowed
-                : 0;            // too bad, we are the fist one in that chain
-        LogPrint("sandstorm", "GetInputSandstormRounds UPDATED   %s %3d %3d\n", hash.ToString(), nout, mDenomWtxes[hash].vout[nout].nRounds);
-        return mDenomWtxes[hash].vout[nout].nRounds;
+        if (fPending)
+            continue;
+
+        mapSandstormRounds[out] = nRounds;
+        LogPrint("sandstorm", "GetInputSandstormRounds UPDATED   %s %3d %3d\n", out.hash.ToString(), out.n, nRounds);
+        vStack.pop_back();
     }
 
-    return rounds-1;
+    return mapSandstormRounds[outpoint];
+}
+
+void CWallet::InvalidateSandstormRounds(const uint256& wtxid)
+{
+    AssertLockHeld(cs_wallet);
+    if (mapSandstormRounds.empty())
+        return;
+
+    // The rounds of the outputs of wtxid and of everything in the wallet
+    // spending them may have been computed without it
+    std::vector<uint256> vToDo;
+    std::set<uint256> setDone;
+    vToDo.push_back(wtxid);
+    while (!vToDo.empty())
+    {
+        uint256 hash = vToDo.back();
+        vToDo.pop_back();
+        if (!setDone.insert(hash).second)
+            continue;
+
+        mapSandstormRounds.erase(mapSandstormRounds.lower_bound(COutPoint(hash, 0)),
+                                 mapSandstormRounds.upper_bound(COutPoint(hash, std::numeric_limits<unsigned int>::max())));
+        TxSpends::const_iterator it = mapTxSpends.lower_bound(COutPoint(hash, 0));
+        TxSpends::const_iterator end = mapTxSpends.upper_bound(COutPoint(hash, std::numeric_limits<unsigned int>::max()));
+        for (; it != end; ++it)
+            vToDo.push_back(it->second);
+    }
 }
 
 // respect current settings
 int CWallet::GetInputSandstormRounds(CTxIn in) const {
     LOCK(cs_wallet);
-    int realSandstormRounds = GetRealInputSandstormRounds(in, 0);
+    int realSandstormRounds = GetRealInputSandstormRounds(in.prevout);
     return realSandstormRounds > nSandstormRounds ? nSandstormRounds : realSandstormRounds;
 }
 
@@ -1513,30 +1834,26 @@ double CWallet::GetAverageAnonymizedRounds() const
     double fCount = 0;
 
     {
-        LOCK(cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
+        LOCK2(cs_main, cs_wallet);
+        const CWalletTx* pcoin = NULL;
+        bool fTrusted = false;
+        BOOST_FOREACH(const COutPoint& outpoint, setUnspent)
         {
-            const CWalletTx* pcoin = &(*it).second;
-
-            if (pcoin->IsTrusted())
+            if (pcoin == NULL || pcoin->GetHash() != outpoint.hash)
             {
-                int nDepth = pcoin->GetDepthInMainChain();
+                pcoin = &mapWallet.find(outpoint.hash)->second;
+                fTrusted = pcoin->IsTrusted();
+            }
+            if (!fTrusted) continue;
 
-                for (unsigned int i = 0; i < pcoin->vout.size(); i++) {
-                    //isminetype mine = IsMine(pcoin->vout[i]);
-                    bool mine = IsMine(pcoin->vout[i]);
-                    //COutput out = COutput(pcoin, i, nDepth, (mine & ISMINE_SPENDABLE) != ISMINE_NO);
-                    COutput out = COutput(pcoin, i, nDepth, mine);
-                    CTxIn vin = CTxIn(out.tx->GetHash(), out.i);
+            unsigned int i = outpoint.n;
+            CTxIn vin = CTxIn(outpoint.hash, i);
 
-                    //if(IsSpent(out.tx->GetHash(), i) || !IsMine(pcoin->vout[i]) || !IsDenominated(vin)) continue;
-                    if(pcoin->IsSpent(i) || !IsMine(pcoin->vout[i]) || !IsDenominated(vin)) continue;
+            if(pcoin->IsSpent(i) || !IsMine(pcoin->vout[i]) || !IsDenominated(vin)) continue;
 
-                    int rounds = GetInputSandstormRounds(vin);
-                    fTotal += (float)rounds;
-                    fCount += 1;
-                }
-            }
+            int rounds = GetInputSandstormRounds(vin);
+            fTotal += (float)rounds;
+            fCount += 1;
         }
     }
 
@@ -1552,29 +1869,25 @@ CAmount CWallet::GetNormalizedAnonymizedBalance() const
     CAmount nTotal = 0;
 
     {
-        LOCK(cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
+        LOCK2(cs_main, cs_wallet);
+        const CWalletTx* pcoin = NULL;
+        bool fTrusted = false;
+        BOOST_FOREACH(const COutPoint& outpoint, setUnspent)
         {
-            const CWalletTx* pcoin = &(*it).second;
-
-            if (pcoin->IsTrusted())
+            if (pcoin == NULL || pcoin->GetHash() != outpoint.hash)
             {
-                int nDepth = pcoin->GetDepthInMainChain();
+                pcoin = &mapWallet.find(outpoint.hash)->second;
+                fTrusted = pcoin->IsTrusted();
+            }
+            if (!fTrusted) continue;
 
-                for (unsigned int i = 0; i < pcoin->vout.size(); i++) {
-                    //isminetype mine = IsMine(pcoin->vout[i]);
-                    bool mine = IsMine(pcoin->vout[i]);
-                    //COutput out = COutput(pcoin, i, nDepth, (mine & ISMINE_SPENDABLE) != ISMINE_NO);
-                    COutput out = COutput(pcoin, i, nDepth, mine);
-                    CTxIn vin = CTxIn(out.tx->GetHash(), out.i);
+            unsigned int i = outpoint.n;
+            CTxIn vin = CTxIn(outpoint.hash, i);
 
-                    //if(IsSpent(out.tx->GetHash(), i) || !IsMine(pcoin->vout[i]) || !IsDenominated(vin)) continue;
-                    if(pcoin->IsSpent(i) || !IsMine(pcoin->vout[i]) || !IsDenominated(vin)) continue;
+            if(pcoin->IsSpent(i) || !IsMine(pcoin->vout[i]) || !IsDenominated(vin)) continue;
 
-                    int rounds = GetInputSandstormRounds(vin);
-                    nTotal += pcoin->vout[i].nValue * rounds / nSandstormRounds;
-                }
-            }
+            int rounds = GetInputSandstormRounds(vin);
+            nTotal += pcoin->vout[i].nValue * rounds / nSandstormRounds;
         }
     }
 
@@ -1584,127 +1897,89 @@ CAmount CWallet::GetNormalizedAnonymizedBalance() const
 CAmount CWallet::GetDenominatedBalance(bool onlyDenom, bool onlyUnconfirmed, bool includeAlreadyAnonymized) const
 {
     if(fLiteMode) return 0;
-    
+
+    LOCK2(cs_main, cs_wallet);
+    CacheBalances();
+    int nKey = (onlyDenom ? 4 : 0) | (onlyUnconfirmed ? 2 : 0) | (includeAlreadyAnonymized ? 1 : 0);
+    std::map<int, CAmount>::const_iterator mi = balances.mapDenominated.find(nKey);
+    if (mi != balances.mapDenominated.end())
+        return mi->second;
+
     CAmount nTotal = 0;
+    const CWalletTx* pcoin = NULL;
+    bool fSkip = true;
+    BOOST_FOREACH(const COutPoint& outpoint, setUnspent)
     {
-        LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
+        if (pcoin == NULL || pcoin->GetHash() != outpoint.hash)
         {
-            const CWalletTx* pcoin = &(*it).second;
+            pcoin = &mapWallet.find(outpoint.hash)->second;
 
             int nDepth = pcoin->GetDepthInMainChain(false);
-
+            bool unconfirmed = (!IsFinalTx(*pcoin) || (!pcoin->IsTrusted() && nDepth == 0));
             // skip conflicted
-            if(nDepth < 0) continue;
+            fSkip = nDepth < 0 || onlyUnconfirmed != unconfirmed;
+        }
+        if (fSkip) continue;
 
-            bool unconfirmed = (!IsFinalTx(*pcoin) || (!pcoin->IsTrusted() && nDepth == 0));
-            if(onlyUnconfirmed != unconfirmed) continue;
-            uint256 hash = (*it).first;
+        uint256 hash = outpoint.hash;
+        unsigned int i = outpoint.n;
 
-            for (unsigned int i = 0; i < pcoin->vout.size(); i++)
-            {
-                if(IsSpent(hash, i)) continue;
-                if(!IsMine(pcoin->vout[i])) continue;
-                if(onlyDenom != IsDenominatedAmount(pcoin->vout[i].nValue)) continue;
+        if(IsSpent(hash, i)) continue;
+        if(!IsMine(pcoin->vout[i])) continue;
+        if(onlyDenom != IsDenominatedAmount(pcoin->vout[i].nValue)) continue;
 
-                CTxIn vin = CTxIn(hash, i);
-                int rounds = GetInputSandstormRounds(vin);
-                if(!includeAlreadyAnonymized && rounds >= nSandstormRounds) continue;
+        CTxIn vin = CTxIn(hash, i);
+        int rounds = GetInputSandstormRounds(vin);
+        if(!includeAlreadyAnonymized && rounds >= nSandstormRounds) continue;
 
-                nTotal += pcoin->vout[i].nValue;
-            }
-        }
+        nTotal += pcoin->vout[i].nValue;
     }
 
+    balances.mapDenominated[nKey] = nTotal;
     return nTotal;
 }
 
 
 CAmount CWallet::GetUnconfirmedBalance() const
 {
-    CAmount nTotal = 0;
-    {
-        LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
-        {
-            const CWalletTx* pcoin = &(*it).second;
-            if (!IsFinalTx(*pcoin) || (!pcoin->IsTrusted() && pcoin->GetDepthInMainChain() == 0))
-                nTotal += pcoin->GetAvailableCredit();
-        }
-    }
-    return nTotal;
+    LOCK2(cs_main, cs_wallet);
+    CacheBalances();
+    return balances.nUnconfirmed;
 }
 
 CAmount CWallet::GetImmatureBalance() const
 {
-    CAmount nTotal = 0;
-    {
-        LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
-        {
-            const CWalletTx* pcoin = &(*it).second;
-            nTotal += pcoin->GetImmatureCredit();
-        }
-    }
-    return nTotal;
+    LOCK2(cs_main, cs_wallet);
+    CacheBalances();
+    return balances.nImmature;
 }
 
 CAmount CWallet::GetWatchOnlyBalance() const
 {
-    CAmount nTotal = 0;
-    {
-        LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
-        {
-            const CWalletTx* pcoin = &(*it).second;
-            if (pcoin->IsTrusted())
-                nTotal += pcoin->GetAvailableWatchOnlyCredit();
-        }
-    }
-
-    return nTotal;
+    LOCK2(cs_main, cs_wallet);
+    CacheBalances();
+    return balances.nWatchOnly;
 }
 
 CAmount CWallet::GetWatchOnlyStake() const
 {
-    CAmount nTotal = 0;
     LOCK2(cs_main, cs_wallet);
-    for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
-    {
-        const CWalletTx* pcoin = &(*it).second;
-        if (pcoin->IsCoinStake() && pcoin->GetBlocksToMaturity() > 0 && pcoin->GetDepthInMainChain() > 0)
-            nTotal += CWallet::GetCredit(*pcoin, ISMINE_WATCH_ONLY);
-    }
-    return nTotal;
+    CacheBalances();
+    return balances.nWatchOnlyStake;
 }
 
 CAmount CWallet::GetUnconfirmedWatchOnlyBalance() const
 {
-    CAmount nTotal = 0;
-    {
-        LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
-        {
-            const CWalletTx* pcoin = &(*it).second;
-            if (!IsFinalTx(*pcoin) || (!pcoin->IsTrusted() && pcoin->GetDepthInMainChain() == 0))
-                nTotal += pcoin->GetAvailableWatchOnlyCredit();
-        }
-    }
-    return nTotal;
-}
-
-CAmount CWallet::GetImmatureWatchOnlyBalance() const
-{
-    CAmount nTotal = 0;
-    {
-        LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
-        {
-            const CWalletTx* pcoin = &(*it).second;
-            nTotal += pcoin->GetImmatureWatchOnlyCredit();
-        }
-    }
-    return nTotal;
+    LOCK2(cs_main, cs_wallet);
+    CacheBalances();
+    return balances.nUnconfirmedWatchOnly;
+}
+
+CAmount CWallet::GetImmatureWatchOnlyBalance() const
+{
+    LOCK2(cs_main, cs_wallet);
+    CacheBalances();
+    return balances.nImmatureWatchOnly;
 }
 
 // populate vCoins with vector of spendable COutputs
@@ -1714,57 +1989,66 @@ void CWallet::AvailableCoins(vector<COutput>& vCoins, bool fOnlyConfirmed, const
 
     {
         LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
+        const CWalletTx* pcoin = NULL;
+        bool fSkip = true;
+        int nDepth = 0;
+        BOOST_FOREACH(const COutPoint& outpoint, setUnspent)
         {
-            const CWalletTx* pcoin = &(*it).second;
+            if (pcoin == NULL || pcoin->GetHash() != outpoint.hash)
+            {
+                pcoin = &mapWallet.find(outpoint.hash)->second;
+                fSkip = true;
 
-            if (!IsFinalTx(*pcoin))
-                continue;
+                if (!IsFinalTx(*pcoin))
+                    continue;
 
-            if (fOnlyConfirmed && !pcoin->IsTrusted())
-                continue;
+                if (fOnlyConfirmed && !pcoin->IsTrusted())
+                    continue;
 
-            if (pcoin->IsCoinBase() && pcoin->GetBlocksToMaturity() > 0)
-                continue;
+                if (pcoin->IsCoinBase() && pcoin->GetBlocksToMaturity() > 0)
+                    continue;
 
-            if(pcoin->IsCoinStake() && pcoin->GetBlocksToMaturity() > 0)
-                continue;
+                if(pcoin->IsCoinStake() && pcoin->GetBlocksToMaturity() > 0)
+                    continue;
 
-            int nDepth = pcoin->GetDepthInMainChain();
-            if (nDepth <= 0) // DARKSILKNOTE: coincontrol fix / ignore 0 confirm
-                continue;
+                nDepth = pcoin->GetDepthInMainChain();
+                if (nDepth <= 0) // DARKSILKNOTE: coincontrol fix / ignore 0 confirm
+                    continue;
 
-            // do not use IX for inputs that have less then 10 blockchain confirmations
-            if (useIX && nDepth < 10)
-                continue;
+                // do not use IX for inputs that have less then 10 blockchain confirmations
+                if (useIX && nDepth < 10)
+                    continue;
 
-            for (unsigned int i = 0; i < pcoin->vout.size(); i++) {
-                bool found = false;
-                if(coin_type == ONLY_DENOMINATED) {
-                    //should make this a vector
-                    found = IsDenominatedAmount(pcoin->vout[i].nValue);
-                } else if(coin_type == ONLY_NONDENOMINATED || coin_type == ONLY_NONDENOMINATED_NOTSN) {
-                    found = true;
-                    if (IsCollateralAmount(pcoin->vout[i].nValue)) continue; // do not use collateral amounts
-                    found = !IsDenominatedAmount(pcoin->vout[i].nValue);
-                    if(found && coin_type == ONLY_NONDENOMINATED_NOTSN) found = (pcoin->vout[i].nValue != 10000*COIN); // do not use SN funds
-                } else {
-                    found = true;
-                }
-                if(!found) continue;
+                fSkip = false;
+            }
+            if (fSkip) continue;
+
+            unsigned int i = outpoint.n;
+            bool found = false;
+            if(coin_type == ONLY_DENOMINATED) {
+                //should make this a vector
+                found = IsDenominatedAmount(pcoin->vout[i].nValue);
+            } else if(coin_type == ONLY_NONDENOMINATED || coin_type == ONLY_NONDENOMINATED_NOTSN) {
+                found = true;
+                if (IsCollateralAmount(pcoin->vout[i].nValue)) continue; // do not use collateral amounts
+                found = !IsDenominatedAmount(pcoin->vout[i].nValue);
+                if(found && coin_type == ONLY_NONDENOMINATED_NOTSN) found = (pcoin->vout[i].nValue != 10000*COIN); // do not use SN funds
+            } else {
+                found = true;
+            }
+            if(!found) continue;
 
 
-                bool mine = IsMine(pcoin->vout[i]);
+            bool mine = IsMine(pcoin->vout[i]);
 
-                if (!(pcoin->IsSpent(i)) && mine &&
-                        !IsLockedCoin((*it).first, i) && pcoin->vout[i].nValue > 0 &&
-                        (!coinControl || !coinControl->HasSelected() || coinControl->IsSelected((*it).first, i)))
-                    {
-                       vCoins.push_back(COutput(pcoin, i, nDepth, ISMINE_SPENDABLE));
-                    }
+            if (!(pcoin->IsSpent(i)) && mine &&
+                    !IsLockedCoin(outpoint.hash, i) && pcoin->vout[i].nValue > 0 &&
+                    (!coinControl || !coinControl->HasSelected() || coinControl->IsSelected(outpoint.hash, i)))
+                {
+                   vCoins.push_back(COutput(pcoin, i, nDepth, ISMINE_SPENDABLE));
                 }
-            }
         }
+    }
 }
 
 void CWallet::AvailableCoinsForStaking(vector<COutput>& vCoins, unsigned int nSpendTime) const
@@ -1773,101 +2057,65 @@ void CWallet::AvailableCoinsForStaking(vector<COutput>& vCoins, unsigned int nSp
 
     {
         LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
+        const CWalletTx* pcoin = NULL;
+        bool fSkip = true;
+        int nDepth = 0;
+        BOOST_FOREACH(const COutPoint& outpoint, setUnspent)
         {
-            const CWalletTx* pcoin = &(*it).second;
-
-            int nDepth = pcoin->GetDepthInMainChain();
-            if (nDepth < 1)
-                continue;
-
-            if (nDepth < nStakeMinConfirmations)
-            {
-                continue;
-            }
-            else
+            if (pcoin == NULL || pcoin->GetHash() != outpoint.hash)
             {
-            // Filtering by tx timestamp instead of block timestamp may give false positives but never false negatives
-            if (pcoin->nTime + nStakeMinAge > nSpendTime)
-               continue;
-            }
-
-            if (pcoin->GetBlocksToMaturity() > 0)
-                continue;
+                pcoin = &mapWallet.find(outpoint.hash)->second;
+                fSkip = true;
 
-            bool found = false;
-            for (unsigned int i = 0; i < pcoin->vout.size(); i++){
-                if (IsDenominatedAmount(pcoin->vout[i].nValue)){
-
-                    //LogPrintf("CWallet::AvailableCoinsForStaking - Found denominated amounts.\n");
-                    found = true;
-                    break;
-                }
-                if (pcoin->vout[i].nValue == 10000*COIN){
+                nDepth = pcoin->GetDepthInMainChain();
+                if (nDepth < 1)
+                    continue;
 
-                    //LogPrintf("CWallet::AvailableCoinsForStaking - Found Stormnode collateral.\n");
-                    found = true;
-                    break;
+                if (nDepth < nStakeMinConfirmations)
+                {
+                    continue;
                 }
-                if (IsCollateralAmount(pcoin->vout[i].nValue)){
-
-                    //LogPrintf("CWallet::AvailableCoinsForStaking - Found Collateral amount.\n");
-                    found = true;
-                    break;
+                else
+                {
+                // Filtering by tx timestamp instead of block timestamp may give false positives but never false negatives
+                if (pcoin->nTime + nStakeMinAge > nSpendTime)
+                   continue;
                 }
-            }
-
-            if(found) continue;
 
-            for (unsigned int i = 0; i < pcoin->vout.size(); i++)
-                if (!(pcoin->IsSpent(i)) && IsMine(pcoin->vout[i]) && pcoin->vout[i].nValue >= nMinimumInputValue)
-                    vCoins.push_back(COutput(pcoin, i, nDepth, true));
-        }
-    }
-}
+                if (pcoin->GetBlocksToMaturity() > 0)
+                    continue;
 
-static void ApproximateBestSubset(vector<pair<CAmount, pair<const CWalletTx*,unsigned int> > >vValue, const CAmount& nTotalLower, const CAmount& nTargetValue,
-                                  vector<char>& vfBest, CAmount& nBest, int iterations = 1000)
-{
-    vector<char> vfIncluded;
+                bool found = false;
+                for (unsigned int i = 0; i < pcoin->vout.size(); i++){
+                    if (IsDenominatedAmount(pcoin->vout[i].nValue)){
 
-    vfBest.assign(vValue.size(), true);
-    nBest = nTotalLower;
+                        //LogPrintf("CWallet::AvailableCoinsForStaking - Found denominated amounts.\n");
+                        found = true;
+                        break;
+                    }
+                    if (pcoin->vout[i].nValue == 10000*COIN){
 
-    seed_insecure_rand();
+                        //LogPrintf("CWallet::AvailableCoinsForStaking - Found Stormnode collateral.\n");
+                        found = true;
+                        break;
+                    }
+                    if (IsCollateralAmount(pcoin->vout[i].nValue)){
 
-    for (int nRep = 0; nRep < iterations && nBest != nTargetValue; nRep++)
-    {
-        vfIncluded.assign(vValue.size(), false);
-        CAmount nTotal = 0;
-        bool fReachedTarget = false;
-        for (int nPass = 0; nPass < 2 && !fReachedTarget; nPass++)
-        {
-            for (unsigned int i = 0; i < vValue.size(); i++)
-            {
-                //The solver here uses a randomized algorithm,
-                //the randomness serves no real security purpose but is just
-                //needed to prevent degenerate behavior and it is important
-                //that the rng fast. We do not use a constant random sequence,
-                //because there may be some privacy improvement by making
-                //the selection random.
-                if (nPass == 0 ? insecure_rand()&1 : !vfIncluded[i])
-                {
-                    nTotal += vValue[i].first;
-                    vfIncluded[i] = true;
-                    if (nTotal >= nTargetValue)
-                    {
-                        fReachedTarget = true;
-                        if (nTotal < nBest)
-                        {
-                            nBest = nTotal;
-                            vfBest = vfIncluded;
-                        }
-                        nTotal -= vValue[i].first;
-                        vfIncluded[i] = false;
+                        //LogPrintf("CWallet::AvailableCoinsForStaking - Found Collateral amount.\n");
+                        found = true;
+                        break;
                     }
                 }
+
+                if(found) continue;
+
+                fSkip = false;
             }
+            if (fSkip) continue;
+
+            unsigned int i = outpoint.n;
+            if (!(pcoin->IsSpent(i)) && IsMine(pcoin->vout[i]) && pcoin->vout[i].nValue >= nMinimumInputValue)
+                vCoins.push_back(COutput(pcoin, i, nDepth, true));
         }
     }
 }
@@ -1875,31 +2123,19 @@ static void ApproximateBestSubset(vector<pair<CAmount, pair<const CWalletTx*,uns
 // ppcoin: total coins staked (non-spendable until maturity)
 CAmount CWallet::GetStake() const
 {
-    CAmount nTotal = 0;
     LOCK2(cs_main, cs_wallet);
-    for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
-    {
-        const CWalletTx* pcoin = &(*it).second;
-        if (pcoin->IsCoinStake() && pcoin->GetBlocksToMaturity() > 0 && pcoin->GetDepthInMainChain() > 0)
-            nTotal += CWallet::GetCredit(*pcoin, ISMINE_ALL);
-    }
-    return nTotal;
+    CacheBalances();
+    return balances.nStake;
 }
 
 CAmount CWallet::GetNewMint() const
 {
-    CAmount nTotal = 0;
     LOCK2(cs_main, cs_wallet);
-    for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
-    {
-        const CWalletTx* pcoin = &(*it).second;
-        if (pcoin->IsCoinBase() && pcoin->GetBlocksToMaturity() > 0 && pcoin->GetDepthInMainChain() > 0)
-            nTotal += CWallet::GetCredit(*pcoin, ISMINE_ALL);
-    }
-    return nTotal;
+    CacheBalances();
+    return balances.nNewMint;
 }
 
-bool CWallet::SelectCoinsMinConfByCoinAge(const CAmount& nTargetValue, unsigned int nSpendTime, int nConfMine, int nConfTheirs, vector<COutput> vCoins, set<pair<const CWalletTx*,unsigned int> >& setCoinsRet, CAmount& nValueRet) const
+bool CWallet::SelectCoinsMinConfByCoinAge(const CAmount& nTargetValue, unsigned int nSpendTime, int nConfMine, int nConfTheirs, const vector<COutput>& vCoins, set<pair<const CWalletTx*,unsigned int> >& setCoinsRet, CAmount& nValueRet) const
 {
     setCoinsRet.clear();
     nValueRet = 0;
@@ -2140,38 +2376,40 @@ bool CWallet::SelectCoinsMinConfByCoinAge(const CAmount& nTargetValue, unsigned
     return true;
 }
 
-bool less_then_denom (const COutput& out1, const COutput& out2)
+bool CWallet::SelectCoinsMinConf(const CAmount& nTargetValue, unsigned int nSpendTime, int nConfMine, int nConfTheirs, const vector<COutput>& vCoins, set<pair<const CWalletTx*,unsigned int> >& setCoinsRet, CAmount& nValueRet, const CCoinSelectionPolicy* pPolicy) const
 {
-    const CWalletTx *pcoin1 = out1.tx;
-    const CWalletTx *pcoin2 = out2.tx;
+    setCoinsRet.clear();
+    nValueRet = 0;
 
-    bool found1 = false;
-    bool found2 = false;
-    BOOST_FOREACH(CAmount d, sandStormDenominations) // loop through predefined denoms
+    CMinInputsPolicy policyDefault;
+    const CCoinSelectionPolicy& policy = pPolicy ? *pPolicy : policyDefault;
+
+    // Candidates, in random order among equal values, largest first
+    vector<CSelectionInput> vInputs;
+    vInputs.reserve(vCoins.size());
+    for (unsigned int i = 0; i < vCoins.size(); i++)
     {
-        if(pcoin1->vout[out1.i].nValue == d) found1 = true;
-        if(pcoin2->vout[out2.i].nValue == d) found2 = true;
-    }
-    return (!found1 && found2);
-}
+        const COutput& output = vCoins[i];
+        if (!output.fSpendable)
+            continue;
 
-bool CWallet::SelectCoinsMinConf(const CAmount& nTargetValue, unsigned int nSpendTime, int nConfMine, int nConfTheirs, vector<COutput> vCoins, set<pair<const CWalletTx*,unsigned int> >& setCoinsRet, CAmount& nValueRet) const
-{
-    setCoinsRet.clear();
-    nValueRet = 0;
+        const CWalletTx *pcoin = output.tx;
+        if (output.nDepth < (pcoin->IsFromMe(ISMINE_ALL) ? nConfMine : nConfTheirs))
+            continue;
+
+        CAmount n = pcoin->vout[output.i].nValue;
+        if (!policy.Accept(n))
+            continue;
+        vInputs.push_back(CSelectionInput(n, policy.Cost(n, pcoin->nTime, nSpendTime), i));
+    }
+    random_shuffle(vInputs.begin(), vInputs.end(), GetRandInt);
+    SortSelectionInputs(vInputs);
 
     // List of values less than target
-    pair<CAmount, pair<const CWalletTx*,unsigned int> > coinLowestLarger;
-    coinLowestLarger.first = std::numeric_limits<CAmount>::max();
-    coinLowestLarger.second.first = NULL;
-    vector<pair<CAmount, pair<const CWalletTx*,unsigned int> > > vValue;
+    const CSelectionInput* pLowestLarger = NULL;
+    vector<CSelectionInput> vValue;
     CAmount nTotalLower = 0;
 
-    random_shuffle(vCoins.begin(), vCoins.end(), GetRandInt);
-
-    // move denoms down on the list
-    sort(vCoins.begin(), vCoins.end(), less_then_denom);
-
     // try to find nondenom first to prevent unneeded spending of mixed coins
     for (unsigned int tryDenom = 0; tryDenom < 2; tryDenom++)
     {
@@ -2180,37 +2418,25 @@ bool CWallet::SelectCoinsMinConf(const CAmount& nTargetValue, unsigned int nSpen
 
         nTotalLower = 0;
 
-        BOOST_FOREACH(const COutput &output, vCoins)
+        BOOST_FOREACH(const CSelectionInput& input, vInputs)
         {
-            if (!output.fSpendable)
-                continue;
-
-            const CWalletTx *pcoin = output.tx;
-
-//            if (fDebug) LogPrint("selectcoins", "value %s confirms %d\n", FormatMoney(pcoin->vout[output.i].nValue), output.nDepth);
-            if (output.nDepth < (pcoin->IsFromMe(ISMINE_ALL) ? nConfMine : nConfTheirs))
-                continue;
-
-            int i = output.i;
-            CAmount n = pcoin->vout[i].nValue;
+            CAmount n = input.nValue;
             if (tryDenom == 0 && IsDenominatedAmount(n)) continue; // we don't want denom values on first run
 
-            pair<CAmount,pair<const CWalletTx*,unsigned int> > coin = make_pair(n,make_pair(pcoin, i));
-
             if (n == nTargetValue)
             {
-                setCoinsRet.insert(coin.second);
-                nValueRet += coin.first;
+                setCoinsRet.insert(make_pair(vCoins[input.nIndex].tx, vCoins[input.nIndex].i));
+                nValueRet += n;
                 return true;
             }
             else if (n < nTargetValue + CENT)
             {
-                vValue.push_back(coin);
+                vValue.push_back(input);
                 nTotalLower += n;
             }
-            else if (n < coinLowestLarger.first)
+            else if (!pLowestLarger || n < pLowestLarger->nValue)
             {
-                coinLowestLarger = coin;
+                pLowestLarger = &input;
             }
         }
 
@@ -2218,8 +2444,8 @@ bool CWallet::SelectCoinsMinConf(const CAmount& nTargetValue, unsigned int nSpen
         {
             for (unsigned int i = 0; i < vValue.size(); ++i)
             {
-                setCoinsRet.insert(vValue[i].second);
-                nValueRet += vValue[i].first;
+                setCoinsRet.insert(make_pair(vCoins[vValue[i].nIndex].tx, vCoins[vValue[i].nIndex].i));
+                nValueRet += vValue[i].nValue;
             }
             return true;
         }
@@ -2227,7 +2453,7 @@ bool CWallet::SelectCoinsMinConf(const CAmount& nTargetValue, unsigned int nSpen
 
         if (nTotalLower < nTargetValue)
         {
-            if (coinLowestLarger.second.first == NULL) // there is no input larger than nTargetValue
+            if (pLowestLarger == NULL) // there is no input larger than nTargetValue
             {
                 if (tryDenom == 0)
                     // we didn't look at denom yet, let's do it
@@ -2236,8 +2462,8 @@ bool CWallet::SelectCoinsMinConf(const CAmount& nTargetValue, unsigned int nSpen
                     // we looked at everything possible and didn't find anything, no luck
                     return false;
             }
-            setCoinsRet.insert(coinLowestLarger.second);
-            nValueRet += coinLowestLarger.first;
+            setCoinsRet.insert(make_pair(vCoins[pLowestLarger->nIndex].tx, vCoins[pLowestLarger->nIndex].i));
+            nValueRet += pLowestLarger->nValue;
             return true;
         }
 
@@ -2246,22 +2472,25 @@ bool CWallet::SelectCoinsMinConf(const CAmount& nTargetValue, unsigned int nSpen
 
     }
 
-    // Solve subset sum by stochastic approximation
-    sort(vValue.rbegin(), vValue.rend(), CompareValueOnly());
     vector<char> vfBest;
     CAmount nBest;
 
-    ApproximateBestSubset(vValue, nTotalLower, nTargetValue, vfBest, nBest, 1000);
-    if (nBest != nTargetValue && nTotalLower >= nTargetValue + CENT)
-        ApproximateBestSubset(vValue, nTotalLower, nTargetValue + CENT, vfBest, nBest, 1000);
+    // An exact subset needs no change output; take the cheapest one by policy
+    if (!SelectCoinsBnB(vValue, nTargetValue, 0, vfBest, nBest))
+    {
+        // Solve subset sum by stochastic approximation
+        ApproximateBestSubset(vValue, nTotalLower, nTargetValue, vfBest, nBest, 1000);
+        if (nBest != nTargetValue && nTotalLower >= nTargetValue + CENT)
+            ApproximateBestSubset(vValue, nTotalLower, nTargetValue + CENT, vfBest, nBest, 1000);
+    }
 
     // If we have a bigger coin and (either the stochastic approximation didn't find a good solution,
     //                                   or the next bigger coin is closer), return the bigger coin
-    if (coinLowestLarger.second.first &&
-        ((nBest != nTargetValue && nBest < nTargetValue + CENT) || coinLowestLarger.first <= nBest))
+    if (pLowestLarger &&
+        ((nBest != nTargetValue && nBest < nTargetValue + CENT) || pLowestLarger->nValue <= nBest))
     {
-        setCoinsRet.insert(coinLowestLarger.second);
-        nValueRet += coinLowestLarger.first;
+        setCoinsRet.insert(make_pair(vCoins[pLowestLarger->nIndex].tx, vCoins[pLowestLarger->nIndex].i));
+        nValueRet += pLowestLarger->nValue;
     }
     else {
         string s = "CWallet::SelectCoinsMinConf best subset: ";
@@ -2269,16 +2498,16 @@ bool CWallet::SelectCoinsMinConf(const CAmount& nTargetValue, unsigned int nSpen
         {
             if (vfBest[i])
             {
-                setCoinsRet.insert(vValue[i].second);
-                nValueRet += vValue[i].first;
-                s += FormatMoney(vValue[i].first) + " ";
+                setCoinsRet.insert(make_pair(vCoins[vValue[i].nIndex].tx, vCoins[vValue[i].nIndex].i));
+                nValueRet += vValue[i].nValue;
+                s += FormatMoney(vValue[i].nValue) + " ";
             }
         }
 
         LogPrint("selectcoins", "SelectCoins() best subset: ");
         for (unsigned int i = 0; i < vValue.size(); i++)
             if (vfBest[i])
-                LogPrint("selectcoins", "%s ", FormatMoney(vValue[i].first));
+                LogPrint("selectcoins", "%s ", FormatMoney(vValue[i].nValue));
 
         LogPrintf("selectcoins %s - total %s\n", s, FormatMoney(nBest));
     }
@@ -2315,6 +2544,30 @@ bool CWallet::SelectCoins(const CAmount& nTargetValue, unsigned int nSpendTime,
 
     //if we're doing only denominated, we need to round up to the nearest .1DRKSLK
     if(coin_type == ONLY_DENOMINATED) {
+        // Look for the fewest anonymized denominations within the rounding window first
+        CDenominatedOnlyPolicy policy(sandStormDenominations);
+        vector<CSelectionInput> vInputs;
+        for (unsigned int i = 0; i < vCoins.size(); i++)
+        {
+            const COutput& out = vCoins[i];
+            CAmount n = out.tx->vout[out.i].nValue;
+            if (!policy.Accept(n))
+                continue;
+            if (GetInputSandstormRounds(CTxIn(out.tx->GetHash(), out.i)) < nSandstormRounds)
+                continue;
+            vInputs.push_back(CSelectionInput(n, policy.Cost(n, out.tx->nTime, nSpendTime), i));
+        }
+        SortSelectionInputs(vInputs);
+
+        vector<char> vfSelected;
+        if (SelectCoinsBnB(vInputs, nTargetValue, (0.1*COIN)+99, vfSelected, nValueRet))
+        {
+            for (unsigned int i = 0; i < vInputs.size(); i++)
+                if (vfSelected[i])
+                    setCoinsRet.insert(make_pair(vCoins[vInputs[i].nIndex].tx, vCoins[vInputs[i].nIndex].i));
+            return true;
+        }
+
         // Make outputs by looping through denominations, from large to small
         BOOST_FOREACH(CAmount v, sandStormDenominations)
         {
@@ -2335,16 +2588,19 @@ bool CWallet::SelectCoins(const CAmount& nTargetValue, unsigned int nSpendTime,
         return (nValueRet >= nTargetValue);
     }
 
-    boost::function<bool (const CWallet*, const CAmount&, unsigned int, int, int, std::vector<COutput>, std::set<std::pair<const CWalletTx*,unsigned int> >&, CAmount&)> f;
-    // f uses SelectCoinsMinConfByCoinAge for the first 250 blocks then without it.
-    if (pindexBest->nHeight <= 250)
-        f = fMinimizeCoinAge ? &CWallet::SelectCoinsMinConfByCoinAge : &CWallet::SelectCoinsMinConf;
-    else
-        f = &CWallet::SelectCoinsMinConf;
+    // Use SelectCoinsMinConfByCoinAge for the first 250 blocks, then keep old coins by policy.
+    if (pindexBest->nHeight <= 250 && fMinimizeCoinAge)
+        return (SelectCoinsMinConfByCoinAge(nTargetValue, nSpendTime, 1, 10, vCoins, setCoinsRet, nValueRet) ||
+                SelectCoinsMinConfByCoinAge(nTargetValue, nSpendTime, 1, 1, vCoins, setCoinsRet, nValueRet) ||
+                SelectCoinsMinConfByCoinAge(nTargetValue, nSpendTime, 0, 1, vCoins, setCoinsRet, nValueRet));
+
+    CMinInputsPolicy policyMinInputs;
+    CPreserveCoinAgePolicy policyCoinAge;
+    const CCoinSelectionPolicy* pPolicy = fMinimizeCoinAge ? (const CCoinSelectionPolicy*)&policyCoinAge : &policyMinInputs;
 
-    return (f(this, nTargetValue, nSpendTime, 1, 10, vCoins, setCoinsRet, nValueRet) ||
-            f(this, nTargetValue, nSpendTime, 1, 1, vCoins, setCoinsRet, nValueRet) ||
-            f(this, nTargetValue, nSpendTime, 0, 1, vCoins, setCoinsRet, nValueRet));
+    return (SelectCoinsMinConf(nTargetValue, nSpendTime, 1, 10, vCoins, setCoinsRet, nValueRet, pPolicy) ||
+            SelectCoinsMinConf(nTargetValue, nSpendTime, 1, 1, vCoins, setCoinsRet, nValueRet, pPolicy) ||
+            SelectCoinsMinConf(nTargetValue, nSpendTime, 0, 1, vCoins, setCoinsRet, nValueRet, pPolicy));
 }
 
 // Select some coins without random shuffle or best subset approximation
@@ -2747,6 +3003,7 @@ bool CWallet::CreateTransaction(const vector<pair<CScript, CAmount> >& vecSend,
 
     wtxNew.fTimeReceivedIsTxTime = true;//TODO (AA): put this back??
     wtxNew.BindWallet(this);
+    CMutableTransaction txNew(wtxNew);
     {
         CTxDB txdb("r");
         LOCK2(cs_main, cs_wallet);
@@ -2756,8 +3013,8 @@ bool CWallet::CreateTransaction(const vector<pair<CScript, CAmount> >& vecSend,
             if(useIX) nFeeRet = max(CENT, nFeeRet);
             while (true)
             {
-                wtxNew.vin.clear();
-                wtxNew.vout.clear();
+                txNew.vin.clear();
+                txNew.vout.clear();
                 wtxNew.fFromMe = true;
 
                 CAmount nTotalValue = nValue + nFeeRet;
@@ -2791,13 +3048,13 @@ bool CWallet::CreateTransaction(const vector<pair<CScript, CAmount> >& vecSend,
                         strFailReason = _("Transaction amount too small");
                         return false;
                     }
-                    wtxNew.vout.push_back(txout);
+                    txNew.vout.push_back(txout);
                 }
 
                 // Choose coins to use
                 set<pair<const CWalletTx*,unsigned int> > setCoins;
                 CAmount nValueIn = 0;
-                if (!SelectCoins(nTotalValue, wtxNew.nTime, setCoins, nValueIn, coinControl, coin_type, useIX))
+                if (!SelectCoins(nTotalValue, txNew.nTime, setCoins, nValueIn, coinControl, coin_type, useIX))
                 {
                     if(coin_type == ALL_COINS) {
                         strFailReason = _("Insufficient funds.");
@@ -2894,8 +3151,8 @@ bool CWallet::CreateTransaction(const vector<pair<CScript, CAmount> >& vecSend,
                     else
                     {
                         // Insert change txn at random position:
-                        vector<CTxOut>::iterator position = wtxNew.vout.begin()+GetRandInt(wtxNew.vout.size()+1);
-                        wtxNew.vout.insert(position, newTxOut);
+                        vector<CTxOut>::iterator position = txNew.vout.begin()+GetRandInt(txNew.vout.size()+1);
+                        txNew.vout.insert(position, newTxOut);
                     }
                 }
                 else
@@ -2906,17 +3163,20 @@ bool CWallet::CreateTransaction(const vector<pair<CScript, CAmount> >& vecSend,
                 // Note how the sequence number is set to max()-1 so that the
                 // nLockTime set above actually works.
                 BOOST_FOREACH(const PAIRTYPE(const CWalletTx*,unsigned int)& coin, setCoins)
-                    wtxNew.vin.push_back(CTxIn(coin.first->GetHash(),coin.second));
+                    txNew.vin.push_back(CTxIn(coin.first->GetHash(),coin.second));
 
                 // Sign
                 int nIn = 0;
                 BOOST_FOREACH(const PAIRTYPE(const CWalletTx*,unsigned int)& coin, setCoins)
-                    if (!SignSignature(*this, *coin.first, wtxNew, nIn++))
+                    if (!SignSignature(*this, *coin.first, txNew, nIn++))
                     {
                         strFailReason = _("Signing transaction failed");
                         return false;
                     }
 
+                // Embed the constructed transaction data in wtxNew.
+                *static_cast<CTransaction*>(&wtxNew) = CTransaction(txNew);
+
                 // Limit size
                 unsigned int nBytes = ::GetSerializeSize(*(CTransaction*)&wtxNew, SER_NETWORK, PROTOCOL_VERSION);
                 if (nBytes >= MAX_STANDARD_TX_SIZE)
@@ -3467,6 +3727,81 @@ bool CWallet::SendStealthMoneyToDestination(CStealthAddress& sxAddress, CAmount
     return true;
 }
 
+// Rebuild the stealth scanner if the owned stealth addresses have changed
+void CWallet::SyncStealthScanner()
+{
+    AssertLockHeld(cs_wallet);
+
+    size_t nOwned = 0;
+    bool fChanged = false;
+    std::set<CStealthAddress>::iterator it;
+    for (it = stealthAddresses.begin(); it != stealthAddresses.end(); ++it)
+    {
+        if (it->scan_secret.size() != ec_secret_size)
+            continue; // stealth address is not owned
+        if (nOwned >= vStealthOwned.size() || vStealthOwned[nOwned] != it->scan_pubkey)
+        {
+            fChanged = true;
+            break;
+        };
+        nOwned++;
+    };
+
+    if (!fChanged && nOwned == vStealthOwned.size())
+        return;
+
+    stealthScanner.Clear();
+    vStealthOwned.clear();
+    vStealthScanPubkey.clear();
+    mapStealthDerived.clear();
+    for (it = stealthAddresses.begin(); it != stealthAddresses.end(); ++it)
+    {
+        if (it->scan_secret.size() != ec_secret_size)
+            continue;
+        vStealthOwned.push_back(it->scan_pubkey);
+        if (stealthScanner.AddAddress(it->scan_secret, it->spend_pubkey))
+            vStealthScanPubkey.push_back(it->scan_pubkey);
+        else
+            LogPrintf("SyncStealthScanner() : invalid keys for stealth address %s\n", it->Encoded());
+    };
+}
+
+// Derive the ephemeral keys of a whole block on all cores ahead of
+// FindStealthTransactions, which takes the results from mapStealthDerived.
+void CWallet::PrepareStealthScan(const std::vector<CTransaction>& vtx)
+{
+    AssertLockHeld(cs_wallet);
+
+    mapStealthDerived.clear();
+    SyncStealthScanner();
+    if (stealthScanner.size() == 0)
+        return;
+
+    std::vector<ec_point> vEphem;
+    std::vector<uint8_t> vchEphemPK;
+    opcodetype opCode;
+    BOOST_FOREACH(const CTransaction& tx, vtx)
+    {
+        BOOST_FOREACH(const CTxOut& txout, tx.vout)
+        {
+            CScript::const_iterator itTxA = txout.scriptPubKey.begin();
+            if (txout.scriptPubKey.GetOp(itTxA, opCode, vchEphemPK)
+                && opCode == OP_RETURN
+                && txout.scriptPubKey.GetOp(itTxA, opCode, vchEphemPK)
+                && vchEphemPK.size() == ec_compressed_size)
+                vEphem.push_back(vchEphemPK);
+        };
+    };
+
+    if (vEphem.empty())
+        return;
+
+    std::vector<std::vector<CStealthScanner::Derived> > vDerived;
+    stealthScanner.DeriveBatch(vEphem, vDerived, boost::thread::hardware_concurrency());
+    for (size_t i = 0; i < vEphem.size(); i++)
+        mapStealthDerived[vEphem[i]].swap(vDerived[i]);
+}
+
 bool CWallet::FindStealthTransactions(const CTransaction& tx, mapValue_t& mapNarr)
 {
     if (fDebug)
@@ -3475,12 +3810,13 @@ bool CWallet::FindStealthTransactions(const CTransaction& tx, mapValue_t& mapNar
     mapNarr.clear();
 
     LOCK(cs_wallet);
+    SyncStealthScanner();
+
     ec_secret sSpendR;
     ec_secret sSpend;
-    ec_secret sScan;
     ec_secret sShared;
 
-    ec_point pkExtracted;
+    std::vector<CStealthScanner::Derived> vDerived;
 
     std::vector<uint8_t> vchEphemPK;
     std::vector<uint8_t> vchDataB;
@@ -3527,8 +3863,31 @@ bool CWallet::FindStealthTransactions(const CTransaction& tx, mapValue_t& mapNar
             continue;
         }
 
-        int32_t nOutputId = -1;
         nStealth++;
+        if (stealthScanner.size() == 0)
+            continue;
+
+        // -- derive once per ephemeral key, then match outputs by key id
+        const std::vector<CStealthScanner::Derived>* pvDerived = &vDerived;
+        std::map<ec_point, std::vector<CStealthScanner::Derived> >::const_iterator mi = mapStealthDerived.find(vchEphemPK);
+        if (mi != mapStealthDerived.end())
+            pvDerived = &mi->second;
+        else
+        if (!stealthScanner.Derive(vchEphemPK, vDerived))
+        {
+            printf("StealthSecret failed.\n");
+            continue;
+        };
+
+        std::map<CKeyID, const CStealthScanner::Derived*> mapDerived;
+        BOOST_FOREACH(const CStealthScanner::Derived& derived, *pvDerived)
+        {
+            CPubKey cpkE(derived.pkSpendR);
+            if (cpkE.IsValid())
+                mapDerived.insert(std::make_pair(cpkE.GetID(), &derived));
+        };
+
+        int32_t nOutputId = -1;
         BOOST_FOREACH(const CTxOut& txoutB, tx.vout)
         {
             nOutputId++;
@@ -3536,9 +3895,6 @@ bool CWallet::FindStealthTransactions(const CTransaction& tx, mapValue_t& mapNar
             if (&txoutB == &txout)
                 continue;
 
-            bool txnMatch = false; // only 1 txn will match an ephem pk
-            //printf("txoutB scriptPubKey %s\n",  txoutB.scriptPubKey.ToString().c_str());
-
             CTxDestination address;
             if (!ExtractDestination(txoutB.scriptPubKey, address))
                 continue;
@@ -3551,145 +3907,121 @@ bool CWallet::FindStealthTransactions(const CTransaction& tx, mapValue_t& mapNar
             if (HaveKey(ckidMatch)) // no point checking if already have key
                 continue;
 
-            std::set<CStealthAddress>::iterator it;
-            for (it = stealthAddresses.begin(); it != stealthAddresses.end(); ++it)
-            {
-                if (it->scan_secret.size() != ec_secret_size)
-                    continue; // stealth address is not owned
-
-                //printf("it->Encodeded() %s\n",  it->Encoded().c_str());
-                memcpy(&sScan.e[0], &it->scan_secret[0], ec_secret_size);
-
-                if (StealthSecret(sScan, vchEphemPK, it->spend_pubkey, sShared, pkExtracted) != 0)
-                {
-                    printf("StealthSecret failed.\n");
-                    continue;
-                };
-                //printf("pkExtracted %"PRIszu": %s\n", pkExtracted.size(), HexStr(pkExtracted).c_str());
+            std::map<CKeyID, const CStealthScanner::Derived*>::const_iterator mdi = mapDerived.find(ckidMatch);
+            if (mdi == mapDerived.end())
+                continue;
 
-                CPubKey cpkE(pkExtracted);
+            CStealthAddress sxFind;
+            sxFind.scan_pubkey = vStealthScanPubkey[mdi->second->nAddress];
+            std::set<CStealthAddress>::iterator it = stealthAddresses.find(sxFind);
+            if (it == stealthAddresses.end())
+                continue;
 
-                if (!cpkE.IsValid())
-                    continue;
-                CKeyID ckidE = cpkE.GetID();
+            memcpy(&sShared.e[0], &mdi->second->sShared.e[0], ec_secret_size);
+            CPubKey cpkE(mdi->second->pkSpendR);
 
-                if (ckidMatch != ckidE)
-                    continue;
+            if (fDebug)
+                printf("Found stealth txn to address %s\n", it->Encoded().c_str());
 
+            if (IsLocked())
+            {
                 if (fDebug)
-                    printf("Found stealth txn to address %s\n", it->Encoded().c_str());
+                    printf("Wallet is locked, adding key without secret.\n");
 
-                if (IsLocked())
-                {
-                    if (fDebug)
-                        printf("Wallet is locked, adding key without secret.\n");
-
-                    // -- add key without secret
-                    std::vector<uint8_t> vchEmpty;
-                    AddCryptedKey(cpkE, vchEmpty);
-                    CKeyID keyId = cpkE.GetID();
-                    CDarkSilkAddress coinAddress(keyId);
-                    std::string sLabel = it->Encoded();
-                    SetAddressBookName(keyId, sLabel);
-
-                    CPubKey cpkEphem(vchEphemPK);
-                    CPubKey cpkScan(it->scan_pubkey);
-                    CStealthKeyMetadata lockedSkMeta(cpkEphem, cpkScan);
-
-                    if (!CWalletDB(strWalletFile).WriteStealthKeyMeta(keyId, lockedSkMeta))
-                        printf("WriteStealthKeyMeta failed for %s\n", coinAddress.ToString().c_str());
-
-                    mapStealthKeyMeta[keyId] = lockedSkMeta;
-                    nFoundStealth++;
-                } else
-                {
-                    if (it->spend_secret.size() != ec_secret_size)
-                        continue;
-                    memcpy(&sSpend.e[0], &it->spend_secret[0], ec_secret_size);
+                // -- add key without secret
+                std::vector<uint8_t> vchEmpty;
+                AddCryptedKey(cpkE, vchEmpty);
+                CKeyID keyId = cpkE.GetID();
+                CDarkSilkAddress coinAddress(keyId);
+                std::string sLabel = it->Encoded();
+                SetAddressBookName(keyId, sLabel);
 
+                CPubKey cpkEphem(vchEphemPK);
+                CPubKey cpkScan(it->scan_pubkey);
+                CStealthKeyMetadata lockedSkMeta(cpkEphem, cpkScan);
 
-                    if (StealthSharedToSecretSpend(sShared, sSpend, sSpendR) != 0)
-                    {
-                        printf("StealthSharedToSecretSpend() failed.\n");
-                        continue;
-                    };
+                if (!CWalletDB(strWalletFile).WriteStealthKeyMeta(keyId, lockedSkMeta))
+                    printf("WriteStealthKeyMeta failed for %s\n", coinAddress.ToString().c_str());
 
-                    ec_point pkTestSpendR;
-                    if (SecretToPublicKey(sSpendR, pkTestSpendR) != 0)
-                    {
-                        printf("SecretToPublicKey() failed.\n");
-                        continue;
-                    };
+                mapStealthKeyMeta[keyId] = lockedSkMeta;
+                nFoundStealth++;
+            } else
+            {
+                if (it->spend_secret.size() != ec_secret_size)
+                    continue;
+                memcpy(&sSpend.e[0], &it->spend_secret[0], ec_secret_size);
 
-                    CSecret vchSecret;
-                    vchSecret.resize(ec_secret_size);
 
-                    memcpy(&vchSecret[0], &sSpendR.e[0], ec_secret_size);
-                    CKey ckey;
+                if (StealthSharedToSecretSpend(sShared, sSpend, sSpendR) != 0)
+                {
+                    printf("StealthSharedToSecretSpend() failed.\n");
+                    continue;
+                };
 
-                    try {
-                        ckey.Set(vchSecret.begin(), vchSecret.end(), true);
-                        //ckey.SetSecret(vchSecret, true);
-                    } catch (std::exception& e) {
-                        printf("ckey.SetSecret() threw: %s.\n", e.what());
-                        continue;
-                    };
+                CSecret vchSecret;
+                vchSecret.resize(ec_secret_size);
 
-                    CPubKey cpkT = ckey.GetPubKey();
-                    if (!cpkT.IsValid())
-                    {
-                        printf("cpkT is invalid.\n");
-                        continue;
-                    };
+                memcpy(&vchSecret[0], &sSpendR.e[0], ec_secret_size);
+                CKey ckey;
 
-                    if (!ckey.IsValid())
-                    {
-                        printf("Reconstructed key is invalid.\n");
-                        continue;
-                    };
+                try {
+                    ckey.Set(vchSecret.begin(), vchSecret.end(), true);
+                } catch (std::exception& e) {
+                    printf("ckey.SetSecret() threw: %s.\n", e.what());
+                    continue;
+                };
 
-                    CKeyID keyID = cpkT.GetID();
-                    if (fDebug)
-                    {
-                        CDarkSilkAddress coinAddress(keyID);
-                        printf("Adding key %s.\n", coinAddress.ToString().c_str());
-                    };
+                CPubKey cpkT = ckey.GetPubKey();
+                if (!cpkT.IsValid())
+                {
+                    printf("cpkT is invalid.\n");
+                    continue;
+                };
 
-                    if (!AddKey(ckey))
-                    {
-                        printf("AddKey failed.\n");
-                        continue;
-                    };
+                if (!ckey.IsValid())
+                {
+                    printf("Reconstructed key is invalid.\n");
+                    continue;
+                };
 
-                    std::string sLabel = it->Encoded();
-                    SetAddressBookName(keyID, sLabel);
-                    nFoundStealth++;
+                CKeyID keyID = cpkT.GetID();
+                if (fDebug)
+                {
+                    CDarkSilkAddress coinAddress(keyID);
+                    printf("Adding key %s.\n", coinAddress.ToString().c_str());
                 };
 
-                if (txout.scriptPubKey.GetOp(itTxA, opCode, vchENarr)
-                    && opCode == OP_RETURN
-                    && txout.scriptPubKey.GetOp(itTxA, opCode, vchENarr)
-                    && vchENarr.size() > 0)
+                if (!AddKey(ckey))
                 {
-                    SecMsgCrypter crypter;
-                    crypter.SetKey(&sShared.e[0], &vchEphemPK[0]);
-                    std::vector<uint8_t> vchNarr;
-                    if (!crypter.Decrypt(&vchENarr[0], vchENarr.size(), vchNarr))
-                    {
-                        printf("Decrypt narration failed.\n");
-                        continue;
-                    };
-                    std::string sNarr = std::string(vchNarr.begin(), vchNarr.end());
+                    printf("AddKey failed.\n");
+                    continue;
+                };
 
-                    snprintf(cbuf, sizeof(cbuf), "n_%d", nOutputId);
-                    mapNarr[cbuf] = sNarr;
+                std::string sLabel = it->Encoded();
+                SetAddressBookName(keyID, sLabel);
+                nFoundStealth++;
+            };
+
+            if (txout.scriptPubKey.GetOp(itTxA, opCode, vchENarr)
+                && opCode == OP_RETURN
+                && txout.scriptPubKey.GetOp(itTxA, opCode, vchENarr)
+                && vchENarr.size() > 0)
+            {
+                SecMsgCrypter crypter;
+                crypter.SetKey(&sShared.e[0], &vchEphemPK[0]);
+                std::vector<uint8_t> vchNarr;
+                if (!crypter.Decrypt(&vchENarr[0], vchENarr.size(), vchNarr))
+                {
+                    printf("Decrypt narration failed.\n");
+                    continue;
                 };
+                std::string sNarr = std::string(vchNarr.begin(), vchNarr.end());
 
-                txnMatch = true;
-                break;
+                snprintf(cbuf, sizeof(cbuf), "n_%d", nOutputId);
+                mapNarr[cbuf] = sNarr;
             };
-            if (txnMatch)
-                break;
+
+            break; // only 1 txn will match an ephem pk
         };
     };
 
@@ -3729,13 +4061,45 @@ uint64_t CWallet::GetStakeWeight() const
     return nWeight;
 }
 
-//TODO (Amir): Use CMutableTransaction...
-bool CWallet::CreateCoinStake(const CKeyStore& keystore, unsigned int nBits, int64_t nSearchInterval, CAmount nFees, CTransaction& txNew, CKey& key)
+void CWallet::UpdateStakeCache(CTxDB& txdb, const CBlockIndex* pindexPrev, const set<pair<const CWalletTx*,unsigned int> >& setCoins, map<COutPoint, CStakeCache>& mapCacheRet)
+{
+    LOCK(cs_wallet);
+
+    // A reorg below the tip the cache was filled at may have moved candidates
+    if (hashStakeCacheTip != 0)
+    {
+        BlockMap::iterator mi = mapBlockIndex.find(hashStakeCacheTip);
+        if (mi == mapBlockIndex.end() || !mi->second->IsInMainChain())
+            mapStakeCache.clear();
+    }
+    hashStakeCacheTip = pindexPrev->GetBlockHash();
+
+    // Keep only the current candidates, reading the new ones from disk
+    map<COutPoint, CStakeCache> mapCandidates;
+    BOOST_FOREACH(const PAIRTYPE(const CWalletTx*, unsigned int)& pcoin, setCoins)
+    {
+        COutPoint prevout(pcoin.first->GetHash(), pcoin.second);
+        map<COutPoint, CStakeCache>::const_iterator it = mapStakeCache.find(prevout);
+        if (it != mapStakeCache.end())
+        {
+            mapCandidates.insert(*it);
+            continue;
+        }
+        CStakeCache stakeCache;
+        if (CacheKernel(txdb, prevout, stakeCache))
+            mapCandidates.insert(make_pair(prevout, stakeCache));
+    }
+    mapStakeCache.swap(mapCandidates);
+    mapCacheRet = mapStakeCache;
+}
+
+bool CWallet::CreateCoinStake(const CKeyStore& keystore, unsigned int nBits, int64_t nSearchInterval, CAmount nFees, CTransaction& txCoinStake, CKey& key)
 {
     CBlockIndex* pindexPrev = pindexBest;
     CBigNum bnTargetPerCoinDay;
     bnTargetPerCoinDay.SetCompact(nBits);
 
+    CMutableTransaction txNew(txCoinStake);
     txNew.vin.clear();
     txNew.vout.clear();
 
@@ -3765,18 +4129,22 @@ bool CWallet::CreateCoinStake(const CKeyStore& keystore, unsigned int nBits, int
     CAmount nCredit = 0;
     CScript scriptPubKeyKernel;
     CTxDB txdb("r");
+    map<COutPoint, CStakeCache> mapKernelCache;
+    UpdateStakeCache(txdb, pindexPrev, setCoins, mapKernelCache);
     BOOST_FOREACH(PAIRTYPE(const CWalletTx*, unsigned int) pcoin, setCoins)
     {
         static int nMaxStakeSearchInterval = 60;
         bool fKernelFound = false;
+        COutPoint prevoutStake = COutPoint(pcoin.first->GetHash(), pcoin.second);
+        map<COutPoint, CStakeCache>::const_iterator itCache = mapKernelCache.find(prevoutStake);
+        if (itCache == mapKernelCache.end())
+            continue; // not in the main chain index yet
         for (unsigned int n=0; n<min(nSearchInterval,(int64_t)nMaxStakeSearchInterval) && !fKernelFound && pindexPrev == pindexBest; n++)
         {
             boost::this_thread::interruption_point();
             // Search backward in time from the given txNew timestamp
             // Search nSearchInterval seconds back up to nMaxStakeSearchInterval
-            COutPoint prevoutStake = COutPoint(pcoin.first->GetHash(), pcoin.second);
-            int64_t nBlockTime;
-            if (CheckKernel(pindexPrev, nBits, txNew.nTime - n, prevoutStake, &nBlockTime))
+            if (CheckKernel(pindexPrev, nBits, txNew.nTime - n, prevoutStake, itCache->second))
             {
                 // Found a kernel
                 LogPrint("coinstake", "CreateCoinStake : kernel found\n");
@@ -3945,9 +4313,10 @@ bool CWallet::CreateCoinStake(const CKeyStore& keystore, unsigned int nBits, int
         if (!SignSignature(*this, *pcoin, txNew, nIn++))
             return error("CreateCoinStake : failed to sign coinstake");
     }
+    txCoinStake = CTransaction(txNew);
 
     // Limit size
-    unsigned int nBytes = ::GetSerializeSize(txNew, SER_NETWORK, PROTOCOL_VERSION);
+    unsigned int nBytes = ::GetSerializeSize(txCoinStake, SER_NETWORK, PROTOCOL_VERSION);
     if (nBytes >= MAX_BLOCK_SIZE_GEN/5)
         return error("CreateCoinStake : exceeded coinstake size limit");
 
@@ -3991,6 +4360,7 @@ bool CWallet::CommitTransaction(CWalletTx& wtxNew, CReserveKey& reservekey, std:
                 coin.BindWallet(this);
                 coin.MarkSpent(txin.prevout.n);
                 coin.WriteToDisk();
+                UpdateUnspent(txin.prevout.hash);
                 NotifyTransactionChanged(this, coin.GetHash(), CT_UPDATED);
             }
 
@@ -4623,6 +4993,7 @@ void CWallet::FixSpentCoins(int& nMismatchFound, CAmount& nBalanceInQuestion, bo
                 {
                     pcoin->MarkUnspent(n);
                     pcoin->WriteToDisk();
+                    UpdateUnspent(pcoin->GetHash());
                 }
             }
             else if (IsMine(pcoin->vout[n]) && !pcoin->IsSpent(n) && (txindex.vSpent.size() > n && !txindex.vSpent[n].IsNull()))
@@ -4635,6 +5006,7 @@ void CWallet::FixSpentCoins(int& nMismatchFound, CAmount& nBalanceInQuestion, bo
                 {
                     pcoin->MarkSpent(n);
                     pcoin->WriteToDisk();
+                    UpdateUnspent(pcoin->GetHash());
                 }
             }
         }
@@ -4658,6 +5030,7 @@ void CWallet::DisableTransaction(const CTransaction &tx)
             {
                 prev.MarkUnspent(txin.prevout.n);
                 prev.WriteToDisk();
+                UpdateUnspent(txin.prevout.hash);
             }
         }
     }
@@ -4780,7 +5153,7 @@ void CWallet::GetKeyBirthTimes(std::map<CKeyID, int64_t> &mapKeyBirth) const {
             mapKeyBirth[it->first] = it->second.nCreateTime;
 
     // map in which we'll infer heights of other keys
-    CBlockIndex *pindexMax = FindBlockByHeight(std::max(0, nBestHeight - 144)); // the tip can be reorganised; use a 144-block safety margin
+    CBlockIndex *pindexMax = chainActive[std::max(0, nBestHeight - 144)]; // the tip can be reorganised; use a 144-block safety margin
     std::map<CKeyID, CBlockIndex*> mapKeyFirstBlock;
     std::set<CKeyID> setKeys;
     GetKeys(setKeys);
@@ -4799,7 +5172,7 @@ void CWallet::GetKeyBirthTimes(std::map<CKeyID, int64_t> &mapKeyBirth) const {
     for (std::map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); it++) {
         // iterate over all wallet transactions...
         const CWalletTx &wtx = (*it).second;
-        std::map<uint256, CBlockIndex*>::const_iterator blit = mapBlockIndex.find(wtx.hashBlock);
+        BlockMap::const_iterator blit = mapBlockIndex.find(wtx.hashBlock);
         if (blit != mapBlockIndex.end() && blit->second->IsInMainChain()) {
             // ... which are already in a block
             int nHeight = blit->second->nHeight;
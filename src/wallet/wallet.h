@@ -15,6 +15,7 @@
 #include "primitives/transaction.h"
 #include "crypter.h"
 #include "main.h"
+#include "kernel.h"
 #include "key.h"
 #include "keystore.h"
 #include "script/script.h"
@@ -22,11 +23,19 @@
 #include "util.h"
 #include "anon/stealth/stealth.h"
 
+#include <boost/atomic.hpp>
+
 const CAmount MIN_TX_FEE = 10000; // 0.00001 DRKSLK Minimum Transaction Fee
 /// Fees smaller than this (in satoshi) are considered zero fee (for relaying)
 const CAmount MIN_RELAY_TX_FEE = MIN_TX_FEE;
 //! -keypool default
 static const unsigned int DEFAULT_KEYPOOL_SIZE = 1000;
+//! Outputs whose sandstorm rounds a wallet remembers before starting over
+static const unsigned int MAX_SANDSTORM_ROUNDS_CACHE = 500000;
+//! Blocks a rescan reads ahead and matches at a time
+static const unsigned int RESCAN_BATCH_BLOCKS = 64;
+//! Blocks a rescan gets through between checkpoints in the wallet file
+static const int RESCAN_CHECKPOINT_BLOCKS = 2000;
 // Settings
 extern CAmount nTransactionFee;
 extern CAmount nReserveBalance;
@@ -36,6 +45,7 @@ extern bool fConfChange;
 
 class CAccountingEntry;
 class CCoinControl;
+class CCoinSelectionPolicy;
 class CWalletTx;
 class CReserveKey;
 class COutput;
@@ -92,6 +102,90 @@ public:
     }
 };
 
+/** Balance totals of a wallet and the state they were computed for. */
+struct CWalletBalances
+{
+    bool fValid;
+    uint256 hashTip;
+    int nTxLocks;
+    int nRounds;
+
+    CAmount nTrusted;
+    CAmount nUnconfirmed;
+    CAmount nImmature;
+    CAmount nStake;
+    CAmount nNewMint;
+    CAmount nWatchOnly;
+    CAmount nUnconfirmedWatchOnly;
+    CAmount nImmatureWatchOnly;
+    CAmount nWatchOnlyStake;
+
+    // Sandstorm totals walk the rounds of every output, so they are only
+    // computed when asked for
+    bool fAnonymizedCached;
+    CAmount nAnonymized;
+    std::map<int, CAmount> mapDenominated;
+
+    CWalletBalances()
+    {
+        SetNull();
+    }
+
+    void SetNull()
+    {
+        fValid = false;
+        hashTip = 0;
+        nTxLocks = 0;
+        nRounds = 0;
+        nTrusted = 0;
+        nUnconfirmed = 0;
+        nImmature = 0;
+        nStake = 0;
+        nNewMint = 0;
+        nWatchOnly = 0;
+        nUnconfirmedWatchOnly = 0;
+        nImmatureWatchOnly = 0;
+        nWatchOnlyStake = 0;
+        fAnonymizedCached = false;
+        nAnonymized = 0;
+        mapDenominated.clear();
+    }
+};
+
+/** Where the running or last rescan of a wallet got to. */
+struct CRescanProgress
+{
+    bool fRunning;
+    int nStartHeight;
+    int nHeight;
+    int nStopHeight;
+    int64_t nBlocks;
+    int64_t nTransactions;
+    int64_t nFound;
+    int64_t nStartTime;
+    int64_t nLastTime;
+
+    CRescanProgress()
+    {
+        SetNull();
+    }
+
+    void SetNull()
+    {
+        fRunning = false;
+        nStartHeight = 0;
+        nHeight = 0;
+        nStopHeight = 0;
+        nBlocks = 0;
+        nTransactions = 0;
+        nFound = 0;
+        nStartTime = 0;
+        nLastTime = 0;
+    }
+};
+
+struct CRescanBlock;
+
 /** A CWallet is an extension of a keystore, which also maintains a set of transactions and balances,
  * and provides the ability to create new transactions.
  */
@@ -118,7 +212,52 @@ private:
 
     void SyncMetaData(std::pair<TxSpends::iterator, TxSpends::iterator>);
 
-    int GetRealInputSandstormRounds(CTxIn in, int rounds) const;
+    // Outputs of wallet transactions that are ours and may still be unspent,
+    // so balance and coin queries walk these instead of all of mapWallet.
+    // An output leaves the set once it is marked spent and a transaction in
+    // the wallet spends it.
+    std::set<COutPoint> setUnspent;
+    void UpdateUnspent(const uint256& wtxid);
+
+    // Totals over setUnspent, recomputed when the wallet, the chain tip, the
+    // InstantX locks or the sandstorm rounds change, or a wallet transaction
+    // leaves the memory pool.
+    mutable CWalletBalances balances;
+    void CacheBalances() const;
+
+    // Set from inside mempool.cs, which may not wait for cs_wallet
+    mutable boost::atomic<bool> fPoolRemovedWalletTx;
+
+    // Sandstorm rounds of wallet outputs and of the outputs they spend,
+    // filled on demand. A transaction entering or leaving the wallet drops
+    // the entries of its outputs and of everything in the wallet spending them.
+    mutable std::map<COutPoint, int> mapSandstormRounds;
+    int GetRealInputSandstormRounds(const COutPoint& outpoint) const;
+    void InvalidateSandstormRounds(const uint256& wtxid);
+
+    // Kernel inputs of staking candidates, so CreateCoinStake reads each
+    // candidate from disk only once. Entries are valid while the block
+    // hashStakeCacheTip is in the main chain.
+    std::map<COutPoint, CStakeCache> mapStakeCache;
+    uint256 hashStakeCacheTip;
+    void UpdateStakeCache(CTxDB& txdb, const CBlockIndex* pindexPrev, const std::set<std::pair<const CWalletTx*,unsigned int> >& setCoins, std::map<COutPoint, CStakeCache>& mapCacheRet);
+
+    // Owned stealth addresses ready for scanning. vStealthOwned lists the
+    // scan pubkeys the scanner was built from, vStealthScanPubkey the scan
+    // pubkey of each scanner entry. mapStealthDerived holds what the
+    // ephemeral keys of the block being rescanned derive to.
+    CStealthScanner stealthScanner;
+    std::vector<ec_point> vStealthOwned;
+    std::vector<ec_point> vStealthScanPubkey;
+    std::map<ec_point, std::vector<CStealthScanner::Derived> > mapStealthDerived;
+    void SyncStealthScanner();
+    void PrepareStealthScan(const std::vector<CTransaction>& vtx);
+
+    // Rescan progress is kept apart from cs_wallet so it can be read while
+    // a rescan holds the wallet
+    mutable CCriticalSection cs_rescan;
+    CRescanProgress rescanProgress;
+    void NextRescanBatch(CBlockIndex*& pindex, std::vector<CRescanBlock>& vBatch) const;
 
 public:
     /// Main wallet lock.
@@ -185,6 +324,8 @@ public:
         nTimeFirstKey = 0;
         nLastFilteredHeight = 0;
         fWalletUnlockAnonymizeOnly = false;
+        hashStakeCacheTip = 0;
+        fPoolRemovedWalletTx = false;
     }
 
     std::map<uint256, CWalletTx> mapWallet;
@@ -204,8 +345,9 @@ public:
 
     void AvailableCoinsForStaking(std::vector<COutput>& vCoins, unsigned int nSpendTime) const;
     void AvailableCoins(std::vector<COutput>& vCoins, bool fOnlyConfirmed=true, const CCoinControl *coinControl = NULL, AvailableCoinsType coin_type=ALL_COINS, bool useIX = false) const;    
-    bool SelectCoinsMinConf(const CAmount& nTargetValue, unsigned int nSpendTime, int nConfMine, int nConfTheirs, vector<COutput> vCoins, set<pair<const CWalletTx*,unsigned int> >& setCoinsRet, CAmount& nValueRet) const;
-    bool SelectCoinsMinConfByCoinAge(const CAmount& nTargetValue, unsigned int nSpendTime, int nConfMine, int nConfTheirs, vector<COutput> vCoins, set<pair<const CWalletTx*,unsigned int> >& setCoinsRet, CAmount& nValueRet) const;
+    /** Exact branch and bound under pPolicy (fewest inputs if NULL), falling back to the knapsack approximation. */
+    bool SelectCoinsMinConf(const CAmount& nTargetValue, unsigned int nSpendTime, int nConfMine, int nConfTheirs, const vector<COutput>& vCoins, set<pair<const CWalletTx*,unsigned int> >& setCoinsRet, CAmount& nValueRet, const CCoinSelectionPolicy* pPolicy = NULL) const;
+    bool SelectCoinsMinConfByCoinAge(const CAmount& nTargetValue, unsigned int nSpendTime, int nConfMine, int nConfTheirs, const vector<COutput>& vCoins, set<pair<const CWalletTx*,unsigned int> >& setCoinsRet, CAmount& nValueRet) const;
 
     bool IsSpent(const uint256& hash, unsigned int n) const;
 
@@ -258,18 +400,34 @@ public:
     typedef std::pair<CWalletTx*, CAccountingEntry*> TxPair;
     typedef std::multimap<int64_t, TxPair > TxItems;
 
-    /** Get the wallet's activity log
-        @return multimap of ordered transactions and accounting entries
-        @warning Returned pointers are *only* valid within the scope of passed acentries
+    /** The wallet's activity log: wallet transactions and the accounting
+        entries of all accounts, by nOrderPos. Kept up to date as they are
+        added, so listings walk it instead of building it each time.
      */
-    TxItems OrderedTxItems(std::list<CAccountingEntry>& acentries, std::string strAccount = "");
+    TxItems wtxOrdered;
+    std::list<CAccountingEntry> laccentries;
+
+    /** Add an accounting entry to the activity log, and write it to walletdb. */
+    bool AddAccountingEntry(const CAccountingEntry& acentry, CWalletDB& walletdb);
+    /** Add an accounting entry to the activity log only (used by LoadWallet). */
+    void LoadAccountingEntry(const CAccountingEntry& acentry);
+    /** Rebuild wtxOrdered after the nOrderPos of its items were rewritten. */
+    void ReindexTxItems();
 
     void MarkDirty();
     bool AddToWallet(const CWalletTx& wtxIn, bool fFromLoadWallet=false);
     void SyncTransaction(const CTransaction& tx, const CBlock* pblock, bool fConnect = true);
     bool AddToWalletIfInvolvingMe(const CTransaction& tx, const CBlock* pblock, bool fUpdate);
     void EraseFromWallet(const uint256 &hash);
+    void RemovedFromMempool(const uint256 &hash);
+    /** Whether outpoint is in the set balance and coin queries walk */
+    bool IsInUnspentSet(const COutPoint& outpoint) const
+    {
+        LOCK(cs_wallet);
+        return setUnspent.count(outpoint) != 0;
+    }
     int ScanForWalletTransactions(CBlockIndex* pindexStart, bool fUpdate = false);
+    void GetRescanProgress(CRescanProgress& progress) const;
     void ReacceptWalletTransactions();
     void ResendWalletTransactions(bool fForce = false);
     CAmount GetBalance() const;
@@ -297,7 +455,7 @@ public:
 
     uint64_t GetStakeWeight() const;
     uint64_t GetStakeWeight2() const;
-    bool CreateCoinStake(const CKeyStore& keystore, unsigned int nBits, int64_t nSearchInterval, CAmount nFees, CTransaction& txNew, CKey& key);
+    bool CreateCoinStake(const CKeyStore& keystore, unsigned int nBits, int64_t nSearchInterval, CAmount nFees, CTransaction& txCoinStake, CKey& key);
 
     std::string SendMoney(CScript scriptPubKey, CAmount nValue, std::string& sNarr, CWalletTx& wtxNew, bool fAskFee=false);
     std::string SendMoneyToDestination(const CTxDestination &address, CAmount nValue, std::string& sNarr, CWalletTx& wtxNew, bool fAskFee=false);
@@ -1198,6 +1356,7 @@ public:
         strOtherAccount.clear();
         strComment.clear();
         nOrderPos = -1;
+        nEntryNo = 0;
     }
 
     ADD_SERIALIZE_METHODS;
@@ -149,6 +149,24 @@ bool CWalletDB::ReadBestBlock(CBlockLocator& locator)
     return Read(std::string("bestblock"), locator);
 }
 
+// Last block an unfinished rescan got through
+bool CWalletDB::WriteRescanPos(const CBlockLocator& locator)
+{
+    nWalletDBUpdated++;
+    return Write(std::string("rescanpos"), locator);
+}
+
+bool CWalletDB::ReadRescanPos(CBlockLocator& locator)
+{
+    return Read(std::string("rescanpos"), locator);
+}
+
+bool CWalletDB::EraseRescanPos()
+{
+    nWalletDBUpdated++;
+    return Erase(std::string("rescanpos"));
+}
+
 bool CWalletDB::WriteOrderPosNext(int64_t nOrderPosNext)
 {
     nWalletDBUpdated++;
@@ -199,9 +217,10 @@ bool CWalletDB::WriteAccountingEntry(const uint64_t nAccEntryNum, const CAccount
     return Write(boost::make_tuple(string("acentry"), acentry.strAccount, nAccEntryNum), acentry);
 }
 
-bool CWalletDB::WriteAccountingEntry(const CAccountingEntry& acentry)
+bool CWalletDB::WriteAccountingEntry(CAccountingEntry& acentry)
 {
-    return WriteAccountingEntry(++nAccountingEntryNumber, acentry);
+    acentry.nEntryNo = ++nAccountingEntryNumber;
+    return WriteAccountingEntry(acentry.nEntryNo, acentry);
 }
 
 CAmount CWalletDB::GetAccountCreditDebit(const string& strAccount)
@@ -275,9 +294,7 @@ DBErrors CWalletDB::ReorderTransactions(CWallet* pwallet)
         CWalletTx* wtx = &((*it).second);
         txByTime.insert(make_pair(wtx->nTimeReceived, TxPair(wtx, (CAccountingEntry*)0)));
     }
-    list<CAccountingEntry> acentries;
-    ListAccountCreditDebit("", acentries);
-    BOOST_FOREACH(CAccountingEntry& entry, acentries)
+    BOOST_FOREACH(CAccountingEntry& entry, pwallet->laccentries)
     {
         txByTime.insert(make_pair(entry.nTime, TxPair((CWalletTx*)0, &entry)));
     }
@@ -331,6 +348,7 @@ DBErrors CWalletDB::ReorderTransactions(CWallet* pwallet)
         }
     }
     WriteOrderPosNext(nOrderPosNext);
+    pwallet->ReindexTxItems();
 
     return DB_LOAD_OK;
 }
@@ -430,13 +448,14 @@ bool ReadKeyValue(CWallet* pwallet, CDataStream& ssKey, CDataStream& ssValue,
             if (nNumber > nAccountingEntryNumber)
                 nAccountingEntryNumber = nNumber;
 
-            if (!wss.fAnyUnordered)
-            {
-                CAccountingEntry acentry;
-                ssValue >> acentry;
-                if (acentry.nOrderPos == -1)
-                    wss.fAnyUnordered = true;
-            }
+            CAccountingEntry acentry;
+            ssValue >> acentry;
+            acentry.strAccount = strAccount;
+            acentry.nEntryNo = nNumber;
+            if (acentry.nOrderPos == -1)
+                wss.fAnyUnordered = true;
+
+            pwallet->LoadAccountingEntry(acentry);
         }
         else if (strType == "watchonly")
         {